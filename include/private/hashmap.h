@@ -185,6 +185,39 @@ static inline struct hash_map_entry *hash_map_insert(struct hash_map *hash_map,
     return target;
 }
 
+static inline void hash_map_remove(struct hash_map *hash_map, struct hash_map_entry *entry)
+{
+    uint32_t hole_idx, entry_idx, home_idx;
+    struct hash_map_entry *current;
+
+    hole_idx = (uint32_t)(((char *)entry - (char *)hash_map->entries) / hash_map->entry_size);
+    entry_idx = hole_idx;
+
+    /* Shift subsequent entries of the probe sequence back into the hole,
+     * so that lookups never run into a gap before finding their entry. */
+    while (true)
+    {
+        entry_idx = hash_map_next_entry_idx(hash_map, entry_idx);
+        current = hash_map_get_entry(hash_map, entry_idx);
+
+        if (!(current->flags & HASH_MAP_ENTRY_OCCUPIED))
+            break;
+
+        home_idx = hash_map_get_entry_idx(hash_map, current->hash_value);
+
+        /* Entries whose home slot lies cyclically in (hole, current] must stay. */
+        if (hole_idx <= entry_idx ? (home_idx > hole_idx && home_idx <= entry_idx) :
+                (home_idx > hole_idx || home_idx <= entry_idx))
+            continue;
+
+        memcpy(hash_map_get_entry(hash_map, hole_idx), current, hash_map->entry_size);
+        hole_idx = entry_idx;
+    }
+
+    memset(hash_map_get_entry(hash_map, hole_idx), 0, hash_map->entry_size);
+    hash_map->used_count -= 1;
+}
+
 static inline void hash_map_init(struct hash_map *hash_map, pfn_hash_func hash_func, pfn_hash_compare_func compare_func, size_t entry_size)
 {
     hash_map->hash_func = hash_func;
@@ -204,6 +237,14 @@ static inline void hash_map_clear(struct hash_map *hash_map)
     hash_map->used_count = 0;
 }
 
+/* Drops all entries, but keeps the storage around for reuse. */
+static inline void hash_map_reset(struct hash_map *hash_map)
+{
+    if (hash_map->entries)
+        memset(hash_map->entries, 0, hash_map->entry_count * hash_map->entry_size);
+    hash_map->used_count = 0;
+}
+
 static inline uint32_t hash_combine(uint32_t old_hash, uint32_t new_hash) {
     return old_hash ^ (new_hash + 0x9e3779b9 + (old_hash << 6) + (old_hash >> 2));
 }
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_BUNDLE_STATS_H
+#define __VKD3D_BUNDLE_STATS_H
+
+#include <stdint.h>
+
+/* Bundle allocators report this through GetPrivateData, so that tests can check
+ * that recording bundles does not allocate. Native D3D12 returns DXGI_ERROR_NOT_FOUND.
+ * Requires the D3D12 headers to be included first. */
+static const GUID VKD3D_BUNDLE_ALLOCATOR_STATS_GUID =
+        {0xe876f07a, 0x0de2, 0x4b58, {0xa0, 0x1e, 0x32, 0x8f, 0x7f, 0x42, 0xa3, 0xd4}};
+
+struct vkd3d_bundle_allocator_stats
+{
+    /* Bundle chunks allocated from the heap by the device-wide pool. */
+    uint64_t chunk_heap_alloc_count;
+    /* Growth of the allocator's chunk array and the scratch memory used to close bundles. */
+    uint64_t scratch_heap_alloc_count;
+};
+
+#endif  /* __VKD3D_BUNDLE_STATS_H */
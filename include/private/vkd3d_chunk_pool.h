@@ -0,0 +1,57 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_CHUNK_POOL_H
+#define __VKD3D_CHUNK_POOL_H
+
+#include "vkd3d_threads.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Free list of fixed-size heap blocks. Chunks which do not fit into the pool
+ * anymore are returned to the heap. Not thread-safe, callers need to lock
+ * pools which are shared between objects. */
+struct vkd3d_chunk_pool
+{
+    void **chunks;
+    size_t chunks_size;
+    size_t chunks_count;
+
+    size_t chunk_size;
+    size_t max_chunk_count;
+
+    /* Number of chunks which had to be allocated from the heap. */
+    size_t heap_alloc_count;
+};
+
+void vkd3d_chunk_pool_init(struct vkd3d_chunk_pool *pool, size_t chunk_size, size_t max_chunk_count);
+void vkd3d_chunk_pool_cleanup(struct vkd3d_chunk_pool *pool);
+
+/* Returns NULL if the pool is empty. */
+void *vkd3d_chunk_pool_take(struct vkd3d_chunk_pool *pool);
+/* Falls back to the heap if the pool is empty. */
+void *vkd3d_chunk_pool_alloc(struct vkd3d_chunk_pool *pool);
+void vkd3d_chunk_pool_free(struct vkd3d_chunk_pool *pool, void *chunk);
+/* Moves chunks used by one recording back into the pool. The pool keeps only as many
+ * chunks as that recording needed, the rest goes to shared_pool under shared_lock,
+ * which may be NULL. */
+void vkd3d_chunk_pool_recycle(struct vkd3d_chunk_pool *pool, void **chunks, size_t count,
+        struct vkd3d_chunk_pool *shared_pool, pthread_mutex_t *shared_lock);
+
+#endif  /* __VKD3D_CHUNK_POOL_H */
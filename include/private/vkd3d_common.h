@@ -45,6 +45,8 @@
 
 #define MEMBER_SIZE(t, m) sizeof(((t *)0)->m)
 
+#define MAKE_MAGIC(a,b,c,d) (((uint32_t)a) | (((uint32_t)b) << 8) | (((uint32_t)c) << 16) | (((uint32_t)d) << 24))
+
 static inline uint64_t align64(uint64_t addr, uint64_t alignment)
 {
     assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
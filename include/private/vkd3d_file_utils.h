@@ -38,5 +38,14 @@ bool vkd3d_file_rename_overwrite(const char *from_path, const char *to_path);
 bool vkd3d_file_rename_no_replace(const char *from_path, const char *to_path);
 bool vkd3d_file_delete(const char *path);
 FILE *vkd3d_file_open_exclusive_write(const char *path);
+/* Takes an exclusive advisory lock on the whole file without blocking.
+ * The lock is released when the file is closed or the process terminates. */
+bool vkd3d_file_try_lock_exclusive(FILE *file);
+/* Flushes the file and discards everything past its current position. */
+bool vkd3d_file_truncate_at_current_position(FILE *file);
+
+typedef void (*vkd3d_file_enumerate_callback)(const char *path, void *userdata);
+/* Invokes callback for every file in the directory of path_prefix whose full path starts with path_prefix. */
+bool vkd3d_file_enumerate_prefix(const char *path_prefix, vkd3d_file_enumerate_callback callback, void *userdata);
 
 #endif
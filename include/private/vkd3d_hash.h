@@ -0,0 +1,40 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_HASH_H
+#define __VKD3D_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Non-cryptographic 64-bit hash for large blobs, e.g. shader code and cache entries.
+ * Long inputs are consumed 64 bytes at a time in eight independent 64-bit lanes,
+ * which maps directly onto SSE2, AVX2 and NEON. All code paths produce identical results.
+ * Any change to the output must bump VKD3D_HASH64_VERSION, since hashes are persisted
+ * in on-disk caches. */
+#define VKD3D_HASH64_VERSION 1
+
+uint64_t vkd3d_hash64(const void *data, size_t size);
+
+/* Reference implementation without SIMD. Only useful to validate the SIMD paths. */
+uint64_t vkd3d_hash64_portable(const void *data, size_t size);
+
+/* Name of the code path vkd3d_hash64() uses on this machine. */
+const char *vkd3d_hash64_get_impl_name(void);
+
+#endif  /* __VKD3D_HASH_H */
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_LZ_H
+#define __VKD3D_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Small byte-oriented LZ77 codec in the spirit of LZ4, used for on-disk cache entries.
+ * The stream is a sequence of (literals, match) pairs with a 64 KiB window.
+ * Decoding is a plain copy loop, so it is cheap enough to do lazily on lookup.
+ * Any change to the format must bump the stream archive version. */
+
+/* Worst case output size of vkd3d_lz_compress() for src_size input bytes. */
+size_t vkd3d_lz_compress_bound(size_t src_size);
+
+/* dst_size must be at least vkd3d_lz_compress_bound(src_size).
+ * Returns the compressed size, or 0 on failure. */
+size_t vkd3d_lz_compress(const void *src, size_t src_size, void *dst, size_t dst_size);
+
+/* Fails if the stream is malformed or does not decode to exactly dst_size bytes. */
+bool vkd3d_lz_decompress(const void *src, size_t src_size, void *dst, size_t dst_size);
+
+#endif  /* __VKD3D_LZ_H */
@@ -0,0 +1,359 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_PIPELINE_LIBRARY_FORMAT_H
+#define __VKD3D_PIPELINE_LIBRARY_FORMAT_H
+
+/* On-disk layout of pipeline libraries and the stream archive disk cache.
+ * Shared between libs/vkd3d/cache.c and offline tooling, so nothing here may depend on Vulkan. */
+
+#include "vkd3d_common.h"
+#include "vkd3d_hash.h"
+#include "hashmap.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Same as VK_UUID_SIZE. */
+#define VKD3D_PIPELINE_LIBRARY_UUID_SIZE 16
+
+#define VKD3D_PIPELINE_BLOB_ALIGN 8
+#define VKD3D_PIPELINE_BLOB_CHUNK_ALIGN 8
+
+#define VKD3D_CACHE_BLOB_VERSION MAKE_MAGIC('V','K','B',4)
+
+enum vkd3d_pipeline_blob_chunk_type
+{
+    /* VkPipelineCache blob data. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PIPELINE_CACHE = 0,
+    /* VkShaderStage is stored in upper 16 bits. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_VARINT_SPIRV = 1,
+    /* For when a blob is stored inside a pipeline library, we can reference blobs by hash instead
+     * to achieve de-dupe. We'll need to maintain the older path as well however since we need to support GetCachedBlob()
+     * as a standalone thing as well. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PIPELINE_CACHE_LINK = 2,
+    /* VkShaderStage is stored in upper 16 bits. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_VARINT_SPIRV_LINK = 3,
+    /* VkShaderStage is stored in upper 16 bits. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_SHADER_META = 4,
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PSO_COMPAT = 5,
+    /* VkShaderStage is stored in upper 16 bits. */
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_SHADER_IDENTIFIER = 6,
+    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_MASK = 0xffff,
+    VKD3D_PIPELINE_BLOB_CHUNK_INDEX_SHIFT = 16,
+};
+
+struct vkd3d_pipeline_blob_chunk
+{
+    uint32_t type; /* vkd3d_pipeline_blob_chunk_type with extra data in upper bits. */
+    uint32_t size; /* size of data. Does not include size of header. */
+    uint8_t data[]; /* struct vkd3d_pipeline_blob_chunk_*. */
+};
+
+struct vkd3d_pipeline_blob_chunk_link
+{
+    uint64_t hash;
+};
+
+STATIC_ASSERT(sizeof(struct vkd3d_pipeline_blob_chunk) == 8);
+STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob_chunk, data) == 8);
+
+struct vkd3d_pipeline_blob
+{
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t checksum; /* Simple checksum for data[] as a sanity check. uint32_t because it conveniently packs here. */
+    uint64_t vkd3d_build;
+    uint64_t vkd3d_shader_interface_key;
+    uint8_t cache_uuid[VKD3D_PIPELINE_LIBRARY_UUID_SIZE];
+    uint8_t data[]; /* vkd3d_pipeline_blob_chunks laid out one after the other with u64 alignment. */
+};
+
+/* Used for de-duplicated pipeline cache and SPIR-V hashmaps. */
+struct vkd3d_pipeline_blob_internal
+{
+    uint32_t checksum; /* Simple checksum for data[] as a sanity check. */
+    uint8_t data[]; /* Either raw uint8_t for pipeline cache, or vkd3d_pipeline_blob_chunk_spirv. */
+};
+
+STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob, data) == (32 + VKD3D_PIPELINE_LIBRARY_UUID_SIZE));
+STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob, data) == sizeof(struct vkd3d_pipeline_blob));
+
+static inline uint32_t vkd3d_pipeline_blob_compute_data_checksum(const uint8_t *data, size_t size)
+{
+    return hash_uint64(vkd3d_hash64(data, size));
+}
+
+/* The stream format is used for internal magic cache.
+ * In this scheme, we optimize for append performance rather than read performance.
+ * TODO: This is a stepping stone for Fossilize integration, which would allow e.g. Steam to provide us with
+ * pre-primed caches. */
+enum vkd3d_serialized_pipeline_stream_entry_type
+{
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV = 0,
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE = 1,
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE = 2,
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT = 3,
+    /* Payload-less record that the PSO with this hash was loaded from the read-only archive.
+     * Only found in write caches. Merging folds it into the LRU index instead of appending it. */
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE = 4,
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_TYPE_MASK = 0xffff,
+    /* Payload is a vkd3d_serialized_pipeline_compressed_blob. */
+    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED = 0x10000,
+    VKD3D_SERIALIZED_PIPELINE_STREAM_MAX_INT = 0x7fffffff,
+};
+
+struct vkd3d_serialized_pipeline_toc_entry
+{
+    uint64_t blob_offset;
+    uint32_t name_length;
+    uint32_t blob_length;
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_toc_entry) == 16);
+
+/* Checksums and keys are derived from vkd3d_hash64(), so these must be bumped along with VKD3D_HASH64_VERSION. */
+STATIC_ASSERT(VKD3D_HASH64_VERSION == 1);
+#define VKD3D_PIPELINE_LIBRARY_VERSION_TOC MAKE_MAGIC('V','K','L',5)
+#define VKD3D_PIPELINE_LIBRARY_VERSION_STREAM MAKE_MAGIC('V','K','S',5)
+
+struct vkd3d_serialized_pipeline_library_toc
+{
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t spirv_count;
+    uint32_t driver_cache_count;
+    uint32_t pipeline_count;
+    uint64_t vkd3d_build;
+    uint64_t vkd3d_shader_interface_key;
+    /* Refers to pipelineCacheUUID if we're using VkPipelineCache blobs,
+     * or shaderModuleIdentifierAlgorithmUUID if using shader module identifiers.
+     * With the nature of UUIDs, we don't risk random mismatches if
+     * a blob cache UUID is consumed by shader module identifiers and vice versa. */
+    uint8_t cache_uuid[VKD3D_PIPELINE_LIBRARY_UUID_SIZE];
+    struct vkd3d_serialized_pipeline_toc_entry entries[];
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_toc) ==
+        offsetof(struct vkd3d_serialized_pipeline_library_toc, entries));
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_toc) == 40 + VKD3D_PIPELINE_LIBRARY_UUID_SIZE);
+
+/* Binary layout:
+ * - Header
+ * - spirv_count x toc_entries [Varint compressed SPIR-V]
+ * - driver_cache_count x toc_entries [VkPipelineCache data]
+ * - pipeline_count x toc_entries [Contains references to SPIR-V and VkPipelineCache blobs]
+ * - After toc entries, raw data is placed. TOC entries refer to keys (names) and values by offsets into this buffer.
+ * - TOC entry offsets for names are implicit. The name lengths are tightly packed from the start of the raw data buffer.
+ *   Name lengths of 0 are treated as u64 hashes. Used for SPIR-V cache and VkPipelineCache cache.
+ *   Name entries are allocated in toc_entry order.
+ * - For blobs, a u64 offset + u32 size pair is added.
+ * - After toc entries, we have the name table.
+ */
+
+/*
+ * A raw blob is treated as a vkd3d_pipeline_blob or vkd3d_pipeline_blob_internal.
+ * The full blob type is used for D3D12 PSOs. These contain:
+ * - Versioning of various kinds. If there is a mismatch we return the appropriate error.
+ * - Checksum is used as sanity check in case we have a corrupt archive.
+ * - Chunked data[].
+ * - This chunked data is a typical stream of { type, length, data }. A D3D12 PSO stores various information here, such as
+ *   - Root signature compatibility
+ *   - SPIR-V shader hash references per stage
+ *   - SPIR-V shader meta information, which is reflection data that we would otherwise get from vkd3d-shader
+ *   - Hash of the VkPipelineCache data
+ */
+
+/*
+ * An internal blob is just checksum + data.
+ * This data does not need versioning information since it's fully internal to the library implementation and is only
+ * referenced after the D3D12 blob header is validated.
+ */
+
+/* Rationale for this split format is:
+ * - It is implied that the pipeline library can be used directly from an mmap-ed on-disk file,
+ *   since users cannot free the pointer to library once created.
+ *   In this situation, we should scan through just the TOC to begin with to avoid page faulting on potentially 100s of MBs.
+ *   It is also more cache friendly this way.
+ * - Having a more split TOC structure like this makes it easier to add SPIR-V deduplication and PSO cache deduplication.
+ */
+
+/* The stream variant. Blobs are emitted one after the other with header + data. */
+
+/* It's possible to just make this header into a bucket hash for e.g. Fossilize. */
+struct vkd3d_serialized_pipeline_library_stream
+{
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t reserved;
+    uint64_t vkd3d_build;
+    uint64_t vkd3d_shader_interface_key;
+    /* Mostly irrelevant since we use GLOBAL_PIPELINE_CACHE by default for stream archives. */
+    uint8_t cache_uuid[VKD3D_PIPELINE_LIBRARY_UUID_SIZE];
+    uint8_t entries[];
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_stream) ==
+        offsetof(struct vkd3d_serialized_pipeline_library_stream, entries));
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_stream) == 32 + VKD3D_PIPELINE_LIBRARY_UUID_SIZE);
+
+/* Sidecar to the stream archive which tracks when each entry was last used.
+ * The epoch is bumped every time write caches are merged into the archive. */
+#define VKD3D_PIPELINE_LIBRARY_VERSION_INDEX MAKE_MAGIC('V','K','I',1)
+
+struct vkd3d_serialized_pipeline_library_index_entry
+{
+    uint64_t hash;
+    uint32_t type; /* vkd3d_serialized_pipeline_stream_entry_type */
+    uint32_t epoch;
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_index_entry) == 16);
+
+struct vkd3d_serialized_pipeline_library_index
+{
+    uint32_t version;
+    uint32_t epoch;
+    uint64_t entry_count;
+    struct vkd3d_serialized_pipeline_library_index_entry entries[];
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_index) ==
+        offsetof(struct vkd3d_serialized_pipeline_library_index, entries));
+
+struct vkd3d_serialized_pipeline_stream_entry
+{
+    uint64_t hash;
+    uint64_t checksum; /* Checksum of the rest of this header + data. */
+    uint32_t size;
+    enum vkd3d_serialized_pipeline_stream_entry_type type;
+    uint8_t data[];
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_stream_entry) ==
+        offsetof(struct vkd3d_serialized_pipeline_stream_entry, data));
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_stream_entry) == 24);
+
+struct vkd3d_serialized_pipeline_compressed_blob
+{
+    uint32_t decompressed_size;
+    uint32_t reserved;
+    uint8_t data[]; /* vkd3d_lz stream. */
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_compressed_blob) == 8);
+
+static inline uint32_t vkd3d_serialized_pipeline_stream_entry_get_type(
+        const struct vkd3d_serialized_pipeline_stream_entry *entry)
+{
+    return entry->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_TYPE_MASK;
+}
+
+static inline uint64_t vkd3d_serialized_pipeline_stream_entry_compute_checksum(const uint8_t *data,
+        const struct vkd3d_serialized_pipeline_stream_entry *entry)
+{
+    uint64_t h;
+
+    h = vkd3d_hash64(data, entry->size);
+    h = hash_fnv1_iterate_u64(h, entry->hash);
+    h = hash_fnv1_iterate_u32(h, entry->size);
+    h = hash_fnv1_iterate_u32(h, entry->type);
+    return h;
+}
+
+static inline bool vkd3d_serialized_pipeline_stream_entry_validate(const uint8_t *data,
+        const struct vkd3d_serialized_pipeline_stream_entry *entry)
+{
+    uint64_t checksum = vkd3d_serialized_pipeline_stream_entry_compute_checksum(data, entry);
+    return checksum == entry->checksum;
+}
+
+/* Stream archive entries are identified by (hash, type), since SPIR-V, driver cache and PSO entries
+ * each have their own hash space. */
+struct vkd3d_serialized_pipeline_entry_key
+{
+    uint64_t hash;
+    uint32_t type; /* vkd3d_serialized_pipeline_stream_entry_type */
+};
+
+/* Hash map entry keyed by vkd3d_serialized_pipeline_entry_key.
+ * Larger entries may append their own data, as long as the key is placed right after the header. */
+struct vkd3d_serialized_pipeline_entry
+{
+    struct hash_map_entry entry;
+    struct vkd3d_serialized_pipeline_entry_key key;
+};
+
+static inline uint32_t vkd3d_serialized_pipeline_entry_hash(const void *key)
+{
+    const struct vkd3d_serialized_pipeline_entry_key *k = key;
+    return hash_combine(hash_uint64(k->hash), k->type);
+}
+
+static inline bool vkd3d_serialized_pipeline_entry_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_serialized_pipeline_entry_key *old_key = &((const struct vkd3d_serialized_pipeline_entry *)entry)->key;
+    const struct vkd3d_serialized_pipeline_entry_key *new_key = key;
+    return new_key->hash == old_key->hash && new_key->type == old_key->type;
+}
+
+/* A PSO links to at most one SPIR-V blob per stage and one driver cache blob. */
+#define VKD3D_PIPELINE_BLOB_MAX_LINKS 16
+
+/* Collects the SPIR-V and driver cache entries an uncompressed PSO blob refers to.
+ * Truncated chunks end the walk. Returns the number of links written. */
+static inline size_t vkd3d_pipeline_blob_get_links(const uint8_t *data, size_t size,
+        struct vkd3d_serialized_pipeline_entry_key *links)
+{
+    const struct vkd3d_pipeline_blob *blob = (const struct vkd3d_pipeline_blob *)data;
+    const struct vkd3d_pipeline_blob_chunk_link *link;
+    const struct vkd3d_pipeline_blob_chunk *chunk;
+    size_t aligned_chunk_size;
+    size_t link_count = 0;
+
+    if (size < sizeof(*blob))
+        return 0;
+
+    chunk = (const struct vkd3d_pipeline_blob_chunk *)blob->data;
+    size -= sizeof(*blob);
+
+    while (size >= sizeof(*chunk) && link_count < VKD3D_PIPELINE_BLOB_MAX_LINKS)
+    {
+        aligned_chunk_size = align(chunk->size + sizeof(*chunk), VKD3D_PIPELINE_BLOB_CHUNK_ALIGN);
+        if (aligned_chunk_size > size)
+            break;
+
+        if (chunk->size >= sizeof(*link))
+        {
+            link = (const struct vkd3d_pipeline_blob_chunk_link *)chunk->data;
+            if ((chunk->type & VKD3D_PIPELINE_BLOB_CHUNK_TYPE_MASK) == VKD3D_PIPELINE_BLOB_CHUNK_TYPE_VARINT_SPIRV_LINK)
+            {
+                links[link_count].hash = link->hash;
+                links[link_count++].type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV;
+            }
+            else if (chunk->type == VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PIPELINE_CACHE_LINK)
+            {
+                links[link_count].hash = link->hash;
+                links[link_count++].type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE;
+            }
+        }
+
+        chunk = (const struct vkd3d_pipeline_blob_chunk *)&chunk->data[align(chunk->size, VKD3D_PIPELINE_BLOB_CHUNK_ALIGN)];
+        size -= aligned_chunk_size;
+    }
+
+    return link_count;
+}
+
+#endif  /* __VKD3D_PIPELINE_LIBRARY_FORMAT_H */
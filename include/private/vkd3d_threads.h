@@ -25,6 +25,7 @@
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <errno.h>
 
 /* pthread_t is passed by value in some functions,
  * which implies we need pthread_t to be a pointer type here. */
@@ -105,6 +106,11 @@ static inline int pthread_mutex_lock(pthread_mutex_t *lock)
     return 0;
 }
 
+static inline int pthread_mutex_trylock(pthread_mutex_t *lock)
+{
+    return TryAcquireSRWLockExclusive(&lock->lock) ? 0 : EBUSY;
+}
+
 static inline int pthread_mutex_unlock(pthread_mutex_t *lock)
 {
     ReleaseSRWLockExclusive(&lock->lock);
@@ -335,6 +341,9 @@ static inline int condvar_reltime_wait_timeout_seconds(condvar_reltime_t *cond,
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/resource.h>
+#elif !defined(_WIN32)
+#include <unistd.h>
 #endif
 
 static inline unsigned int vkd3d_get_current_thread_id(void)
@@ -348,4 +357,47 @@ static inline unsigned int vkd3d_get_current_thread_id(void)
 #endif
 }
 
+static inline unsigned int vkd3d_get_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+enum vkd3d_thread_priority
+{
+    VKD3D_THREAD_PRIORITY_LOWEST,
+    VKD3D_THREAD_PRIORITY_LOW,
+    VKD3D_THREAD_PRIORITY_NORMAL,
+};
+
+/* Applies to the calling thread only. Best effort, failure is ignored. */
+static inline void vkd3d_set_current_thread_priority(enum vkd3d_thread_priority priority)
+{
+#ifdef _WIN32
+    static const int win32_priorities[] =
+    {
+        THREAD_PRIORITY_LOWEST,
+        THREAD_PRIORITY_BELOW_NORMAL,
+    };
+#elif defined(__linux__)
+    /* On Linux, nice values are per-thread when addressed by TID. */
+    static const int nice_values[] = { 19, 10 };
+#endif
+
+    if (priority == VKD3D_THREAD_PRIORITY_NORMAL)
+        return;
+
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), win32_priorities[priority]);
+#elif defined(__linux__)
+    setpriority(PRIO_PROCESS, vkd3d_get_current_thread_id(), nice_values[priority]);
+#endif
+}
+
 #endif /* __VKD3D_THREADS_H */
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __VKD3D_TLSF_H
+#define __VKD3D_TLSF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Two-level segregated fit allocator for address ranges which are not CPU accessible,
+ * e.g. GPU memory. Block metadata lives in a separate node array, and multiple
+ * disjoint regions can be managed by the same instance. Blocks are never merged
+ * across region boundaries. Allocation and free are O(1). */
+
+#define VKD3D_TLSF_GRANULARITY_LOG2 8u
+#define VKD3D_TLSF_GRANULARITY (1ull << VKD3D_TLSF_GRANULARITY_LOG2)
+#define VKD3D_TLSF_SL_COUNT_LOG2 4u
+#define VKD3D_TLSF_SL_COUNT (1u << VKD3D_TLSF_SL_COUNT_LOG2)
+#define VKD3D_TLSF_FL_COUNT 32u
+#define VKD3D_TLSF_INVALID_BLOCK UINT32_MAX
+
+struct vkd3d_tlsf_block
+{
+    uint64_t offset;
+    uint64_t size;
+    void *region;
+
+    /* Address-ordered neighbours within the same region. */
+    uint32_t phys_prev;
+    uint32_t phys_next;
+    /* Free list links. Unused nodes are chained through free_next. */
+    uint32_t free_prev;
+    uint32_t free_next;
+    bool is_free;
+};
+
+struct vkd3d_tlsf_allocation
+{
+    void *region;
+    uint64_t offset;
+    uint32_t block_index;
+};
+
+struct vkd3d_tlsf
+{
+    struct vkd3d_tlsf_block *blocks;
+    size_t blocks_size;
+    uint32_t block_count;
+    uint32_t unused_block_index;
+
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[VKD3D_TLSF_FL_COUNT];
+    uint32_t heads[VKD3D_TLSF_FL_COUNT][VKD3D_TLSF_SL_COUNT];
+
+    uint64_t total_size;
+    uint64_t free_size;
+};
+
+void vkd3d_tlsf_init(struct vkd3d_tlsf *tlsf);
+void vkd3d_tlsf_cleanup(struct vkd3d_tlsf *tlsf);
+
+/* Size must be a multiple of VKD3D_TLSF_GRANULARITY. Returns the block index of the region. */
+uint32_t vkd3d_tlsf_add_region(struct vkd3d_tlsf *tlsf, void *region, uint64_t size);
+/* The region must be entirely free, i.e. vkd3d_tlsf_block_is_region() must be true. */
+void vkd3d_tlsf_remove_region(struct vkd3d_tlsf *tlsf, uint32_t block_index);
+
+bool vkd3d_tlsf_allocate(struct vkd3d_tlsf *tlsf, uint64_t size, uint64_t alignment,
+        struct vkd3d_tlsf_allocation *allocation);
+/* Returns the index of the free block the allocation was merged into. */
+uint32_t vkd3d_tlsf_free(struct vkd3d_tlsf *tlsf, uint32_t block_index);
+
+static inline bool vkd3d_tlsf_block_is_region(const struct vkd3d_tlsf *tlsf, uint32_t block_index)
+{
+    const struct vkd3d_tlsf_block *block = &tlsf->blocks[block_index];
+    return block->is_free && block->phys_prev == VKD3D_TLSF_INVALID_BLOCK &&
+            block->phys_next == VKD3D_TLSF_INVALID_BLOCK;
+}
+
+uint64_t vkd3d_tlsf_get_largest_free_block_size(const struct vkd3d_tlsf *tlsf);
+
+#endif  /* __VKD3D_TLSF_H */
@@ -94,6 +94,8 @@ extern "C" {
 #define VKD3D_CONFIG_FLAG_USE_HOST_IMPORT_FALLBACK (1ull << 32)
 #define VKD3D_CONFIG_FLAG_PREALLOCATE_SRV_MIP_CLAMPS (1ull << 33)
 #define VKD3D_CONFIG_FLAG_FORCE_INITIAL_TRANSITION (1ull << 34)
+#define VKD3D_CONFIG_FLAG_ASYNC_PIPELINE_COMPILE (1ull << 35)
+#define VKD3D_CONFIG_FLAG_SHADER_CACHE_NO_COMPRESSION (1ull << 36)
 
 typedef HRESULT (*PFN_vkd3d_signal_event)(HANDLE event);
 
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_chunk_pool.h"
+#include "vkd3d_memory.h"
+
+#include <string.h>
+
+void vkd3d_chunk_pool_init(struct vkd3d_chunk_pool *pool, size_t chunk_size, size_t max_chunk_count)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->chunk_size = chunk_size;
+    pool->max_chunk_count = max_chunk_count;
+}
+
+void vkd3d_chunk_pool_cleanup(struct vkd3d_chunk_pool *pool)
+{
+    size_t i;
+
+    for (i = 0; i < pool->chunks_count; i++)
+        vkd3d_free(pool->chunks[i]);
+
+    vkd3d_free(pool->chunks);
+    pool->chunks = NULL;
+    pool->chunks_size = 0;
+    pool->chunks_count = 0;
+}
+
+void *vkd3d_chunk_pool_take(struct vkd3d_chunk_pool *pool)
+{
+    if (!pool->chunks_count)
+        return NULL;
+
+    return pool->chunks[--pool->chunks_count];
+}
+
+void *vkd3d_chunk_pool_alloc(struct vkd3d_chunk_pool *pool)
+{
+    void *chunk;
+
+    if ((chunk = vkd3d_chunk_pool_take(pool)))
+        return chunk;
+
+    if ((chunk = vkd3d_malloc(pool->chunk_size)))
+        pool->heap_alloc_count++;
+
+    return chunk;
+}
+
+void vkd3d_chunk_pool_free(struct vkd3d_chunk_pool *pool, void *chunk)
+{
+    if (!chunk)
+        return;
+
+    if (pool->chunks_count < pool->max_chunk_count &&
+            vkd3d_array_reserve((void **)&pool->chunks, &pool->chunks_size,
+                    pool->chunks_count + 1, sizeof(*pool->chunks)))
+        pool->chunks[pool->chunks_count++] = chunk;
+    else
+        vkd3d_free(chunk);
+}
+
+void vkd3d_chunk_pool_recycle(struct vkd3d_chunk_pool *pool, void **chunks, size_t count,
+        struct vkd3d_chunk_pool *shared_pool, pthread_mutex_t *shared_lock)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        vkd3d_chunk_pool_free(pool, chunks[i]);
+
+    if (pool->chunks_count <= count)
+        return;
+
+    if (shared_lock)
+        pthread_mutex_lock(shared_lock);
+
+    while (pool->chunks_count > count)
+        vkd3d_chunk_pool_free(shared_pool, vkd3d_chunk_pool_take(pool));
+
+    if (shared_lock)
+        pthread_mutex_unlock(shared_lock);
+}
@@ -19,6 +19,7 @@
 #define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
 
 #include "vkd3d_file_utils.h"
+#include "vkd3d_platform.h"
 #include "vkd3d_debug.h"
 
 /* For disk cache. */
@@ -27,6 +28,8 @@
 #include <io.h>
 #else
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <errno.h>
 #endif
@@ -34,6 +37,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <string.h>
 
 bool vkd3d_file_rename_overwrite(const char *from_path, const char *to_path)
 {
@@ -105,6 +109,111 @@ FILE *vkd3d_file_open_exclusive_write(const char *path)
 #endif
 }
 
+bool vkd3d_file_try_lock_exclusive(FILE *file)
+{
+#ifdef _WIN32
+    OVERLAPPED overlapped;
+    HANDLE handle;
+
+    handle = (HANDLE)_get_osfhandle(_fileno(file));
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    return LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY,
+            0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+    return flock(fileno(file), LOCK_EX | LOCK_NB) == 0;
+#endif
+}
+
+bool vkd3d_file_truncate_at_current_position(FILE *file)
+{
+#ifdef _WIN32
+    __int64 off;
+
+    if (fflush(file) != 0 || (off = _ftelli64(file)) < 0)
+        return false;
+    return _chsize_s(_fileno(file), off) == 0;
+#else
+    off_t off;
+
+    if (fflush(file) != 0 || (off = ftello(file)) < 0)
+        return false;
+    return ftruncate(fileno(file), off) == 0;
+#endif
+}
+
+bool vkd3d_file_enumerate_prefix(const char *path_prefix, vkd3d_file_enumerate_callback callback, void *userdata)
+{
+    char dir_path[VKD3D_PATH_MAX];
+    char path[VKD3D_PATH_MAX];
+    const char *name_prefix;
+    size_t name_prefix_len;
+    size_t dir_len;
+#ifdef _WIN32
+    WIN32_FIND_DATAA find_data;
+    const char *separator;
+    HANDLE find_handle;
+#else
+    struct dirent *dirent;
+    DIR *dir;
+#endif
+
+    name_prefix = strrchr(path_prefix, '/');
+#ifdef _WIN32
+    if ((separator = strrchr(path_prefix, '\\')) && (!name_prefix || separator > name_prefix))
+        name_prefix = separator;
+#endif
+    name_prefix = name_prefix ? name_prefix + 1 : path_prefix;
+    name_prefix_len = strlen(name_prefix);
+
+    /* Keep the trailing separator, so names can be appended directly. */
+    dir_len = name_prefix - path_prefix;
+    if (dir_len >= sizeof(dir_path))
+        return false;
+    memcpy(dir_path, path_prefix, dir_len);
+    dir_path[dir_len] = '\0';
+
+#ifdef _WIN32
+    if (snprintf(path, sizeof(path), "%s*", path_prefix) >= (int)sizeof(path))
+        return false;
+
+    find_handle = FindFirstFileA(path, &find_data);
+    if (find_handle == INVALID_HANDLE_VALUE)
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+
+    do
+    {
+        if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if (strncmp(find_data.cFileName, name_prefix, name_prefix_len) != 0)
+            continue;
+        if (snprintf(path, sizeof(path), "%s%s", dir_path, find_data.cFileName) < (int)sizeof(path))
+            callback(path, userdata);
+    } while (FindNextFileA(find_handle, &find_data));
+
+    FindClose(find_handle);
+#else
+    if (!(dir = opendir(dir_len ? dir_path : ".")))
+        return errno == ENOENT;
+
+    while ((dirent = readdir(dir)))
+    {
+        if (strncmp(dirent->d_name, name_prefix, name_prefix_len) != 0)
+            continue;
+        if (dirent->d_type != DT_REG && dirent->d_type != DT_UNKNOWN)
+            continue;
+        if (snprintf(path, sizeof(path), "%s%s", dir_path, dirent->d_name) < (int)sizeof(path))
+            callback(path, userdata);
+    }
+
+    closedir(dir);
+#endif
+
+    return true;
+}
+
 void vkd3d_file_unmap(struct vkd3d_memory_mapped_file *file)
 {
     if (file->mapped)
@@ -0,0 +1,434 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_hash.h"
+#include "vkd3d_common.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKD3D_HASH64_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define VKD3D_HASH64_AVX2
+#include <immintrin.h>
+#elif defined(VKD3D_HASH64_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* Default builds do not target AVX2, so select it at runtime. */
+#define VKD3D_HASH64_AVX2
+#define VKD3D_HASH64_AVX2_RUNTIME
+#define VKD3D_HASH64_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+#ifndef VKD3D_HASH64_TARGET_AVX2
+#define VKD3D_HASH64_TARGET_AVX2
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define VKD3D_HASH64_NEON
+#include <arm_neon.h>
+#endif
+
+#define VKD3D_HASH64_PRIME32_1 0x9e3779b1u
+#define VKD3D_HASH64_PRIME32_2 0x85ebca77u
+#define VKD3D_HASH64_PRIME32_3 0xc2b2ae3du
+#define VKD3D_HASH64_PRIME64_1 0x9e3779b185ebca87ull
+#define VKD3D_HASH64_PRIME64_2 0xc2b2ae3d27d4eb4full
+#define VKD3D_HASH64_PRIME64_3 0x165667b19e3779f9ull
+#define VKD3D_HASH64_PRIME64_4 0x85ebca77c2b2ae63ull
+#define VKD3D_HASH64_PRIME64_5 0x27d4eb2f165667c5ull
+
+#define VKD3D_HASH64_STRIPE_SIZE 64
+#define VKD3D_HASH64_LANE_COUNT 8
+#define VKD3D_HASH64_SECRET_WORDS 24
+/* The key advances by one word per stripe, and the accumulators are scrambled
+ * once the key runs out. */
+#define VKD3D_HASH64_STRIPES_PER_BLOCK (VKD3D_HASH64_SECRET_WORDS - VKD3D_HASH64_LANE_COUNT)
+#define VKD3D_HASH64_BLOCK_SIZE (VKD3D_HASH64_STRIPE_SIZE * VKD3D_HASH64_STRIPES_PER_BLOCK)
+
+static const uint64_t vkd3d_hash64_secret[VKD3D_HASH64_SECRET_WORDS] =
+{
+    0xd449c6726e6dbcbbull, 0x72b056f1ab4d77f2ull, 0x76e5ef1b727d8d5dull, 0x358c73c43444da36ull,
+    0x6f49452768804f9dull, 0x5c4df13196b5f695ull, 0x5912e00ff6ffb9c5ull, 0x2e391d31e806ce25ull,
+    0x764b79872c18ed10ull, 0x5d03f7e13ebdb125ull, 0x81ebb9ad241a65c3ull, 0x07eeaedca4716ae5ull,
+    0xc1c8c59fc9dd6282ull, 0x0d7912be47d1ff1full, 0x0bcc7e3c36fb65adull, 0x941545dfe8da9a1aull,
+    0xfd6517e6fa1140f1ull, 0x9c03452f10000e10ull, 0x03f8d519d8008987ull, 0x8aac254e76a488e7ull,
+    0xf71169d787bb46eeull, 0xeedadc098bb8da9cull, 0x85fbfb31565877feull, 0x49a9183724360be9ull,
+};
+
+typedef void (*vkd3d_hash64_accumulate_func)(uint64_t *acc, const uint8_t *data,
+        size_t stripe_count, const uint64_t *secret);
+typedef void (*vkd3d_hash64_scramble_func)(uint64_t *acc, const uint64_t *secret);
+
+struct vkd3d_hash64_impl
+{
+    const char *name;
+    vkd3d_hash64_accumulate_func accumulate;
+    vkd3d_hash64_scramble_func scramble;
+};
+
+static inline uint64_t vkd3d_hash64_read64(const uint8_t *data)
+{
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+static inline uint32_t vkd3d_hash64_read32(const uint8_t *data)
+{
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+static inline uint64_t vkd3d_hash64_rotl(uint64_t v, unsigned int r)
+{
+    return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t vkd3d_hash64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * VKD3D_HASH64_PRIME64_2;
+    acc = vkd3d_hash64_rotl(acc, 31);
+    return acc * VKD3D_HASH64_PRIME64_1;
+}
+
+static inline uint64_t vkd3d_hash64_avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= VKD3D_HASH64_PRIME64_2;
+    h ^= h >> 29;
+    h *= VKD3D_HASH64_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void vkd3d_hash64_accumulate_portable(uint64_t *acc, const uint8_t *data,
+        size_t stripe_count, const uint64_t *secret)
+{
+    uint64_t d, dk;
+    unsigned int i;
+    size_t n;
+
+    for (n = 0; n < stripe_count; n++, data += VKD3D_HASH64_STRIPE_SIZE)
+    {
+        for (i = 0; i < VKD3D_HASH64_LANE_COUNT; i++)
+        {
+            d = vkd3d_hash64_read64(data + i * sizeof(uint64_t));
+            dk = d ^ secret[n + i];
+            acc[i ^ 1] += d;
+            acc[i] += (dk & UINT32_MAX) * (dk >> 32);
+        }
+    }
+}
+
+static void vkd3d_hash64_scramble_portable(uint64_t *acc, const uint64_t *secret)
+{
+    unsigned int i;
+    uint64_t a;
+
+    for (i = 0; i < VKD3D_HASH64_LANE_COUNT; i++)
+    {
+        a = acc[i];
+        a ^= a >> 47;
+        a ^= secret[i];
+        acc[i] = a * VKD3D_HASH64_PRIME32_1;
+    }
+}
+
+static const struct vkd3d_hash64_impl vkd3d_hash64_impl_portable =
+{
+    "portable", vkd3d_hash64_accumulate_portable, vkd3d_hash64_scramble_portable,
+};
+
+#ifdef VKD3D_HASH64_SSE2
+static void vkd3d_hash64_accumulate_sse2(uint64_t *acc, const uint8_t *data,
+        size_t stripe_count, const uint64_t *secret)
+{
+    __m128i a[4], d, dk, product;
+    unsigned int i;
+    size_t n;
+
+    for (i = 0; i < 4; i++)
+        a[i] = _mm_loadu_si128((const __m128i *)acc + i);
+
+    for (n = 0; n < stripe_count; n++, data += VKD3D_HASH64_STRIPE_SIZE)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            d = _mm_loadu_si128((const __m128i *)data + i);
+            dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i *)(secret + n) + i));
+            /* Multiply the low and high halves of each 64-bit lane. */
+            product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            /* Each lane receives the data of its neighbour. */
+            d = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, d));
+        }
+    }
+
+    for (i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i *)acc + i, a[i]);
+}
+
+static void vkd3d_hash64_scramble_sse2(uint64_t *acc, const uint64_t *secret)
+{
+    const __m128i prime = _mm_set1_epi32((int)VKD3D_HASH64_PRIME32_1);
+    __m128i a, lo, hi;
+    unsigned int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        a = _mm_loadu_si128((const __m128i *)acc + i);
+        a = _mm_xor_si128(a, _mm_srli_epi64(a, 47));
+        a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)secret + i));
+        /* 64x32-bit multiply from two 32x32-bit multiplies. */
+        lo = _mm_mul_epu32(a, prime);
+        hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+        a = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+        _mm_storeu_si128((__m128i *)acc + i, a);
+    }
+}
+
+static const struct vkd3d_hash64_impl vkd3d_hash64_impl_sse2 =
+{
+    "sse2", vkd3d_hash64_accumulate_sse2, vkd3d_hash64_scramble_sse2,
+};
+#endif
+
+#ifdef VKD3D_HASH64_AVX2
+static VKD3D_HASH64_TARGET_AVX2 void vkd3d_hash64_accumulate_avx2(uint64_t *acc, const uint8_t *data,
+        size_t stripe_count, const uint64_t *secret)
+{
+    __m256i a[2], d, dk, product;
+    unsigned int i;
+    size_t n;
+
+    for (i = 0; i < 2; i++)
+        a[i] = _mm256_loadu_si256((const __m256i *)acc + i);
+
+    for (n = 0; n < stripe_count; n++, data += VKD3D_HASH64_STRIPE_SIZE)
+    {
+        for (i = 0; i < 2; i++)
+        {
+            d = _mm256_loadu_si256((const __m256i *)data + i);
+            dk = _mm256_xor_si256(d, _mm256_loadu_si256((const __m256i *)(secret + n) + i));
+            product = _mm256_mul_epu32(dk, _mm256_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            d = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            a[i] = _mm256_add_epi64(a[i], _mm256_add_epi64(product, d));
+        }
+    }
+
+    for (i = 0; i < 2; i++)
+        _mm256_storeu_si256((__m256i *)acc + i, a[i]);
+}
+
+static VKD3D_HASH64_TARGET_AVX2 void vkd3d_hash64_scramble_avx2(uint64_t *acc, const uint64_t *secret)
+{
+    const __m256i prime = _mm256_set1_epi32((int)VKD3D_HASH64_PRIME32_1);
+    __m256i a, lo, hi;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        a = _mm256_loadu_si256((const __m256i *)acc + i);
+        a = _mm256_xor_si256(a, _mm256_srli_epi64(a, 47));
+        a = _mm256_xor_si256(a, _mm256_loadu_si256((const __m256i *)secret + i));
+        lo = _mm256_mul_epu32(a, prime);
+        hi = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), prime);
+        a = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+        _mm256_storeu_si256((__m256i *)acc + i, a);
+    }
+}
+
+static const struct vkd3d_hash64_impl vkd3d_hash64_impl_avx2 =
+{
+    "avx2", vkd3d_hash64_accumulate_avx2, vkd3d_hash64_scramble_avx2,
+};
+#endif
+
+#ifdef VKD3D_HASH64_NEON
+static void vkd3d_hash64_accumulate_neon(uint64_t *acc, const uint8_t *data,
+        size_t stripe_count, const uint64_t *secret)
+{
+    uint64x2_t a[4], d, dk, product;
+    unsigned int i;
+    size_t n;
+
+    for (i = 0; i < 4; i++)
+        a[i] = vld1q_u64(acc + 2 * i);
+
+    for (n = 0; n < stripe_count; n++, data += VKD3D_HASH64_STRIPE_SIZE)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            d = vreinterpretq_u64_u8(vld1q_u8(data + 16 * i));
+            dk = veorq_u64(d, vld1q_u64(secret + n + 2 * i));
+            product = vmull_u32(vmovn_u64(dk), vshrn_n_u64(dk, 32));
+            a[i] = vaddq_u64(a[i], vaddq_u64(product, vextq_u64(d, d, 1)));
+        }
+    }
+
+    for (i = 0; i < 4; i++)
+        vst1q_u64(acc + 2 * i, a[i]);
+}
+
+static void vkd3d_hash64_scramble_neon(uint64_t *acc, const uint64_t *secret)
+{
+    const uint32x2_t prime = vdup_n_u32(VKD3D_HASH64_PRIME32_1);
+    uint64x2_t a, lo, hi;
+    unsigned int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        a = vld1q_u64(acc + 2 * i);
+        a = veorq_u64(a, vshrq_n_u64(a, 47));
+        a = veorq_u64(a, vld1q_u64(secret + 2 * i));
+        lo = vmull_u32(vmovn_u64(a), prime);
+        hi = vmull_u32(vshrn_n_u64(a, 32), prime);
+        vst1q_u64(acc + 2 * i, vaddq_u64(lo, vshlq_n_u64(hi, 32)));
+    }
+}
+
+static const struct vkd3d_hash64_impl vkd3d_hash64_impl_neon =
+{
+    "neon", vkd3d_hash64_accumulate_neon, vkd3d_hash64_scramble_neon,
+};
+#endif
+
+static uint64_t vkd3d_hash64_short(const uint8_t *data, size_t size)
+{
+    uint64_t h = VKD3D_HASH64_PRIME64_5 + size;
+
+    while (size >= 8)
+    {
+        h ^= vkd3d_hash64_round(0, vkd3d_hash64_read64(data));
+        h = vkd3d_hash64_rotl(h, 27) * VKD3D_HASH64_PRIME64_1 + VKD3D_HASH64_PRIME64_4;
+        data += 8;
+        size -= 8;
+    }
+
+    if (size >= 4)
+    {
+        h ^= (uint64_t)vkd3d_hash64_read32(data) * VKD3D_HASH64_PRIME64_1;
+        h = vkd3d_hash64_rotl(h, 23) * VKD3D_HASH64_PRIME64_2 + VKD3D_HASH64_PRIME64_3;
+        data += 4;
+        size -= 4;
+    }
+
+    while (size)
+    {
+        h ^= *data * VKD3D_HASH64_PRIME64_5;
+        h = vkd3d_hash64_rotl(h, 11) * VKD3D_HASH64_PRIME64_1;
+        data++;
+        size--;
+    }
+
+    return vkd3d_hash64_avalanche(h);
+}
+
+static uint64_t vkd3d_hash64_long(const uint8_t *data, size_t size, const struct vkd3d_hash64_impl *impl)
+{
+    uint64_t acc[VKD3D_HASH64_LANE_COUNT] =
+    {
+        VKD3D_HASH64_PRIME32_3, VKD3D_HASH64_PRIME64_1, VKD3D_HASH64_PRIME64_2, VKD3D_HASH64_PRIME64_3,
+        VKD3D_HASH64_PRIME64_4, VKD3D_HASH64_PRIME32_2, VKD3D_HASH64_PRIME64_5, VKD3D_HASH64_PRIME32_1,
+    };
+    const uint64_t *scramble_secret = vkd3d_hash64_secret + VKD3D_HASH64_STRIPES_PER_BLOCK;
+    size_t block_count, stripe_count, i;
+    uint64_t h;
+
+    /* The final stripe is always handled separately, even if it is complete. */
+    block_count = (size - 1) / VKD3D_HASH64_BLOCK_SIZE;
+    for (i = 0; i < block_count; i++)
+    {
+        impl->accumulate(acc, data + i * VKD3D_HASH64_BLOCK_SIZE,
+                VKD3D_HASH64_STRIPES_PER_BLOCK, vkd3d_hash64_secret);
+        impl->scramble(acc, scramble_secret);
+    }
+
+    stripe_count = (size - 1 - block_count * VKD3D_HASH64_BLOCK_SIZE) / VKD3D_HASH64_STRIPE_SIZE;
+    impl->accumulate(acc, data + block_count * VKD3D_HASH64_BLOCK_SIZE, stripe_count, vkd3d_hash64_secret);
+
+    /* The last stripe overlaps with already consumed data if size is not a multiple of the stripe size. */
+    impl->accumulate(acc, data + size - VKD3D_HASH64_STRIPE_SIZE, 1, scramble_secret - 1);
+
+    h = size * VKD3D_HASH64_PRIME64_1;
+    for (i = 0; i < VKD3D_HASH64_LANE_COUNT; i++)
+    {
+        h ^= vkd3d_hash64_round(0, acc[i]);
+        h = vkd3d_hash64_rotl(h, 27) * VKD3D_HASH64_PRIME64_1 + VKD3D_HASH64_PRIME64_4;
+    }
+
+    return vkd3d_hash64_avalanche(h);
+}
+
+static const struct vkd3d_hash64_impl *vkd3d_hash64_select_impl(void)
+{
+#ifdef VKD3D_HASH64_AVX2_RUNTIME
+    if (__builtin_cpu_supports("avx2"))
+        return &vkd3d_hash64_impl_avx2;
+#elif defined(VKD3D_HASH64_AVX2)
+    return &vkd3d_hash64_impl_avx2;
+#endif
+
+#if defined(VKD3D_HASH64_SSE2)
+    return &vkd3d_hash64_impl_sse2;
+#elif defined(VKD3D_HASH64_NEON)
+    return &vkd3d_hash64_impl_neon;
+#else
+    return &vkd3d_hash64_impl_portable;
+#endif
+}
+
+static const struct vkd3d_hash64_impl *vkd3d_hash64_get_impl(void)
+{
+    static const struct vkd3d_hash64_impl *selected_impl;
+    const struct vkd3d_hash64_impl *impl;
+
+    /* Racing threads select the same implementation, so this does not need a lock. */
+    if (!(impl = vkd3d_atomic_ptr_load_explicit(&selected_impl, vkd3d_memory_order_relaxed)))
+    {
+        impl = vkd3d_hash64_select_impl();
+        vkd3d_atomic_ptr_store_explicit(&selected_impl, impl, vkd3d_memory_order_relaxed);
+    }
+
+    return impl;
+}
+
+uint64_t vkd3d_hash64(const void *data, size_t size)
+{
+    if (size < VKD3D_HASH64_STRIPE_SIZE)
+        return vkd3d_hash64_short(data, size);
+    return vkd3d_hash64_long(data, size, vkd3d_hash64_get_impl());
+}
+
+uint64_t vkd3d_hash64_portable(const void *data, size_t size)
+{
+    if (size < VKD3D_HASH64_STRIPE_SIZE)
+        return vkd3d_hash64_short(data, size);
+    return vkd3d_hash64_long(data, size, &vkd3d_hash64_impl_portable);
+}
+
+const char *vkd3d_hash64_get_impl_name(void)
+{
+    return vkd3d_hash64_get_impl()->name;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_lz.h"
+#include "vkd3d_common.h"
+
+#include <string.h>
+
+/* Each sequence starts with a token byte. The upper nibble is the literal length,
+ * the lower nibble is the match length minus VKD3D_LZ_MIN_MATCH.
+ * A nibble of 15 is followed by extra length bytes, which continue while they are 255.
+ * Literals follow the literal length, then a little endian 16-bit match offset.
+ * The final sequence only has literals and ends the stream. */
+#define VKD3D_LZ_MIN_MATCH 4
+#define VKD3D_LZ_MAX_OFFSET 0xffff
+#define VKD3D_LZ_HASH_BITS 13
+#define VKD3D_LZ_INVALID_POSITION UINT32_MAX
+
+static inline uint32_t vkd3d_lz_read_u32(const uint8_t *data)
+{
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+static inline uint32_t vkd3d_lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - VKD3D_LZ_HASH_BITS);
+}
+
+static uint8_t *vkd3d_lz_write_length(uint8_t *dst, size_t length)
+{
+    length -= 15;
+    while (length >= 255)
+    {
+        *dst++ = 255;
+        length -= 255;
+    }
+    *dst++ = length;
+    return dst;
+}
+
+static uint8_t *vkd3d_lz_write_sequence(uint8_t *dst, const uint8_t *literals, size_t literal_length,
+        size_t offset, size_t match_length)
+{
+    uint8_t *token = dst++;
+
+    *token = min(literal_length, 15) << 4;
+    if (literal_length >= 15)
+        dst = vkd3d_lz_write_length(dst, literal_length);
+    memcpy(dst, literals, literal_length);
+    dst += literal_length;
+
+    if (match_length)
+    {
+        *dst++ = offset & 0xff;
+        *dst++ = offset >> 8;
+        match_length -= VKD3D_LZ_MIN_MATCH;
+        *token |= min(match_length, 15);
+        if (match_length >= 15)
+            dst = vkd3d_lz_write_length(dst, match_length);
+    }
+
+    return dst;
+}
+
+size_t vkd3d_lz_compress_bound(size_t src_size)
+{
+    /* Incompressible data degenerates to a single literal run. */
+    return src_size + src_size / 255 + 16;
+}
+
+size_t vkd3d_lz_compress(const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+    uint32_t table[1u << VKD3D_LZ_HASH_BITS];
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    size_t match_length;
+    uint32_t candidate;
+    size_t anchor = 0;
+    size_t pos = 0;
+    uint32_t v, h;
+
+    if (dst_size < vkd3d_lz_compress_bound(src_size) || src_size >= VKD3D_LZ_INVALID_POSITION)
+        return 0;
+
+    memset(table, 0xff, sizeof(table));
+
+    while (pos + VKD3D_LZ_MIN_MATCH <= src_size)
+    {
+        v = vkd3d_lz_read_u32(src + pos);
+        h = vkd3d_lz_hash(v);
+        candidate = table[h];
+        table[h] = pos;
+
+        if (candidate == VKD3D_LZ_INVALID_POSITION || pos - candidate > VKD3D_LZ_MAX_OFFSET ||
+                vkd3d_lz_read_u32(src + candidate) != v)
+        {
+            pos++;
+            continue;
+        }
+
+        match_length = VKD3D_LZ_MIN_MATCH;
+        while (pos + match_length < src_size && src[candidate + match_length] == src[pos + match_length])
+            match_length++;
+
+        dst = vkd3d_lz_write_sequence(dst, src + anchor, pos - anchor, pos - candidate, match_length);
+
+        /* Seed the table inside the match as well. Helps with the short strides typical for SPIR-V. */
+        if (pos + match_length + VKD3D_LZ_MIN_MATCH <= src_size)
+            table[vkd3d_lz_hash(vkd3d_lz_read_u32(src + pos + match_length - 2))] = pos + match_length - 2;
+
+        pos += match_length;
+        anchor = pos;
+    }
+
+    dst = vkd3d_lz_write_sequence(dst, src + anchor, src_size - anchor, 0, 0);
+    return dst - (uint8_t *)dst_;
+}
+
+static bool vkd3d_lz_read_length(const uint8_t **src, const uint8_t *src_end, size_t *length)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*src >= src_end)
+            return false;
+        b = *(*src)++;
+        *length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+bool vkd3d_lz_decompress(const void *src_, size_t src_size, void *dst_, size_t dst_size)
+{
+    const uint8_t *src = src_, *src_end = src + src_size;
+    uint8_t *dst = dst_, *dst_end = dst + dst_size;
+    const uint8_t *match;
+    size_t length, offset;
+    uint8_t token;
+
+    while (src < src_end)
+    {
+        token = *src++;
+
+        length = token >> 4;
+        if (length == 15 && !vkd3d_lz_read_length(&src, src_end, &length))
+            return false;
+        if (length > (size_t)(src_end - src) || length > (size_t)(dst_end - dst))
+            return false;
+
+        memcpy(dst, src, length);
+        dst += length;
+        src += length;
+
+        if (src == src_end)
+            break;
+
+        if (src_end - src < 2)
+            return false;
+        offset = src[0] | (src[1] << 8);
+        src += 2;
+
+        if (!offset || offset > (size_t)(dst - (uint8_t *)dst_))
+            return false;
+
+        length = token & 15;
+        if (length == 15 && !vkd3d_lz_read_length(&src, src_end, &length))
+            return false;
+        length += VKD3D_LZ_MIN_MATCH;
+        if (length > (size_t)(dst_end - dst))
+            return false;
+
+        match = dst - offset;
+        if (offset >= length)
+        {
+            memcpy(dst, match, length);
+            dst += length;
+        }
+        else
+        {
+            /* Overlapping match, i.e. a repeating pattern. */
+            while (length--)
+                *dst++ = *match++;
+        }
+    }
+
+    return dst == dst_end;
+}
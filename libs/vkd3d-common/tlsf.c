@@ -0,0 +1,331 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_tlsf.h"
+#include "vkd3d_memory.h"
+
+#include <string.h>
+
+static void vkd3d_tlsf_mapping(uint32_t units, uint32_t *fl, uint32_t *sl)
+{
+    uint32_t l = vkd3d_log2i(units);
+
+    if (l < VKD3D_TLSF_SL_COUNT_LOG2)
+        *sl = (units << (VKD3D_TLSF_SL_COUNT_LOG2 - l)) & (VKD3D_TLSF_SL_COUNT - 1);
+    else
+        *sl = (units >> (l - VKD3D_TLSF_SL_COUNT_LOG2)) & (VKD3D_TLSF_SL_COUNT - 1);
+
+    *fl = l;
+}
+
+static uint32_t vkd3d_tlsf_size_to_units(uint64_t size)
+{
+    uint64_t units = (size + VKD3D_TLSF_GRANULARITY - 1) >> VKD3D_TLSF_GRANULARITY_LOG2;
+    assert(units && units <= UINT32_MAX);
+    return (uint32_t)units;
+}
+
+static uint32_t vkd3d_tlsf_alloc_node(struct vkd3d_tlsf *tlsf)
+{
+    uint32_t index;
+
+    if ((index = tlsf->unused_block_index) != VKD3D_TLSF_INVALID_BLOCK)
+    {
+        tlsf->unused_block_index = tlsf->blocks[index].free_next;
+        return index;
+    }
+
+    if (!vkd3d_array_reserve((void **)&tlsf->blocks, &tlsf->blocks_size,
+            tlsf->block_count + 1, sizeof(*tlsf->blocks)))
+        return VKD3D_TLSF_INVALID_BLOCK;
+
+    return tlsf->block_count++;
+}
+
+static void vkd3d_tlsf_free_node(struct vkd3d_tlsf *tlsf, uint32_t index)
+{
+    tlsf->blocks[index].free_next = tlsf->unused_block_index;
+    tlsf->unused_block_index = index;
+}
+
+static void vkd3d_tlsf_insert_free_block(struct vkd3d_tlsf *tlsf, uint32_t index)
+{
+    struct vkd3d_tlsf_block *block = &tlsf->blocks[index];
+    uint32_t fl, sl, head;
+
+    vkd3d_tlsf_mapping(vkd3d_tlsf_size_to_units(block->size), &fl, &sl);
+
+    head = tlsf->heads[fl][sl];
+    block->is_free = true;
+    block->free_prev = VKD3D_TLSF_INVALID_BLOCK;
+    block->free_next = head;
+    if (head != VKD3D_TLSF_INVALID_BLOCK)
+        tlsf->blocks[head].free_prev = index;
+    tlsf->heads[fl][sl] = index;
+
+    tlsf->fl_bitmap |= 1u << fl;
+    tlsf->sl_bitmap[fl] |= 1u << sl;
+    tlsf->free_size += block->size;
+}
+
+static void vkd3d_tlsf_remove_free_block(struct vkd3d_tlsf *tlsf, uint32_t index)
+{
+    struct vkd3d_tlsf_block *block = &tlsf->blocks[index];
+    uint32_t fl, sl;
+
+    vkd3d_tlsf_mapping(vkd3d_tlsf_size_to_units(block->size), &fl, &sl);
+
+    if (block->free_prev != VKD3D_TLSF_INVALID_BLOCK)
+        tlsf->blocks[block->free_prev].free_next = block->free_next;
+    else
+        tlsf->heads[fl][sl] = block->free_next;
+
+    if (block->free_next != VKD3D_TLSF_INVALID_BLOCK)
+        tlsf->blocks[block->free_next].free_prev = block->free_prev;
+
+    if (tlsf->heads[fl][sl] == VKD3D_TLSF_INVALID_BLOCK)
+    {
+        tlsf->sl_bitmap[fl] &= ~(1u << sl);
+        if (!tlsf->sl_bitmap[fl])
+            tlsf->fl_bitmap &= ~(1u << fl);
+    }
+
+    block->is_free = false;
+    tlsf->free_size -= block->size;
+}
+
+static uint32_t vkd3d_tlsf_find_free_block(struct vkd3d_tlsf *tlsf, uint32_t units)
+{
+    uint32_t fl, sl, sl_map, fl_map;
+
+    /* Round up to the next list, so that any block in the list we find is large enough. */
+    fl = vkd3d_log2i(units);
+    if (fl >= VKD3D_TLSF_SL_COUNT_LOG2)
+    {
+        if (units > UINT32_MAX - ((1u << (fl - VKD3D_TLSF_SL_COUNT_LOG2)) - 1))
+            return VKD3D_TLSF_INVALID_BLOCK;
+        units += (1u << (fl - VKD3D_TLSF_SL_COUNT_LOG2)) - 1;
+    }
+
+    vkd3d_tlsf_mapping(units, &fl, &sl);
+
+    if (!(sl_map = tlsf->sl_bitmap[fl] & (~0u << sl)))
+    {
+        if (fl + 1 >= VKD3D_TLSF_FL_COUNT || !(fl_map = tlsf->fl_bitmap & (~0u << (fl + 1))))
+            return VKD3D_TLSF_INVALID_BLOCK;
+
+        fl = vkd3d_bitmask_tzcnt32(fl_map);
+        sl_map = tlsf->sl_bitmap[fl];
+    }
+
+    sl = vkd3d_bitmask_tzcnt32(sl_map);
+    return tlsf->heads[fl][sl];
+}
+
+/* Keeps the first size bytes in the block, and splits off the rest as a new free block. */
+static bool vkd3d_tlsf_split_block(struct vkd3d_tlsf *tlsf, uint32_t index, uint64_t size)
+{
+    struct vkd3d_tlsf_block *block, *tail;
+    uint32_t tail_index;
+
+    if ((tail_index = vkd3d_tlsf_alloc_node(tlsf)) == VKD3D_TLSF_INVALID_BLOCK)
+        return false;
+
+    block = &tlsf->blocks[index];
+    tail = &tlsf->blocks[tail_index];
+
+    tail->offset = block->offset + size;
+    tail->size = block->size - size;
+    tail->region = block->region;
+    tail->phys_prev = index;
+    tail->phys_next = block->phys_next;
+
+    if (block->phys_next != VKD3D_TLSF_INVALID_BLOCK)
+        tlsf->blocks[block->phys_next].phys_prev = tail_index;
+
+    block->phys_next = tail_index;
+    block->size = size;
+
+    vkd3d_tlsf_insert_free_block(tlsf, tail_index);
+    return true;
+}
+
+static void vkd3d_tlsf_absorb_next(struct vkd3d_tlsf *tlsf, uint32_t index)
+{
+    struct vkd3d_tlsf_block *block = &tlsf->blocks[index];
+    uint32_t next_index = block->phys_next;
+    struct vkd3d_tlsf_block *next = &tlsf->blocks[next_index];
+
+    block->size += next->size;
+    block->phys_next = next->phys_next;
+    if (next->phys_next != VKD3D_TLSF_INVALID_BLOCK)
+        tlsf->blocks[next->phys_next].phys_prev = index;
+
+    vkd3d_tlsf_free_node(tlsf, next_index);
+}
+
+void vkd3d_tlsf_init(struct vkd3d_tlsf *tlsf)
+{
+    memset(tlsf, 0, sizeof(*tlsf));
+    memset(tlsf->heads, 0xff, sizeof(tlsf->heads));
+    tlsf->unused_block_index = VKD3D_TLSF_INVALID_BLOCK;
+}
+
+void vkd3d_tlsf_cleanup(struct vkd3d_tlsf *tlsf)
+{
+    vkd3d_free(tlsf->blocks);
+}
+
+uint32_t vkd3d_tlsf_add_region(struct vkd3d_tlsf *tlsf, void *region, uint64_t size)
+{
+    struct vkd3d_tlsf_block *block;
+    uint32_t index;
+
+    assert(!(size & (VKD3D_TLSF_GRANULARITY - 1)));
+
+    if ((index = vkd3d_tlsf_alloc_node(tlsf)) == VKD3D_TLSF_INVALID_BLOCK)
+        return VKD3D_TLSF_INVALID_BLOCK;
+
+    block = &tlsf->blocks[index];
+    block->offset = 0;
+    block->size = size;
+    block->region = region;
+    block->phys_prev = VKD3D_TLSF_INVALID_BLOCK;
+    block->phys_next = VKD3D_TLSF_INVALID_BLOCK;
+
+    vkd3d_tlsf_insert_free_block(tlsf, index);
+    tlsf->total_size += size;
+    return index;
+}
+
+void vkd3d_tlsf_remove_region(struct vkd3d_tlsf *tlsf, uint32_t block_index)
+{
+    assert(vkd3d_tlsf_block_is_region(tlsf, block_index));
+
+    vkd3d_tlsf_remove_free_block(tlsf, block_index);
+    tlsf->total_size -= tlsf->blocks[block_index].size;
+    vkd3d_tlsf_free_node(tlsf, block_index);
+}
+
+bool vkd3d_tlsf_allocate(struct vkd3d_tlsf *tlsf, uint64_t size, uint64_t alignment,
+        struct vkd3d_tlsf_allocation *allocation)
+{
+    uint64_t search_size, aligned_offset, padding;
+    struct vkd3d_tlsf_block *block;
+    uint32_t index, prev_index;
+
+    size = align64(size ? size : 1, VKD3D_TLSF_GRANULARITY);
+    alignment = max(alignment, VKD3D_TLSF_GRANULARITY);
+
+    search_size = size + alignment - VKD3D_TLSF_GRANULARITY;
+    if (search_size >> VKD3D_TLSF_GRANULARITY_LOG2 > UINT32_MAX)
+        return false;
+
+    /* Block offsets are mostly aligned already, so try a block that fits the
+     * unpadded size first before searching for one that fits in any case. */
+    index = vkd3d_tlsf_find_free_block(tlsf, vkd3d_tlsf_size_to_units(size));
+
+    if (index != VKD3D_TLSF_INVALID_BLOCK)
+    {
+        block = &tlsf->blocks[index];
+        if (block->offset + block->size < align64(block->offset, alignment) + size)
+            index = VKD3D_TLSF_INVALID_BLOCK;
+    }
+
+    if (index == VKD3D_TLSF_INVALID_BLOCK &&
+            (index = vkd3d_tlsf_find_free_block(tlsf, vkd3d_tlsf_size_to_units(search_size))) == VKD3D_TLSF_INVALID_BLOCK)
+        return false;
+
+    vkd3d_tlsf_remove_free_block(tlsf, index);
+    block = &tlsf->blocks[index];
+
+    aligned_offset = align64(block->offset, alignment);
+
+    if ((padding = aligned_offset - block->offset))
+    {
+        /* Give the misaligned head back to the free lists. */
+        if (!vkd3d_tlsf_split_block(tlsf, index, padding))
+        {
+            vkd3d_tlsf_insert_free_block(tlsf, index);
+            return false;
+        }
+
+        /* The head keeps the original node, so re-insert it with its new size. */
+        prev_index = index;
+        index = tlsf->blocks[prev_index].phys_next;
+        vkd3d_tlsf_remove_free_block(tlsf, index);
+        vkd3d_tlsf_insert_free_block(tlsf, prev_index);
+    }
+
+    block = &tlsf->blocks[index];
+    if (block->size - size >= VKD3D_TLSF_GRANULARITY)
+        vkd3d_tlsf_split_block(tlsf, index, size);
+
+    block = &tlsf->blocks[index];
+    block->is_free = false;
+
+    allocation->region = block->region;
+    allocation->offset = block->offset;
+    allocation->block_index = index;
+    return true;
+}
+
+uint32_t vkd3d_tlsf_free(struct vkd3d_tlsf *tlsf, uint32_t block_index)
+{
+    struct vkd3d_tlsf_block *block = &tlsf->blocks[block_index];
+    uint32_t prev_index;
+
+    assert(!block->is_free);
+
+    if (block->phys_next != VKD3D_TLSF_INVALID_BLOCK && tlsf->blocks[block->phys_next].is_free)
+    {
+        vkd3d_tlsf_remove_free_block(tlsf, block->phys_next);
+        vkd3d_tlsf_absorb_next(tlsf, block_index);
+    }
+
+    block = &tlsf->blocks[block_index];
+    if ((prev_index = block->phys_prev) != VKD3D_TLSF_INVALID_BLOCK && tlsf->blocks[prev_index].is_free)
+    {
+        vkd3d_tlsf_remove_free_block(tlsf, prev_index);
+        vkd3d_tlsf_absorb_next(tlsf, prev_index);
+        block_index = prev_index;
+    }
+
+    vkd3d_tlsf_insert_free_block(tlsf, block_index);
+    return block_index;
+}
+
+uint64_t vkd3d_tlsf_get_largest_free_block_size(const struct vkd3d_tlsf *tlsf)
+{
+    uint64_t largest = 0;
+    uint32_t fl, sl, index;
+
+    if (!tlsf->fl_bitmap)
+        return 0;
+
+    /* Only the highest non-empty list can contain the largest block. */
+    fl = vkd3d_log2i(tlsf->fl_bitmap);
+    sl = vkd3d_log2i(tlsf->sl_bitmap[fl]);
+
+    for (index = tlsf->heads[fl][sl]; index != VKD3D_TLSF_INVALID_BLOCK; index = tlsf->blocks[index].free_next)
+        largest = max(largest, tlsf->blocks[index].size);
+
+    return largest;
+}
@@ -494,10 +494,14 @@ enum vkd3d_sm4_shader_data_type
     VKD3D_SM4_SHADER_DATA_MESSAGE                   = 0x4,
 };
 
-struct vkd3d_shader_src_param_entry
+#define VKD3D_SM4_ARENA_BLOCK_SIZE (64 * 1024)
+
+struct vkd3d_sm4_arena_block
 {
-    struct list entry;
-    struct vkd3d_shader_src_param param;
+    struct vkd3d_sm4_arena_block *next;
+    size_t size;
+    size_t offset;
+    uint64_t data[];
 };
 
 struct vkd3d_sm4_data
@@ -507,13 +511,38 @@ struct vkd3d_sm4_data
 
     unsigned int output_map[MAX_REG_OUTPUT];
 
-    struct vkd3d_shader_src_param src_param[6];
-    struct vkd3d_shader_dst_param dst_param[2];
-    struct list src_free;
-    struct list src;
-    struct vkd3d_shader_immediate_constant_buffer icb;
+    /* Parameters of the instruction being decoded. Everything an instruction points to
+     * is allocated from the arena and stays valid until shader_sm4_free(),
+     * so decoded instructions can be kept around and consumed more than once. */
+    struct vkd3d_shader_src_param *src_param;
+    struct vkd3d_shader_dst_param *dst_param;
+    struct vkd3d_sm4_arena_block *arena;
 };
 
+static void *shader_sm4_arena_alloc(struct vkd3d_sm4_data *priv, size_t size)
+{
+    struct vkd3d_sm4_arena_block *block = priv->arena;
+    size_t block_size;
+    void *ptr;
+
+    size = align(size, sizeof(uint64_t));
+
+    if (!block || block->size - block->offset < size)
+    {
+        block_size = max(size, VKD3D_SM4_ARENA_BLOCK_SIZE);
+        if (!(block = vkd3d_malloc(offsetof(struct vkd3d_sm4_arena_block, data) + block_size)))
+            return NULL;
+        block->next = priv->arena;
+        block->size = block_size;
+        block->offset = 0;
+        priv->arena = block;
+    }
+
+    ptr = (uint8_t *)block->data + block->offset;
+    block->offset += size;
+    return ptr;
+}
+
 struct vkd3d_sm4_opcode_info
 {
     enum vkd3d_sm4_opcode opcode;
@@ -616,6 +645,7 @@ static void shader_sm4_read_shader_data(struct vkd3d_shader_instruction *ins,
         struct vkd3d_sm4_data *priv)
 {
     enum vkd3d_sm4_shader_data_type type;
+    struct vkd3d_shader_immediate_constant_buffer *icb;
     unsigned int icb_size;
 
     type = (opcode_token & VKD3D_SM4_SHADER_DATA_TYPE_MASK) >> VKD3D_SM4_SHADER_DATA_TYPE_SHIFT;
@@ -635,9 +665,18 @@ static void shader_sm4_read_shader_data(struct vkd3d_shader_instruction *ins,
         return;
     }
 
-    priv->icb.vec4_count = icb_size / 4;
-    memcpy(priv->icb.data, tokens, sizeof(*tokens) * icb_size);
-    ins->declaration.icb = &priv->icb;
+    /* Only allocate the part of the buffer which is actually used. */
+    if (!(icb = shader_sm4_arena_alloc(priv,
+            offsetof(struct vkd3d_shader_immediate_constant_buffer, data) + icb_size * sizeof(*icb->data))))
+    {
+        ERR("Failed to allocate immediate constant buffer.\n");
+        ins->handler_idx = VKD3DSIH_INVALID;
+        return;
+    }
+
+    icb->vec4_count = icb_size / 4;
+    memcpy(icb->data, tokens, sizeof(*tokens) * icb_size);
+    ins->declaration.icb = icb;
 }
 
 static void shader_sm4_read_dcl_resource(struct vkd3d_shader_instruction *ins,
@@ -1491,45 +1530,29 @@ void *shader_sm4_init(const DWORD *byte_code, size_t byte_code_size,
         priv->output_map[e->register_index] = e->semantic_index;
     }
 
-    list_init(&priv->src_free);
-    list_init(&priv->src);
+    priv->src_param = NULL;
+    priv->dst_param = NULL;
+    priv->arena = NULL;
 
     return priv;
 }
 
 void shader_sm4_free(void *data)
 {
-    struct vkd3d_shader_src_param_entry *e1, *e2;
+    struct vkd3d_sm4_arena_block *block, *next;
     struct vkd3d_sm4_data *priv = data;
 
-    list_move_head(&priv->src_free, &priv->src);
-    LIST_FOR_EACH_ENTRY_SAFE(e1, e2, &priv->src_free, struct vkd3d_shader_src_param_entry, entry)
+    for (block = priv->arena; block; block = next)
     {
-        vkd3d_free(e1);
+        next = block->next;
+        vkd3d_free(block);
     }
     vkd3d_free(priv);
 }
 
 static struct vkd3d_shader_src_param *get_src_param(struct vkd3d_sm4_data *priv)
 {
-    struct vkd3d_shader_src_param_entry *e;
-    struct list *elem;
-
-    if (!list_empty(&priv->src_free))
-    {
-        elem = list_head(&priv->src_free);
-        list_remove(elem);
-    }
-    else
-    {
-        if (!(e = vkd3d_malloc(sizeof(*e))))
-            return NULL;
-        elem = &e->entry;
-    }
-
-    list_add_tail(&priv->src, elem);
-    e = LIST_ENTRY(elem, struct vkd3d_shader_src_param_entry, entry);
-    return &e->param;
+    return shader_sm4_arena_alloc(priv, sizeof(struct vkd3d_shader_src_param));
 }
 
 void shader_sm4_read_header(void *data, const DWORD **ptr, struct vkd3d_shader_version *shader_version)
@@ -1902,8 +1925,6 @@ void shader_sm4_read_instruction(void *data, const DWORD **ptr, struct vkd3d_sha
     const DWORD *p;
     DWORD precise;
 
-    list_move_head(&priv->src_free, &priv->src);
-
     if (*ptr >= priv->end)
     {
         WARN("End of byte-code, failed to read opcode.\n");
@@ -1944,11 +1965,22 @@ void shader_sm4_read_instruction(void *data, const DWORD **ptr, struct vkd3d_sha
     ins->coissue = false;
     ins->predicate = NULL;
     ins->dst_count = strlen(opcode_info->dst_info);
-    ins->dst = priv->dst_param;
     ins->src_count = strlen(opcode_info->src_info);
-    ins->src = priv->src_param;
     memset(&ins->texel_offset, 0, sizeof(ins->texel_offset));
 
+    priv->dst_param = NULL;
+    priv->src_param = NULL;
+    if ((ins->dst_count && !(priv->dst_param = shader_sm4_arena_alloc(priv, ins->dst_count * sizeof(*priv->dst_param)))) ||
+            (ins->src_count && !(priv->src_param = shader_sm4_arena_alloc(priv, ins->src_count * sizeof(*priv->src_param)))))
+    {
+        ERR("Failed to allocate instruction parameters.\n");
+        *ptr += len;
+        ins->handler_idx = VKD3DSIH_INVALID;
+        return;
+    }
+    ins->dst = priv->dst_param;
+    ins->src = priv->src_param;
+
     p = *ptr;
     *ptr += len;
 
@@ -199,7 +199,8 @@ struct vkd3d_spirv_builder
 
     uint32_t current_id;
     uint32_t main_function_id;
-    struct rb_tree declarations;
+    /* Types and constants which must only be declared once. */
+    struct hash_map declarations;
     uint32_t type_sampler_id;
     uint32_t type_bool_id;
     uint32_t type_void_id;
@@ -358,60 +359,70 @@ static uint32_t vkd3d_spirv_build_once(struct vkd3d_spirv_builder *builder,
 
 #define MAX_SPIRV_DECLARATION_PARAMETER_COUNT 7
 
-struct vkd3d_spirv_declaration
+struct vkd3d_spirv_declaration_key
 {
-    struct rb_entry entry;
-
     SpvOp op;
     unsigned int parameter_count;
     uint32_t parameters[MAX_SPIRV_DECLARATION_PARAMETER_COUNT];
+};
+
+/* Stored by value in the hash map, so there is no allocation per declaration. */
+struct vkd3d_spirv_declaration
+{
+    struct hash_map_entry entry;
+    struct vkd3d_spirv_declaration_key key;
     uint32_t id;
 };
 
-static int vkd3d_spirv_declaration_compare(const void *key, const struct rb_entry *e)
+static uint32_t vkd3d_spirv_declaration_hash(const void *key)
+{
+    const struct vkd3d_spirv_declaration_key *k = key;
+    uint32_t hash = hash_combine(k->op, k->parameter_count);
+    unsigned int i;
+
+    for (i = 0; i < k->parameter_count; ++i)
+        hash = hash_combine(hash, k->parameters[i]);
+    return hash;
+}
+
+static bool vkd3d_spirv_declaration_compare(const void *key, const struct hash_map_entry *entry)
 {
-    const struct vkd3d_spirv_declaration *a = key;
-    const struct vkd3d_spirv_declaration *b = RB_ENTRY_VALUE(e, const struct vkd3d_spirv_declaration, entry);
+    const struct vkd3d_spirv_declaration *d = (const struct vkd3d_spirv_declaration *)entry;
+    const struct vkd3d_spirv_declaration_key *k = key;
 
-    if (a->op != b->op)
-        return a->op - b->op;
-    if (a->parameter_count != b->parameter_count)
-        return a->parameter_count - b->parameter_count;
-    assert(a->parameter_count <= ARRAY_SIZE(a->parameters));
-    return memcmp(&a->parameters, &b->parameters, a->parameter_count * sizeof(*a->parameters));
+    return k->op == d->key.op && k->parameter_count == d->key.parameter_count &&
+            !memcmp(k->parameters, d->key.parameters, k->parameter_count * sizeof(*k->parameters));
 }
 
-static void vkd3d_spirv_declaration_free(struct rb_entry *entry, void *context)
+static uint32_t vkd3d_spirv_find_declaration(struct vkd3d_spirv_builder *builder,
+        const struct vkd3d_spirv_declaration_key *key)
 {
-    struct vkd3d_spirv_declaration *d = RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry);
+    const struct vkd3d_spirv_declaration *d;
 
-    vkd3d_free(d);
+    d = (const struct vkd3d_spirv_declaration *)hash_map_find(&builder->declarations, key);
+    return d ? d->id : 0;
 }
 
 static void vkd3d_spirv_insert_declaration(struct vkd3d_spirv_builder *builder,
-        const struct vkd3d_spirv_declaration *declaration)
+        const struct vkd3d_spirv_declaration_key *key, uint32_t id)
 {
-    struct vkd3d_spirv_declaration *d;
+    struct vkd3d_spirv_declaration declaration;
 
-    assert(declaration->parameter_count <= ARRAY_SIZE(declaration->parameters));
+    assert(key->parameter_count <= ARRAY_SIZE(key->parameters));
 
-    if (!(d = vkd3d_malloc(sizeof(*d))))
-        return;
-    memcpy(d, declaration, sizeof(*d));
-    if (rb_put(&builder->declarations, d, &d->entry) == -1)
-    {
+    declaration.key = *key;
+    declaration.id = id;
+    if (!hash_map_insert(&builder->declarations, key, &declaration.entry))
         ERR("Failed to insert declaration entry.\n");
-        vkd3d_free(d);
-    }
 }
 
 static uint32_t vkd3d_spirv_build_once_v(struct vkd3d_spirv_builder *builder,
         SpvOp op, const uint32_t *operands, unsigned int operand_count,
         vkd3d_spirv_build_v_pfn build_pfn)
 {
-    struct vkd3d_spirv_declaration declaration;
+    struct vkd3d_spirv_declaration_key declaration;
     unsigned int i, param_idx = 0;
-    struct rb_entry *entry;
+    uint32_t id;
 
     if (operand_count > ARRAY_SIZE(declaration.parameters))
     {
@@ -424,39 +435,39 @@ static uint32_t vkd3d_spirv_build_once_v(struct vkd3d_spirv_builder *builder,
         declaration.parameters[param_idx++] = operands[i];
     declaration.parameter_count = param_idx;
 
-    if ((entry = rb_get(&builder->declarations, &declaration)))
-        return RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry)->id;
+    if ((id = vkd3d_spirv_find_declaration(builder, &declaration)))
+        return id;
 
-    declaration.id = build_pfn(builder, operands, operand_count);
-    vkd3d_spirv_insert_declaration(builder, &declaration);
-    return declaration.id;
+    id = build_pfn(builder, operands, operand_count);
+    vkd3d_spirv_insert_declaration(builder, &declaration, id);
+    return id;
 }
 
 static uint32_t vkd3d_spirv_build_once1(struct vkd3d_spirv_builder *builder,
         SpvOp op, uint32_t operand0, vkd3d_spirv_build1_pfn build_pfn)
 {
-    struct vkd3d_spirv_declaration declaration;
-    struct rb_entry *entry;
+    struct vkd3d_spirv_declaration_key declaration;
+    uint32_t id;
 
     declaration.op = op;
     declaration.parameter_count = 1;
     declaration.parameters[0] = operand0;
 
-    if ((entry = rb_get(&builder->declarations, &declaration)))
-        return RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry)->id;
+    if ((id = vkd3d_spirv_find_declaration(builder, &declaration)))
+        return id;
 
-    declaration.id = build_pfn(builder, operand0);
-    vkd3d_spirv_insert_declaration(builder, &declaration);
-    return declaration.id;
+    id = build_pfn(builder, operand0);
+    vkd3d_spirv_insert_declaration(builder, &declaration, id);
+    return id;
 }
 
 static uint32_t vkd3d_spirv_build_once1v(struct vkd3d_spirv_builder *builder,
         SpvOp op, uint32_t operand0, const uint32_t *operands, unsigned int operand_count,
         vkd3d_spirv_build1v_pfn build_pfn)
 {
-    struct vkd3d_spirv_declaration declaration;
+    struct vkd3d_spirv_declaration_key declaration;
     unsigned int i, param_idx = 0;
-    struct rb_entry *entry;
+    uint32_t id;
 
     if (operand_count >= ARRAY_SIZE(declaration.parameters))
     {
@@ -470,50 +481,50 @@ static uint32_t vkd3d_spirv_build_once1v(struct vkd3d_spirv_builder *builder,
         declaration.parameters[param_idx++] = operands[i];
     declaration.parameter_count = param_idx;
 
-    if ((entry = rb_get(&builder->declarations, &declaration)))
-        return RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry)->id;
+    if ((id = vkd3d_spirv_find_declaration(builder, &declaration)))
+        return id;
 
-    declaration.id = build_pfn(builder, operand0, operands, operand_count);
-    vkd3d_spirv_insert_declaration(builder, &declaration);
-    return declaration.id;
+    id = build_pfn(builder, operand0, operands, operand_count);
+    vkd3d_spirv_insert_declaration(builder, &declaration, id);
+    return id;
 }
 
 static uint32_t vkd3d_spirv_build_once2(struct vkd3d_spirv_builder *builder,
         SpvOp op, uint32_t operand0, uint32_t operand1, vkd3d_spirv_build2_pfn build_pfn)
 {
-    struct vkd3d_spirv_declaration declaration;
-    struct rb_entry *entry;
+    struct vkd3d_spirv_declaration_key declaration;
+    uint32_t id;
 
     declaration.op = op;
     declaration.parameter_count = 2;
     declaration.parameters[0] = operand0;
     declaration.parameters[1] = operand1;
 
-    if ((entry = rb_get(&builder->declarations, &declaration)))
-        return RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry)->id;
+    if ((id = vkd3d_spirv_find_declaration(builder, &declaration)))
+        return id;
 
-    declaration.id = build_pfn(builder, operand0, operand1);
-    vkd3d_spirv_insert_declaration(builder, &declaration);
-    return declaration.id;
+    id = build_pfn(builder, operand0, operand1);
+    vkd3d_spirv_insert_declaration(builder, &declaration, id);
+    return id;
 }
 
 static uint32_t vkd3d_spirv_build_once7(struct vkd3d_spirv_builder *builder,
         SpvOp op, const uint32_t *operands, vkd3d_spirv_build7_pfn build_pfn)
 {
-    struct vkd3d_spirv_declaration declaration;
-    struct rb_entry *entry;
+    struct vkd3d_spirv_declaration_key declaration;
+    uint32_t id;
 
     declaration.op = op;
     declaration.parameter_count = 7;
     memcpy(&declaration.parameters, operands, declaration.parameter_count * sizeof(*operands));
 
-    if ((entry = rb_get(&builder->declarations, &declaration)))
-        return RB_ENTRY_VALUE(entry, struct vkd3d_spirv_declaration, entry)->id;
+    if ((id = vkd3d_spirv_find_declaration(builder, &declaration)))
+        return id;
 
-    declaration.id = build_pfn(builder, operands[0], operands[1], operands[2],
+    id = build_pfn(builder, operands[0], operands[1], operands[2],
             operands[3], operands[4], operands[5], operands[6]);
-    vkd3d_spirv_insert_declaration(builder, &declaration);
-    return declaration.id;
+    vkd3d_spirv_insert_declaration(builder, &declaration, id);
+    return id;
 }
 
 /*
@@ -1752,7 +1763,8 @@ static void vkd3d_spirv_builder_init(struct vkd3d_spirv_builder *builder)
 
     builder->current_id = 1;
 
-    rb_init(&builder->declarations, vkd3d_spirv_declaration_compare);
+    hash_map_init(&builder->declarations, vkd3d_spirv_declaration_hash,
+            vkd3d_spirv_declaration_compare, sizeof(struct vkd3d_spirv_declaration));
 
     builder->main_function_id = vkd3d_spirv_alloc_id(builder);
     vkd3d_spirv_build_op_name(builder, builder->main_function_id, "main");
@@ -1782,7 +1794,7 @@ static void vkd3d_spirv_builder_free(struct vkd3d_spirv_builder *builder)
 
     vkd3d_spirv_stream_free(&builder->insertion_stream);
 
-    rb_destroy(&builder->declarations, vkd3d_spirv_declaration_free, NULL);
+    hash_map_clear(&builder->declarations);
 
     vkd3d_free(builder->capabilities);
     vkd3d_free(builder->iface);
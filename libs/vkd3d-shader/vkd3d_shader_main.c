@@ -179,6 +179,12 @@ struct vkd3d_shader_parser
     struct vkd3d_shader_version shader_version;
     void *data;
     const DWORD *ptr;
+
+    /* The token stream is decoded once, and both the scanner and the SPIR-V backend
+     * walk this array. Parameters are owned by the SM4 parser in data. */
+    struct vkd3d_shader_instruction *instructions;
+    size_t instructions_size;
+    size_t instruction_count;
 };
 
 static int vkd3d_shader_parser_init(struct vkd3d_shader_parser *parser,
@@ -202,15 +208,44 @@ static int vkd3d_shader_parser_init(struct vkd3d_shader_parser *parser,
     }
 
     shader_sm4_read_header(parser->data, &parser->ptr, &parser->shader_version);
+    parser->instructions = NULL;
+    parser->instructions_size = 0;
+    parser->instruction_count = 0;
     return VKD3D_OK;
 }
 
 static void vkd3d_shader_parser_destroy(struct vkd3d_shader_parser *parser)
 {
+    vkd3d_free(parser->instructions);
     shader_sm4_free(parser->data);
     free_shader_desc(&parser->shader_desc);
 }
 
+static int vkd3d_shader_parser_decode(struct vkd3d_shader_parser *parser)
+{
+    struct vkd3d_shader_instruction *instruction;
+
+    while (!shader_sm4_is_end(parser->data, &parser->ptr))
+    {
+        if (!vkd3d_array_reserve((void **)&parser->instructions, &parser->instructions_size,
+                parser->instruction_count + 1, sizeof(*parser->instructions)))
+            return VKD3D_ERROR_OUT_OF_MEMORY;
+
+        instruction = &parser->instructions[parser->instruction_count];
+        shader_sm4_read_instruction(parser->data, &parser->ptr, instruction);
+
+        if (instruction->handler_idx == VKD3DSIH_INVALID)
+        {
+            WARN("Encountered unrecognized or invalid instruction.\n");
+            return VKD3D_ERROR_INVALID_ARGUMENT;
+        }
+
+        parser->instruction_count++;
+    }
+
+    return VKD3D_OK;
+}
+
 static int vkd3d_shader_validate_compile_args(const struct vkd3d_shader_compile_arguments *compile_args)
 {
     if (!compile_args)
@@ -322,16 +357,30 @@ static int vkd3d_shader_validate_shader_type(enum vkd3d_shader_type type, VkShad
     return 0;
 }
 
+static void vkd3d_shader_scan_program(struct vkd3d_shader_scan_info *scan_info,
+        const struct vkd3d_shader_parser *parser);
+
+static bool vkd3d_shader_timing_enabled(void)
+{
+    static int enabled = -1;
+    char value[16];
+
+    if (enabled < 0)
+        enabled = vkd3d_get_env_var("VKD3D_SHADER_TIMING", value, sizeof(value)) && strcmp(value, "0");
+    return !!enabled;
+}
+
 int vkd3d_shader_compile_dxbc(const struct vkd3d_shader_code *dxbc,
         struct vkd3d_shader_code *spirv, unsigned int compiler_options,
         const struct vkd3d_shader_interface_info *shader_interface_info,
         const struct vkd3d_shader_compile_arguments *compile_args)
 {
-    struct vkd3d_shader_instruction instruction;
+    uint64_t start_ts, parse_ts, scan_ts, codegen_ts;
     struct vkd3d_dxbc_compiler *spirv_compiler;
     struct vkd3d_shader_scan_info scan_info;
     struct vkd3d_shader_parser parser;
     vkd3d_shader_hash_t hash;
+    size_t i;
     int ret;
 
     TRACE("dxbc {%p, %zu}, spirv %p, compiler_options %#x, shader_interface_info %p, compile_args %p.\n",
@@ -356,19 +405,14 @@ int vkd3d_shader_compile_dxbc(const struct vkd3d_shader_code *dxbc,
         return VKD3D_OK;
     }
 
-    vkd3d_shader_scan_init(&scan_info);
+    start_ts = vkd3d_get_current_time_ns();
 
-    if ((ret = vkd3d_shader_scan_dxbc(dxbc, &scan_info)) < 0)
-    {
-        vkd3d_shader_scan_destroy(&scan_info);
+    if ((ret = vkd3d_shader_parser_init(&parser, dxbc)) < 0)
         return ret;
-    }
 
-    spirv->meta.patch_vertex_count = scan_info.patch_vertex_count;
-
-    if ((ret = vkd3d_shader_parser_init(&parser, dxbc)) < 0)
+    if ((ret = vkd3d_shader_parser_decode(&parser)) < 0)
     {
-        vkd3d_shader_scan_destroy(&scan_info);
+        vkd3d_shader_parser_destroy(&parser);
         return ret;
     }
 
@@ -376,11 +420,19 @@ int vkd3d_shader_compile_dxbc(const struct vkd3d_shader_code *dxbc,
     {
         if ((ret = vkd3d_shader_validate_shader_type(parser.shader_version.type, shader_interface_info->stage)) < 0)
         {
-            vkd3d_shader_scan_destroy(&scan_info);
+            vkd3d_shader_parser_destroy(&parser);
             return ret;
         }
     }
 
+    parse_ts = vkd3d_get_current_time_ns();
+
+    vkd3d_shader_scan_init(&scan_info);
+    vkd3d_shader_scan_program(&scan_info, &parser);
+    spirv->meta.patch_vertex_count = scan_info.patch_vertex_count;
+
+    scan_ts = vkd3d_get_current_time_ns();
+
     vkd3d_shader_dump_shader(hash, dxbc, "dxbc");
 
     if (!(spirv_compiler = vkd3d_dxbc_compiler_create(&parser.shader_version,
@@ -393,29 +445,29 @@ int vkd3d_shader_compile_dxbc(const struct vkd3d_shader_code *dxbc,
         return VKD3D_ERROR;
     }
 
-    while (!shader_sm4_is_end(parser.data, &parser.ptr))
+    for (i = 0; i < parser.instruction_count; i++)
     {
-        shader_sm4_read_instruction(parser.data, &parser.ptr, &instruction);
-
-        if (instruction.handler_idx == VKD3DSIH_INVALID)
-        {
-            WARN("Encountered unrecognized or invalid instruction.\n");
-            vkd3d_dxbc_compiler_destroy(spirv_compiler);
-            vkd3d_shader_scan_destroy(&scan_info);
-            vkd3d_shader_parser_destroy(&parser);
-            return VKD3D_ERROR_INVALID_ARGUMENT;
-        }
-
-        if ((ret = vkd3d_dxbc_compiler_handle_instruction(spirv_compiler, &instruction)) < 0)
+        if ((ret = vkd3d_dxbc_compiler_handle_instruction(spirv_compiler, &parser.instructions[i])) < 0)
             break;
     }
 
     if (ret >= 0)
         ret = vkd3d_dxbc_compiler_generate_spirv(spirv_compiler, spirv);
 
+    codegen_ts = vkd3d_get_current_time_ns();
+
     if (ret == 0)
         vkd3d_shader_dump_spirv_shader(hash, spirv);
 
+    if (vkd3d_shader_timing_enabled())
+    {
+        INFO("Shader %016"PRIx64": %zu instructions, parse %.3f ms, scan %.3f ms, codegen %.3f ms.\n",
+                hash, parser.instruction_count,
+                1e-6 * (double)(parse_ts - start_ts),
+                1e-6 * (double)(scan_ts - parse_ts),
+                1e-6 * (double)(codegen_ts - scan_ts));
+    }
+
     vkd3d_dxbc_compiler_destroy(spirv_compiler);
     vkd3d_shader_scan_destroy(&scan_info);
     vkd3d_shader_parser_destroy(&parser);
@@ -590,10 +642,18 @@ static void vkd3d_shader_scan_instruction(struct vkd3d_shader_scan_info *scan_in
         vkd3d_shader_scan_record_uav_counter(scan_info, &instruction->src[0].reg);
 }
 
+static void vkd3d_shader_scan_program(struct vkd3d_shader_scan_info *scan_info,
+        const struct vkd3d_shader_parser *parser)
+{
+    size_t i;
+
+    for (i = 0; i < parser->instruction_count; i++)
+        vkd3d_shader_scan_instruction(scan_info, &parser->instructions[i]);
+}
+
 int vkd3d_shader_scan_dxbc(const struct vkd3d_shader_code *dxbc,
         struct vkd3d_shader_scan_info *scan_info)
 {
-    struct vkd3d_shader_instruction instruction;
     struct vkd3d_shader_parser parser;
     int ret;
 
@@ -609,22 +669,11 @@ int vkd3d_shader_scan_dxbc(const struct vkd3d_shader_code *dxbc,
         if ((ret = vkd3d_shader_parser_init(&parser, dxbc)) < 0)
             return ret;
 
-        while (!shader_sm4_is_end(parser.data, &parser.ptr))
-        {
-            shader_sm4_read_instruction(parser.data, &parser.ptr, &instruction);
-
-            if (instruction.handler_idx == VKD3DSIH_INVALID)
-            {
-                WARN("Encountered unrecognized or invalid instruction.\n");
-                vkd3d_shader_parser_destroy(&parser);
-                return VKD3D_ERROR_INVALID_ARGUMENT;
-            }
-
-            vkd3d_shader_scan_instruction(scan_info, &instruction);
-        }
+        if ((ret = vkd3d_shader_parser_decode(&parser)) >= 0)
+            vkd3d_shader_scan_program(scan_info, &parser);
 
         vkd3d_shader_parser_destroy(&parser);
-        return VKD3D_OK;
+        return ret;
     }
 }
 
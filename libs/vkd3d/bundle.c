@@ -19,6 +19,7 @@
 #define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
 
 #include "vkd3d_private.h"
+#include "vkd3d_bundle_stats.h"
 
 /* ID3D12CommandAllocator */
 static inline struct d3d12_bundle_allocator *impl_from_ID3D12CommandAllocator(ID3D12CommandAllocator *iface)
@@ -26,6 +27,19 @@ static inline struct d3d12_bundle_allocator *impl_from_ID3D12CommandAllocator(ID
     return CONTAINING_RECORD(iface, struct d3d12_bundle_allocator, ID3D12CommandAllocator_iface);
 }
 
+static bool d3d12_bundle_allocator_reserve_scratch(struct d3d12_bundle_allocator *allocator,
+        void **elements, size_t *capacity, size_t element_count, size_t element_size)
+{
+    size_t old_capacity = *capacity;
+
+    if (!vkd3d_array_reserve(elements, capacity, element_count, element_size))
+        return false;
+
+    if (*capacity != old_capacity)
+        allocator->scratch_heap_alloc_count++;
+    return true;
+}
+
 static void *d3d12_bundle_allocator_alloc_chunk_data(struct d3d12_bundle_allocator *allocator, size_t size)
 {
     size_t chunk_offset = 0;
@@ -41,11 +55,12 @@ static void *d3d12_bundle_allocator_alloc_chunk_data(struct d3d12_bundle_allocat
 
     if (!chunk || chunk_offset + size > VKD3D_BUNDLE_CHUNK_SIZE)
     {
-        if (!vkd3d_array_reserve((void **)&allocator->chunks, &allocator->chunks_size,
+        if (!d3d12_bundle_allocator_reserve_scratch(allocator, (void **)&allocator->chunks, &allocator->chunks_size,
                 allocator->chunks_count + 1, sizeof(*allocator->chunks)))
             return NULL;
 
-        if (!(chunk = vkd3d_malloc(VKD3D_BUNDLE_CHUNK_SIZE)))
+        if (!(chunk = vkd3d_chunk_pool_take(&allocator->free_chunks)) &&
+                !(chunk = d3d12_device_alloc_bundle_chunk(allocator->device)))
             return NULL;
 
         allocator->chunks[allocator->chunks_count++] = chunk;
@@ -56,18 +71,39 @@ static void *d3d12_bundle_allocator_alloc_chunk_data(struct d3d12_bundle_allocat
     return void_ptr_offset(chunk, chunk_offset);
 }
 
+static void d3d12_bundle_allocator_recycle_chunks(struct d3d12_bundle_allocator *allocator)
+{
+    /* Anything the last recording did not need is better off in the device pool. */
+    vkd3d_chunk_pool_recycle(&allocator->free_chunks, allocator->chunks, allocator->chunks_count,
+            &allocator->device->bundle_chunk_pool, &allocator->device->mutex);
+
+    allocator->chunks_count = 0;
+    allocator->chunk_offset = 0;
+}
+
 static void d3d12_bundle_allocator_free_chunks(struct d3d12_bundle_allocator *allocator)
 {
+    void *chunk;
     size_t i;
 
     for (i = 0; i < allocator->chunks_count; i++)
-        vkd3d_free(allocator->chunks[i]);
+        d3d12_device_free_bundle_chunk(allocator->device, allocator->chunks[i]);
+
+    while ((chunk = vkd3d_chunk_pool_take(&allocator->free_chunks)))
+        d3d12_device_free_bundle_chunk(allocator->device, chunk);
+
+    vkd3d_chunk_pool_cleanup(&allocator->free_chunks);
 
     vkd3d_free(allocator->chunks);
     allocator->chunks = NULL;
     allocator->chunks_size = 0;
     allocator->chunks_count = 0;
     allocator->chunk_offset = 0;
+
+    vkd3d_free(allocator->bake_commands);
+    allocator->bake_commands = NULL;
+    allocator->bake_commands_size = 0;
+    hash_map_clear(&allocator->bake_state_map);
 }
 
 static HRESULT STDMETHODCALLTYPE d3d12_bundle_allocator_QueryInterface(ID3D12CommandAllocator *iface,
@@ -111,13 +147,46 @@ static ULONG STDMETHODCALLTYPE d3d12_bundle_allocator_Release(ID3D12CommandAlloc
 
     if (!refcount)
     {
+        struct d3d12_device *device = allocator->device;
+
         d3d12_bundle_allocator_free_chunks(allocator);
+        vkd3d_private_store_destroy(&allocator->private_store);
         vkd3d_free(allocator);
+
+        d3d12_device_release(device);
     }
 
     return refcount;
 }
 
+static HRESULT d3d12_bundle_allocator_get_stats(struct d3d12_bundle_allocator *allocator,
+        UINT *data_size, void *data)
+{
+    struct vkd3d_bundle_allocator_stats stats;
+    struct d3d12_device *device = allocator->device;
+
+    if (!data_size)
+        return E_INVALIDARG;
+
+    if (!data)
+    {
+        *data_size = sizeof(stats);
+        return S_OK;
+    }
+
+    if (*data_size < sizeof(stats))
+        return DXGI_ERROR_MORE_DATA;
+
+    pthread_mutex_lock(&device->mutex);
+    stats.chunk_heap_alloc_count = device->bundle_chunk_pool.heap_alloc_count;
+    pthread_mutex_unlock(&device->mutex);
+    stats.scratch_heap_alloc_count = allocator->scratch_heap_alloc_count;
+
+    memcpy(data, &stats, sizeof(stats));
+    *data_size = sizeof(stats);
+    return S_OK;
+}
+
 static HRESULT STDMETHODCALLTYPE d3d12_bundle_allocator_GetPrivateData(ID3D12CommandAllocator *iface,
         REFGUID guid, UINT *data_size, void *data)
 {
@@ -125,6 +194,9 @@ static HRESULT STDMETHODCALLTYPE d3d12_bundle_allocator_GetPrivateData(ID3D12Com
 
     TRACE("iface %p, guid %s, data_size %p, data %p.\n", iface, debugstr_guid(guid), data_size, data);
 
+    if (IsEqualGUID(guid, &VKD3D_BUNDLE_ALLOCATOR_STATS_GUID))
+        return d3d12_bundle_allocator_get_stats(allocator, data_size, data);
+
     return vkd3d_get_private_data(&allocator->private_store, guid, data_size, data);
 }
 
@@ -176,7 +248,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_bundle_allocator_Reset(ID3D12CommandAlloc
         bundle->tail = NULL;
     }
 
-    d3d12_bundle_allocator_free_chunks(allocator);
+    d3d12_bundle_allocator_recycle_chunks(allocator);
     return S_OK;
 }
 
@@ -210,12 +282,15 @@ HRESULT d3d12_bundle_allocator_create(struct d3d12_device *device,
     object->refcount = 1;
     object->device = device;
 
+    vkd3d_chunk_pool_init(&object->free_chunks, VKD3D_BUNDLE_CHUNK_SIZE, SIZE_MAX);
+
     if (FAILED(hr = vkd3d_private_store_init(&object->private_store)))
     {
         vkd3d_free(object);
         return hr;
     }
 
+    d3d12_device_add_ref(device);
     *allocator = object;
     return S_OK;
 }
@@ -238,6 +313,8 @@ void *d3d12_bundle_add_command(struct d3d12_bundle *bundle, pfn_d3d12_bundle_com
 {
     struct d3d12_bundle_command *command = d3d12_bundle_allocator_alloc_chunk_data(bundle->allocator, size);
 
+    /* Chunks are recycled, clear padding so that d3d12_bundle_bake() can compare commands bytewise. */
+    memset(command, 0, size);
     command->proc = proc;
     command->next = NULL;
 
@@ -355,6 +432,8 @@ static D3D12_COMMAND_LIST_TYPE STDMETHODCALLTYPE d3d12_bundle_GetType(d3d12_comm
     return D3D12_COMMAND_LIST_TYPE_BUNDLE;
 }
 
+static void d3d12_bundle_bake(struct d3d12_bundle *bundle);
+
 static HRESULT STDMETHODCALLTYPE d3d12_bundle_Close(d3d12_command_list_iface *iface)
 {
     struct d3d12_bundle *bundle = impl_from_ID3D12GraphicsCommandList(iface);
@@ -367,6 +446,8 @@ static HRESULT STDMETHODCALLTYPE d3d12_bundle_Close(d3d12_command_list_iface *if
         return E_FAIL;
     }
 
+    d3d12_bundle_bake(bundle);
+
     bundle->is_recording = false;
     return S_OK;
 }
@@ -1648,6 +1729,319 @@ static void STDMETHODCALLTYPE d3d12_bundle_DispatchMesh(d3d12_command_list_iface
     args->z = z;
 }
 
+enum vkd3d_bundle_state_type
+{
+    VKD3D_BUNDLE_STATE_PIPELINE_STATE = 1,
+    VKD3D_BUNDLE_STATE_PRIMITIVE_TOPOLOGY,
+    VKD3D_BUNDLE_STATE_BLEND_FACTOR,
+    VKD3D_BUNDLE_STATE_STENCIL_REF,
+    VKD3D_BUNDLE_STATE_DEPTH_BOUNDS,
+    VKD3D_BUNDLE_STATE_INDEX_BUFFER,
+    VKD3D_BUNDLE_STATE_VERTEX_BUFFERS,
+    VKD3D_BUNDLE_STATE_ROOT_DESCRIPTOR_TABLE,
+    VKD3D_BUNDLE_STATE_ROOT_DESCRIPTOR,
+    VKD3D_BUNDLE_STATE_ROOT_CONSTANT,
+    VKD3D_BUNDLE_STATE_ROOT_CONSTANTS,
+};
+
+enum vkd3d_bundle_state_class
+{
+    VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION,
+    VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT,
+    VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT,
+    VKD3D_BUNDLE_STATE_CLASS_COUNT,
+};
+
+struct vkd3d_bundle_state_info
+{
+    /* Commands with the same key fully overwrite each other's state. */
+    uint64_t key;
+    enum vkd3d_bundle_state_class state_class;
+    size_t size;
+    /* False if other keys can partially overwrite the same state,
+     * in which case repeating the last value is not necessarily redundant. */
+    bool track_value;
+};
+
+struct vkd3d_bundle_state_entry
+{
+    struct hash_map_entry entry;
+    uint64_t key;
+    /* Last command for this key since the last command which may consume state. */
+    size_t pending_index;
+    uint32_t pending_epoch;
+    /* Last command for this key which was kept. */
+    const struct d3d12_bundle_command *live_command;
+    size_t live_size;
+    uint32_t live_epoch;
+};
+
+static uint32_t vkd3d_bundle_state_entry_hash(const void *key)
+{
+    return hash_uint64(*(const uint64_t *)key);
+}
+
+static bool vkd3d_bundle_state_entry_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_bundle_state_entry *state = (const struct vkd3d_bundle_state_entry *)entry;
+    return state->key == *(const uint64_t *)key;
+}
+
+static bool vkd3d_bundle_state_info_init(struct vkd3d_bundle_state_info *info, enum vkd3d_bundle_state_type type,
+        enum vkd3d_bundle_state_class state_class, UINT index, UINT offset, UINT count, size_t size, bool track_value)
+{
+    /* Out of range values are invalid API usage anyway, just don't fold them. */
+    if (index > 0xffff || offset > 0xffff || count > 0xffff)
+        return false;
+
+    info->key = type | (state_class << 8) | (index << 16) | ((uint64_t)offset << 32) | ((uint64_t)count << 48);
+    info->state_class = state_class;
+    info->size = size;
+    info->track_value = track_value;
+    return true;
+}
+
+static bool d3d12_bundle_command_get_state_info(const struct d3d12_bundle_command *command,
+        struct vkd3d_bundle_state_info *info)
+{
+    const struct d3d12_set_root_32bit_constants_command *root_constants;
+    const struct d3d12_set_root_descriptor_table_command *root_table;
+    const struct d3d12_set_root_32bit_constant_command *root_constant;
+    const struct d3d12_ia_set_vertex_buffers_command *vertex_buffers;
+    const struct d3d12_set_root_descriptor_command *root_descriptor;
+    enum vkd3d_bundle_state_class state_class;
+    pfn_d3d12_bundle_command proc = command->proc;
+
+    if (proc == d3d12_bundle_exec_set_pipeline_state)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_PIPELINE_STATE,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_set_pipeline_state_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_ia_set_primitive_topology)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_PRIMITIVE_TOPOLOGY,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_ia_set_primitive_topology_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_om_set_blend_factor)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_BLEND_FACTOR,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_om_set_blend_factor_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_om_set_stencil_ref)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_STENCIL_REF,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_om_set_stencil_ref_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_om_set_depth_bounds)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_DEPTH_BOUNDS,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_om_set_depth_bounds_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_ia_set_index_buffer)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_INDEX_BUFFER,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_ia_set_index_buffer_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_ia_set_index_buffer_null)
+    {
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_INDEX_BUFFER,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, 0, 0, 0, sizeof(struct d3d12_bundle_command), true);
+    }
+    else if (proc == d3d12_bundle_exec_ia_set_vertex_buffers)
+    {
+        vertex_buffers = (const struct d3d12_ia_set_vertex_buffers_command *)command;
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_VERTEX_BUFFERS,
+                VKD3D_BUNDLE_STATE_CLASS_FIXED_FUNCTION, vertex_buffers->start_slot, 0, vertex_buffers->view_count,
+                sizeof(*vertex_buffers) + vertex_buffers->view_count * sizeof(*vertex_buffers->views), false);
+    }
+    else if (proc == d3d12_bundle_exec_set_compute_root_descriptor_table ||
+            proc == d3d12_bundle_exec_set_graphics_root_descriptor_table)
+    {
+        root_table = (const struct d3d12_set_root_descriptor_table_command *)command;
+        state_class = proc == d3d12_bundle_exec_set_compute_root_descriptor_table
+                ? VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT : VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT;
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_ROOT_DESCRIPTOR_TABLE,
+                state_class, root_table->parameter_index, 0, 0, sizeof(*root_table), true);
+    }
+    else if (proc == d3d12_bundle_exec_set_compute_root_cbv ||
+            proc == d3d12_bundle_exec_set_compute_root_srv ||
+            proc == d3d12_bundle_exec_set_compute_root_uav ||
+            proc == d3d12_bundle_exec_set_graphics_root_cbv ||
+            proc == d3d12_bundle_exec_set_graphics_root_srv ||
+            proc == d3d12_bundle_exec_set_graphics_root_uav)
+    {
+        root_descriptor = (const struct d3d12_set_root_descriptor_command *)command;
+        state_class = (proc == d3d12_bundle_exec_set_compute_root_cbv ||
+                proc == d3d12_bundle_exec_set_compute_root_srv ||
+                proc == d3d12_bundle_exec_set_compute_root_uav)
+                ? VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT : VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT;
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_ROOT_DESCRIPTOR,
+                state_class, root_descriptor->parameter_index, 0, 0, sizeof(*root_descriptor), true);
+    }
+    else if (proc == d3d12_bundle_exec_set_compute_root_32bit_constant ||
+            proc == d3d12_bundle_exec_set_graphics_root_32bit_constant)
+    {
+        root_constant = (const struct d3d12_set_root_32bit_constant_command *)command;
+        state_class = proc == d3d12_bundle_exec_set_compute_root_32bit_constant
+                ? VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT : VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT;
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_ROOT_CONSTANT,
+                state_class, root_constant->parameter_index, root_constant->offset, 1, sizeof(*root_constant), false);
+    }
+    else if (proc == d3d12_bundle_exec_set_compute_root_32bit_constants ||
+            proc == d3d12_bundle_exec_set_graphics_root_32bit_constants)
+    {
+        root_constants = (const struct d3d12_set_root_32bit_constants_command *)command;
+        state_class = proc == d3d12_bundle_exec_set_compute_root_32bit_constants
+                ? VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT : VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT;
+        return vkd3d_bundle_state_info_init(info, VKD3D_BUNDLE_STATE_ROOT_CONSTANTS,
+                state_class, root_constants->parameter_index, root_constants->offset, root_constants->constant_count,
+                sizeof(*root_constants) + root_constants->constant_count * sizeof(*root_constants->data), false);
+    }
+
+    return false;
+}
+
+static bool d3d12_bundle_command_preserves_state(const struct d3d12_bundle_command *command)
+{
+    /* Commands which consume state, but can not modify any state a bundle can set. */
+    return command->proc == d3d12_bundle_exec_draw_instanced ||
+            command->proc == d3d12_bundle_exec_draw_indexed_instanced ||
+            command->proc == d3d12_bundle_exec_dispatch ||
+            command->proc == d3d12_bundle_exec_dispatch_mesh ||
+            command->proc == d3d12_bundle_exec_dispatch_rays;
+}
+
+static void d3d12_bundle_bake(struct d3d12_bundle *bundle)
+{
+    struct d3d12_bundle_allocator *allocator = bundle->allocator;
+    struct hash_map *map = &allocator->bake_state_map;
+    uint32_t live_epoch[VKD3D_BUNDLE_STATE_CLASS_COUNT];
+    struct vkd3d_bundle_state_entry new_entry;
+    struct d3d12_bundle_command **commands;
+    struct d3d12_bundle_command *command;
+    struct vkd3d_bundle_state_entry *entry;
+    struct vkd3d_bundle_state_info info;
+    size_t command_count = 0;
+    size_t folded_count = 0;
+    uint32_t pending_epoch;
+    uint32_t map_size;
+    size_t i, j;
+
+    /* Fold state which is set but overwritten before any command can observe it,
+     * as well as state which is set to the value the bundle already set earlier,
+     * so that replaying the bundle does not go through all of that again. */
+    for (command = bundle->head; command; command = command->next)
+        command_count++;
+
+    if (!d3d12_bundle_allocator_reserve_scratch(allocator, (void **)&allocator->bake_commands,
+            &allocator->bake_commands_size, command_count, sizeof(*allocator->bake_commands)))
+        return;
+
+    commands = allocator->bake_commands;
+    for (i = 0, command = bundle->head; command; command = command->next)
+        commands[i++] = command;
+
+    /* The allocator is zero-initialized, so the map is set up on first use, and reused afterwards. */
+    if (!map->entry_size)
+        hash_map_init(map, vkd3d_bundle_state_entry_hash, vkd3d_bundle_state_entry_compare, sizeof(*entry));
+    else
+        hash_map_reset(map);
+    map_size = map->entry_count;
+
+    memset(&new_entry, 0, sizeof(new_entry));
+
+    pending_epoch = 1;
+    for (i = 0; i < ARRAY_SIZE(live_epoch); i++)
+        live_epoch[i] = 1;
+
+    for (i = 0; i < command_count; i++)
+    {
+        command = commands[i];
+
+        /* Changing the root signature may reset root parameters, but it does not consume any state. */
+        if (command->proc == d3d12_bundle_exec_set_compute_root_signature)
+        {
+            live_epoch[VKD3D_BUNDLE_STATE_CLASS_COMPUTE_ROOT]++;
+            continue;
+        }
+        else if (command->proc == d3d12_bundle_exec_set_graphics_root_signature)
+        {
+            live_epoch[VKD3D_BUNDLE_STATE_CLASS_GRAPHICS_ROOT]++;
+            continue;
+        }
+
+        if (!d3d12_bundle_command_get_state_info(command, &info))
+        {
+            pending_epoch++;
+
+            if (!d3d12_bundle_command_preserves_state(command))
+            {
+                for (j = 0; j < ARRAY_SIZE(live_epoch); j++)
+                    live_epoch[j]++;
+            }
+            continue;
+        }
+
+        if (!(entry = (struct vkd3d_bundle_state_entry *)hash_map_find(map, &info.key)))
+        {
+            new_entry.key = info.key;
+            if (!(entry = (struct vkd3d_bundle_state_entry *)hash_map_insert(map, &info.key, &new_entry.entry)))
+            {
+                pending_epoch++;
+                continue;
+            }
+        }
+
+        if (info.track_value && entry->live_epoch == live_epoch[info.state_class] &&
+                entry->live_command->proc == command->proc && entry->live_size == info.size &&
+                !memcmp(entry->live_command + 1, command + 1, info.size - sizeof(*command)))
+        {
+            commands[i] = NULL;
+            folded_count++;
+            continue;
+        }
+
+        if (entry->pending_epoch == pending_epoch)
+        {
+            commands[entry->pending_index] = NULL;
+            folded_count++;
+        }
+
+        entry->pending_index = i;
+        entry->pending_epoch = pending_epoch;
+        entry->live_command = command;
+        entry->live_size = info.size;
+        entry->live_epoch = live_epoch[info.state_class];
+    }
+
+    if (map->entry_count != map_size)
+        allocator->scratch_heap_alloc_count++;
+
+    if (folded_count)
+    {
+        bundle->head = NULL;
+        bundle->tail = NULL;
+
+        for (i = 0; i < command_count; i++)
+        {
+            if (!(command = commands[i]))
+                continue;
+
+            if (bundle->tail)
+                bundle->tail->next = command;
+            else
+                bundle->head = command;
+
+            bundle->tail = command;
+        }
+
+        if (bundle->tail)
+            bundle->tail->next = NULL;
+    }
+
+    TRACE("Folded %zu of %zu commands in bundle %p.\n", folded_count, command_count, bundle);
+}
+
 static CONST_VTBL struct ID3D12GraphicsCommandList6Vtbl d3d12_bundle_vtbl =
 {
     /* IUnknown methods */
@@ -21,6 +21,12 @@
 
 #include "vkd3d_private.h"
 #include "vkd3d_shader.h"
+#include "vkd3d_lz.h"
+#include "vkd3d_pipeline_library_format.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 struct vkd3d_cached_pipeline_key
 {
@@ -38,6 +44,10 @@ struct vkd3d_cached_pipeline_data
      * This is a good performance boost for applications which load PSOs from library directly
      * multiple times throughout the lifetime of an application. */
     struct d3d12_pipeline_state *state;
+    /* blob is a vkd3d_serialized_pipeline_compressed_blob. Most entries are never looked up
+     * in a given session, so decompress on first lookup, and keep the result around. */
+    size_t is_compressed;
+    void *decompressed_blob;
 };
 
 struct vkd3d_cached_pipeline_entry
@@ -47,18 +57,6 @@ struct vkd3d_cached_pipeline_entry
     struct vkd3d_cached_pipeline_data data;
 };
 
-/* The stream format is used for internal magic cache.
- * In this scheme, we optimize for append performance rather than read performance.
- * TODO: This is a stepping stone for Fossilize integration, which would allow e.g. Steam to provide us with
- * pre-primed caches. */
-enum vkd3d_serialized_pipeline_stream_entry_type
-{
-    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV = 0,
-    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE = 1,
-    VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE = 2,
-    VKD3D_SERIALIZED_PIPELINE_STREAM_MAX_INT = 0x7fffffff,
-};
-
 #define VKD3D_PIPELINE_BLOB_CHUNK_SIZE(type) \
     align(sizeof(struct vkd3d_pipeline_blob_chunk) + sizeof(struct vkd3d_pipeline_blob_chunk_##type), \
     VKD3D_PIPELINE_BLOB_CHUNK_ALIGN)
@@ -69,13 +67,34 @@ enum vkd3d_serialized_pipeline_stream_entry_type
     align(sizeof(struct vkd3d_pipeline_blob_chunk) + sizeof(struct vkd3d_pipeline_blob_chunk_##type) + (extra), \
     VKD3D_PIPELINE_BLOB_CHUNK_ALIGN)
 
+STATIC_ASSERT(VK_UUID_SIZE == VKD3D_PIPELINE_LIBRARY_UUID_SIZE);
+
 #define CAST_CHUNK_BASE(blob) ((struct vkd3d_pipeline_blob_chunk *)((blob)->data))
 #define CONST_CAST_CHUNK_BASE(blob) ((const struct vkd3d_pipeline_blob_chunk *)((blob)->data))
 #define CAST_CHUNK_DATA(chunk, type) ((struct vkd3d_pipeline_blob_chunk_##type *)((chunk)->data))
 #define CONST_CAST_CHUNK_DATA(chunk, type) ((const struct vkd3d_pipeline_blob_chunk_##type *)((chunk)->data))
 
-#define VKD3D_PIPELINE_BLOB_ALIGN 8
-#define VKD3D_PIPELINE_BLOB_CHUNK_ALIGN 8
+/* Payload of a PIPELINE_VARIANT stream entry. Records that a fallback pipeline
+ * had to be compiled at draw time for the PSO identified by pso_hash. */
+struct vkd3d_serialized_pipeline_variant
+{
+    uint64_t pso_hash;
+    struct vkd3d_pipeline_variant_desc desc;
+};
+STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_variant) % VKD3D_PIPELINE_BLOB_ALIGN == 0);
+
+/* Only a handful of variants are expected per PSO. Cap it so that a pathological
+ * application cannot make us precompile an unbounded amount of pipelines. */
+#define VKD3D_PIPELINE_MAX_RECORDED_VARIANTS 16
+
+struct vkd3d_pipeline_variant_list
+{
+    struct hash_map_entry entry;
+    uint64_t pso_hash;
+    struct vkd3d_pipeline_variant_desc *variants;
+    size_t variants_size;
+    size_t variant_count;
+};
 
 static size_t vkd3d_compute_size_varint(const uint32_t *words, size_t word_count)
 {
@@ -181,36 +200,6 @@ VkResult vkd3d_create_pipeline_cache(struct d3d12_device *device,
     return VK_CALL(vkCreatePipelineCache(device->vk_device, &info, NULL, cache));
 }
 
-#define VKD3D_CACHE_BLOB_VERSION MAKE_MAGIC('V','K','B',3)
-
-enum vkd3d_pipeline_blob_chunk_type
-{
-    /* VkPipelineCache blob data. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PIPELINE_CACHE = 0,
-    /* VkShaderStage is stored in upper 16 bits. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_VARINT_SPIRV = 1,
-    /* For when a blob is stored inside a pipeline library, we can reference blobs by hash instead
-     * to achieve de-dupe. We'll need to maintain the older path as well however since we need to support GetCachedBlob()
-     * as a standalone thing as well. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PIPELINE_CACHE_LINK = 2,
-    /* VkShaderStage is stored in upper 16 bits. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_VARINT_SPIRV_LINK = 3,
-    /* VkShaderStage is stored in upper 16 bits. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_SHADER_META = 4,
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_PSO_COMPAT = 5,
-    /* VkShaderStage is stored in upper 16 bits. */
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_SHADER_IDENTIFIER = 6,
-    VKD3D_PIPELINE_BLOB_CHUNK_TYPE_MASK = 0xffff,
-    VKD3D_PIPELINE_BLOB_CHUNK_INDEX_SHIFT = 16,
-};
-
-struct vkd3d_pipeline_blob_chunk
-{
-    uint32_t type; /* vkd3d_pipeline_blob_chunk_type with extra data in upper bits. */
-    uint32_t size; /* size of data. Does not include size of header. */
-    uint8_t data[]; /* struct vkd3d_pipeline_blob_chunk_*. */
-};
-
 struct vkd3d_pipeline_blob_chunk_spirv
 {
     uint32_t decompressed_spirv_size;
@@ -218,11 +207,6 @@ struct vkd3d_pipeline_blob_chunk_spirv
     uint8_t data[];
 };
 
-struct vkd3d_pipeline_blob_chunk_link
-{
-    uint64_t hash;
-};
-
 struct vkd3d_pipeline_blob_chunk_shader_meta
 {
     struct vkd3d_shader_meta meta;
@@ -233,72 +217,55 @@ struct vkd3d_pipeline_blob_chunk_pso_compat
     struct vkd3d_pipeline_cache_compatibility compat;
 };
 
-STATIC_ASSERT(sizeof(struct vkd3d_pipeline_blob_chunk) == 8);
-STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob_chunk, data) == 8);
 STATIC_ASSERT(sizeof(struct vkd3d_pipeline_blob_chunk_spirv) == 8);
 STATIC_ASSERT(sizeof(struct vkd3d_pipeline_blob_chunk_spirv) == offsetof(struct vkd3d_pipeline_blob_chunk_spirv, data));
 
-struct vkd3d_pipeline_blob
-{
-    uint32_t version;
-    uint32_t vendor_id;
-    uint32_t device_id;
-    uint32_t checksum; /* Simple checksum for data[] as a sanity check. uint32_t because it conveniently packs here. */
-    uint64_t vkd3d_build;
-    uint64_t vkd3d_shader_interface_key;
-    uint8_t cache_uuid[VK_UUID_SIZE];
-    uint8_t data[]; /* vkd3d_pipeline_blob_chunks laid out one after the other with u64 alignment. */
-};
+/* Don't bother with tiny entries, and only keep the compressed form if it saves a meaningful amount. */
+#define VKD3D_SERIALIZED_PIPELINE_COMPRESS_MIN_SIZE 256
 
-/* Used for de-duplicated pipeline cache and SPIR-V hashmaps. */
-struct vkd3d_pipeline_blob_internal
+static bool vkd3d_cached_pipeline_entry_get_blob(const struct vkd3d_cached_pipeline_entry *entry,
+        const void **blob, size_t *blob_length)
 {
-    uint32_t checksum; /* Simple checksum for data[] as a sanity check. */
-    uint8_t data[]; /* Either raw uint8_t for pipeline cache, or vkd3d_pipeline_blob_chunk_spirv. */
-};
-
-STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob, data) == (32 + VK_UUID_SIZE));
-STATIC_ASSERT(offsetof(struct vkd3d_pipeline_blob, data) == sizeof(struct vkd3d_pipeline_blob));
+    const struct vkd3d_serialized_pipeline_compressed_blob *compressed;
+    void *decompressed, *existing;
 
-struct vkd3d_serialized_pipeline_stream_entry
-{
-    uint64_t hash;
-    uint64_t checksum; /* Checksum of the rest of this header + data. */
-    uint32_t size;
-    enum vkd3d_serialized_pipeline_stream_entry_type type;
-    uint8_t data[];
-};
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_stream_entry) ==
-        offsetof(struct vkd3d_serialized_pipeline_stream_entry, data));
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_stream_entry) == 24);
+    if (!entry->data.is_compressed)
+    {
+        *blob = entry->data.blob;
+        *blob_length = entry->data.blob_length;
+        return true;
+    }
 
-static uint32_t vkd3d_pipeline_blob_compute_data_checksum(const uint8_t *data, size_t size)
-{
-    const struct vkd3d_shader_code code = { data, size };
-    vkd3d_shader_hash_t h;
+    compressed = entry->data.blob;
+    if (entry->data.blob_length < sizeof(*compressed))
+        return false;
 
-    h = vkd3d_shader_hash(&code);
-    return hash_uint64(h);
-}
+    /* Callers only hold a read lock, so several threads may race to decompress. Only one copy survives. */
+    if (!(decompressed = vkd3d_atomic_ptr_load_explicit(&entry->data.decompressed_blob, vkd3d_memory_order_acquire)))
+    {
+        if (!(decompressed = vkd3d_malloc(compressed->decompressed_size)))
+            return false;
 
-static uint64_t vkd3d_serialized_pipeline_stream_entry_compute_checksum(const uint8_t *data,
-        const struct vkd3d_serialized_pipeline_stream_entry *entry)
-{
-    const struct vkd3d_shader_code code = { data, entry->size };
-    vkd3d_shader_hash_t h;
+        if (!vkd3d_lz_decompress(compressed->data, entry->data.blob_length - sizeof(*compressed),
+                decompressed, compressed->decompressed_size))
+        {
+            FIXME("Failed to decompress blob.\n");
+            vkd3d_free(decompressed);
+            return false;
+        }
 
-    h = vkd3d_shader_hash(&code);
-    h = hash_fnv1_iterate_u64(h, entry->hash);
-    h = hash_fnv1_iterate_u32(h, entry->size);
-    h = hash_fnv1_iterate_u32(h, entry->type);
-    return h;
-}
+        existing = vkd3d_atomic_ptr_compare_exchange((void **)&entry->data.decompressed_blob, NULL, decompressed,
+                vkd3d_memory_order_acq_rel, vkd3d_memory_order_acquire);
+        if (existing)
+        {
+            vkd3d_free(decompressed);
+            decompressed = existing;
+        }
+    }
 
-static bool vkd3d_serialized_pipeline_stream_entry_validate(const uint8_t *data,
-        const struct vkd3d_serialized_pipeline_stream_entry *entry)
-{
-    uint64_t checksum = vkd3d_serialized_pipeline_stream_entry_compute_checksum(data, entry);
-    return checksum == entry->checksum;
+    *blob = decompressed;
+    *blob_length = compressed->decompressed_size;
+    return true;
 }
 
 static const struct vkd3d_pipeline_blob_chunk *find_blob_chunk_masked(const struct vkd3d_pipeline_blob_chunk *chunk,
@@ -501,35 +468,188 @@ static struct vkd3d_pipeline_blob_chunk *finish_and_iterate_blob_chunk(struct vk
     return (struct vkd3d_pipeline_blob_chunk *)&chunk->data[aligned_size];
 }
 
+static uint32_t d3d12_pipeline_library_map_hash_key(const struct d3d12_pipeline_library_map *map,
+        const struct vkd3d_cached_pipeline_key *key)
+{
+    /* All shards share the same hash function. The low bits pick the bucket within a shard,
+     * and the key hashes are weak in the high bits, so scramble before taking the top bits. */
+    return map->shards[0].map.hash_func(key) * 0x9e3779b9u;
+}
+
+static unsigned int d3d12_pipeline_library_map_get_shard_index(uint32_t hash)
+{
+    return hash >> (32 - VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT_LOG2);
+}
+
+static struct d3d12_pipeline_library_map_shard *d3d12_pipeline_library_map_get_shard(
+        struct d3d12_pipeline_library_map *map, const struct vkd3d_cached_pipeline_key *key)
+{
+    return &map->shards[d3d12_pipeline_library_map_get_shard_index(d3d12_pipeline_library_map_hash_key(map, key))];
+}
+
+static bool d3d12_pipeline_library_map_shard_insert_locked(struct d3d12_pipeline_library_map_shard *shard,
+        const struct vkd3d_cached_pipeline_entry *entry);
+
+static void d3d12_pipeline_library_lazy_entry_get_key(const struct d3d12_pipeline_library_map *map,
+        const struct d3d12_pipeline_library_lazy_entry *lazy, struct vkd3d_cached_pipeline_key *key)
+{
+    key->name_length = map->lazy_toc_entries[lazy->toc_index].name_length;
+
+    if (key->name_length)
+    {
+        key->name = lazy->name;
+        key->internal_key_hash = 0;
+    }
+    else
+    {
+        key->name = NULL;
+        memcpy(&key->internal_key_hash, lazy->name, sizeof(key->internal_key_hash));
+    }
+}
+
+static const struct d3d12_pipeline_library_lazy_entry *d3d12_pipeline_library_map_shard_find_lazy(
+        const struct d3d12_pipeline_library_map *map, const struct d3d12_pipeline_library_map_shard *shard,
+        const struct vkd3d_cached_pipeline_key *key)
+{
+    const struct d3d12_pipeline_library_lazy_entry *lazy;
+    struct vkd3d_cached_pipeline_entry candidate;
+    size_t lo = 0, hi = shard->lazy_count, mid;
+    uint32_t hash;
+
+    hash = d3d12_pipeline_library_map_hash_key(map, key);
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (shard->lazy_entries[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (lazy = &shard->lazy_entries[lo]; lazy < shard->lazy_entries + shard->lazy_count && lazy->hash == hash; lazy++)
+    {
+        d3d12_pipeline_library_lazy_entry_get_key(map, lazy, &candidate.key);
+        if (shard->map.compare_func(key, &candidate.entry))
+            return lazy;
+    }
+
+    return NULL;
+}
+
+static void d3d12_pipeline_library_map_shard_materialize_locked(const struct d3d12_pipeline_library_map *map,
+        struct d3d12_pipeline_library_map_shard *shard, const struct d3d12_pipeline_library_lazy_entry *lazy)
+{
+    const struct vkd3d_serialized_pipeline_toc_entry *toc_entry = &map->lazy_toc_entries[lazy->toc_index];
+    struct vkd3d_cached_pipeline_entry entry;
+
+    d3d12_pipeline_library_lazy_entry_get_key(map, lazy, &entry.key);
+    entry.data.blob_length = toc_entry->blob_length;
+    entry.data.blob = map->lazy_data + toc_entry->blob_offset;
+    entry.data.is_new = 0;
+    entry.data.is_compressed = 0;
+    entry.data.decompressed_blob = NULL;
+    entry.data.state = NULL;
+
+    if (d3d12_pipeline_library_map_shard_insert_locked(shard, &entry))
+        shard->lazy_pending_count--;
+}
+
+/* Must be called with the shard read lock held, which is also held on return.
+ * Entries from a lazily loaded blob are moved into the hash map the first time they are looked up. */
+static const struct vkd3d_cached_pipeline_entry *d3d12_pipeline_library_map_find_locked(
+        struct d3d12_pipeline_library_map *map, struct d3d12_pipeline_library_map_shard *shard,
+        const struct vkd3d_cached_pipeline_key *key)
+{
+    const struct d3d12_pipeline_library_lazy_entry *lazy;
+    const struct hash_map_entry *entry;
+
+    if ((entry = hash_map_find(&shard->map, key)) || !shard->lazy_pending_count)
+        return (const struct vkd3d_cached_pipeline_entry *)entry;
+
+    if (!(lazy = d3d12_pipeline_library_map_shard_find_lazy(map, shard, key)))
+        return NULL;
+
+    /* Promote to a writer lock. Another thread may materialize the same entry in the meantime. */
+    rwlock_unlock_read(&shard->lock);
+    if (rwlock_lock_write(&shard->lock))
+    {
+        /* Treat it as a miss, the caller still expects the read lock to be held. */
+        rwlock_lock_read(&shard->lock);
+        return NULL;
+    }
+
+    if (!hash_map_find(&shard->map, key))
+        d3d12_pipeline_library_map_shard_materialize_locked(map, shard, lazy);
+    rwlock_unlock_write(&shard->lock);
+    rwlock_lock_read(&shard->lock);
+
+    return (const struct vkd3d_cached_pipeline_entry *)hash_map_find(&shard->map, key);
+}
+
+/* Serialization needs every entry in the hash maps. */
+static void d3d12_pipeline_library_map_materialize_all(struct d3d12_pipeline_library_map *map)
+{
+    struct d3d12_pipeline_library_map_shard *shard;
+    struct vkd3d_cached_pipeline_key key;
+    unsigned int i;
+    size_t j;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+    {
+        shard = &map->shards[i];
+
+        if (!shard->lazy_count)
+            continue;
+
+        rwlock_lock_write(&shard->lock);
+        for (j = 0; j < shard->lazy_count && shard->lazy_pending_count; j++)
+        {
+            d3d12_pipeline_library_lazy_entry_get_key(map, &shard->lazy_entries[j], &key);
+            if (!hash_map_find(&shard->map, &key))
+                d3d12_pipeline_library_map_shard_materialize_locked(map, shard, &shard->lazy_entries[j]);
+        }
+        rwlock_unlock_write(&shard->lock);
+    }
+}
+
 static bool d3d12_pipeline_library_find_internal_blob(struct d3d12_pipeline_library *pipeline_library,
-        const struct hash_map *map, uint64_t hash, const void **data, size_t *size)
+        struct d3d12_pipeline_library_map *map, uint64_t hash, const void **data, size_t *size)
 {
     const struct vkd3d_pipeline_blob_internal *internal;
+    struct d3d12_pipeline_library_map_shard *shard;
     const struct vkd3d_cached_pipeline_entry *entry;
     struct vkd3d_cached_pipeline_key key;
+    size_t blob_length;
     uint32_t checksum;
+    const void *blob;
     bool ret = false;
 
-    /* We are called from within D3D12 PSO creation, and we won't have read locks active here. */
-    if (rwlock_lock_read(&pipeline_library->mutex))
-        return false;
-
     key.name_length = 0;
     key.name = NULL;
     key.internal_key_hash = hash;
-    entry = (const struct vkd3d_cached_pipeline_entry *)hash_map_find(map, &key);
+    shard = d3d12_pipeline_library_map_get_shard(map, &key);
+
+    /* We are called from within D3D12 PSO creation, and we won't have read locks active here. */
+    if (rwlock_lock_read(&shard->lock))
+        return false;
+
+    entry = d3d12_pipeline_library_map_find_locked(map, shard, &key);
 
     if (entry)
     {
-        internal = entry->data.blob;
-        if (entry->data.blob_length < sizeof(*internal))
+        if (!vkd3d_cached_pipeline_entry_get_blob(entry, &blob, &blob_length))
+            goto out;
+
+        internal = blob;
+        if (blob_length < sizeof(*internal))
         {
             FIXME("Internal blob length is too small.\n");
             goto out;
         }
 
         *data = internal->data;
-        *size = entry->data.blob_length - sizeof(*internal);
+        *size = blob_length - sizeof(*internal);
 
         /* In stream archives, checksums are handled at the outer layer, just ignore them here. */
         if (!(pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE))
@@ -546,7 +666,7 @@ static bool d3d12_pipeline_library_find_internal_blob(struct d3d12_pipeline_libr
     }
 
 out:
-    rwlock_unlock_read(&pipeline_library->mutex);
+    rwlock_unlock_read(&shard->lock);
     return ret;
 }
 
@@ -718,60 +838,61 @@ static uint32_t d3d12_cached_pipeline_entry_name_table_size(const struct vkd3d_c
         return sizeof(entry->key.internal_key_hash);
 }
 
-static bool d3d12_pipeline_library_insert_hash_map_blob_locked(struct d3d12_pipeline_library *pipeline_library,
-        struct hash_map *map, const struct vkd3d_cached_pipeline_entry *entry)
+static bool d3d12_pipeline_library_map_shard_insert_locked(struct d3d12_pipeline_library_map_shard *shard,
+        const struct vkd3d_cached_pipeline_entry *entry)
 {
     const struct vkd3d_cached_pipeline_entry *new_entry;
-    if ((new_entry = (const struct vkd3d_cached_pipeline_entry*)hash_map_insert(map, &entry->key, &entry->entry)) &&
+    if ((new_entry = (const struct vkd3d_cached_pipeline_entry*)hash_map_insert(&shard->map, &entry->key, &entry->entry)) &&
             new_entry->data.blob == entry->data.blob)
     {
-        pipeline_library->total_name_table_size += d3d12_cached_pipeline_entry_name_table_size(entry);
-        pipeline_library->total_blob_size += align(entry->data.blob_length, VKD3D_PIPELINE_BLOB_ALIGN);
+        shard->name_table_size += d3d12_cached_pipeline_entry_name_table_size(entry);
+        shard->blob_size += align(entry->data.blob_length, VKD3D_PIPELINE_BLOB_ALIGN);
         return true;
     }
     else
         return false;
 }
 
-static bool d3d12_pipeline_library_insert_hash_map_blob_internal(struct d3d12_pipeline_library *pipeline_library,
-        struct hash_map *map, const struct vkd3d_cached_pipeline_entry *entry)
+static bool d3d12_pipeline_library_map_insert_locked(struct d3d12_pipeline_library_map *map,
+        const struct vkd3d_cached_pipeline_entry *entry)
 {
-    /* Used for internal hashmap updates. We expect reasonable amount of duplicates,
-     * prefer read -> write promotion. */
-    const struct vkd3d_cached_pipeline_entry *new_entry;
+    return d3d12_pipeline_library_map_shard_insert_locked(
+            d3d12_pipeline_library_map_get_shard(map, &entry->key), entry);
+}
+
+static bool d3d12_pipeline_library_map_insert(struct d3d12_pipeline_library_map *map,
+        const struct vkd3d_cached_pipeline_entry *entry)
+{
+    /* We expect a reasonable amount of duplicates, prefer read -> write promotion. */
+    struct d3d12_pipeline_library_map_shard *shard;
     bool ret;
     int rc;
 
-    if ((rc = rwlock_lock_read(&pipeline_library->internal_hashmap_mutex)))
+    shard = d3d12_pipeline_library_map_get_shard(map, &entry->key);
+
+    if ((rc = rwlock_lock_read(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         return false;
     }
 
-    if (hash_map_find(map, &entry->key))
+    /* An entry still pending in the lazy index counts as present. Looking it up moves it
+     * into the hash map, so the insert below cannot add the same key a second time. */
+    if (d3d12_pipeline_library_map_find_locked(map, shard, &entry->key))
     {
-        rwlock_unlock_read(&pipeline_library->internal_hashmap_mutex);
+        rwlock_unlock_read(&shard->lock);
         return false;
     }
 
-    rwlock_unlock_read(&pipeline_library->internal_hashmap_mutex);
-    if ((rc = rwlock_lock_write(&pipeline_library->internal_hashmap_mutex)))
+    rwlock_unlock_read(&shard->lock);
+    if ((rc = rwlock_lock_write(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         return false;
     }
 
-    if ((new_entry = (const struct vkd3d_cached_pipeline_entry*)hash_map_insert(map, &entry->key, &entry->entry)) &&
-            new_entry->data.blob == entry->data.blob)
-    {
-        pipeline_library->total_name_table_size += d3d12_cached_pipeline_entry_name_table_size(entry);
-        pipeline_library->total_blob_size += align(entry->data.blob_length, VKD3D_PIPELINE_BLOB_ALIGN);
-        ret = true;
-    }
-    else
-        ret = false;
-
-    rwlock_unlock_write(&pipeline_library->internal_hashmap_mutex);
+    ret = d3d12_pipeline_library_map_shard_insert_locked(shard, entry);
+    rwlock_unlock_write(&shard->lock);
     return ret;
 }
 
@@ -869,7 +990,6 @@ static void vkd3d_shader_code_serialize_referenced(struct d3d12_pipeline_library
     struct vkd3d_pipeline_blob_internal *internal;
     struct vkd3d_pipeline_blob_chunk_link *link;
     struct vkd3d_cached_pipeline_entry entry;
-    struct vkd3d_shader_code blob;
     size_t wrapped_varint_size;
 
     if (code->size && !(code->meta.flags & VKD3D_SHADER_META_FLAG_REPLACED))
@@ -877,6 +997,8 @@ static void vkd3d_shader_code_serialize_referenced(struct d3d12_pipeline_library
         entry.key.name_length = 0;
         entry.key.name = NULL;
         entry.data.is_new = 1;
+        entry.data.is_compressed = 0;
+        entry.data.decompressed_blob = NULL;
         entry.data.state = NULL;
 
         wrapped_varint_size = sizeof(struct vkd3d_pipeline_blob_chunk_spirv) + varint_size;
@@ -889,9 +1011,7 @@ static void vkd3d_shader_code_serialize_referenced(struct d3d12_pipeline_library
         vkd3d_encode_varint(spirv->data, code->code, code->size / sizeof(uint32_t));
 
         entry.data.blob = internal;
-        blob.code = spirv->data;
-        blob.size = varint_size;
-        entry.key.internal_key_hash = vkd3d_shader_hash(&blob);
+        entry.key.internal_key_hash = vkd3d_hash64(spirv->data, varint_size);
 
         /* In stream archives, checksums are handled at the outer layer, just ignore them here. */
         if (!pipeline_library || !(pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE))
@@ -900,8 +1020,7 @@ static void vkd3d_shader_code_serialize_referenced(struct d3d12_pipeline_library
             internal->checksum = 0;
 
         /* For duplicate, we won't insert. Just free the blob. */
-        if (!d3d12_pipeline_library_insert_hash_map_blob_internal(pipeline_library,
-                &pipeline_library->spirv_cache_map, &entry))
+        if (!d3d12_pipeline_library_map_insert(&pipeline_library->spirv_cache_map, &entry))
         {
             vkd3d_free(internal);
         }
@@ -992,7 +1111,6 @@ static VkResult vkd3d_serialize_pipeline_state_referenced(struct d3d12_pipeline_
     struct vkd3d_pipeline_blob_internal *internal;
     struct vkd3d_pipeline_blob_chunk_link *link;
     struct vkd3d_cached_pipeline_entry entry;
-    struct vkd3d_shader_code blob;
     size_t reference_size;
     unsigned int i;
     VkResult vr;
@@ -1000,6 +1118,8 @@ static VkResult vkd3d_serialize_pipeline_state_referenced(struct d3d12_pipeline_
     entry.key.name_length = 0;
     entry.key.name = NULL;
     entry.data.is_new = 1;
+    entry.data.is_compressed = 0;
+    entry.data.decompressed_blob = NULL;
     entry.data.state = NULL;
 
     if (state->vk_pso_cache && (pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_SAVE_PSO_BLOB))
@@ -1025,19 +1145,16 @@ static VkResult vkd3d_serialize_pipeline_state_referenced(struct d3d12_pipeline_
                     (unsigned int)vk_pipeline_cache_size);
         }
 
-        blob.code = internal->data;
-        blob.size = vk_pipeline_cache_size;
-        entry.key.internal_key_hash = vkd3d_shader_hash(&blob);
+        entry.key.internal_key_hash = vkd3d_hash64(internal->data, vk_pipeline_cache_size);
 
         /* In stream archives, checksums are handled at the outer layer, just ignore them here. */
         if (!pipeline_library || !(pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE))
-            internal->checksum = vkd3d_pipeline_blob_compute_data_checksum(blob.code, blob.size);
+            internal->checksum = vkd3d_pipeline_blob_compute_data_checksum(internal->data, vk_pipeline_cache_size);
         else
             internal->checksum = 0;
 
         /* For duplicate, we won't insert. Just free the blob. */
-        if (!d3d12_pipeline_library_insert_hash_map_blob_internal(pipeline_library,
-                &pipeline_library->driver_cache_map, &entry))
+        if (!d3d12_pipeline_library_map_insert(&pipeline_library->driver_cache_map, &entry))
         {
             vkd3d_free(internal);
         }
@@ -1184,7 +1301,10 @@ VkResult vkd3d_serialize_pipeline_state(struct d3d12_pipeline_library *pipeline_
     total_size += vk_blob_size;
 
     if (blob && *size < total_size)
+    {
+        *size = total_size;
         return VK_INCOMPLETE;
+    }
 
     if (blob)
     {
@@ -1274,97 +1394,6 @@ static bool vkd3d_cached_pipeline_compare_internal(const void *key, const struct
     return k->internal_key_hash == e->key.internal_key_hash;
 }
 
-struct vkd3d_serialized_pipeline_toc_entry
-{
-    uint64_t blob_offset;
-    uint32_t name_length;
-    uint32_t blob_length;
-};
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_toc_entry) == 16);
-
-#define VKD3D_PIPELINE_LIBRARY_VERSION_TOC MAKE_MAGIC('V','K','L',4)
-#define VKD3D_PIPELINE_LIBRARY_VERSION_STREAM MAKE_MAGIC('V','K','S',4)
-
-struct vkd3d_serialized_pipeline_library_toc
-{
-    uint32_t version;
-    uint32_t vendor_id;
-    uint32_t device_id;
-    uint32_t spirv_count;
-    uint32_t driver_cache_count;
-    uint32_t pipeline_count;
-    uint64_t vkd3d_build;
-    uint64_t vkd3d_shader_interface_key;
-    /* Refers to pipelineCacheUUID if we're using VkPipelineCache blobs,
-     * or shaderModuleIdentifierAlgorithmUUID if using shader module identifiers.
-     * With the nature of UUIDs, we don't risk random mismatches if
-     * a blob cache UUID is consumed by shader module identifiers and vice versa. */
-    uint8_t cache_uuid[VK_UUID_SIZE];
-    struct vkd3d_serialized_pipeline_toc_entry entries[];
-};
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_toc) ==
-        offsetof(struct vkd3d_serialized_pipeline_library_toc, entries));
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_toc) == 40 + VK_UUID_SIZE);
-
-/* Binary layout:
- * - Header
- * - spirv_count x toc_entries [Varint compressed SPIR-V]
- * - driver_cache_count x toc_entries [VkPipelineCache data]
- * - pipeline_count x toc_entries [Contains references to SPIR-V and VkPipelineCache blobs]
- * - After toc entries, raw data is placed. TOC entries refer to keys (names) and values by offsets into this buffer.
- * - TOC entry offsets for names are implicit. The name lengths are tightly packed from the start of the raw data buffer.
- *   Name lengths of 0 are treated as u64 hashes. Used for SPIR-V cache and VkPipelineCache cache.
- *   Name entries are allocated in toc_entry order.
- * - For blobs, a u64 offset + u32 size pair is added.
- * - After toc entries, we have the name table.
- */
-
-/*
- * A raw blob is treated as a vkd3d_pipeline_blob or vkd3d_pipeline_blob_internal.
- * The full blob type is used for D3D12 PSOs. These contain:
- * - Versioning of various kinds. If there is a mismatch we return the appropriate error.
- * - Checksum is used as sanity check in case we have a corrupt archive.
- * - Chunked data[].
- * - This chunked data is a typical stream of { type, length, data }. A D3D12 PSO stores various information here, such as
- *   - Root signature compatibility
- *   - SPIR-V shader hash references per stage
- *   - SPIR-V shader meta information, which is reflection data that we would otherwise get from vkd3d-shader
- *   - Hash of the VkPipelineCache data
- */
-
-/*
- * An internal blob is just checksum + data.
- * This data does not need versioning information since it's fully internal to the library implementation and is only
- * referenced after the D3D12 blob header is validated.
- */
-
-/* Rationale for this split format is:
- * - It is implied that the pipeline library can be used directly from an mmap-ed on-disk file,
- *   since users cannot free the pointer to library once created.
- *   In this situation, we should scan through just the TOC to begin with to avoid page faulting on potentially 100s of MBs.
- *   It is also more cache friendly this way.
- * - Having a more split TOC structure like this makes it easier to add SPIR-V deduplication and PSO cache deduplication.
- */
-
-/* The stream variant. Blobs are emitted one after the other with header + data. */
-
-/* It's possible to just make this header into a bucket hash for e.g. Fossilize. */
-struct vkd3d_serialized_pipeline_library_stream
-{
-    uint32_t version;
-    uint32_t vendor_id;
-    uint32_t device_id;
-    uint32_t reserved;
-    uint64_t vkd3d_build;
-    uint64_t vkd3d_shader_interface_key;
-    /* Mostly irrelevant since we use GLOBAL_PIPELINE_CACHE by default for stream archives. */
-    uint8_t cache_uuid[VK_UUID_SIZE];
-    uint8_t entries[];
-};
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_stream) ==
-        offsetof(struct vkd3d_serialized_pipeline_library_stream, entries));
-STATIC_ASSERT(sizeof(struct vkd3d_serialized_pipeline_library_stream) == 32 + VK_UUID_SIZE);
-
 /* ID3D12PipelineLibrary */
 static inline struct d3d12_pipeline_library *impl_from_ID3D12PipelineLibrary(d3d12_pipeline_library_iface *iface)
 {
@@ -1388,7 +1417,79 @@ static void d3d12_pipeline_library_serialize_entry(
     memcpy(data + blob_offset, entry->data.blob, entry->data.blob_length);
 }
 
-static void d3d12_pipeline_library_cleanup_map(struct hash_map *map)
+static uint32_t vkd3d_pipeline_variant_list_hash(const void *key)
+{
+    return hash_uint64(*(const uint64_t *)key);
+}
+
+static bool vkd3d_pipeline_variant_list_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_pipeline_variant_list *list = (const struct vkd3d_pipeline_variant_list *)entry;
+    return list->pso_hash == *(const uint64_t *)key;
+}
+
+static uint64_t vkd3d_serialized_pipeline_variant_hash(const struct vkd3d_serialized_pipeline_variant *variant)
+{
+    const struct vkd3d_pipeline_variant_desc *desc = &variant->desc;
+    unsigned int i;
+    uint64_t h;
+
+    h = hash_fnv1_init();
+    h = hash_fnv1_iterate_u64(h, variant->pso_hash);
+    h = hash_fnv1_iterate_u32(h, desc->topology);
+    h = hash_fnv1_iterate_u32(h, desc->viewport_count);
+    h = hash_fnv1_iterate_u32(h, desc->dsv_format);
+    h = hash_fnv1_iterate_u32(h, desc->flags);
+    for (i = 0; i < ARRAY_SIZE(desc->strides); i++)
+        h = hash_fnv1_iterate_u32(h, desc->strides[i]);
+    return h;
+}
+
+/* Returns true if the variant was not known before. */
+static bool d3d12_pipeline_library_insert_variant_locked(struct d3d12_pipeline_library *pipeline_library,
+        const struct vkd3d_serialized_pipeline_variant *variant)
+{
+    struct vkd3d_pipeline_variant_list new_list, *list;
+    size_t i;
+
+    memset(&new_list, 0, sizeof(new_list));
+    new_list.pso_hash = variant->pso_hash;
+
+    if (!(list = (struct vkd3d_pipeline_variant_list *)hash_map_insert(&pipeline_library->pso_variant_map,
+            &variant->pso_hash, &new_list.entry)))
+        return false;
+
+    for (i = 0; i < list->variant_count; i++)
+        if (!memcmp(&list->variants[i], &variant->desc, sizeof(variant->desc)))
+            return false;
+
+    if (list->variant_count >= VKD3D_PIPELINE_MAX_RECORDED_VARIANTS)
+        return false;
+
+    if (!vkd3d_array_reserve((void **)&list->variants, &list->variants_size,
+            list->variant_count + 1, sizeof(*list->variants)))
+        return false;
+
+    list->variants[list->variant_count++] = variant->desc;
+    return true;
+}
+
+static void d3d12_pipeline_library_cleanup_variant_map(struct hash_map *map)
+{
+    struct vkd3d_pipeline_variant_list *list;
+    size_t i;
+
+    for (i = 0; i < map->entry_count; i++)
+    {
+        list = (struct vkd3d_pipeline_variant_list *)hash_map_get_entry(map, i);
+        if (list->entry.flags & HASH_MAP_ENTRY_OCCUPIED)
+            vkd3d_free(list->variants);
+    }
+
+    hash_map_clear(map);
+}
+
+static void d3d12_pipeline_library_cleanup_hash_map(struct hash_map *map)
 {
     size_t i;
 
@@ -1406,21 +1507,140 @@ static void d3d12_pipeline_library_cleanup_map(struct hash_map *map)
 
             if (e->data.state)
                 d3d12_pipeline_state_dec_ref(e->data.state);
+
+            vkd3d_free(e->data.decompressed_blob);
         }
     }
 
     hash_map_clear(map);
 }
 
+static int d3d12_pipeline_library_map_init(struct d3d12_pipeline_library_map *map,
+        pfn_hash_func hash_func, pfn_hash_compare_func compare_func)
+{
+    unsigned int i;
+    int rc;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+    {
+        if ((rc = rwlock_init(&map->shards[i].lock)))
+        {
+            while (i--)
+                rwlock_destroy(&map->shards[i].lock);
+            return rc;
+        }
+
+        hash_map_init(&map->shards[i].map, hash_func, compare_func, sizeof(struct vkd3d_cached_pipeline_entry));
+        map->shards[i].name_table_size = 0;
+        map->shards[i].blob_size = 0;
+        map->shards[i].lazy_entries = NULL;
+        map->shards[i].lazy_count = 0;
+        map->shards[i].lazy_pending_count = 0;
+    }
+
+    map->lazy_index = NULL;
+    map->lazy_toc_entries = NULL;
+    map->lazy_data = NULL;
+    return 0;
+}
+
+static void d3d12_pipeline_library_map_cleanup(struct d3d12_pipeline_library_map *map)
+{
+    unsigned int i;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+    {
+        d3d12_pipeline_library_cleanup_hash_map(&map->shards[i].map);
+        rwlock_destroy(&map->shards[i].lock);
+    }
+
+    vkd3d_free(map->lazy_index);
+}
+
+static uint32_t d3d12_pipeline_library_map_get_count(const struct d3d12_pipeline_library_map *map)
+{
+    uint32_t count = 0;
+    unsigned int i;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+        count += map->shards[i].map.used_count;
+    return count;
+}
+
+static int d3d12_pipeline_library_map_lock_read_all(struct d3d12_pipeline_library_map *map)
+{
+    unsigned int i;
+    int rc;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+    {
+        if ((rc = rwlock_lock_read(&map->shards[i].lock)))
+        {
+            while (i--)
+                rwlock_unlock_read(&map->shards[i].lock);
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+static void d3d12_pipeline_library_map_unlock_read_all(struct d3d12_pipeline_library_map *map)
+{
+    unsigned int i;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+        rwlock_unlock_read(&map->shards[i].lock);
+}
+
+/* Serializing the library needs a consistent view of all maps. Shards are always
+ * locked in the same order, and nothing else holds more than one shard lock at a time. */
+static int d3d12_pipeline_library_lock_read_all(struct d3d12_pipeline_library *pipeline_library)
+{
+    int rc;
+
+    if ((rc = d3d12_pipeline_library_map_lock_read_all(&pipeline_library->spirv_cache_map)))
+        return rc;
+
+    if ((rc = d3d12_pipeline_library_map_lock_read_all(&pipeline_library->driver_cache_map)))
+    {
+        d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->spirv_cache_map);
+        return rc;
+    }
+
+    if ((rc = d3d12_pipeline_library_map_lock_read_all(&pipeline_library->pso_map)))
+    {
+        d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->driver_cache_map);
+        d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->spirv_cache_map);
+        return rc;
+    }
+
+    return 0;
+}
+
+static void d3d12_pipeline_library_materialize_all(struct d3d12_pipeline_library *pipeline_library)
+{
+    d3d12_pipeline_library_map_materialize_all(&pipeline_library->spirv_cache_map);
+    d3d12_pipeline_library_map_materialize_all(&pipeline_library->driver_cache_map);
+    d3d12_pipeline_library_map_materialize_all(&pipeline_library->pso_map);
+}
+
+static void d3d12_pipeline_library_unlock_read_all(struct d3d12_pipeline_library *pipeline_library)
+{
+    d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->pso_map);
+    d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->driver_cache_map);
+    d3d12_pipeline_library_map_unlock_read_all(&pipeline_library->spirv_cache_map);
+}
+
 static void d3d12_pipeline_library_cleanup(struct d3d12_pipeline_library *pipeline_library, struct d3d12_device *device)
 {
-    d3d12_pipeline_library_cleanup_map(&pipeline_library->pso_map);
-    d3d12_pipeline_library_cleanup_map(&pipeline_library->driver_cache_map);
-    d3d12_pipeline_library_cleanup_map(&pipeline_library->spirv_cache_map);
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->pso_map);
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->driver_cache_map);
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->spirv_cache_map);
+    d3d12_pipeline_library_cleanup_variant_map(&pipeline_library->pso_variant_map);
 
     vkd3d_private_store_destroy(&pipeline_library->private_store);
     rwlock_destroy(&pipeline_library->mutex);
-    rwlock_destroy(&pipeline_library->internal_hashmap_mutex);
 }
 
 static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_QueryInterface(d3d12_pipeline_library_iface *iface,
@@ -1541,8 +1761,10 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(d3d12_pipe
 {
     struct d3d12_pipeline_library *pipeline_library = impl_from_ID3D12PipelineLibrary(iface);
     struct d3d12_pipeline_state *pipeline_state = impl_from_ID3D12PipelineState(pipeline);
+    struct d3d12_pipeline_library_map_shard *shard;
     struct vkd3d_cached_pipeline_entry entry;
     void *new_name, *new_blob;
+    bool exists;
     VkResult vr;
     HRESULT hr;
     int rc;
@@ -1552,44 +1774,46 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(d3d12_pipe
     if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
         INFO("Serializing pipeline to library.\n");
 
-    if ((rc = rwlock_lock_read(&pipeline_library->mutex)))
+    d3d12_pipeline_state_wait_async_compile(pipeline_state);
+
+    entry.key.name_length = vkd3d_wcslen(name) * sizeof(WCHAR);
+    entry.key.name = name;
+    entry.key.internal_key_hash = 0;
+    shard = d3d12_pipeline_library_map_get_shard(&pipeline_library->pso_map, &entry.key);
+
+    if ((rc = rwlock_lock_read(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         return hresult_from_errno(rc);
     }
 
-    entry.key.name_length = vkd3d_wcslen(name) * sizeof(WCHAR);
-    entry.key.name = name;
-    entry.key.internal_key_hash = 0;
+    exists = !!d3d12_pipeline_library_map_find_locked(&pipeline_library->pso_map, shard, &entry.key);
+    rwlock_unlock_read(&shard->lock);
 
-    if (hash_map_find(&pipeline_library->pso_map, &entry.key))
+    if (exists)
     {
         WARN("Pipeline %s already exists.\n", debugstr_w(name));
-        rwlock_unlock_read(&pipeline_library->mutex);
         return E_INVALIDARG;
     }
 
     /* We need to allocate persistent storage for the name */
     if (!(new_name = vkd3d_malloc(entry.key.name_length)))
-    {
-        rwlock_unlock_read(&pipeline_library->mutex);
         return E_OUTOFMEMORY;
-    }
 
     memcpy(new_name, name, entry.key.name_length);
     entry.key.name = new_name;
 
+    /* Serialization only touches the internal maps, which have their own locks,
+     * so don't hold the shard lock while doing the expensive part. */
     if (FAILED(vr = vkd3d_serialize_pipeline_state(pipeline_library, pipeline_state, &entry.data.blob_length, NULL)))
     {
         vkd3d_free(new_name);
-        rwlock_unlock_read(&pipeline_library->mutex);
         return hresult_from_vk_result(vr);
     }
 
     if (!(new_blob = vkd3d_malloc(entry.data.blob_length)))
     {
         vkd3d_free(new_name);
-        rwlock_unlock_read(&pipeline_library->mutex);
         return E_OUTOFMEMORY;
     }
 
@@ -1597,18 +1821,17 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(d3d12_pipe
     {
         vkd3d_free(new_name);
         vkd3d_free(new_blob);
-        rwlock_unlock_read(&pipeline_library->mutex);
         return hresult_from_vk_result(vr);
     }
 
-    rwlock_unlock_read(&pipeline_library->mutex);
-
     entry.data.blob = new_blob;
     entry.data.is_new = 1;
+    entry.data.is_compressed = 0;
+    entry.data.decompressed_blob = NULL;
     entry.data.state = pipeline_state;
 
     /* Now is the time to promote to a writer lock. */
-    if ((rc = rwlock_lock_write(&pipeline_library->mutex)))
+    if ((rc = rwlock_lock_write(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         vkd3d_free(new_name);
@@ -1617,12 +1840,12 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(d3d12_pipe
     }
 
     /* Detected duplicate late, but be accurate in how we report this. */
-    if (hash_map_find(&pipeline_library->pso_map, &entry.key))
+    if (hash_map_find(&shard->map, &entry.key))
     {
         WARN("Pipeline %s already exists.\n", debugstr_w(name));
         hr = E_INVALIDARG;
     }
-    else if (!d3d12_pipeline_library_insert_hash_map_blob_locked(pipeline_library, &pipeline_library->pso_map, &entry))
+    else if (!d3d12_pipeline_library_map_shard_insert_locked(shard, &entry))
     {
         /* This path shouldn't happen unless there are OOM scenarios. */
         hr = E_OUTOFMEMORY;
@@ -1635,7 +1858,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_StorePipeline(d3d12_pipe
         hr = S_OK;
     }
 
-    rwlock_unlock_write(&pipeline_library->mutex);
+    rwlock_unlock_write(&shard->lock);
 
     if (FAILED(hr))
     {
@@ -1650,6 +1873,7 @@ static HRESULT d3d12_pipeline_library_load_pipeline(struct d3d12_pipeline_librar
         VkPipelineBindPoint bind_point, struct d3d12_pipeline_state_desc *desc, struct d3d12_pipeline_state **state)
 {
     struct vkd3d_pipeline_cache_compatibility pipeline_cache_compat;
+    struct d3d12_pipeline_library_map_shard *shard;
     const struct vkd3d_cached_pipeline_entry *e;
     struct d3d12_pipeline_state *existing_state;
     struct d3d12_root_signature *root_signature;
@@ -1658,19 +1882,20 @@ static HRESULT d3d12_pipeline_library_load_pipeline(struct d3d12_pipeline_librar
     HRESULT hr;
     int rc;
 
-    if ((rc = rwlock_lock_read(&pipeline_library->mutex)))
+    key.name_length = vkd3d_wcslen(name) * sizeof(WCHAR);
+    key.name = name;
+    shard = d3d12_pipeline_library_map_get_shard(&pipeline_library->pso_map, &key);
+
+    if ((rc = rwlock_lock_read(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         return hresult_from_errno(rc);
     }
 
-    key.name_length = vkd3d_wcslen(name) * sizeof(WCHAR);
-    key.name = name;
-
-    if (!(e = (const struct vkd3d_cached_pipeline_entry*)hash_map_find(&pipeline_library->pso_map, &key)))
+    if (!(e = d3d12_pipeline_library_map_find_locked(&pipeline_library->pso_map, shard, &key)))
     {
         WARN("Pipeline %s does not exist.\n", debugstr_w(name));
-        rwlock_unlock_read(&pipeline_library->mutex);
+        rwlock_unlock_read(&shard->lock);
         return E_INVALIDARG;
     }
 
@@ -1681,7 +1906,7 @@ static HRESULT d3d12_pipeline_library_load_pipeline(struct d3d12_pipeline_librar
 
     if (cached_state)
     {
-        rwlock_unlock_read(&pipeline_library->mutex);
+        rwlock_unlock_read(&shard->lock);
 
         /* If we have handed out the PSO once, just need to do a quick validation. */
         memset(&pipeline_cache_compat, 0, sizeof(pipeline_cache_compat));
@@ -1720,7 +1945,7 @@ static HRESULT d3d12_pipeline_library_load_pipeline(struct d3d12_pipeline_librar
         desc->cached_pso.blob.CachedBlobSizeInBytes = e->data.blob_length;
         desc->cached_pso.blob.pCachedBlob = e->data.blob;
         desc->cached_pso.library = pipeline_library;
-        rwlock_unlock_read(&pipeline_library->mutex);
+        rwlock_unlock_read(&shard->lock);
 
         /* Don't hold locks while creating pipeline, it takes *some* time to validate and decompress stuff,
          * and in heavily multi-threaded scenarios we want to go as wide as we can. */
@@ -1728,11 +1953,11 @@ static HRESULT d3d12_pipeline_library_load_pipeline(struct d3d12_pipeline_librar
             return hr;
 
         /* These really should not fail ... */
-        rwlock_lock_read(&pipeline_library->mutex);
-        e = (const struct vkd3d_cached_pipeline_entry*)hash_map_find(&pipeline_library->pso_map, &key);
+        rwlock_lock_read(&shard->lock);
+        e = (const struct vkd3d_cached_pipeline_entry*)hash_map_find(&shard->map, &key);
         existing_state = vkd3d_atomic_ptr_compare_exchange(&e->data.state, NULL, cached_state,
                 vkd3d_memory_order_acq_rel, vkd3d_memory_order_acquire);
-        rwlock_unlock_read(&pipeline_library->mutex);
+        rwlock_unlock_read(&shard->lock);
 
         if (!existing_state)
         {
@@ -1803,25 +2028,50 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_LoadComputePipeline(d3d1
             &IID_ID3D12PipelineState, iid, pipeline_state);
 }
 
+static void d3d12_pipeline_library_map_get_serialized_size(const struct d3d12_pipeline_library_map *map,
+        size_t *name_table_size, size_t *blob_size)
+{
+    unsigned int i;
+
+    for (i = 0; i < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; i++)
+    {
+        *name_table_size += map->shards[i].name_table_size;
+        *blob_size += map->shards[i].blob_size;
+    }
+}
+
 static size_t d3d12_pipeline_library_get_aligned_name_table_size(struct d3d12_pipeline_library *pipeline_library)
 {
-    return align(pipeline_library->total_name_table_size, VKD3D_PIPELINE_BLOB_ALIGN);
+    size_t name_table_size = 0, blob_size = 0;
+
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->pso_map, &name_table_size, &blob_size);
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->spirv_cache_map, &name_table_size, &blob_size);
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->driver_cache_map, &name_table_size, &blob_size);
+    return align(name_table_size, VKD3D_PIPELINE_BLOB_ALIGN);
 }
 
 static size_t d3d12_pipeline_library_get_serialized_size(struct d3d12_pipeline_library *pipeline_library)
 {
+    size_t name_table_size = 0, blob_size = 0;
     size_t total_size = 0;
 
     /* Stream archives are not serialized as a monolithic blob. */
     if (pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE)
         return 0;
 
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->pso_map, &name_table_size, &blob_size);
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->spirv_cache_map, &name_table_size, &blob_size);
+    d3d12_pipeline_library_map_get_serialized_size(&pipeline_library->driver_cache_map, &name_table_size, &blob_size);
+
     total_size += sizeof(struct vkd3d_serialized_pipeline_library_toc);
-    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) * pipeline_library->pso_map.used_count;
-    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) * pipeline_library->spirv_cache_map.used_count;
-    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) * pipeline_library->driver_cache_map.used_count;
-    total_size += d3d12_pipeline_library_get_aligned_name_table_size(pipeline_library);
-    total_size += pipeline_library->total_blob_size;
+    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) *
+            d3d12_pipeline_library_map_get_count(&pipeline_library->pso_map);
+    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) *
+            d3d12_pipeline_library_map_get_count(&pipeline_library->spirv_cache_map);
+    total_size += sizeof(struct vkd3d_serialized_pipeline_toc_entry) *
+            d3d12_pipeline_library_map_get_count(&pipeline_library->driver_cache_map);
+    total_size += align(name_table_size, VKD3D_PIPELINE_BLOB_ALIGN);
+    total_size += blob_size;
 
     return total_size;
 }
@@ -1834,38 +2084,33 @@ static SIZE_T STDMETHODCALLTYPE d3d12_pipeline_library_GetSerializedSize(d3d12_p
 
     TRACE("iface %p.\n", iface);
 
-    if ((rc = rwlock_lock_read(&pipeline_library->mutex)))
-    {
-        ERR("Failed to lock mutex, rc %d.\n", rc);
-        return 0;
-    }
+    d3d12_pipeline_library_materialize_all(pipeline_library);
 
-    if ((rc = rwlock_lock_read(&pipeline_library->internal_hashmap_mutex)))
+    if ((rc = d3d12_pipeline_library_lock_read_all(pipeline_library)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
-        rwlock_unlock_read(&pipeline_library->mutex);
         return 0;
     }
 
     total_size = d3d12_pipeline_library_get_serialized_size(pipeline_library);
-
-    rwlock_unlock_read(&pipeline_library->mutex);
-    rwlock_unlock_read(&pipeline_library->internal_hashmap_mutex);
+    d3d12_pipeline_library_unlock_read_all(pipeline_library);
     return total_size;
 }
 
-static void d3d12_pipeline_library_serialize_hash_map(const struct hash_map *map,
+static void d3d12_pipeline_library_serialize_hash_map(const struct d3d12_pipeline_library_map *map,
         struct vkd3d_serialized_pipeline_toc_entry **inout_toc_entries, uint8_t *serialized_data,
         size_t *inout_name_offset, size_t *inout_blob_offset)
 {
     struct vkd3d_serialized_pipeline_toc_entry *toc_entries = *inout_toc_entries;
     size_t name_offset = *inout_name_offset;
     size_t blob_offset = *inout_blob_offset;
-    uint32_t i;
+    const struct hash_map *hash_map;
+    uint32_t i, j;
 
-    for (i = 0; i < map->entry_count; i++)
+    for (j = 0; j < VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT; j++)
+    for (i = 0, hash_map = &map->shards[j].map; i < hash_map->entry_count; i++)
     {
-        struct vkd3d_cached_pipeline_entry *e = (struct vkd3d_cached_pipeline_entry*)hash_map_get_entry(map, i);
+        struct vkd3d_cached_pipeline_entry *e = (struct vkd3d_cached_pipeline_entry*)hash_map_get_entry(hash_map, i);
 
         if (e->entry.flags & HASH_MAP_ENTRY_OCCUPIED)
         {
@@ -1930,9 +2175,9 @@ static HRESULT d3d12_pipeline_library_serialize(struct d3d12_pipeline_library *p
     header->version = VKD3D_PIPELINE_LIBRARY_VERSION_TOC;
     header->vendor_id = device_properties->vendorID;
     header->device_id = device_properties->deviceID;
-    header->pipeline_count = pipeline_library->pso_map.used_count;
-    header->spirv_count = pipeline_library->spirv_cache_map.used_count;
-    header->driver_cache_count = pipeline_library->driver_cache_map.used_count;
+    header->pipeline_count = d3d12_pipeline_library_map_get_count(&pipeline_library->pso_map);
+    header->spirv_count = d3d12_pipeline_library_map_get_count(&pipeline_library->spirv_cache_map);
+    header->driver_cache_count = d3d12_pipeline_library_map_get_count(&pipeline_library->driver_cache_map);
     header->vkd3d_build = vkd3d_build;
     header->vkd3d_shader_interface_key = pipeline_library->device->shader_interface_key;
 
@@ -1997,22 +2242,16 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_library_Serialize(d3d12_pipeline
 
     TRACE("iface %p.\n", iface);
 
-    if ((rc = rwlock_lock_read(&pipeline_library->mutex)))
-    {
-        ERR("Failed to lock mutex, rc %d.\n", rc);
-        return E_FAIL;
-    }
+    d3d12_pipeline_library_materialize_all(pipeline_library);
 
-    if ((rc = rwlock_lock_read(&pipeline_library->internal_hashmap_mutex)))
+    if ((rc = d3d12_pipeline_library_lock_read_all(pipeline_library)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
-        rwlock_unlock_read(&pipeline_library->mutex);
         return E_FAIL;
     }
 
     hr = d3d12_pipeline_library_serialize(pipeline_library, data, data_size);
-    rwlock_unlock_read(&pipeline_library->mutex);
-    rwlock_unlock_read(&pipeline_library->internal_hashmap_mutex);
+    d3d12_pipeline_library_unlock_read_all(pipeline_library);
     return hr;
 }
 
@@ -2065,56 +2304,89 @@ static CONST_VTBL struct ID3D12PipelineLibrary1Vtbl d3d12_pipeline_library_vtbl
     d3d12_pipeline_library_LoadPipeline,
 };
 
-static HRESULT d3d12_pipeline_library_unserialize_hash_map(
-        struct d3d12_pipeline_library *pipeline_library,
-        const struct vkd3d_serialized_pipeline_toc_entry *entries,
-        size_t entries_count, struct hash_map *map,
+static int d3d12_pipeline_library_lazy_entry_compare(const void *a, const void *b)
+{
+    const struct d3d12_pipeline_library_lazy_entry *lazy_a = a;
+    const struct d3d12_pipeline_library_lazy_entry *lazy_b = b;
+
+    if (lazy_a->hash != lazy_b->hash)
+        return lazy_a->hash < lazy_b->hash ? -1 : 1;
+    return lazy_a->toc_index < lazy_b->toc_index ? -1 : (lazy_a->toc_index > lazy_b->toc_index ? 1 : 0);
+}
+
+static HRESULT d3d12_pipeline_library_map_init_lazy_index(struct d3d12_pipeline_library_map *map,
+        const struct vkd3d_serialized_pipeline_toc_entry *entries, size_t entries_count,
         const uint8_t *serialized_data_base, size_t serialized_data_size,
         const uint8_t **inout_name_table)
 {
     const uint8_t *name_table = *inout_name_table;
-    uint32_t i;
+    struct d3d12_pipeline_library_lazy_entry *lazy;
+    struct d3d12_pipeline_library_map_shard *shard;
+    struct vkd3d_cached_pipeline_entry candidate;
+    struct vkd3d_cached_pipeline_key key;
+    size_t name_size, lazy_count = 0;
+    bool duplicate;
+    uint32_t i, j;
+
+    if (!entries_count)
+        return S_OK;
+
+    /* The application is not allowed to free the blob, so we can point straight into it.
+     * Only keys are looked at here, everything else is deferred until the entry is requested. */
+    if (!(map->lazy_index = vkd3d_malloc(entries_count * sizeof(*map->lazy_index))))
+        return E_OUTOFMEMORY;
+
+    map->lazy_toc_entries = entries;
+    map->lazy_data = serialized_data_base;
 
-    /* The application is not allowed to free the blob, so we
-     * can safely use pointers without copying the data first. */
     for (i = 0; i < entries_count; i++)
     {
-        const struct vkd3d_serialized_pipeline_toc_entry *toc_entry = &entries[i];
-        struct vkd3d_cached_pipeline_entry entry;
+        name_size = entries[i].name_length ? entries[i].name_length : sizeof(key.internal_key_hash);
 
-        entry.key.name_length = toc_entry->name_length;
+        /* Verify that name table entry does not overflow. */
+        if (name_table + name_size > serialized_data_base + serialized_data_size)
+            return E_INVALIDARG;
 
-        if (entry.key.name_length)
-        {
-            entry.key.name = name_table;
-            entry.key.internal_key_hash = 0;
-            /* Verify that name table entry does not overflow. */
-            if (name_table + entry.key.name_length > serialized_data_base + serialized_data_size)
-                return E_INVALIDARG;
-            name_table += entry.key.name_length;
-        }
-        else
+        /* The blob itself is not touched until the entry is requested, but an entry which can
+         * never be materialized must not be counted as pending, so drop it here. */
+        if (entries[i].blob_offset + entries[i].blob_length > serialized_data_size)
         {
-            entry.key.name = NULL;
-            entry.key.internal_key_hash = 0;
-            /* Verify that name table entry does not overflow. */
-            if (name_table + sizeof(entry.key.internal_key_hash) > serialized_data_base + serialized_data_size)
-                return E_INVALIDARG;
-            memcpy(&entry.key.internal_key_hash, name_table, sizeof(entry.key.internal_key_hash));
-            name_table += sizeof(entry.key.internal_key_hash);
+            WARN("Pipeline library entry %u overflows the blob, ignoring.\n", i);
+            name_table += name_size;
+            continue;
         }
 
-        /* Verify that blob entry does not overflow. */
-        if (toc_entry->blob_offset + toc_entry->blob_length > serialized_data_size)
-            return E_INVALIDARG;
+        lazy = &map->lazy_index[lazy_count++];
+        lazy->toc_index = i;
+        lazy->name = name_table;
+        d3d12_pipeline_library_lazy_entry_get_key(map, lazy, &key);
+        lazy->hash = d3d12_pipeline_library_map_hash_key(map, &key);
+        name_table += name_size;
+    }
 
-        entry.data.blob_length = toc_entry->blob_length;
-        entry.data.blob = serialized_data_base + toc_entry->blob_offset;
-        entry.data.is_new = 0;
-        entry.data.state = NULL;
+    /* Sorting by hash also groups entries by shard, since the shard is picked from the top bits. */
+    qsort(map->lazy_index, lazy_count, sizeof(*map->lazy_index), d3d12_pipeline_library_lazy_entry_compare);
 
-        if (!d3d12_pipeline_library_insert_hash_map_blob_locked(pipeline_library, map, &entry))
-            return E_OUTOFMEMORY;
+    for (i = 0; i < lazy_count; i++)
+    {
+        lazy = &map->lazy_index[i];
+        shard = &map->shards[d3d12_pipeline_library_map_get_shard_index(lazy->hash)];
+        if (!shard->lazy_entries)
+            shard->lazy_entries = lazy;
+        shard->lazy_count++;
+
+        /* Lookups only ever resolve to the first entry with a given key,
+         * so later duplicates are never materialized and must not be counted as pending. */
+        d3d12_pipeline_library_lazy_entry_get_key(map, lazy, &key);
+        duplicate = false;
+        for (j = i; j && map->lazy_index[j - 1].hash == lazy->hash && !duplicate; j--)
+        {
+            d3d12_pipeline_library_lazy_entry_get_key(map, &map->lazy_index[j - 1], &candidate.key);
+            duplicate = shard->map.compare_func(&key, &candidate.entry);
+        }
+
+        if (!duplicate)
+            shard->lazy_pending_count++;
     }
 
     *inout_name_table = name_table;
@@ -2157,38 +2429,118 @@ static HRESULT d3d12_pipeline_library_validate_stream_format_header(struct d3d12
     return S_OK;
 }
 
+/* Validating checksums is by far the most expensive part of loading a large stream archive,
+ * so it is split across threads. Entries are handed out in small batches to balance
+ * out the large variance in blob sizes. Insertion into the hash maps remains serial. */
+#define VKD3D_STREAM_ARCHIVE_VALIDATE_BATCH_SIZE 64
+#define VKD3D_STREAM_ARCHIVE_MAX_VALIDATE_THREADS 8
+#define VKD3D_STREAM_ARCHIVE_PARALLEL_VALIDATE_THRESHOLD 1024
+
+struct d3d12_pipeline_library_stream_validate_context
+{
+    struct d3d12_pipeline_library *pipeline_library;
+    const struct vkd3d_serialized_pipeline_stream_entry **entries;
+    uint8_t *valid;
+    uint32_t entry_count;
+    uint32_t next_entry;
+};
+
+static void *d3d12_pipeline_library_stream_validate_main(void *userdata)
+{
+    struct d3d12_pipeline_library_stream_validate_context *ctx = userdata;
+    uint32_t begin, end, i;
+
+    for (;;)
+    {
+        /* Invalid entries past a cancellation point are treated as the end of the archive. */
+        if (vkd3d_atomic_uint32_load_explicit(&ctx->pipeline_library->stream_archive_cancellation_point,
+                vkd3d_memory_order_relaxed))
+            break;
+
+        begin = vkd3d_atomic_uint32_add(&ctx->next_entry, VKD3D_STREAM_ARCHIVE_VALIDATE_BATCH_SIZE,
+                vkd3d_memory_order_relaxed) - VKD3D_STREAM_ARCHIVE_VALIDATE_BATCH_SIZE;
+        if (begin >= ctx->entry_count)
+            break;
+
+        end = min(begin + VKD3D_STREAM_ARCHIVE_VALIDATE_BATCH_SIZE, ctx->entry_count);
+        for (i = begin; i < end; i++)
+            ctx->valid[i] = vkd3d_serialized_pipeline_stream_entry_validate(ctx->entries[i]->data, ctx->entries[i]);
+    }
+
+    return NULL;
+}
+
+static unsigned int d3d12_pipeline_library_validate_stream_entries(struct d3d12_pipeline_library *pipeline_library,
+        const struct vkd3d_serialized_pipeline_stream_entry **entries, uint8_t *valid, uint32_t entry_count)
+{
+    pthread_t threads[VKD3D_STREAM_ARCHIVE_MAX_VALIDATE_THREADS - 1];
+    struct d3d12_pipeline_library_stream_validate_context ctx;
+    unsigned int thread_count = 0, max_threads, i;
+
+    ctx.pipeline_library = pipeline_library;
+    ctx.entries = entries;
+    ctx.valid = valid;
+    ctx.entry_count = entry_count;
+    ctx.next_entry = 0;
+
+    max_threads = 1;
+    if (entry_count >= VKD3D_STREAM_ARCHIVE_PARALLEL_VALIDATE_THRESHOLD)
+        max_threads = min(vkd3d_get_cpu_count(), VKD3D_STREAM_ARCHIVE_MAX_VALIDATE_THREADS);
+
+    /* The calling thread participates as well. */
+    for (i = 0; i + 1 < max_threads; i++)
+    {
+        if (pthread_create(&threads[thread_count], NULL, d3d12_pipeline_library_stream_validate_main, &ctx))
+        {
+            WARN("Failed to create stream archive validation thread.\n");
+            break;
+        }
+        thread_count++;
+    }
+
+    d3d12_pipeline_library_stream_validate_main(&ctx);
+
+    for (i = 0; i < thread_count; i++)
+        pthread_join(threads[i], NULL);
+
+    return thread_count + 1;
+}
+
 static HRESULT d3d12_pipeline_library_read_blob_stream_format(struct d3d12_pipeline_library *pipeline_library,
         struct d3d12_device *device, const void *blob, size_t blob_length)
 {
     const struct vkd3d_serialized_pipeline_library_stream *header = blob;
+    const struct vkd3d_serialized_pipeline_stream_entry **entry_list = NULL;
     const struct vkd3d_serialized_pipeline_stream_entry *entries;
+    uint64_t begin_ts, validate_ts, insert_ts;
+    struct vkd3d_serialized_pipeline_variant variant;
     struct vkd3d_cached_pipeline_entry entry;
     uint64_t blob_length_saved = blob_length;
+    unsigned int validate_thread_count;
     uint32_t driver_cache_count = 0;
+    uint32_t variant_count = 0;
     uint32_t pipeline_count = 0;
+    size_t entry_list_size = 0;
     bool early_teardown = false;
+    uint32_t entry_count = 0;
     uint32_t spirv_count = 0;
+    uint8_t *valid = NULL;
     uint32_t aligned_size;
-    struct hash_map *map;
+    struct d3d12_pipeline_library_map *map;
+    uint32_t i;
     HRESULT hr;
 
     if (FAILED(hr = d3d12_pipeline_library_validate_stream_format_header(pipeline_library, device, blob, blob_length)))
         return hr;
 
+    begin_ts = vkd3d_get_current_time_ns();
+
     entries = (const struct vkd3d_serialized_pipeline_stream_entry *)header->entries;
     blob_length -= offsetof(struct vkd3d_serialized_pipeline_library_stream, entries);
 
+    /* Walking the entry headers is cheap, so gather them up front to be able to validate in parallel. */
     while (blob_length >= sizeof(*entries))
     {
-        /* Parsing this can take a long time. Tear down as quick as we can. */
-        if (vkd3d_atomic_uint32_load_explicit(&pipeline_library->stream_archive_cancellation_point,
-                vkd3d_memory_order_relaxed))
-        {
-            INFO("Device teardown request received, stopping parse early.\n");
-            early_teardown = true;
-            break;
-        }
-
         blob_length -= sizeof(*entries);
         aligned_size = align(entries->size, VKD3D_PIPELINE_BLOB_ALIGN);
 
@@ -2199,12 +2551,45 @@ static HRESULT d3d12_pipeline_library_read_blob_stream_format(struct d3d12_pipel
             break;
         }
 
-        if (!vkd3d_serialized_pipeline_stream_entry_validate(entries->data, entries))
+        if (!vkd3d_array_reserve((void **)&entry_list, &entry_list_size, entry_count + 1, sizeof(*entry_list)))
         {
-            INFO("Corrupt stream cache entry detected. Ignoring rest of archive.\n");
+            vkd3d_free(entry_list);
+            return E_OUTOFMEMORY;
+        }
+
+        entry_list[entry_count++] = entries;
+        blob_length -= aligned_size;
+        entries = (const struct vkd3d_serialized_pipeline_stream_entry *)&entries->data[aligned_size];
+    }
+
+    if (entry_count && !(valid = vkd3d_calloc(entry_count, sizeof(*valid))))
+    {
+        vkd3d_free(entry_list);
+        return E_OUTOFMEMORY;
+    }
+
+    validate_thread_count = d3d12_pipeline_library_validate_stream_entries(pipeline_library,
+            entry_list, valid, entry_count);
+    validate_ts = vkd3d_get_current_time_ns();
+
+    for (i = 0; i < entry_count; i++)
+    {
+        /* Parsing this can take a long time. Tear down as quick as we can. */
+        if (vkd3d_atomic_uint32_load_explicit(&pipeline_library->stream_archive_cancellation_point,
+                vkd3d_memory_order_relaxed))
+        {
+            INFO("Device teardown request received, stopping parse early.\n");
+            early_teardown = true;
             break;
         }
 
+        entries = entry_list[i];
+
+        if (!valid[i])
+        {
+            INFO("Corrupt stream cache entry detected. Ignoring rest of archive.\n");
+            break;
+        }
         entry.key.name_length = 0;
         entry.key.name = NULL;
         entry.key.internal_key_hash = entries->hash;
@@ -2213,9 +2598,11 @@ static HRESULT d3d12_pipeline_library_read_blob_stream_format(struct d3d12_pipel
         /* The read-only portion of the stream archive is backed by mmap so we avoid committing too much memory.
          * Similar idea as normal application pipeline libraries. */
         entry.data.is_new = 0;
+        entry.data.is_compressed = !!(entries->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED);
+        entry.data.decompressed_blob = NULL;
         entry.data.state = NULL;
 
-        switch (entries->type)
+        switch (vkd3d_serialized_pipeline_stream_entry_get_type(entries))
         {
             case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV:
                 map = &pipeline_library->spirv_cache_map;
@@ -2232,8 +2619,28 @@ static HRESULT d3d12_pipeline_library_read_blob_stream_format(struct d3d12_pipel
                 pipeline_count++;
                 break;
 
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT:
+                /* Variant records are tiny and are not blobs in their own right, so copy them out. */
+                map = NULL;
+                if (entries->size == sizeof(variant))
+                {
+                    memcpy(&variant, entries->data, sizeof(variant));
+                    if (pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE_PARSE_ASYNC)
+                        rwlock_lock_write(&pipeline_library->mutex);
+                    if (d3d12_pipeline_library_insert_variant_locked(pipeline_library, &variant))
+                        variant_count++;
+                    if (pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE_PARSE_ASYNC)
+                        rwlock_unlock_write(&pipeline_library->mutex);
+                }
+                break;
+
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE:
+                /* Only present if a write cache was promoted as-is, nothing to load. */
+                map = NULL;
+                break;
+
             default:
-                FIXME("Unrecognized type %u.\n", entries->type);
+                FIXME("Unrecognized type %u.\n", vkd3d_serialized_pipeline_stream_entry_get_type(entries));
                 map = NULL;
                 break;
         }
@@ -2244,38 +2651,36 @@ static HRESULT d3d12_pipeline_library_read_blob_stream_format(struct d3d12_pipel
              * might be busy trying to create pipelines at this time.
              * If we're parsing at device init, we don't need to lock. */
             if (pipeline_library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE_PARSE_ASYNC)
-            {
-                if (entries->type == VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE)
-                {
-                    /* Pipeline entries are handled with the main mutex. */
-                    rwlock_lock_write(&pipeline_library->mutex);
-                    d3d12_pipeline_library_insert_hash_map_blob_locked(pipeline_library, map, &entry);
-                    rwlock_unlock_write(&pipeline_library->mutex);
-                }
-                else
-                {
-                    /* Non-PSO caches use the internal lock implicitly here. */
-                    d3d12_pipeline_library_insert_hash_map_blob_internal(pipeline_library, map, &entry);
-                }
-            }
+                d3d12_pipeline_library_map_insert(map, &entry);
             else
-                d3d12_pipeline_library_insert_hash_map_blob_locked(pipeline_library, map, &entry);
+                d3d12_pipeline_library_map_insert_locked(map, &entry);
         }
-
-        blob_length -= aligned_size;
-        entries = (const struct vkd3d_serialized_pipeline_stream_entry *)&entries->data[aligned_size];
     }
 
+    insert_ts = vkd3d_get_current_time_ns();
+
+    vkd3d_free(entry_list);
+    vkd3d_free(valid);
+
     if (!early_teardown && (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG))
     {
+        if (entry_count)
+        {
+            INFO("Stream archive: %u entries, validation took %.3f ms on %u threads, insertion took %.3f ms.\n",
+                    entry_count, 1e-6 * (double)(validate_ts - begin_ts), validate_thread_count,
+                    1e-6 * (double)(insert_ts - validate_ts));
+        }
+
         INFO("Loading stream pipeline library (%"PRIu64" bytes):\n"
                 "  D3D12 PSO count: %u\n"
                 "  Unique SPIR-V count: %u\n"
-                "  Unique VkPipelineCache count: %u\n",
+                "  Unique VkPipelineCache count: %u\n"
+                "  Pipeline variant count: %u\n",
                 blob_length_saved,
                 pipeline_count,
                 spirv_count,
-                driver_cache_count);
+                driver_cache_count,
+                variant_count);
     }
 
     return S_OK;
@@ -2366,23 +2771,20 @@ static HRESULT d3d12_pipeline_library_read_blob_toc_format(struct d3d12_pipeline
 
     i = 0;
 
-    if (FAILED(hr = d3d12_pipeline_library_unserialize_hash_map(pipeline_library,
-            &header->entries[i], header->spirv_count,
-            &pipeline_library->spirv_cache_map, serialized_data_base, serialized_data_size,
+    if (FAILED(hr = d3d12_pipeline_library_map_init_lazy_index(&pipeline_library->spirv_cache_map,
+            &header->entries[i], header->spirv_count, serialized_data_base, serialized_data_size,
             &name_table)))
         return hr;
     i += header->spirv_count;
 
-    if (FAILED(hr = d3d12_pipeline_library_unserialize_hash_map(pipeline_library,
-            &header->entries[i], header->driver_cache_count,
-            &pipeline_library->driver_cache_map, serialized_data_base, serialized_data_size,
+    if (FAILED(hr = d3d12_pipeline_library_map_init_lazy_index(&pipeline_library->driver_cache_map,
+            &header->entries[i], header->driver_cache_count, serialized_data_base, serialized_data_size,
             &name_table)))
         return hr;
     i += header->driver_cache_count;
 
-    if (FAILED(hr = d3d12_pipeline_library_unserialize_hash_map(pipeline_library,
-            &header->entries[i], header->pipeline_count,
-            &pipeline_library->pso_map, serialized_data_base, serialized_data_size,
+    if (FAILED(hr = d3d12_pipeline_library_map_init_lazy_index(&pipeline_library->pso_map,
+            &header->entries[i], header->pipeline_count, serialized_data_base, serialized_data_size,
             &name_table)))
         return hr;
     i += header->pipeline_count;
@@ -2443,22 +2845,32 @@ static HRESULT d3d12_pipeline_library_init(struct d3d12_pipeline_library *pipeli
     if ((rc = rwlock_init(&pipeline_library->mutex)))
         return hresult_from_errno(rc);
 
-    if ((rc = rwlock_init(&pipeline_library->internal_hashmap_mutex)))
+    internal_keys = !!(flags & VKD3D_PIPELINE_LIBRARY_FLAG_INTERNAL_KEYS);
+
+    if ((rc = d3d12_pipeline_library_map_init(&pipeline_library->spirv_cache_map,
+            vkd3d_cached_pipeline_hash_internal, vkd3d_cached_pipeline_compare_internal)))
     {
-        rwlock_destroy(&pipeline_library->mutex);
-        return hresult_from_errno(rc);
+        hr = hresult_from_errno(rc);
+        goto cleanup_mutex;
     }
 
-    internal_keys = !!(flags & VKD3D_PIPELINE_LIBRARY_FLAG_INTERNAL_KEYS);
+    if ((rc = d3d12_pipeline_library_map_init(&pipeline_library->driver_cache_map,
+            vkd3d_cached_pipeline_hash_internal, vkd3d_cached_pipeline_compare_internal)))
+    {
+        hr = hresult_from_errno(rc);
+        goto cleanup_spirv_map;
+    }
 
-    hash_map_init(&pipeline_library->spirv_cache_map, vkd3d_cached_pipeline_hash_internal,
-            vkd3d_cached_pipeline_compare_internal, sizeof(struct vkd3d_cached_pipeline_entry));
-    hash_map_init(&pipeline_library->driver_cache_map, vkd3d_cached_pipeline_hash_internal,
-            vkd3d_cached_pipeline_compare_internal, sizeof(struct vkd3d_cached_pipeline_entry));
-    hash_map_init(&pipeline_library->pso_map,
+    if ((rc = d3d12_pipeline_library_map_init(&pipeline_library->pso_map,
             internal_keys ? vkd3d_cached_pipeline_hash_internal : vkd3d_cached_pipeline_hash_name,
-            internal_keys ? vkd3d_cached_pipeline_compare_internal : vkd3d_cached_pipeline_compare_name,
-            sizeof(struct vkd3d_cached_pipeline_entry));
+            internal_keys ? vkd3d_cached_pipeline_compare_internal : vkd3d_cached_pipeline_compare_name)))
+    {
+        hr = hresult_from_errno(rc);
+        goto cleanup_driver_cache_map;
+    }
+
+    hash_map_init(&pipeline_library->pso_variant_map, vkd3d_pipeline_variant_list_hash,
+            vkd3d_pipeline_variant_list_compare, sizeof(struct vkd3d_pipeline_variant_list));
 
     if (blob_length)
     {
@@ -2481,15 +2893,18 @@ static HRESULT d3d12_pipeline_library_init(struct d3d12_pipeline_library *pipeli
         INFO("Creating empty pipeline library.\n");
 
     if (FAILED(hr = vkd3d_private_store_init(&pipeline_library->private_store)))
-        goto cleanup_mutex;
+        goto cleanup_hash_map;
 
     d3d12_device_add_ref(pipeline_library->device = device);
     return hr;
 
 cleanup_hash_map:
-    hash_map_clear(&pipeline_library->pso_map);
-    hash_map_clear(&pipeline_library->spirv_cache_map);
-    hash_map_clear(&pipeline_library->driver_cache_map);
+    d3d12_pipeline_library_cleanup_variant_map(&pipeline_library->pso_variant_map);
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->pso_map);
+cleanup_driver_cache_map:
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->driver_cache_map);
+cleanup_spirv_map:
+    d3d12_pipeline_library_map_cleanup(&pipeline_library->spirv_cache_map);
 cleanup_mutex:
     rwlock_destroy(&pipeline_library->mutex);
     return hr;
@@ -2651,8 +3066,8 @@ void vkd3d_pipeline_cache_compat_from_state_desc(struct vkd3d_pipeline_cache_com
     {
         if (code_list[i]->BytecodeLength)
         {
-            const struct vkd3d_shader_code dxbc = { code_list[i]->pShaderBytecode, code_list[i]->BytecodeLength };
-            compat->dxbc_blob_hashes[output_index] = vkd3d_shader_hash(&dxbc);
+            compat->dxbc_blob_hashes[output_index] = vkd3d_hash64(code_list[i]->pShaderBytecode,
+                    code_list[i]->BytecodeLength);
             compat->dxbc_blob_hashes[output_index] = hash_fnv1_iterate_u8(compat->dxbc_blob_hashes[output_index], i);
             output_index++;
         }
@@ -2672,15 +3087,78 @@ static uint64_t vkd3d_pipeline_cache_compatibility_condense(const struct vkd3d_p
     return h;
 }
 
+static HRESULT vkd3d_pipeline_library_disk_cache_save_pipeline_use(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_pipeline_library_disk_cache_item *item)
+{
+    struct vkd3d_serialized_pipeline_entry entry;
+
+    /* Only the disk thread touches this map. One record per PSO is enough to refresh its LRU epoch. */
+    entry.key.hash = item->use_hash;
+    entry.key.type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE;
+    if (hash_map_find(&cache->used_pipeline_map, &entry.key))
+        return E_INVALIDARG;
+    if (!hash_map_insert(&cache->used_pipeline_map, &entry.key, &entry.entry))
+        return E_OUTOFMEMORY;
+
+    vkd3d_pipeline_library_disk_cache_notify_blob_insert(cache, item->use_hash,
+            VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE, NULL, 0);
+    return S_OK;
+}
+
+static HRESULT vkd3d_pipeline_library_disk_cache_save_pipeline_variant(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_pipeline_library_disk_cache_item *item)
+{
+    struct d3d12_pipeline_library *library = cache->library;
+    struct vkd3d_serialized_pipeline_variant variant;
+    bool is_new;
+    int rc;
+
+    memset(&variant, 0, sizeof(variant));
+    variant.pso_hash = vkd3d_pipeline_cache_compatibility_condense(&item->state->pipeline_cache_compat);
+    variant.desc = item->variant;
+
+    if ((rc = rwlock_lock_write(&library->mutex)))
+    {
+        ERR("Failed to lock mutex, rc %d.\n", rc);
+        return hresult_from_errno(rc);
+    }
+
+    is_new = d3d12_pipeline_library_insert_variant_locked(library, &variant);
+    rwlock_unlock_write(&library->mutex);
+
+    /* Duplicates are expected if multiple threads hit the same variant. */
+    if (!is_new)
+        return E_INVALIDARG;
+
+    if (library->disk_cache_listener)
+    {
+        vkd3d_pipeline_library_disk_cache_notify_blob_insert(library->disk_cache_listener,
+                vkd3d_serialized_pipeline_variant_hash(&variant),
+                VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT,
+                &variant, sizeof(variant));
+    }
+
+    return S_OK;
+}
+
+#define VKD3D_PIPELINE_LIBRARY_DISK_CACHE_INITIAL_SERIALIZE_SIZE (64 * 1024)
+
 static HRESULT vkd3d_pipeline_library_disk_cache_save_pipeline_state(struct vkd3d_pipeline_library_disk_cache *cache,
         const struct vkd3d_pipeline_library_disk_cache_item *item)
 {
     struct d3d12_pipeline_library *library = cache->library;
+    struct d3d12_pipeline_library_map_shard *shard;
     struct vkd3d_cached_pipeline_entry entry;
     void *new_blob;
+    bool exists;
     VkResult vr;
     int rc;
 
+    if (!item->state)
+        return vkd3d_pipeline_library_disk_cache_save_pipeline_use(cache, item);
+    if (item->is_variant)
+        return vkd3d_pipeline_library_disk_cache_save_pipeline_variant(cache, item);
+
     /* Try to avoid taking writer locks until we're absolutely forced to.
      * It's fairly likely we'll see duplicates here, so we should avoid stalling
      * when multiple threads are hammering us with PSO creation. */
@@ -2688,65 +3166,74 @@ static HRESULT vkd3d_pipeline_library_disk_cache_save_pipeline_state(struct vkd3
     entry.key.name_length = 0;
     entry.key.name = NULL;
     entry.key.internal_key_hash = vkd3d_pipeline_cache_compatibility_condense(&item->state->pipeline_cache_compat);
+    shard = d3d12_pipeline_library_map_get_shard(&library->pso_map, &entry.key);
 
-    if ((rc = rwlock_lock_read(&library->mutex)))
+    if ((rc = rwlock_lock_read(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         return hresult_from_errno(rc);
     }
 
-    if (hash_map_find(&library->pso_map, &entry.key))
-    {
-        /* This could happen if a parallel thread tried to create the same PSO.
-         * In a single threaded scenario we would find the PSO when creating the PSO,
-         * and we would never try to enter this path. */
-        rwlock_unlock_read(&library->mutex);
+    exists = !!hash_map_find(&shard->map, &entry.key);
+    rwlock_unlock_read(&shard->lock);
+
+    /* This could happen if a parallel thread tried to create the same PSO.
+     * In a single threaded scenario we would find the PSO when creating the PSO,
+     * and we would never try to enter this path. */
+    if (exists)
         return E_INVALIDARG;
-    }
 
-    if (FAILED(vr = vkd3d_serialize_pipeline_state(library, item->state, &entry.data.blob_length, NULL)))
+    /* Serialize into scratch memory in one pass. Only a PSO larger than anything we've seen so far
+     * needs a second attempt. No map lock is held here, so other threads can keep looking up
+     * and inserting pipelines while we serialize. */
+    if (!vkd3d_array_reserve((void **)&cache->serialize_buffer, &cache->serialize_buffer_size,
+            VKD3D_PIPELINE_LIBRARY_DISK_CACHE_INITIAL_SERIALIZE_SIZE, sizeof(*cache->serialize_buffer)))
+        return E_OUTOFMEMORY;
+
+    entry.data.blob_length = cache->serialize_buffer_size;
+    if ((vr = vkd3d_serialize_pipeline_state(library, item->state,
+            &entry.data.blob_length, cache->serialize_buffer)) == VK_INCOMPLETE)
     {
-        rwlock_unlock_read(&library->mutex);
-        return hresult_from_vk_result(vr);
+        if (!vkd3d_array_reserve((void **)&cache->serialize_buffer, &cache->serialize_buffer_size,
+                entry.data.blob_length, sizeof(*cache->serialize_buffer)))
+            return E_OUTOFMEMORY;
+
+        entry.data.blob_length = cache->serialize_buffer_size;
+        vr = vkd3d_serialize_pipeline_state(library, item->state, &entry.data.blob_length, cache->serialize_buffer);
     }
 
+    if (vr != VK_SUCCESS)
+        return vr == VK_INCOMPLETE ? E_FAIL : hresult_from_vk_result(vr);
+
+    /* The map entry outlives this batch, so it needs its own copy. */
     if (!(new_blob = vkd3d_malloc(entry.data.blob_length)))
-    {
-        rwlock_unlock_read(&library->mutex);
         return E_OUTOFMEMORY;
-    }
-
-    if (FAILED(vr = vkd3d_serialize_pipeline_state(library, item->state, &entry.data.blob_length, new_blob)))
-    {
-        vkd3d_free(new_blob);
-        rwlock_unlock_read(&library->mutex);
-        return hresult_from_vk_result(vr);
-    }
+    memcpy(new_blob, cache->serialize_buffer, entry.data.blob_length);
 
     entry.data.blob = new_blob;
     entry.data.is_new = 1;
+    entry.data.is_compressed = 0;
+    entry.data.decompressed_blob = NULL;
     /* We cannot hand the same object out again, since this is not part of the ID3D12PipelineLibrary interface. */
     entry.data.state = NULL;
 
-    /* Now is the time to promote to a writer lock. */
-    rwlock_unlock_read(&library->mutex);
-
-    if ((rc = rwlock_lock_write(&library->mutex)))
+    /* Now is the time to take the writer lock. */
+    if ((rc = rwlock_lock_write(&shard->lock)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
         vkd3d_free(new_blob);
         return hresult_from_errno(rc);
     }
 
-    if (!d3d12_pipeline_library_insert_hash_map_blob_locked(library, &library->pso_map, &entry))
+    if (!d3d12_pipeline_library_map_shard_insert_locked(shard, &entry))
     {
         /* Found duplicate. */
         vkd3d_free(new_blob);
-        rwlock_unlock_write(&library->mutex);
+        rwlock_unlock_write(&shard->lock);
         return E_OUTOFMEMORY;
     }
 
-    rwlock_unlock_write(&library->mutex);
+    rwlock_unlock_write(&shard->lock);
 
     if (library->disk_cache_listener)
     {
@@ -2769,6 +3256,7 @@ HRESULT vkd3d_pipeline_library_store_pipeline_to_disk_cache(
     vkd3d_array_reserve((void**)&cache->items, &cache->items_size,
             cache->items_count + 1, sizeof(*cache->items));
     cache->items[cache->items_count].state = state;
+    cache->items[cache->items_count].is_variant = false;
     cache->items_count++;
     condvar_reltime_signal(&cache->cond);
     pthread_mutex_unlock(&cache->lock);
@@ -2776,112 +3264,270 @@ HRESULT vkd3d_pipeline_library_store_pipeline_to_disk_cache(
     return S_OK;
 }
 
-HRESULT vkd3d_pipeline_library_find_cached_blob_from_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
-        const struct vkd3d_pipeline_cache_compatibility *compat,
-        struct d3d12_cached_pipeline_state *cached_state)
+HRESULT vkd3d_pipeline_library_store_pipeline_variant_to_disk_cache(
+        struct vkd3d_pipeline_library_disk_cache *cache,
+        struct d3d12_pipeline_state *state, const struct vkd3d_pipeline_variant_desc *variant)
+{
+    /* Variants are recorded from draw time, so defer all work to the disk thread. */
+    d3d12_pipeline_state_inc_ref(state);
+    pthread_mutex_lock(&cache->lock);
+    vkd3d_array_reserve((void**)&cache->items, &cache->items_size,
+            cache->items_count + 1, sizeof(*cache->items));
+    cache->items[cache->items_count].state = state;
+    cache->items[cache->items_count].is_variant = true;
+    cache->items[cache->items_count].variant = *variant;
+    cache->items_count++;
+    condvar_reltime_signal(&cache->cond);
+    pthread_mutex_unlock(&cache->lock);
+
+    return S_OK;
+}
+
+static void vkd3d_pipeline_library_disk_cache_record_use(struct vkd3d_pipeline_library_disk_cache *cache,
+        uint64_t hash)
+{
+    pthread_mutex_lock(&cache->lock);
+    vkd3d_array_reserve((void**)&cache->items, &cache->items_size,
+            cache->items_count + 1, sizeof(*cache->items));
+    cache->items[cache->items_count].state = NULL;
+    cache->items[cache->items_count].is_variant = false;
+    cache->items[cache->items_count].use_hash = hash;
+    cache->items_count++;
+    condvar_reltime_signal(&cache->cond);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+size_t vkd3d_pipeline_library_find_variants_from_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_pipeline_cache_compatibility *compat, struct vkd3d_pipeline_variant_desc **variants)
 {
     struct d3d12_pipeline_library *library = cache->library;
-    const struct vkd3d_cached_pipeline_entry *e;
-    struct vkd3d_cached_pipeline_key key;
+    const struct vkd3d_pipeline_variant_list *list;
+    size_t count = 0;
+    uint64_t hash;
     int rc;
 
+    *variants = NULL;
+    hash = vkd3d_pipeline_cache_compatibility_condense(compat);
+
     if ((rc = rwlock_lock_read(&library->mutex)))
     {
         ERR("Failed to lock mutex, rc %d.\n", rc);
-        return hresult_from_errno(rc);
+        return 0;
     }
 
-    key.name_length = 0;
-    key.name = NULL;
-    key.internal_key_hash = vkd3d_pipeline_cache_compatibility_condense(compat);
-
-    if (!(e = (const struct vkd3d_cached_pipeline_entry*)hash_map_find(&library->pso_map, &key)))
+    if ((list = (const struct vkd3d_pipeline_variant_list *)hash_map_find(&library->pso_variant_map, &hash)) &&
+            list->variant_count && (*variants = vkd3d_malloc(list->variant_count * sizeof(**variants))))
     {
-        rwlock_unlock_read(&library->mutex);
-        return E_INVALIDARG;
+        memcpy(*variants, list->variants, list->variant_count * sizeof(**variants));
+        count = list->variant_count;
     }
 
-    cached_state->blob.CachedBlobSizeInBytes = e->data.blob_length;
-    cached_state->blob.pCachedBlob = e->data.blob;
-    cached_state->library = library;
     rwlock_unlock_read(&library->mutex);
-    return S_OK;
+    return count;
 }
 
-static void *vkd3d_pipeline_library_disk_thread_main(void *userarg);
-
-struct disk_cache_entry_key
+HRESULT vkd3d_pipeline_library_find_cached_blob_from_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_pipeline_cache_compatibility *compat,
+        struct d3d12_cached_pipeline_state *cached_state)
 {
-    uint64_t hash;
-    enum vkd3d_serialized_pipeline_stream_entry_type type;
-};
+    struct d3d12_pipeline_library *library = cache->library;
+    struct d3d12_pipeline_library_map_shard *shard;
+    const struct vkd3d_cached_pipeline_entry *e;
+    struct vkd3d_cached_pipeline_key key;
+    size_t blob_length;
+    const void *blob;
+    bool from_archive;
+    int rc;
+
+    key.name_length = 0;
+    key.name = NULL;
+    key.internal_key_hash = vkd3d_pipeline_cache_compatibility_condense(compat);
+    shard = d3d12_pipeline_library_map_get_shard(&library->pso_map, &key);
+
+    if ((rc = rwlock_lock_read(&shard->lock)))
+    {
+        ERR("Failed to lock mutex, rc %d.\n", rc);
+        return hresult_from_errno(rc);
+    }
+
+    if (!(e = (const struct vkd3d_cached_pipeline_entry*)hash_map_find(&shard->map, &key)))
+    {
+        rwlock_unlock_read(&shard->lock);
+        return E_INVALIDARG;
+    }
+
+    if (!vkd3d_cached_pipeline_entry_get_blob(e, &blob, &blob_length))
+    {
+        rwlock_unlock_read(&shard->lock);
+        return E_INVALIDARG;
+    }
+
+    cached_state->blob.CachedBlobSizeInBytes = blob_length;
+    cached_state->blob.pCachedBlob = blob;
+    cached_state->library = library;
+    from_archive = !e->data.is_new;
+    rwlock_unlock_read(&shard->lock);
+
+    /* Keep the entry from being evicted as least recently used. New entries are written out anyway. */
+    if (from_archive)
+        vkd3d_pipeline_library_disk_cache_record_use(cache, key.internal_key_hash);
+
+    return S_OK;
+}
+
+static void *vkd3d_pipeline_library_disk_thread_main(void *userarg);
 
-struct disk_cache_entry
+struct vkd3d_pipeline_library_disk_cache_shards
 {
-    struct hash_map_entry entry;
-    struct disk_cache_entry_key key;
+    char (*paths)[VKD3D_PATH_MAX];
+    size_t count;
+    size_t size;
 };
 
-static uint32_t disk_cache_entry_key_cb(const void *key_)
+static void vkd3d_pipeline_library_disk_cache_add_shard_cb(const char *path, void *userdata)
 {
-    const struct disk_cache_entry_key *key = key_;
-    return hash_combine(hash_uint64(key->hash), key->type);
+    struct vkd3d_pipeline_library_disk_cache_shards *shards = userdata;
+    FILE *file;
+
+    /* A process holds a lock on its write cache until it exits.
+     * Shards which are still being written to are picked up by a later merge instead. */
+    if (!(file = fopen(path, "rb")))
+        return;
+
+    if (!vkd3d_file_try_lock_exclusive(file))
+    {
+        INFO("Write cache %s is in use by another process, skipping it.\n", path);
+        fclose(file);
+        return;
+    }
+
+    fclose(file);
+
+    if (!vkd3d_array_reserve((void **)&shards->paths, &shards->size, shards->count + 1, sizeof(*shards->paths)))
+        return;
+
+    strcpy(shards->paths[shards->count++], path);
 }
 
-static bool disk_cache_entry_compare_cb(const void *key, const struct hash_map_entry *entry)
+static bool vkd3d_pipeline_library_disk_cache_append_shard(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_memory_mapped_file *mapped_write_cache, FILE *merge_file,
+        struct hash_map *map, struct hash_map *used_pipelines, unsigned int *new_entries)
 {
-    const struct disk_cache_entry_key *new_key = key;
-    const struct disk_cache_entry_key *old_key = &((const struct disk_cache_entry *)entry)->key;
-    return new_key->hash == old_key->hash && new_key->type == old_key->type;
+    const struct vkd3d_serialized_pipeline_library_stream *write_cache_header;
+    const struct vkd3d_serialized_pipeline_stream_entry *write_entries;
+    struct vkd3d_serialized_pipeline_entry entry;
+    size_t write_cache_size;
+    size_t aligned_size;
+
+    write_cache_header = mapped_write_cache->mapped;
+    write_cache_size = mapped_write_cache->mapped_size;
+    write_entries = (const struct vkd3d_serialized_pipeline_stream_entry *)write_cache_header->entries;
+    write_cache_size -= sizeof(*write_cache_header);
+
+    while (write_cache_size >= sizeof(*write_entries))
+    {
+        /* Don't want to throw away the disk caches here. Try again next time. */
+        if (vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
+                vkd3d_memory_order_relaxed))
+        {
+            INFO("Device teardown request received, stopping parse early.\n");
+            return false;
+        }
+
+        write_cache_size -= sizeof(*write_entries);
+        aligned_size = align(write_entries->size, VKD3D_PIPELINE_BLOB_ALIGN);
+
+        if (write_cache_size < aligned_size)
+        {
+            INFO("Write-only archive entry is sliced. Ignoring rest of archive.\n");
+            break;
+        }
+
+        if (!vkd3d_serialized_pipeline_stream_entry_validate(write_entries->data, write_entries))
+        {
+            INFO("Found corrupt entry in write-only archive. Ignoring rest of archive.\n");
+            break;
+        }
+
+        entry.key.hash = write_entries->hash;
+        entry.key.type = vkd3d_serialized_pipeline_stream_entry_get_type(write_entries);
+
+        if (entry.key.type == VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE)
+        {
+            /* Goes into the LRU index rather than the archive. */
+            hash_map_insert(used_pipelines, &entry.key, &entry.entry);
+        }
+        else if (!hash_map_find(map, &entry.key) && hash_map_insert(map, &entry.key, &entry.entry))
+        {
+            if (fwrite(write_entries, sizeof(*write_entries), 1, merge_file) != 1 ||
+                    fwrite(write_entries->data, 1, aligned_size, merge_file) != aligned_size)
+            {
+                ERR("Failed to append blob to read-cache.\n");
+                break;
+            }
+            (*new_entries)++;
+        }
+
+        write_cache_size -= aligned_size;
+        write_entries = (const struct vkd3d_serialized_pipeline_stream_entry *)&write_entries->data[aligned_size];
+    }
+
+    return true;
 }
 
+static void vkd3d_pipeline_library_disk_cache_compact(struct vkd3d_pipeline_library_disk_cache *cache,
+        const char *read_path, const char *archive_path, const struct hash_map *used_pipelines);
+
+/* Folds all write caches into the read-only archive, and compacts the result.
+ * Recorded uses of archived PSOs are collected in used_pipelines. */
 static void vkd3d_pipeline_library_disk_cache_merge(struct vkd3d_pipeline_library_disk_cache *cache,
-        const char *read_path, const char *write_path)
+        const char *read_path, struct hash_map *used_pipelines)
 {
-    const struct vkd3d_serialized_pipeline_library_stream *write_cache_header;
-    const struct vkd3d_serialized_pipeline_stream_entry *write_entries;
+    struct vkd3d_pipeline_library_disk_cache_shards shards;
     struct vkd3d_serialized_pipeline_stream_entry stream_entry;
     struct vkd3d_serialized_pipeline_library_stream header;
     struct vkd3d_memory_mapped_file mapped_write_cache;
+    char shard_prefix[VKD3D_PATH_MAX];
     char merge_path[VKD3D_PATH_MAX];
     unsigned int existing_entries;
-    struct disk_cache_entry entry;
+    struct vkd3d_serialized_pipeline_entry entry;
     uint8_t *tmp_buffer = NULL;
     size_t tmp_buffer_size = 0;
     unsigned int new_entries;
-    size_t write_cache_size;
+    size_t first_shard = 0;
     struct hash_map map;
+    uint64_t begin_ts;
     size_t aligned_size;
     FILE *merge_file;
     int64_t off;
     HRESULT hr;
+    size_t i;
 
     memset(&mapped_write_cache, 0, sizeof(mapped_write_cache));
+    memset(&shards, 0, sizeof(shards));
     snprintf(merge_path, sizeof(merge_path), "%s.merge", read_path);
-    hash_map_init(&map, disk_cache_entry_key_cb, disk_cache_entry_compare_cb, sizeof(struct disk_cache_entry));
+    snprintf(shard_prefix, sizeof(shard_prefix), "%s.write", read_path);
+    hash_map_init(&map, vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct vkd3d_serialized_pipeline_entry));
     merge_file = NULL;
 
-    /* If we only have a write-only cache, but no read-only one, this will succeed.
-     * We're done. */
-    if (vkd3d_file_rename_no_replace(write_path, read_path))
-    {
-        INFO("Promoting write cache to read cache. No need to merge any disk caches.\n");
-        goto out;
-    }
+    /* Every process writes to its own <read_path>.write.<pid> shard.
+     * Older builds wrote a plain <read_path>.write, which shares the same prefix. */
+    vkd3d_file_enumerate_prefix(shard_prefix, vkd3d_pipeline_library_disk_cache_add_shard_cb, &shards);
 
-    /* We're going to fwrite the mapped data directly. */
-    if (!vkd3d_file_map_read_only(write_path, &mapped_write_cache))
+    if (!shards.count)
     {
         INFO("No write cache exists. No need to merge any disk caches.\n");
         goto out;
     }
 
-    /* If the write cache is out of date, just nuke it and move on. Nothing to do. */
-    if (FAILED(hr = d3d12_pipeline_library_validate_stream_format_header(cache->library,
-            cache->library->device, mapped_write_cache.mapped, mapped_write_cache.mapped_size)))
+    /* If we only have a write-only cache, but no read-only one, this will succeed.
+     * Any remaining shards are merged into the promoted cache.
+     * We still go through the merge path on our own, since the promoted cache needs compaction. */
+    if (vkd3d_file_rename_no_replace(shards.paths[0], read_path))
     {
-        INFO("Write cache is invalid (hr #%x), nuking it.\n", hr);
-        goto out;
+        first_shard = 1;
+        INFO("Promoting write cache to read cache.\n");
     }
 
     /* If we fail here, there is either a stale merge file lying around (which we will clean up at the end),
@@ -2889,158 +3535,167 @@ static void vkd3d_pipeline_library_disk_cache_merge(struct vkd3d_pipeline_librar
      * It is somewhat unpredictable what will happen with all the atomic renames and deletions in flight,
      * but we'll end up in a consistent state either way.
      * The expectation is that games are loaded with one instance. */
-    if (vkd3d_file_rename_no_replace(read_path, merge_path))
+    if (!vkd3d_file_rename_no_replace(read_path, merge_path))
+        goto out;
+
+    INFO("Merging %zu write caches.\n", shards.count - first_shard);
+    merge_file = fopen(merge_path, "rb+");
+
+    /* Shouldn't happen, but can happen if another process races us and deletes the merge file
+     * in the interim. */
+    if (!merge_file)
     {
-        INFO("Merging disk caches.\n");
-        merge_file = fopen(merge_path, "rb+");
+        INFO("Cannot re-open merge cache. Likely a race condition with multiple processes.\n");
+        goto out;
+    }
+
+    existing_entries = 0;
+    new_entries = 0;
 
-        /* Shouldn't happen, but can happen if another process races us and deletes the merge file
-         * in the interim. */
-        if (!merge_file)
+    /* If we have a read-only cache, atomically move to the merge path.
+     * If we win, the merge-only file is "owned" by this thread, and we consider it safe to append to it.
+     * Here, we will open the file in append mode, seek to the last whole blob entry,
+     * and then append the write-only shards. */
+
+    if (fread(&header, sizeof(header), 1, merge_file) != 1 ||
+            FAILED(hr = d3d12_pipeline_library_validate_stream_format_header(cache->library,
+                    cache->library->device, &header, sizeof(header))))
+    {
+        INFO("Read-only cache is out of date, discarding it.\n");
+        /* Start over with an empty archive. We still own the merge path. */
+        fclose(merge_file);
+        vkd3d_file_delete(merge_path);
+        if (!(merge_file = vkd3d_file_open_exclusive_write(merge_path)))
         {
-            INFO("Cannot re-open merge cache. Likely a race condition with multiple processes.\n");
+            INFO("Cannot re-create merge cache. Likely a race condition with multiple processes.\n");
             goto out;
         }
 
-        existing_entries = 0;
-        new_entries = 0;
-
-        /* If we have a read-only cache, atomically move to the merge path.
-         * If we win, the merge-only file is "owned" by this thread, and we consider it safe to append to it.
-         * Here, we will open the file in append mode, seek to the last whole blob entry,
-         * and then append the write-only portion. */
-
-        if (fread(&header, sizeof(header), 1, merge_file) != 1 ||
-                FAILED(hr = d3d12_pipeline_library_validate_stream_format_header(cache->library,
-                        cache->library->device, &header, sizeof(header))))
+        d3d12_pipeline_library_serialize_stream_archive_header(cache->library, &header);
+        if (fwrite(&header, sizeof(header), 1, merge_file) != 1)
         {
-            INFO("Read-only cache is out of date, discarding it.\n");
-            /* Just promote the write cache to read cache and call it a day. */
-            fclose(merge_file);
-            merge_file = NULL;
-            vkd3d_file_delete(merge_path);
-            if (vkd3d_file_rename_overwrite(write_path, read_path))
-                INFO("Successfully promoted write cache to read cache.\n");
+            ERR("Failed to write stream archive header.\n");
+            goto out;
         }
-        else
-        {
-            /* Find the end of the read cache which contains whole and sane entries.
-             * At the same time, add entries to the hash map, so that we don't insert duplicates. */
-            off = _ftelli64(merge_file);
+        off = _ftelli64(merge_file);
+    }
+    else
+    {
+        /* Find the end of the read cache which contains whole and sane entries.
+         * At the same time, add entries to the hash map, so that we don't insert duplicates. */
+        off = _ftelli64(merge_file);
 
-            /* From a cold disk cache, this can be quite slow. Poll the teardown atomic. */
-            while (fread(&stream_entry, sizeof(stream_entry), 1, merge_file) == 1)
+        /* From a cold disk cache, this can be quite slow. Poll the teardown atomic. */
+        while (fread(&stream_entry, sizeof(stream_entry), 1, merge_file) == 1)
+        {
+            /* Don't want to throw away the disk caches here. Try again next time. */
+            if (vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
+                    vkd3d_memory_order_relaxed))
             {
-                /* Don't want to throw away the disk caches here. Try again next time. */
-                if (vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
-                        vkd3d_memory_order_relaxed))
-                {
-                    INFO("Device teardown request received, stopping parse early.\n");
-                    /* Move the file back, don't delete anything. */
-                    fclose(merge_file);
-                    merge_file = NULL;
-                    vkd3d_file_rename_overwrite(merge_path, read_path);
-                    goto out_cancellation;
-                }
-
-                aligned_size = align(stream_entry.size, VKD3D_PIPELINE_BLOB_ALIGN);
-
-                /* Before accepting this as a valid entry, ensure checksums are correct.
-                 * Ideally we'd have mmap going here, but appending while mmaping a file is ... dubious :) */
-                if (!vkd3d_array_reserve((void**)&tmp_buffer, &tmp_buffer_size,
-                        aligned_size, 1))
-                    break;
+                INFO("Device teardown request received, stopping parse early.\n");
+                /* Move the file back, don't delete anything. */
+                fclose(merge_file);
+                merge_file = NULL;
+                vkd3d_file_rename_overwrite(merge_path, read_path);
+                goto out_cancellation;
+            }
 
-                if (fread(tmp_buffer, 1, aligned_size, merge_file) != aligned_size)
-                {
-                    INFO("Read-only archive entry is sliced. Ignoring rest of archive.\n");
-                    break;
-                }
+            aligned_size = align(stream_entry.size, VKD3D_PIPELINE_BLOB_ALIGN);
 
-                if (!vkd3d_serialized_pipeline_stream_entry_validate(tmp_buffer, &stream_entry))
-                {
-                    INFO("Found corrupt entry in read-only archive. Ignoring rest of archive.\n");
-                    break;
-                }
+            /* Before accepting this as a valid entry, ensure checksums are correct.
+             * Ideally we'd have mmap going here, but appending while mmaping a file is ... dubious :) */
+            if (!vkd3d_array_reserve((void**)&tmp_buffer, &tmp_buffer_size,
+                    aligned_size, 1))
+                break;
 
-                entry.key.hash = stream_entry.hash;
-                entry.key.type = stream_entry.type;
-                if (!hash_map_find(&map, &entry.key) && hash_map_insert(&map, &entry.key, &entry.entry))
-                    existing_entries++;
-                off = _ftelli64(merge_file);
+            if (fread(tmp_buffer, 1, aligned_size, merge_file) != aligned_size)
+            {
+                INFO("Read-only archive entry is sliced. Ignoring rest of archive.\n");
+                break;
             }
 
-            if (_fseeki64(merge_file, off, SEEK_SET) == 0)
+            if (!vkd3d_serialized_pipeline_stream_entry_validate(tmp_buffer, &stream_entry))
             {
-                /* Merge entries. */
-                write_cache_header = mapped_write_cache.mapped;
-                write_cache_size = mapped_write_cache.mapped_size;
-                write_entries = (const struct vkd3d_serialized_pipeline_stream_entry *)write_cache_header->entries;
-                write_cache_size -= sizeof(*write_cache_header);
+                INFO("Found corrupt entry in read-only archive. Ignoring rest of archive.\n");
+                break;
+            }
 
-                while (write_cache_size >= sizeof(*write_entries))
-                {
-                    /* Don't want to throw away the disk caches here. Try again next time. */
-                    if (vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
-                            vkd3d_memory_order_relaxed))
-                    {
-                        INFO("Device teardown request received, stopping parse early.\n");
-                        /* Move the file back, don't delete anything. */
-                        fclose(merge_file);
-                        merge_file = NULL;
-                        vkd3d_file_rename_overwrite(merge_path, read_path);
-                        goto out_cancellation;
-                    }
+            entry.key.hash = stream_entry.hash;
+            entry.key.type = vkd3d_serialized_pipeline_stream_entry_get_type(&stream_entry);
+            if (!hash_map_find(&map, &entry.key) && hash_map_insert(&map, &entry.key, &entry.entry))
+                existing_entries++;
+            off = _ftelli64(merge_file);
+        }
+    }
 
-                    write_cache_size -= sizeof(*write_entries);
-                    aligned_size = align(write_entries->size, VKD3D_PIPELINE_BLOB_ALIGN);
+    if (_fseeki64(merge_file, off, SEEK_SET) == 0)
+    {
+        /* Merge entries. The hash map is shared, so blobs which were written by
+         * several processes only end up in the read-only cache once. */
+        for (i = first_shard; i < shards.count; i++)
+        {
+            /* We're going to fwrite the mapped data directly. */
+            if (!vkd3d_file_map_read_only(shards.paths[i], &mapped_write_cache))
+                continue;
 
-                    if (write_cache_size < aligned_size)
-                    {
-                        INFO("Write-only archive entry is sliced. Ignoring rest of archive.\n");
-                        break;
-                    }
+            /* If the write cache is out of date, just nuke it and move on. Nothing to do. */
+            if (FAILED(hr = d3d12_pipeline_library_validate_stream_format_header(cache->library,
+                    cache->library->device, mapped_write_cache.mapped, mapped_write_cache.mapped_size)))
+            {
+                INFO("Write cache %s is invalid (hr #%x), nuking it.\n", shards.paths[i], hr);
+            }
+            else if (!vkd3d_pipeline_library_disk_cache_append_shard(cache, &mapped_write_cache,
+                    merge_file, &map, used_pipelines, &new_entries))
+            {
+                /* Move the file back, don't delete anything.
+                 * Entries we already appended are deduplicated on the next merge. */
+                fclose(merge_file);
+                merge_file = NULL;
+                vkd3d_file_rename_overwrite(merge_path, read_path);
+                goto out_cancellation;
+            }
 
-                    if (!vkd3d_serialized_pipeline_stream_entry_validate(write_entries->data, write_entries))
-                    {
-                        INFO("Found corrupt entry in write-only archive. Ignoring rest of archive.\n");
-                        break;
-                    }
+            vkd3d_file_unmap(&mapped_write_cache);
+        }
 
-                    entry.key.hash = write_entries->hash;
-                    entry.key.type = write_entries->type;
-                    if (!hash_map_find(&map, &entry.key) && hash_map_insert(&map, &entry.key, &entry.entry))
-                    {
-                        if (fwrite(write_entries, sizeof(*write_entries), 1, merge_file) != 1 ||
-                                fwrite(write_entries->data, 1, aligned_size, merge_file) != aligned_size)
-                        {
-                            ERR("Failed to append blob to read-cache.\n");
-                            break;
-                        }
-                        new_entries++;
-                    }
+        /* If a writer died mid-write, the old archive ends with a torn entry which may be longer than
+         * what we appended over it. Cut it off so that the archive only contains whole entries. */
+        if (!vkd3d_file_truncate_at_current_position(merge_file))
+            WARN("Failed to truncate merged archive.\n");
+    }
 
-                    write_cache_size -= aligned_size;
-                    write_entries = (const struct vkd3d_serialized_pipeline_stream_entry *)&write_entries->data[aligned_size];
-                }
-            }
+    INFO("Done merging shader caches, existing entries: %u, new entries: %u.\n",
+            existing_entries, new_entries);
 
-            INFO("Done merging shader caches, existing entries: %u, new entries: %u.\n",
-                    existing_entries, new_entries);
+    fclose(merge_file);
+    merge_file = NULL;
 
-            fclose(merge_file);
-            merge_file = NULL;
-            if (vkd3d_file_rename_overwrite(merge_path, read_path))
-                INFO("Successfully replaced shader cache with merged cache.\n");
-            else
-                INFO("Failed to replace shader cache.\n");
-        }
+    /* Compact while we still own the merge path. Nobody else can append to the archive in the meantime,
+     * so we cannot throw away entries which were merged by another process. */
+    if (!vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
+            vkd3d_memory_order_relaxed))
+    {
+        begin_ts = vkd3d_get_current_time_ns();
+        vkd3d_pipeline_library_disk_cache_compact(cache, read_path, merge_path, used_pipelines);
+        INFO("Compacting pipeline libraries took %.3f ms.\n",
+                1e-6 * (double)(vkd3d_get_current_time_ns() - begin_ts));
     }
 
+    if (vkd3d_file_rename_overwrite(merge_path, read_path))
+        INFO("Successfully replaced shader cache with merged cache.\n");
+    else
+        INFO("Failed to replace shader cache.\n");
+
 out:
-    /* There shouldn't be any write cache left after merging. */
+    /* There shouldn't be any inactive write cache left after merging. */
     vkd3d_file_unmap(&mapped_write_cache);
-    vkd3d_file_delete(write_path);
+    if (merge_file)
+    {
+        fclose(merge_file);
+        merge_file = NULL;
+    }
+    for (i = first_shard; i < shards.count; i++)
+        vkd3d_file_delete(shards.paths[i]);
 
     /* If we have a stale merge file lying around, we might have been killed at some point
      * when we tried to merge the read-only cache earlier.
@@ -3055,118 +3710,596 @@ out_cancellation:
     if (merge_file)
         fclose(merge_file);
     hash_map_clear(&map);
+    vkd3d_free(shards.paths);
     vkd3d_free(tmp_buffer);
 }
 
-static void vkd3d_pipeline_library_disk_cache_initial_setup(struct vkd3d_pipeline_library_disk_cache *cache)
+struct disk_cache_index_entry
 {
-    uint64_t begin_ts;
-    uint64_t end_ts;
-    HRESULT hr;
+    struct hash_map_entry entry;
+    struct vkd3d_serialized_pipeline_entry_key key;
+    uint32_t value;
+};
 
-    begin_ts = vkd3d_get_current_time_ns();
+struct disk_cache_compact_entry
+{
+    const struct vkd3d_serialized_pipeline_stream_entry *entry;
+    uint32_t epoch;
+    uint32_t visit;
+    bool keep;
+};
 
-    /* Fairly complex operation. Ideally, Steam handles this.
-     * After this operation, only read_path should remain, and write_path (and temporary merge path) is deleted. */
-    vkd3d_pipeline_library_disk_cache_merge(cache, cache->read_path, cache->write_path);
+struct disk_cache_compact_pipeline
+{
+    uint32_t epoch;
+    uint32_t index;
+};
 
-    end_ts = vkd3d_get_current_time_ns();
+static int disk_cache_compact_pipeline_compare(const void *a_, const void *b_)
+{
+    const struct disk_cache_compact_pipeline *a = a_;
+    const struct disk_cache_compact_pipeline *b = b_;
+
+    /* Most recently used first. Among equals, prefer entries which were appended later. */
+    if (a->epoch != b->epoch)
+        return a->epoch > b->epoch ? -1 : 1;
+    if (a->index != b->index)
+        return a->index > b->index ? -1 : 1;
+    return 0;
+}
 
-    INFO("Merging pipeline libraries took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+static size_t disk_cache_stream_entry_size(const struct vkd3d_serialized_pipeline_stream_entry *entry)
+{
+    return sizeof(*entry) + align(entry->size, VKD3D_PIPELINE_BLOB_ALIGN);
+}
 
-    begin_ts = vkd3d_get_current_time_ns();
+static size_t disk_cache_stream_entry_get_links(const struct vkd3d_serialized_pipeline_stream_entry *entry,
+        struct vkd3d_serialized_pipeline_entry_key *links)
+{
+    const struct vkd3d_serialized_pipeline_compressed_blob *compressed;
+    void *decompressed;
+    size_t link_count;
 
-    if (!vkd3d_file_map_read_only(cache->read_path, &cache->mapped_file))
-    {
-        INFO("Failed to map read-only cache: %s.\n", cache->read_path);
-    }
-    else
-    {
-        end_ts = vkd3d_get_current_time_ns();
-        INFO("Mapping read-only cache took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+    if (!(entry->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED))
+        return vkd3d_pipeline_blob_get_links(entry->data, entry->size, links);
 
-        begin_ts = vkd3d_get_current_time_ns();
-        hr = d3d12_pipeline_library_read_blob_stream_format(cache->library, cache->library->device,
-                cache->mapped_file.mapped, cache->mapped_file.mapped_size);
-        end_ts = vkd3d_get_current_time_ns();
-        INFO("Parsing stream archive took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+    compressed = (const struct vkd3d_serialized_pipeline_compressed_blob *)entry->data;
+    if (entry->size < sizeof(*compressed) || !(decompressed = vkd3d_malloc(compressed->decompressed_size)))
+        return 0;
 
-        if (hr == D3D12_ERROR_DRIVER_VERSION_MISMATCH)
-            INFO("Cannot load existing on-disk cache due to driver version mismatch.\n");
-        else if (hr == D3D12_ERROR_ADAPTER_NOT_FOUND)
-            INFO("Cannot load existing on-disk cache due to driver version mismatch.\n");
-        else if (FAILED(hr))
-            INFO("Failed to load driver cache with hr #%x, falling back to empty cache.\n", hr);
-    }
+    if (vkd3d_lz_decompress(compressed->data, entry->size - sizeof(*compressed),
+            decompressed, compressed->decompressed_size))
+        link_count = vkd3d_pipeline_blob_get_links(decompressed, compressed->decompressed_size, links);
+    else
+        link_count = 0;
 
-    /* When we add new internal blobs from this point,
-     * we'll be notified where we can write out a stream blob to disk.
-     * This all happens within the disk$ thread. */
-    cache->library->disk_cache_listener = cache;
+    vkd3d_free(decompressed);
+    return link_count;
 }
 
-HRESULT vkd3d_pipeline_library_init_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
-        struct d3d12_device *device)
+static bool vkd3d_pipeline_library_disk_cache_write_index(const char *index_path, uint32_t epoch,
+        const struct disk_cache_compact_entry *entries, size_t entry_count)
 {
-    char path_buf[VKD3D_PATH_MAX];
-    VKD3D_UNUSED size_t i, n;
-    const char *separator;
-    const char *path;
-    uint32_t flags;
-    HRESULT hr;
-    int rc;
+    struct vkd3d_serialized_pipeline_library_index_entry index_entry;
+    struct vkd3d_serialized_pipeline_library_index header;
+    char tmp_path[VKD3D_PATH_MAX];
+    bool success = true;
+    FILE *file;
+    size_t i;
 
-    memset(cache, 0, sizeof(*cache));
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", index_path);
 
-    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_APP_CACHE_ONLY)
-        return S_OK;
+    /* A stale temporary file can only be left behind if we were killed while writing it. */
+    vkd3d_file_delete(tmp_path);
+    if (!(file = vkd3d_file_open_exclusive_write(tmp_path)))
+        return false;
 
-    /* Match DXVK style here. The environment variable is a directory.
-     * If not set, it is in current working directory. */
-    vkd3d_get_env_var("VKD3D_SHADER_CACHE_PATH", path_buf, sizeof(path_buf));
-    path = *path_buf != '\0' ? path_buf : NULL;
+    header.version = VKD3D_PIPELINE_LIBRARY_VERSION_INDEX;
+    header.epoch = epoch;
+    header.entry_count = 0;
+    for (i = 0; i < entry_count; i++)
+        if (entries[i].keep)
+            header.entry_count++;
 
-    if (path)
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+        success = false;
+
+    for (i = 0; i < entry_count && success; i++)
     {
-        separator = &path[strlen(path) - 1];
-        separator = (*separator == '/' || *separator == '\\') ? "" : "/";
+        if (!entries[i].keep)
+            continue;
+
+        index_entry.hash = entries[i].entry->hash;
+        index_entry.type = vkd3d_serialized_pipeline_stream_entry_get_type(entries[i].entry);
+        index_entry.epoch = entries[i].epoch;
+        if (fwrite(&index_entry, sizeof(index_entry), 1, file) != 1)
+            success = false;
     }
-    else
-        separator = "";
 
-#ifdef _WIN32
-    /* Wine has some curious bugs when it comes to MoveFileA, DeleteFileA and RenameFileA.
-     * RenameFileA only works if we use Windows style paths with back-slashes (not forward slashes) for whatever reason.
-     * Seems to be related to drive detection (Rename fails with drive mismatch in some cases for example).
-     * Manually remap Unix style paths to conservative Win32.
-     * Normally Wine accepts Unix style paths, but not here for whatever reason. */
+    fclose(file);
 
-    if (path && path[0] == '/')
-        snprintf(cache->read_path, sizeof(cache->read_path), "Z:\\%s%svkd3d-proton.cache", path + 1, separator);
-    else if (path)
-        snprintf(cache->read_path, sizeof(cache->read_path), "%s%svkd3d-proton.cache", path, separator);
-    else
-        strcpy(cache->read_path, "vkd3d-proton.cache");
+    if (success)
+        success = vkd3d_file_rename_overwrite(tmp_path, index_path);
+    if (!success)
+        vkd3d_file_delete(tmp_path);
+    return success;
+}
 
-    for (i = 0, n = strlen(cache->read_path); i < n; i++)
-        if (cache->read_path[i] == '/')
-            cache->read_path[i] = '\\';
-    INFO("Remapping VKD3D_SHADER_CACHE to: %s.\n", cache->read_path);
+/* Rewrites the merged archive at archive_path without PSOs which are beyond the size budget in LRU order,
+ * as well as SPIR-V and driver cache blobs which no surviving PSO refers to.
+ * The last-used epoch of every entry is kept in a sidecar index next to the read-only archive.
+ * Must only be called by the process which owns archive_path. */
+static void vkd3d_pipeline_library_disk_cache_compact(struct vkd3d_pipeline_library_disk_cache *cache,
+        const char *read_path, const char *archive_path, const struct hash_map *used_pipelines)
+{
+    const struct vkd3d_serialized_pipeline_library_index *index_header;
+    const struct vkd3d_serialized_pipeline_library_stream *archive_header;
+    struct vkd3d_serialized_pipeline_entry_key links[VKD3D_PIPELINE_BLOB_MAX_LINKS];
+    const struct vkd3d_serialized_pipeline_stream_entry *stream_entry;
+    struct disk_cache_compact_pipeline *pipelines = NULL;
+    struct disk_cache_compact_entry *entries = NULL;
+    const struct disk_cache_index_entry *found;
+    struct vkd3d_memory_mapped_file mapped_archive;
+    struct vkd3d_memory_mapped_file mapped_index;
+    struct vkd3d_serialized_pipeline_variant variant;
+    uint64_t dropped_size = 0, kept_size = 0;
+    uint64_t total_size, cost;
+    uint64_t unique_size = 0;
+    char compact_path[VKD3D_PATH_MAX];
+    char index_path[VKD3D_PATH_MAX];
+    struct disk_cache_index_entry e;
+    size_t pipelines_size = 0;
+    size_t pipeline_count = 0;
+    size_t entries_size = 0;
+    size_t entry_count = 0;
+    uint32_t dropped_count;
+    size_t archive_size;
+    struct hash_map epoch_map;
+    struct hash_map entry_map;
+    size_t link_count;
+    uint32_t epoch;
+    FILE *file;
+    size_t i, j;
+
+    memset(&mapped_archive, 0, sizeof(mapped_archive));
+    memset(&mapped_index, 0, sizeof(mapped_index));
+    hash_map_init(&epoch_map, vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct disk_cache_index_entry));
+    hash_map_init(&entry_map, vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct disk_cache_index_entry));
+    snprintf(index_path, sizeof(index_path), "%s.index", read_path);
+    /* Per-process, so that we never touch a compacted archive which another process is writing. */
+#ifdef _WIN32
+    snprintf(compact_path, sizeof(compact_path), "%s.compact.%u",
+            read_path, (unsigned int)GetCurrentProcessId());
 #else
-    if (path)
-        snprintf(cache->read_path, sizeof(cache->read_path), "%s%svkd3d-proton.cache", path, separator);
-    else
-        strcpy(cache->read_path, "vkd3d-proton.cache");
+    snprintf(compact_path, sizeof(compact_path), "%s.compact.%u",
+            read_path, (unsigned int)getpid());
 #endif
+    file = NULL;
 
-    INFO("Attempting to load disk cache from: %s.\n", cache->read_path);
-
-    /* Split the reader and writer. */
-    snprintf(cache->write_path, sizeof(cache->write_path), "%s.write", cache->read_path);
+    epoch = 1;
 
-    flags = VKD3D_PIPELINE_LIBRARY_FLAG_INTERNAL_KEYS | VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE;
+    if (vkd3d_file_map_read_only(index_path, &mapped_index))
+    {
+        index_header = mapped_index.mapped;
+        if (mapped_index.mapped_size >= sizeof(*index_header) &&
+                index_header->version == VKD3D_PIPELINE_LIBRARY_VERSION_INDEX &&
+                index_header->entry_count <= (mapped_index.mapped_size - sizeof(*index_header)) /
+                        sizeof(*index_header->entries))
+        {
+            epoch = index_header->epoch + 1;
 
-    /* This flag is mostly for debug. Normally we want to do shader cache management in disk thread. */
+            for (i = 0; i < index_header->entry_count; i++)
+            {
+                e.key.hash = index_header->entries[i].hash;
+                e.key.type = index_header->entries[i].type;
+                e.value = index_header->entries[i].epoch;
+                hash_map_insert(&epoch_map, &e.key, &e.entry);
+            }
+        }
+        else
+            INFO("Disk cache index is out of date, discarding it.\n");
+
+        vkd3d_file_unmap(&mapped_index);
+    }
+
+    if (!vkd3d_file_map_read_only(archive_path, &mapped_archive))
+        goto out;
+
+    if (FAILED(d3d12_pipeline_library_validate_stream_format_header(cache->library,
+            cache->library->device, mapped_archive.mapped, mapped_archive.mapped_size)))
+        goto out;
+
+    archive_header = mapped_archive.mapped;
+    archive_size = mapped_archive.mapped_size - sizeof(*archive_header);
+    stream_entry = (const struct vkd3d_serialized_pipeline_stream_entry *)archive_header->entries;
+
+    /* Entries which the index does not know about yet were added in the sessions we just merged. */
+    while (archive_size >= sizeof(*stream_entry))
+    {
+        archive_size -= sizeof(*stream_entry);
+        if (archive_size < align(stream_entry->size, VKD3D_PIPELINE_BLOB_ALIGN))
+            break;
+        archive_size -= align(stream_entry->size, VKD3D_PIPELINE_BLOB_ALIGN);
+
+        if (!vkd3d_array_reserve((void **)&entries, &entries_size, entry_count + 1, sizeof(*entries)))
+            goto out;
+
+        entries[entry_count].entry = stream_entry;
+        entries[entry_count].visit = 0;
+        entries[entry_count].keep = false;
+
+        e.key.hash = stream_entry->hash;
+        e.key.type = vkd3d_serialized_pipeline_stream_entry_get_type(stream_entry);
+        found = (const struct disk_cache_index_entry *)hash_map_find(&epoch_map, &e.key);
+        entries[entry_count].epoch = found ? found->value : epoch;
+
+        /* Duplicates and use records are dropped by never being kept. */
+        e.value = entry_count;
+        if (e.key.type != VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE &&
+                !hash_map_find(&entry_map, &e.key))
+        {
+            hash_map_insert(&entry_map, &e.key, &e.entry);
+            unique_size += disk_cache_stream_entry_size(stream_entry);
+
+            if (e.key.type == VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE)
+            {
+                if (!vkd3d_array_reserve((void **)&pipelines, &pipelines_size,
+                        pipeline_count + 1, sizeof(*pipelines)))
+                    goto out;
+                pipelines[pipeline_count++].index = entry_count;
+            }
+        }
+
+        entry_count++;
+        stream_entry = (const struct vkd3d_serialized_pipeline_stream_entry *)
+                &stream_entry->data[align(stream_entry->size, VKD3D_PIPELINE_BLOB_ALIGN)];
+    }
+
+    /* Refresh PSOs which were used since the last merge.
+     * Use records can also be found in the archive itself if a write cache was promoted as-is. */
+    for (i = 0; i < entry_count; i++)
+    {
+        if (vkd3d_serialized_pipeline_stream_entry_get_type(entries[i].entry) !=
+                VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE)
+            continue;
+        e.key.hash = entries[i].entry->hash;
+        e.key.type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE;
+        if ((found = (const struct disk_cache_index_entry *)hash_map_find(&entry_map, &e.key)))
+            entries[found->value].epoch = epoch;
+    }
+
+    for (i = 0; i < pipeline_count; i++)
+    {
+        stream_entry = entries[pipelines[i].index].entry;
+        e.key.hash = stream_entry->hash;
+        e.key.type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE;
+        if (hash_map_find(used_pipelines, &e.key))
+            entries[pipelines[i].index].epoch = epoch;
+        pipelines[i].epoch = entries[pipelines[i].index].epoch;
+    }
+
+    total_size = sizeof(*archive_header);
+
+    if (!cache->max_size || total_size + unique_size <= cache->max_size)
+    {
+        /* Everything fits. Don't bother looking at links, which may require decompressing every PSO. */
+        for (i = 0; i < entry_count; i++)
+        {
+            switch (vkd3d_serialized_pipeline_stream_entry_get_type(entries[i].entry))
+            {
+                case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV:
+                case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE:
+                case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE:
+                    entries[i].keep = true;
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        /* Skip the budget walk below. */
+        pipeline_count = 0;
+    }
+    else
+        qsort(pipelines, pipeline_count, sizeof(*pipelines), disk_cache_compact_pipeline_compare);
+
+    /* Keep PSOs along with the blobs they link to until the budget is exhausted.
+     * A blob shared by several PSOs is only paid for by the most recently used one. */
+    for (i = 0; i < pipeline_count; i++)
+    {
+        stream_entry = entries[pipelines[i].index].entry;
+        link_count = disk_cache_stream_entry_get_links(stream_entry, links);
+        cost = disk_cache_stream_entry_size(stream_entry);
+
+        for (j = 0; j < link_count; j++)
+        {
+            e.key = links[j];
+            if ((found = (const struct disk_cache_index_entry *)hash_map_find(&entry_map, &e.key)) &&
+                    !entries[found->value].keep && entries[found->value].visit != i + 1)
+            {
+                entries[found->value].visit = i + 1;
+                cost += disk_cache_stream_entry_size(entries[found->value].entry);
+            }
+        }
+
+        if (cache->max_size && total_size + cost > cache->max_size)
+            break;
+
+        total_size += cost;
+        entries[pipelines[i].index].keep = true;
+        for (j = 0; j < link_count; j++)
+        {
+            e.key = links[j];
+            if ((found = (const struct disk_cache_index_entry *)hash_map_find(&entry_map, &e.key)) &&
+                    !entries[found->value].keep)
+            {
+                entries[found->value].keep = true;
+                entries[found->value].epoch = pipelines[i].epoch;
+            }
+        }
+    }
+
+    dropped_count = 0;
+    for (i = 0; i < entry_count; i++)
+    {
+        stream_entry = entries[i].entry;
+
+        switch (vkd3d_serialized_pipeline_stream_entry_get_type(stream_entry))
+        {
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV:
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE:
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE:
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE:
+                /* Already decided above. */
+                break;
+
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT:
+                /* Variants live and die with their PSO. */
+                if (stream_entry->size == sizeof(struct vkd3d_serialized_pipeline_variant))
+                {
+                    memcpy(&variant, stream_entry->data, sizeof(variant));
+                    e.key.hash = variant.pso_hash;
+                    e.key.type = VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE;
+                    if ((found = (const struct disk_cache_index_entry *)hash_map_find(&entry_map, &e.key)) &&
+                            entries[found->value].keep)
+                    {
+                        entries[i].keep = true;
+                        entries[i].epoch = entries[found->value].epoch;
+                    }
+                }
+                break;
+
+            default:
+                /* Don't know how to track references, so leave it alone. */
+                entries[i].keep = true;
+                break;
+        }
+
+        /* Entries which are duplicates of an earlier entry are not in entry_map. */
+        if (entries[i].keep)
+        {
+            e.key.hash = stream_entry->hash;
+            e.key.type = vkd3d_serialized_pipeline_stream_entry_get_type(stream_entry);
+            found = (const struct disk_cache_index_entry *)hash_map_find(&entry_map, &e.key);
+            if (found && found->value != i)
+                entries[i].keep = false;
+        }
+
+        if (entries[i].keep)
+            kept_size += disk_cache_stream_entry_size(stream_entry);
+        else
+        {
+            dropped_count++;
+            dropped_size += disk_cache_stream_entry_size(stream_entry);
+        }
+    }
+
+    if (dropped_count)
+    {
+        /* Write out the surviving entries in their original order, then atomically replace the archive. */
+        if (!(file = vkd3d_file_open_exclusive_write(compact_path)))
+        {
+            INFO("Cannot create compacted disk cache %s.\n", compact_path);
+            goto out;
+        }
+
+        if (fwrite(archive_header, sizeof(*archive_header), 1, file) != 1)
+            goto out_write_fail;
+
+        for (i = 0; i < entry_count; i++)
+        {
+            if (vkd3d_atomic_uint32_load_explicit(&cache->library->stream_archive_cancellation_point,
+                    vkd3d_memory_order_relaxed))
+            {
+                INFO("Device teardown request received, stopping compaction early.\n");
+                goto out_write_fail;
+            }
+
+            if (entries[i].keep && fwrite(entries[i].entry, 1, disk_cache_stream_entry_size(entries[i].entry),
+                    file) != disk_cache_stream_entry_size(entries[i].entry))
+            {
+                ERR("Failed to write compacted disk cache.\n");
+                goto out_write_fail;
+            }
+        }
+
+        fclose(file);
+        file = NULL;
+
+        /* The index must not reference the mapping past this point, so write it first. */
+        if (!vkd3d_pipeline_library_disk_cache_write_index(index_path, epoch, entries, entry_count))
+            INFO("Failed to write disk cache index.\n");
+
+        vkd3d_file_unmap(&mapped_archive);
+        if (vkd3d_file_rename_overwrite(compact_path, archive_path))
+        {
+            INFO("Compacted disk cache, dropped %u entries (%"PRIu64" KiB), %"PRIu64" KiB remain, epoch %u.\n",
+                    dropped_count, dropped_size / 1024, kept_size / 1024, epoch);
+        }
+        else
+        {
+            INFO("Failed to replace disk cache with compacted cache.\n");
+            vkd3d_file_delete(compact_path);
+        }
+    }
+    else if (!vkd3d_pipeline_library_disk_cache_write_index(index_path, epoch, entries, entry_count))
+        INFO("Failed to write disk cache index.\n");
+
+    goto out;
+
+out_write_fail:
+    fclose(file);
+    file = NULL;
+    vkd3d_file_delete(compact_path);
+
+out:
+    vkd3d_file_unmap(&mapped_archive);
+    hash_map_clear(&epoch_map);
+    hash_map_clear(&entry_map);
+    vkd3d_free(pipelines);
+    vkd3d_free(entries);
+}
+
+static void vkd3d_pipeline_library_disk_cache_initial_setup(struct vkd3d_pipeline_library_disk_cache *cache)
+{
+    VKD3D_REGION_DECL(stream_archive_parse);
+    struct hash_map used_pipelines;
+    uint64_t begin_ts;
+    uint64_t end_ts;
+    HRESULT hr;
+
+    begin_ts = vkd3d_get_current_time_ns();
+
+    /* Fairly complex operation. Ideally, Steam handles this.
+     * After this operation, only read_path should remain, and all write caches which are not in use
+     * by another process (and temporary merge path) are deleted. */
+    hash_map_init(&used_pipelines, vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct vkd3d_serialized_pipeline_entry));
+    vkd3d_pipeline_library_disk_cache_merge(cache, cache->read_path, &used_pipelines);
+    hash_map_clear(&used_pipelines);
+
+    end_ts = vkd3d_get_current_time_ns();
+
+    INFO("Merging pipeline libraries took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+
+    begin_ts = vkd3d_get_current_time_ns();
+
+    if (!vkd3d_file_map_read_only(cache->read_path, &cache->mapped_file))
+    {
+        INFO("Failed to map read-only cache: %s.\n", cache->read_path);
+    }
+    else
+    {
+        end_ts = vkd3d_get_current_time_ns();
+        INFO("Mapping read-only cache took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+
+        begin_ts = vkd3d_get_current_time_ns();
+        VKD3D_REGION_BEGIN(stream_archive_parse);
+        hr = d3d12_pipeline_library_read_blob_stream_format(cache->library, cache->library->device,
+                cache->mapped_file.mapped, cache->mapped_file.mapped_size);
+        VKD3D_REGION_END(stream_archive_parse);
+        end_ts = vkd3d_get_current_time_ns();
+        INFO("Parsing stream archive took %.3f ms.\n", 1e-6 * (double)(end_ts - begin_ts));
+
+        if (hr == D3D12_ERROR_DRIVER_VERSION_MISMATCH)
+            INFO("Cannot load existing on-disk cache due to driver version mismatch.\n");
+        else if (hr == D3D12_ERROR_ADAPTER_NOT_FOUND)
+            INFO("Cannot load existing on-disk cache due to driver version mismatch.\n");
+        else if (FAILED(hr))
+            INFO("Failed to load driver cache with hr #%x, falling back to empty cache.\n", hr);
+    }
+
+    /* When we add new internal blobs from this point,
+     * we'll be notified where we can write out a stream blob to disk.
+     * This all happens within the disk$ thread. */
+    cache->library->disk_cache_listener = cache;
+}
+
+/* Least recently used PSOs are evicted from the read-only archive beyond this size. */
+#define VKD3D_SHADER_CACHE_DEFAULT_MAX_SIZE_MB 1024
+
+HRESULT vkd3d_pipeline_library_init_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
+        struct d3d12_device *device)
+{
+    char path_buf[VKD3D_PATH_MAX];
+    VKD3D_UNUSED size_t i, n;
+    const char *separator;
+    const char *path;
+    uint32_t flags;
+    HRESULT hr;
+    int rc;
+
+    memset(cache, 0, sizeof(*cache));
+    hash_map_init(&cache->used_pipeline_map,
+            vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct vkd3d_serialized_pipeline_entry));
+
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_APP_CACHE_ONLY)
+        return S_OK;
+
+    cache->max_size = VKD3D_SHADER_CACHE_DEFAULT_MAX_SIZE_MB * 1024ull * 1024ull;
+    if (vkd3d_get_env_var("VKD3D_SHADER_CACHE_MAX_SIZE", path_buf, sizeof(path_buf)))
+    {
+        cache->max_size = strtoull(path_buf, NULL, 0) * 1024ull * 1024ull;
+        INFO("Setting disk cache size limit to %"PRIu64" MiB.\n", cache->max_size / (1024 * 1024));
+    }
+
+    /* Match DXVK style here. The environment variable is a directory.
+     * If not set, it is in current working directory. */
+    vkd3d_get_env_var("VKD3D_SHADER_CACHE_PATH", path_buf, sizeof(path_buf));
+    path = *path_buf != '\0' ? path_buf : NULL;
+
+    if (path)
+    {
+        separator = &path[strlen(path) - 1];
+        separator = (*separator == '/' || *separator == '\\') ? "" : "/";
+    }
+    else
+        separator = "";
+
+#ifdef _WIN32
+    /* Wine has some curious bugs when it comes to MoveFileA, DeleteFileA and RenameFileA.
+     * RenameFileA only works if we use Windows style paths with back-slashes (not forward slashes) for whatever reason.
+     * Seems to be related to drive detection (Rename fails with drive mismatch in some cases for example).
+     * Manually remap Unix style paths to conservative Win32.
+     * Normally Wine accepts Unix style paths, but not here for whatever reason. */
+
+    if (path && path[0] == '/')
+        snprintf(cache->read_path, sizeof(cache->read_path), "Z:\\%s%svkd3d-proton.cache", path + 1, separator);
+    else if (path)
+        snprintf(cache->read_path, sizeof(cache->read_path), "%s%svkd3d-proton.cache", path, separator);
+    else
+        strcpy(cache->read_path, "vkd3d-proton.cache");
+
+    for (i = 0, n = strlen(cache->read_path); i < n; i++)
+        if (cache->read_path[i] == '/')
+            cache->read_path[i] = '\\';
+    INFO("Remapping VKD3D_SHADER_CACHE to: %s.\n", cache->read_path);
+#else
+    if (path)
+        snprintf(cache->read_path, sizeof(cache->read_path), "%s%svkd3d-proton.cache", path, separator);
+    else
+        strcpy(cache->read_path, "vkd3d-proton.cache");
+#endif
+
+    INFO("Attempting to load disk cache from: %s.\n", cache->read_path);
+
+    /* Split the reader and writer. Each process gets its own write cache,
+     * so concurrent instances of an application can all contribute to the cache. */
+#ifdef _WIN32
+    snprintf(cache->write_path, sizeof(cache->write_path), "%s.write.%u",
+            cache->read_path, (unsigned int)GetCurrentProcessId());
+#else
+    snprintf(cache->write_path, sizeof(cache->write_path), "%s.write.%u",
+            cache->read_path, (unsigned int)getpid());
+#endif
+
+    flags = VKD3D_PIPELINE_LIBRARY_FLAG_INTERNAL_KEYS | VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE;
+
+    /* This flag is mostly for debug. Normally we want to do shader cache management in disk thread. */
     if (!(vkd3d_config_flags & VKD3D_CONFIG_FLAG_SHADER_CACHE_SYNC))
         flags |= VKD3D_PIPELINE_LIBRARY_FLAG_STREAM_ARCHIVE_PARSE_ASYNC;
 
@@ -3240,6 +4373,17 @@ void vkd3d_pipeline_library_flush_disk_cache(struct vkd3d_pipeline_library_disk_
     cache->items = NULL;
     cache->items_count = 0;
     cache->items_size = 0;
+    hash_map_clear(&cache->used_pipeline_map);
+    vkd3d_free(cache->compress_buffer);
+    cache->compress_buffer = NULL;
+    cache->compress_buffer_size = 0;
+    vkd3d_free(cache->serialize_buffer);
+    cache->serialize_buffer = NULL;
+    cache->serialize_buffer_size = 0;
+    vkd3d_free(cache->write_buffer);
+    cache->write_buffer = NULL;
+    cache->write_buffer_size = 0;
+    cache->write_buffer_offset = 0;
 
     if (cache->library)
     {
@@ -3250,25 +4394,79 @@ void vkd3d_pipeline_library_flush_disk_cache(struct vkd3d_pipeline_library_disk_
     vkd3d_file_unmap(&cache->mapped_file);
 }
 
+#define VKD3D_PIPELINE_LIBRARY_DISK_CACHE_MAX_PENDING_WRITE_SIZE (4 * 1024 * 1024)
+
+static void vkd3d_pipeline_library_disk_cache_commit_writes(struct vkd3d_pipeline_library_disk_cache *disk_cache)
+{
+    size_t size = disk_cache->write_buffer_offset;
+
+    if (!size)
+        return;
+
+    disk_cache->write_buffer_offset = 0;
+    if (!disk_cache->stream_archive_write_file)
+        return;
+
+    /* File is unbuffered, so this ends up as a single write. */
+    if (fwrite(disk_cache->write_buffer, 1, size, disk_cache->stream_archive_write_file) != size)
+    {
+        /* Anything we append after a short write would be ignored on merge anyway. */
+        ERR("Failed to write %zu bytes to stream archive, disabling further writes.\n", size);
+        fclose(disk_cache->stream_archive_write_file);
+        disk_cache->stream_archive_write_file = NULL;
+    }
+}
+
+static FILE *vkd3d_pipeline_library_disk_cache_open_write_file(const char *path)
+{
+    FILE *file;
+
+    if ((file = vkd3d_file_open_exclusive_write(path)))
+        return file;
+
+    /* The shard name is only unique among live processes. A crashed process with a reused pid
+     * leaves a shard behind which nobody holds a lock on anymore, and which would make us lose the write cache. */
+    if (!(file = fopen(path, "rb")))
+        return NULL;
+
+    if (!vkd3d_file_try_lock_exclusive(file))
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    WARN("Removing stale write cache %s.\n", path);
+    vkd3d_file_delete(path);
+    return vkd3d_file_open_exclusive_write(path);
+}
+
 void vkd3d_pipeline_library_disk_cache_notify_blob_insert(struct vkd3d_pipeline_library_disk_cache *disk_cache,
         uint64_t hash, uint32_t type /* vkd3d_serialized_pipeline_stream_entry_type */,
         const void *data, size_t size)
 {
     /* Always called from disk$ thread, so we don't have to consider thread safety. */
+    struct vkd3d_serialized_pipeline_compressed_blob *compressed;
     struct vkd3d_serialized_pipeline_library_stream header;
-    struct vkd3d_serialized_pipeline_stream_entry entry;
-    uint8_t zero_array[VKD3D_PIPELINE_BLOB_ALIGN];
-    uint32_t padding_size;
+    struct vkd3d_serialized_pipeline_stream_entry *entry;
+    size_t compressed_size, bound;
+    size_t aligned_size;
 
     /* On first write (new blob), create a new file. */
     if (!disk_cache->stream_archive_attempted_write)
     {
         disk_cache->stream_archive_attempted_write = true;
 
-        /* Fails if multiple processes run the same application, but this doesn't really happen in practice. */
-        disk_cache->stream_archive_write_file = vkd3d_file_open_exclusive_write(disk_cache->write_path);
+        disk_cache->stream_archive_write_file = vkd3d_pipeline_library_disk_cache_open_write_file(disk_cache->write_path);
         if (disk_cache->stream_archive_write_file)
         {
+            /* Held until the file is closed, so that a concurrent merge does not steal our write cache. */
+            if (!vkd3d_file_try_lock_exclusive(disk_cache->stream_archive_write_file))
+                WARN("Failed to lock stream archive write file: %s.\n", disk_cache->write_path);
+
+            /* Entries are staged in write_buffer and committed in one go, stdio buffering only gets in the way. */
+            setvbuf(disk_cache->stream_archive_write_file, NULL, _IONBF, 0);
+
             d3d12_pipeline_library_serialize_stream_archive_header(disk_cache->library, &header);
             if (fwrite(&header, sizeof(header), 1, disk_cache->stream_archive_write_file) != 1)
             {
@@ -3281,29 +4479,54 @@ void vkd3d_pipeline_library_disk_cache_notify_blob_insert(struct vkd3d_pipeline_
             ERR("Failed to open stream archive write file exclusively: %s.\n", disk_cache->write_path);
     }
 
-    if (disk_cache->stream_archive_write_file)
-    {
-        entry.hash = hash;
-        entry.type = type;
-        entry.size = size;
-        entry.checksum = vkd3d_serialized_pipeline_stream_entry_compute_checksum(data, &entry);
-
-        if (fwrite(&entry, sizeof(entry), 1, disk_cache->stream_archive_write_file) != 1)
-            ERR("Failed to write entry header.\n");
-        if (fwrite(data, 1, size, disk_cache->stream_archive_write_file) != size)
-            ERR("Failed to write blob data.\n");
+    if (!disk_cache->stream_archive_write_file)
+        return;
 
-        /* Write padding data. */
-        padding_size = align(size, VKD3D_PIPELINE_BLOB_ALIGN) - size;
-        if (padding_size)
+    if (type != VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE &&
+            size >= VKD3D_SERIALIZED_PIPELINE_COMPRESS_MIN_SIZE &&
+            !(vkd3d_config_flags & VKD3D_CONFIG_FLAG_SHADER_CACHE_NO_COMPRESSION))
+    {
+        bound = sizeof(*compressed) + vkd3d_lz_compress_bound(size);
+        if (vkd3d_array_reserve((void **)&disk_cache->compress_buffer, &disk_cache->compress_buffer_size,
+                bound, sizeof(*disk_cache->compress_buffer)))
         {
-            memset(zero_array, 0, padding_size);
-            if (fwrite(zero_array, 1, padding_size, disk_cache->stream_archive_write_file) != padding_size)
-                ERR("Failed to write padding.\n");
-        }
+            compressed = (struct vkd3d_serialized_pipeline_compressed_blob *)disk_cache->compress_buffer;
+            compressed->decompressed_size = size;
+            compressed->reserved = 0;
+            compressed_size = vkd3d_lz_compress(data, size, compressed->data, bound - sizeof(*compressed));
 
-        /* Defer fflush until things quiet down. No need to spam fflush 1000s of times per second. */
-    }
+            /* Only worth the decompression cost on load if we save at least 1/8th. */
+            if (compressed_size && sizeof(*compressed) + compressed_size <= size - size / 8)
+            {
+                data = compressed;
+                size = sizeof(*compressed) + compressed_size;
+                type |= VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED;
+            }
+        }
+    }
+
+    /* Every entry is a self-contained frame with a checksum over header and payload.
+     * If we crash mid-write, the merge keeps all whole frames and cuts off the torn one. */
+    aligned_size = align(size, VKD3D_PIPELINE_BLOB_ALIGN);
+    if (!vkd3d_array_reserve((void **)&disk_cache->write_buffer, &disk_cache->write_buffer_size,
+            disk_cache->write_buffer_offset + sizeof(*entry) + aligned_size, sizeof(*disk_cache->write_buffer)))
+    {
+        ERR("Failed to allocate write buffer.\n");
+        return;
+    }
+
+    entry = (struct vkd3d_serialized_pipeline_stream_entry *)&disk_cache->write_buffer[disk_cache->write_buffer_offset];
+    entry->hash = hash;
+    entry->type = type;
+    entry->size = size;
+    memcpy(entry->data, data, size);
+    memset(entry->data + size, 0, aligned_size - size);
+    entry->checksum = vkd3d_serialized_pipeline_stream_entry_compute_checksum(entry->data, entry);
+    disk_cache->write_buffer_offset += sizeof(*entry) + aligned_size;
+
+    /* Normally, entries are committed once per batch, but don't let a burst of PSOs grow the buffer without bound. */
+    if (disk_cache->write_buffer_offset >= VKD3D_PIPELINE_LIBRARY_DISK_CACHE_MAX_PENDING_WRITE_SIZE)
+        vkd3d_pipeline_library_disk_cache_commit_writes(disk_cache);
 }
 
 static void *vkd3d_pipeline_library_disk_thread_main(void *userarg)
@@ -3370,21 +4593,22 @@ static void *vkd3d_pipeline_library_disk_thread_main(void *userarg)
                 INFO("Pipeline cache marked dirty. Flush is scheduled.\n");
             }
 
-            d3d12_pipeline_state_dec_ref(tmp_items[i].state);
+            if (tmp_items[i].state)
+                d3d12_pipeline_state_dec_ref(tmp_items[i].state);
         }
         tmp_items_count = 0;
 
+        /* Group commit. Everything we picked up in this wakeup goes to disk with one write,
+         * so we don't depend on a quiet period to make progress durable. */
+        vkd3d_pipeline_library_disk_cache_commit_writes(cache);
+
         if (rc > 0)
         {
-            /* Timeout, try to flush. */
             if (dirty)
             {
-                INFO("Flushing disk cache (wakeup counter since last flush = %u). "
+                INFO("Disk cache is idle (wakeup counter since last idle = %u). "
                      "It seems like application has stopped creating new PSOs for the time being.\n",
                      wakeup_counter);
-
-                if (cache->stream_archive_write_file)
-                    fflush(cache->stream_archive_write_file);
                 wakeup_counter = 0;
                 dirty = false;
             }
@@ -3408,7 +4632,8 @@ static void *vkd3d_pipeline_library_disk_thread_main(void *userarg)
         else
             dirty = true;
 
-        d3d12_pipeline_state_dec_ref(tmp_items[i].state);
+        if (tmp_items[i].state)
+            d3d12_pipeline_state_dec_ref(tmp_items[i].state);
     }
 
     for (i = 0; i < cache->items_count; i++)
@@ -3422,9 +4647,12 @@ static void *vkd3d_pipeline_library_disk_thread_main(void *userarg)
         else
             dirty = true;
 
-        d3d12_pipeline_state_dec_ref(cache->items[i].state);
+        if (cache->items[i].state)
+            d3d12_pipeline_state_dec_ref(cache->items[i].state);
     }
 
+    vkd3d_pipeline_library_disk_cache_commit_writes(cache);
+
     if (cache->stream_archive_write_file)
     {
         fclose(cache->stream_archive_write_file);
@@ -3434,3 +4662,607 @@ static void *vkd3d_pipeline_library_disk_thread_main(void *userarg)
     vkd3d_free(tmp_items);
     return NULL;
 }
+
+/* In-memory SPIR-V memo cache. Identical DXBC compiled against an identical interface
+ * produces identical SPIR-V, so PSOs which only differ in fixed function state can
+ * skip the DXBC -> SPIR-V conversion entirely. */
+#define VKD3D_SHADER_MEMO_CACHE_DEFAULT_SIZE_MB 64
+
+struct vkd3d_shader_memo_entry
+{
+    struct list lru_entry;
+    struct vkd3d_shader_memo_key key;
+    struct vkd3d_shader_code code;
+};
+
+struct vkd3d_shader_memo_map_entry
+{
+    struct hash_map_entry entry;
+    struct vkd3d_shader_memo_key key;
+    struct vkd3d_shader_memo_entry *memo;
+};
+
+static uint32_t vkd3d_shader_memo_key_hash(const void *key)
+{
+    const struct vkd3d_shader_memo_key *k = key;
+    uint32_t hash;
+
+    hash = hash_uint64(k->dxbc_hash);
+    hash = hash_combine(hash, hash_uint64(k->shader_interface_key));
+    hash = hash_combine(hash, hash_uint64(k->root_signature_hash));
+    hash = hash_combine(hash, hash_uint64(k->compile_args_hash));
+    return hash;
+}
+
+static bool vkd3d_shader_memo_key_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_shader_memo_map_entry *e = (const struct vkd3d_shader_memo_map_entry *)entry;
+    return !memcmp(key, &e->key, sizeof(e->key));
+}
+
+static size_t vkd3d_shader_memo_entry_size(const struct vkd3d_shader_memo_entry *memo)
+{
+    return sizeof(*memo) + memo->code.size;
+}
+
+static void vkd3d_shader_memo_cache_evict_locked(struct vkd3d_shader_memo_cache *cache)
+{
+    struct vkd3d_shader_memo_entry *memo;
+    struct hash_map_entry *entry;
+
+    memo = LIST_ENTRY(list_tail(&cache->lru), struct vkd3d_shader_memo_entry, lru_entry);
+
+    if ((entry = hash_map_find(&cache->map, &memo->key)))
+        hash_map_remove(&cache->map, entry);
+
+    list_remove(&memo->lru_entry);
+    cache->total_size -= vkd3d_shader_memo_entry_size(memo);
+    cache->eviction_count++;
+
+    vkd3d_shader_free_shader_code(&memo->code);
+    vkd3d_free(memo);
+}
+
+HRESULT vkd3d_shader_memo_cache_init(struct vkd3d_shader_memo_cache *cache)
+{
+    char env[VKD3D_PATH_MAX];
+    int rc;
+
+    memset(cache, 0, sizeof(*cache));
+
+    cache->max_size = VKD3D_SHADER_MEMO_CACHE_DEFAULT_SIZE_MB * 1024 * 1024;
+    if (vkd3d_get_env_var("VKD3D_SHADER_MEMO_CACHE_SIZE", env, sizeof(env)))
+    {
+        cache->max_size = (size_t)strtoul(env, NULL, 0) * 1024 * 1024;
+        INFO("Setting SPIR-V memo cache size to %zu MiB.\n", cache->max_size / (1024 * 1024));
+    }
+
+    if ((rc = pthread_mutex_init(&cache->lock, NULL)))
+        return hresult_from_errno(rc);
+
+    hash_map_init(&cache->map, vkd3d_shader_memo_key_hash,
+            vkd3d_shader_memo_key_compare, sizeof(struct vkd3d_shader_memo_map_entry));
+    list_init(&cache->lru);
+    return S_OK;
+}
+
+void vkd3d_shader_memo_cache_cleanup(struct vkd3d_shader_memo_cache *cache)
+{
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
+    {
+        INFO("SPIR-V memo cache: %u hits, %u misses, %u evictions, %zu KiB resident.\n",
+                cache->hit_count, cache->miss_count, cache->eviction_count, cache->total_size / 1024);
+    }
+
+    while (!list_empty(&cache->lru))
+        vkd3d_shader_memo_cache_evict_locked(cache);
+
+    hash_map_clear(&cache->map);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+bool vkd3d_shader_memo_cache_lookup(struct vkd3d_shader_memo_cache *cache,
+        const struct vkd3d_shader_memo_key *key, struct vkd3d_shader_code *spirv_code)
+{
+    const struct vkd3d_shader_memo_map_entry *entry;
+    struct vkd3d_shader_memo_entry *memo;
+    void *code;
+
+    if (!cache->max_size)
+        return false;
+
+    pthread_mutex_lock(&cache->lock);
+
+    if (!(entry = (const struct vkd3d_shader_memo_map_entry *)hash_map_find(&cache->map, key)))
+    {
+        cache->miss_count++;
+        pthread_mutex_unlock(&cache->lock);
+        return false;
+    }
+
+    memo = entry->memo;
+
+    /* Callers own the returned code, so hand out a copy. */
+    if (!(code = vkd3d_malloc(memo->code.size)))
+    {
+        pthread_mutex_unlock(&cache->lock);
+        return false;
+    }
+
+    memcpy(code, memo->code.code, memo->code.size);
+    spirv_code->code = code;
+    spirv_code->size = memo->code.size;
+    spirv_code->meta = memo->code.meta;
+
+    list_remove(&memo->lru_entry);
+    list_add_head(&cache->lru, &memo->lru_entry);
+    cache->hit_count++;
+
+    pthread_mutex_unlock(&cache->lock);
+    return true;
+}
+
+void vkd3d_shader_memo_cache_insert(struct vkd3d_shader_memo_cache *cache,
+        const struct vkd3d_shader_memo_key *key, const struct vkd3d_shader_code *spirv_code)
+{
+    struct vkd3d_shader_memo_map_entry entry;
+    struct vkd3d_shader_memo_entry *memo;
+    struct hash_map_entry *map_entry;
+    void *code;
+
+    if (!cache->max_size || sizeof(*memo) + spirv_code->size > cache->max_size)
+        return;
+
+    if (!(memo = vkd3d_malloc(sizeof(*memo))))
+        return;
+
+    if (!(code = vkd3d_malloc(spirv_code->size)))
+    {
+        vkd3d_free(memo);
+        return;
+    }
+
+    memcpy(code, spirv_code->code, spirv_code->size);
+    memo->key = *key;
+    memo->code.code = code;
+    memo->code.size = spirv_code->size;
+    memo->code.meta = spirv_code->meta;
+
+    entry.key = *key;
+    entry.memo = memo;
+
+    pthread_mutex_lock(&cache->lock);
+
+    /* Another thread may have compiled the same shader concurrently, keep the first one. */
+    if (!(map_entry = hash_map_insert(&cache->map, key, &entry.entry)) ||
+            ((struct vkd3d_shader_memo_map_entry *)map_entry)->memo != memo)
+    {
+        pthread_mutex_unlock(&cache->lock);
+        vkd3d_free(code);
+        vkd3d_free(memo);
+        return;
+    }
+
+    list_add_head(&cache->lru, &memo->lru_entry);
+    cache->total_size += vkd3d_shader_memo_entry_size(memo);
+
+    while (cache->total_size > cache->max_size)
+        vkd3d_shader_memo_cache_evict_locked(cache);
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* Shader intern table. Games commonly create thousands of PSOs out of a handful of
+ * vertex shaders, so keep a single copy of each distinct SPIR-V blob and a single
+ * VkShaderModule for it rather than one per PSO. */
+struct vkd3d_shader_intern_key
+{
+    uint64_t spirv_hash;
+    size_t size;
+};
+
+struct vkd3d_shader_intern_entry
+{
+    struct vkd3d_shader_intern_key key;
+    /* Owned by the table. Freed once the last PSO drops its SPIR-V, even if the module lives on. */
+    struct vkd3d_shader_code code;
+    uint32_t code_refcount;
+    VkShaderModule vk_module;
+    uint32_t module_refcount;
+};
+
+struct vkd3d_shader_intern_code_map_entry
+{
+    struct hash_map_entry entry;
+    struct vkd3d_shader_intern_key key;
+    struct vkd3d_shader_intern_entry *intern;
+};
+
+struct vkd3d_shader_intern_module_map_entry
+{
+    struct hash_map_entry entry;
+    VkShaderModule vk_module;
+    struct vkd3d_shader_intern_entry *intern;
+};
+
+static uint32_t vkd3d_shader_intern_key_hash(const void *key)
+{
+    const struct vkd3d_shader_intern_key *k = key;
+    return hash_combine(hash_uint64(k->spirv_hash), hash_uint64(k->size));
+}
+
+static bool vkd3d_shader_intern_key_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_shader_intern_code_map_entry *e = (const struct vkd3d_shader_intern_code_map_entry *)entry;
+    const struct vkd3d_shader_intern_key *k = key;
+    return k->spirv_hash == e->key.spirv_hash && k->size == e->key.size;
+}
+
+static uint32_t vkd3d_shader_intern_module_hash(const void *key)
+{
+    return hash_uint64((uint64_t)*(const VkShaderModule *)key);
+}
+
+static bool vkd3d_shader_intern_module_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_shader_intern_module_map_entry *e = (const struct vkd3d_shader_intern_module_map_entry *)entry;
+    return *(const VkShaderModule *)key == e->vk_module;
+}
+
+static void vkd3d_shader_intern_key_init(struct vkd3d_shader_intern_key *key,
+        const struct vkd3d_shader_code *spirv_code)
+{
+    key->spirv_hash = vkd3d_hash64(spirv_code->code, spirv_code->size);
+    key->size = spirv_code->size;
+}
+
+static bool vkd3d_shader_intern_entry_matches(const struct vkd3d_shader_intern_entry *intern,
+        const struct vkd3d_shader_code *spirv_code)
+{
+    /* If the table no longer holds the code, trust the 64-bit hash like the memo cache does. */
+    return !intern->code.code || intern->code.code == spirv_code->code ||
+            !memcmp(intern->code.code, spirv_code->code, spirv_code->size);
+}
+
+static void vkd3d_shader_intern_table_update_peak_locked(struct vkd3d_shader_intern_table *table)
+{
+    table->peak_saved_code_size = max(table->peak_saved_code_size,
+            table->referenced_code_size - table->resident_code_size);
+    table->peak_saved_module_count = max(table->peak_saved_module_count,
+            table->referenced_module_count - table->resident_module_count);
+}
+
+static struct vkd3d_shader_intern_entry *vkd3d_shader_intern_table_find_locked(
+        struct vkd3d_shader_intern_table *table, const struct vkd3d_shader_intern_key *key)
+{
+    const struct vkd3d_shader_intern_code_map_entry *entry;
+
+    entry = (const struct vkd3d_shader_intern_code_map_entry *)hash_map_find(&table->code_map, key);
+    return entry ? entry->intern : NULL;
+}
+
+static struct vkd3d_shader_intern_entry *vkd3d_shader_intern_table_get_locked(
+        struct vkd3d_shader_intern_table *table, const struct vkd3d_shader_intern_key *key)
+{
+    struct vkd3d_shader_intern_code_map_entry entry;
+    struct vkd3d_shader_intern_entry *intern;
+
+    if ((intern = vkd3d_shader_intern_table_find_locked(table, key)))
+        return intern;
+
+    if (!(intern = vkd3d_calloc(1, sizeof(*intern))))
+        return NULL;
+
+    intern->key = *key;
+    entry.key = *key;
+    entry.intern = intern;
+
+    if (!hash_map_insert(&table->code_map, key, &entry.entry))
+    {
+        vkd3d_free(intern);
+        return NULL;
+    }
+
+    return intern;
+}
+
+static void vkd3d_shader_intern_table_free_if_unused_locked(struct vkd3d_shader_intern_table *table,
+        struct vkd3d_shader_intern_entry *intern)
+{
+    struct hash_map_entry *entry;
+
+    if (intern->code_refcount || intern->module_refcount)
+        return;
+
+    if ((entry = hash_map_find(&table->code_map, &intern->key)))
+        hash_map_remove(&table->code_map, entry);
+    vkd3d_free(intern);
+}
+
+static HRESULT vkd3d_shader_intern_create_module(struct d3d12_device *device,
+        const struct vkd3d_shader_code *spirv_code, VkShaderModule *vk_module)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    VkShaderModuleCreateInfo shader_desc;
+    char hash_str[16 + 1];
+    VkResult vr;
+
+    shader_desc.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shader_desc.pNext = NULL;
+    shader_desc.flags = 0;
+    shader_desc.codeSize = spirv_code->size;
+    shader_desc.pCode = spirv_code->code;
+
+    vr = VK_CALL(vkCreateShaderModule(device->vk_device, &shader_desc, NULL, vk_module));
+    if (vr < 0)
+    {
+        WARN("Failed to create Vulkan shader module, vr %d.\n", vr);
+        return hresult_from_vk_result(vr);
+    }
+
+    /* Helpful for tooling like RenderDoc. A shared module is named after the first PSO's shader. */
+    sprintf(hash_str, "%016"PRIx64, spirv_code->meta.hash);
+    vkd3d_set_vk_object_name(device, (uint64_t)*vk_module, VK_OBJECT_TYPE_SHADER_MODULE, hash_str);
+    return S_OK;
+}
+
+HRESULT vkd3d_shader_intern_table_init(struct vkd3d_shader_intern_table *table)
+{
+    int rc;
+
+    memset(table, 0, sizeof(*table));
+
+    if ((rc = pthread_mutex_init(&table->lock, NULL)))
+        return hresult_from_errno(rc);
+
+    hash_map_init(&table->code_map, vkd3d_shader_intern_key_hash,
+            vkd3d_shader_intern_key_compare, sizeof(struct vkd3d_shader_intern_code_map_entry));
+    hash_map_init(&table->module_map, vkd3d_shader_intern_module_hash,
+            vkd3d_shader_intern_module_compare, sizeof(struct vkd3d_shader_intern_module_map_entry));
+    return S_OK;
+}
+
+void vkd3d_shader_intern_table_cleanup(struct vkd3d_shader_intern_table *table, struct d3d12_device *device)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    struct vkd3d_shader_intern_code_map_entry *entry;
+    uint32_t i;
+
+    if (vkd3d_config_flags & (VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG | VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET))
+        vkd3d_shader_intern_table_report(table);
+
+    /* Every PSO holds a device reference, so anything left here has leaked. */
+    for (i = 0; i < table->code_map.entry_count; i++)
+    {
+        entry = (struct vkd3d_shader_intern_code_map_entry *)hash_map_get_entry(&table->code_map, i);
+        if (!(entry->entry.flags & HASH_MAP_ENTRY_OCCUPIED))
+            continue;
+
+        WARN("Leaked interned shader %016"PRIx64".\n", entry->key.spirv_hash);
+        VK_CALL(vkDestroyShaderModule(device->vk_device, entry->intern->vk_module, NULL));
+        vkd3d_shader_free_shader_code(&entry->intern->code);
+        vkd3d_free(entry->intern);
+    }
+
+    hash_map_clear(&table->code_map);
+    hash_map_clear(&table->module_map);
+    pthread_mutex_destroy(&table->lock);
+}
+
+void vkd3d_shader_intern_table_intern_code(struct vkd3d_shader_intern_table *table,
+        struct vkd3d_shader_code *spirv_code)
+{
+    struct vkd3d_shader_intern_entry *intern;
+    struct vkd3d_shader_intern_key key;
+    struct vkd3d_shader_code duplicate;
+
+    if (!spirv_code->size)
+        return;
+
+    vkd3d_shader_intern_key_init(&key, spirv_code);
+    memset(&duplicate, 0, sizeof(duplicate));
+
+    pthread_mutex_lock(&table->lock);
+
+    /* On allocation failure or a hash collision the caller simply keeps its private copy,
+     * which vkd3d_shader_intern_table_release_code() knows how to free. */
+    if (!(intern = vkd3d_shader_intern_table_get_locked(table, &key)))
+        goto out;
+
+    if (intern->code.code)
+    {
+        if (memcmp(intern->code.code, spirv_code->code, spirv_code->size))
+        {
+            WARN("SPIR-V hash collision for %016"PRIx64", not interning.\n", key.spirv_hash);
+            goto out;
+        }
+
+        TRACE("Sharing SPIR-V %016"PRIx64" (%zu bytes).\n", key.spirv_hash, key.size);
+        duplicate = *spirv_code;
+        spirv_code->code = intern->code.code;
+    }
+    else
+    {
+        intern->code = *spirv_code;
+        table->resident_code_size += key.size;
+    }
+
+    intern->code_refcount++;
+    table->referenced_code_size += key.size;
+    vkd3d_shader_intern_table_update_peak_locked(table);
+
+out:
+    pthread_mutex_unlock(&table->lock);
+    if (duplicate.code)
+        vkd3d_shader_free_shader_code(&duplicate);
+}
+
+void vkd3d_shader_intern_table_release_code(struct vkd3d_shader_intern_table *table,
+        struct vkd3d_shader_code *spirv_code)
+{
+    struct vkd3d_shader_intern_entry *intern;
+    struct vkd3d_shader_intern_key key;
+    struct vkd3d_shader_code code;
+
+    if (!spirv_code->code)
+        return;
+
+    vkd3d_shader_intern_key_init(&key, spirv_code);
+    code = *spirv_code;
+
+    pthread_mutex_lock(&table->lock);
+
+    if ((intern = vkd3d_shader_intern_table_find_locked(table, &key)) && intern->code.code == spirv_code->code)
+    {
+        table->referenced_code_size -= key.size;
+
+        if (--intern->code_refcount)
+        {
+            memset(&code, 0, sizeof(code));
+        }
+        else
+        {
+            table->resident_code_size -= key.size;
+            memset(&intern->code, 0, sizeof(intern->code));
+            vkd3d_shader_intern_table_free_if_unused_locked(table, intern);
+        }
+    }
+
+    pthread_mutex_unlock(&table->lock);
+
+    /* Either the last reference, or a private copy which never made it into the table. */
+    if (code.code)
+        vkd3d_shader_free_shader_code(&code);
+
+    /* Keep meta. */
+    spirv_code->code = NULL;
+    spirv_code->size = 0;
+}
+
+HRESULT vkd3d_shader_intern_table_acquire_module(struct vkd3d_shader_intern_table *table,
+        struct d3d12_device *device, const struct vkd3d_shader_code *spirv_code, VkShaderModule *vk_module)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    struct vkd3d_shader_intern_module_map_entry entry;
+    VkShaderModule new_module, stale_module;
+    struct vkd3d_shader_intern_entry *intern;
+    struct vkd3d_shader_intern_key key;
+    HRESULT hr;
+
+    vkd3d_shader_intern_key_init(&key, spirv_code);
+
+    pthread_mutex_lock(&table->lock);
+    if ((intern = vkd3d_shader_intern_table_find_locked(table, &key)) && intern->vk_module &&
+            vkd3d_shader_intern_entry_matches(intern, spirv_code))
+    {
+        TRACE("Sharing shader module for SPIR-V %016"PRIx64".\n", key.spirv_hash);
+        intern->module_refcount++;
+        table->referenced_module_count++;
+        vkd3d_shader_intern_table_update_peak_locked(table);
+        *vk_module = intern->vk_module;
+        pthread_mutex_unlock(&table->lock);
+        return S_OK;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    /* Don't serialize PSO creation on the driver compiling modules. */
+    if (FAILED(hr = vkd3d_shader_intern_create_module(device, spirv_code, &new_module)))
+        return hr;
+
+    stale_module = VK_NULL_HANDLE;
+    *vk_module = new_module;
+
+    pthread_mutex_lock(&table->lock);
+
+    /* On allocation failure or a hash collision, hand out a private module.
+     * vkd3d_shader_intern_table_release_module() destroys modules it does not know about. */
+    if (!(intern = vkd3d_shader_intern_table_get_locked(table, &key)))
+        goto out;
+
+    if (!vkd3d_shader_intern_entry_matches(intern, spirv_code))
+    {
+        WARN("SPIR-V hash collision for %016"PRIx64", not sharing module.\n", key.spirv_hash);
+        goto out;
+    }
+
+    if (intern->vk_module)
+    {
+        /* Another thread won the race. */
+        stale_module = new_module;
+    }
+    else
+    {
+        entry.vk_module = new_module;
+        entry.intern = intern;
+
+        if (!hash_map_insert(&table->module_map, &new_module, &entry.entry))
+        {
+            vkd3d_shader_intern_table_free_if_unused_locked(table, intern);
+            goto out;
+        }
+
+        intern->vk_module = new_module;
+        table->resident_module_count++;
+    }
+
+    intern->module_refcount++;
+    table->referenced_module_count++;
+    vkd3d_shader_intern_table_update_peak_locked(table);
+    *vk_module = intern->vk_module;
+
+out:
+    pthread_mutex_unlock(&table->lock);
+    if (stale_module != VK_NULL_HANDLE)
+        VK_CALL(vkDestroyShaderModule(device->vk_device, stale_module, NULL));
+    return S_OK;
+}
+
+void vkd3d_shader_intern_table_release_module(struct vkd3d_shader_intern_table *table,
+        struct d3d12_device *device, VkShaderModule vk_module)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    struct vkd3d_shader_intern_module_map_entry *entry;
+    struct vkd3d_shader_intern_entry *intern;
+
+    if (vk_module == VK_NULL_HANDLE)
+        return;
+
+    pthread_mutex_lock(&table->lock);
+
+    if ((entry = (struct vkd3d_shader_intern_module_map_entry *)hash_map_find(&table->module_map, &vk_module)))
+    {
+        intern = entry->intern;
+        table->referenced_module_count--;
+
+        if (--intern->module_refcount)
+        {
+            vk_module = VK_NULL_HANDLE;
+        }
+        else
+        {
+            hash_map_remove(&table->module_map, &entry->entry);
+            intern->vk_module = VK_NULL_HANDLE;
+            table->resident_module_count--;
+            vkd3d_shader_intern_table_free_if_unused_locked(table, intern);
+        }
+    }
+
+    pthread_mutex_unlock(&table->lock);
+
+    if (vk_module != VK_NULL_HANDLE)
+        VK_CALL(vkDestroyShaderModule(device->vk_device, vk_module, NULL));
+}
+
+void vkd3d_shader_intern_table_report(struct vkd3d_shader_intern_table *table)
+{
+    pthread_mutex_lock(&table->lock);
+    INFO("Shader intern table: %zu KiB SPIR-V resident for %zu KiB referenced (%zu KiB saved, peak %zu KiB), "
+            "%u shader modules resident for %u referenced (%u saved, peak %u).\n",
+            table->resident_code_size / 1024, table->referenced_code_size / 1024,
+            (table->referenced_code_size - table->resident_code_size) / 1024,
+            table->peak_saved_code_size / 1024,
+            table->resident_module_count, table->referenced_module_count,
+            table->referenced_module_count - table->resident_module_count,
+            table->peak_saved_module_count);
+    pthread_mutex_unlock(&table->lock);
+}
@@ -36,15 +36,6 @@ static void d3d12_shared_fence_dec_ref(struct d3d12_shared_fence *fence);
 static void d3d12_fence_iface_inc_ref(d3d12_fence_iface *iface);
 static void d3d12_fence_iface_dec_ref(d3d12_fence_iface *iface);
 
-#define MAX_BATCHED_IMAGE_BARRIERS 16
-struct d3d12_command_list_barrier_batch
-{
-    VkImageMemoryBarrier vk_image_barriers[MAX_BATCHED_IMAGE_BARRIERS];
-    VkMemoryBarrier vk_memory_barrier;
-    uint32_t image_barrier_count;
-    VkPipelineStageFlags dst_stage_mask, src_stage_mask;
-};
-
 static void d3d12_command_list_barrier_batch_init(struct d3d12_command_list_barrier_batch *batch);
 static void d3d12_command_list_barrier_batch_end(struct d3d12_command_list *list,
         struct d3d12_command_list_barrier_batch *batch);
@@ -436,6 +427,31 @@ static HRESULT vkd3d_create_timeline_semaphore(struct d3d12_device *device, uint
     return hresult_from_vk_result(vr);
 }
 
+static void vkd3d_fence_worker_wake_locked(struct vkd3d_fence_worker *worker)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &worker->device->vk_procs;
+    VkSemaphoreSignalInfoKHR signal_info;
+    VkResult vr;
+
+    if (!worker->waiting_on_gpu)
+    {
+        pthread_cond_signal(&worker->cond);
+        return;
+    }
+
+    /* The worker is blocked in vkWaitSemaphores. It waits for exactly one increment of the wake timeline,
+     * so only signal it once per wait. */
+    worker->waiting_on_gpu = false;
+
+    signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR;
+    signal_info.pNext = NULL;
+    signal_info.semaphore = worker->wake_timeline;
+    signal_info.value = ++worker->wake_timeline_value;
+
+    if ((vr = VK_CALL(vkSignalSemaphoreKHR(worker->device->vk_device, &signal_info))))
+        ERR("Failed to signal wake timeline, vr %d.\n", vr);
+}
+
 static HRESULT vkd3d_enqueue_timeline_semaphore(struct vkd3d_fence_worker *worker,
         d3d12_fence_iface *fence, VkSemaphore timeline, uint64_t value, bool signal,
         LONG **submission_counters, size_t num_submission_counts)
@@ -478,7 +494,7 @@ static HRESULT vkd3d_enqueue_timeline_semaphore(struct vkd3d_fence_worker *worke
     waiting_fence->num_submission_counts = num_submission_counts;
     ++worker->enqueued_fence_count;
 
-    pthread_cond_signal(&worker->cond);
+    vkd3d_fence_worker_wake_locked(worker);
     pthread_mutex_unlock(&worker->mutex);
     return S_OK;
 }
@@ -491,14 +507,48 @@ static void vkd3d_waiting_fence_release_submissions(const struct vkd3d_waiting_f
     vkd3d_free(fence->submission_counters);
 }
 
+static uint64_t vkd3d_fence_worker_get_wait_timeout(void)
+{
+    /* Some drivers hang indefinitely in face of device lost.
+     * If a wait here takes more than 5 seconds, this is pretty much
+     * a guaranteed timeout (TDR) scenario.
+     * Usually, we'd observe DEVICE_LOST in subsequent submissions,
+     * but if application submits something and expects to wait on that submission
+     * immediately, this can happen. */
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_BREADCRUMBS)
+        return 5000000000ull;
+    else
+        return UINT64_MAX;
+}
+
+static void vkd3d_waiting_fence_complete(const struct vkd3d_waiting_fence *fence)
+{
+    struct d3d12_fence *local_fence;
+    HRESULT hr;
+
+    if (fence->fence && !is_shared_ID3D12Fence1(fence->fence) && fence->signal)
+    {
+        local_fence = impl_from_ID3D12Fence1(fence->fence);
+        TRACE("Signaling fence %p value %#"PRIx64".\n", local_fence, fence->value);
+        if (FAILED(hr = d3d12_fence_signal(local_fence, fence->value)))
+            ERR("Failed to signal D3D12 fence, hr %#x.\n", hr);
+    }
+
+    if (fence->fence)
+        d3d12_fence_iface_dec_ref(fence->fence);
+
+    /* Submission release should only be paired with an execute command.
+     * Such execute commands can be paired with a d3d12_fence_dec_ref(),
+     * but no signalling operation. */
+    assert(!fence->num_submission_counts || !fence->signal);
+    vkd3d_waiting_fence_release_submissions(fence);
+}
+
 static void vkd3d_wait_for_gpu_timeline_semaphore(struct vkd3d_fence_worker *worker, const struct vkd3d_waiting_fence *fence)
 {
     struct d3d12_device *device = worker->device;
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     VkSemaphoreWaitInfoKHR wait_info;
-    struct d3d12_fence *local_fence;
-    uint64_t timeout = UINT64_MAX;
-    HRESULT hr;
     int vr;
 
     wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
@@ -508,16 +558,7 @@ static void vkd3d_wait_for_gpu_timeline_semaphore(struct vkd3d_fence_worker *wor
     wait_info.pSemaphores = &fence->submission_timeline;
     wait_info.pValues = &fence->value;
 
-    /* Some drivers hang indefinitely in face of device lost.
-     * If a wait here takes more than 5 seconds, this is pretty much
-     * a guaranteed timeout (TDR) scenario.
-     * Usually, we'd observe DEVICE_LOST in subsequent submissions,
-     * but if application submits something and expects to wait on that submission
-     * immediately, this can happen. */
-    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_BREADCRUMBS)
-        timeout = 5000000000ull;
-
-    if ((vr = VK_CALL(vkWaitSemaphoresKHR(device->vk_device, &wait_info, timeout))))
+    if ((vr = VK_CALL(vkWaitSemaphoresKHR(device->vk_device, &wait_info, vkd3d_fence_worker_get_wait_timeout()))))
     {
         ERR("Failed to wait for Vulkan timeline semaphore, vr %d.\n", vr);
         VKD3D_DEVICE_REPORT_BREADCRUMB_IF(device, vr == VK_ERROR_DEVICE_LOST || vr == VK_TIMEOUT);
@@ -529,39 +570,145 @@ static void vkd3d_wait_for_gpu_timeline_semaphore(struct vkd3d_fence_worker *wor
     vkd3d_shader_debug_ring_kick(&device->debug_ring, device, false);
     vkd3d_descriptor_debug_kick_qa_check(device->descriptor_qa_global_info);
 
-    if (fence->fence && !is_shared_ID3D12Fence1(fence->fence) && fence->signal)
+    vkd3d_waiting_fence_complete(fence);
+}
+
+struct vkd3d_fence_worker_wait_list
+{
+    VkSemaphore *semaphores;
+    size_t semaphores_size;
+    uint64_t *values;
+    size_t values_size;
+    uint32_t count;
+};
+
+static bool vkd3d_fence_worker_wait_list_add(struct vkd3d_fence_worker_wait_list *list,
+        VkSemaphore semaphore, uint64_t value)
+{
+    uint32_t i;
+
+    /* Only the lowest pending value matters for a wait-any. */
+    for (i = 0; i < list->count; i++)
     {
-        local_fence = impl_from_ID3D12Fence1(fence->fence);
-        TRACE("Signaling fence %p value %#"PRIx64".\n", local_fence, fence->value);
-        if (FAILED(hr = d3d12_fence_signal(local_fence, fence->value)))
-            ERR("Failed to signal D3D12 fence, hr %#x.\n", hr);
+        if (list->semaphores[i] == semaphore)
+        {
+            list->values[i] = min(list->values[i], value);
+            return true;
+        }
     }
 
-    if (fence->fence)
-        d3d12_fence_iface_dec_ref(fence->fence);
+    if (!vkd3d_array_reserve((void **)&list->semaphores, &list->semaphores_size,
+            list->count + 1, sizeof(*list->semaphores)) ||
+            !vkd3d_array_reserve((void **)&list->values, &list->values_size,
+            list->count + 1, sizeof(*list->values)))
+        return false;
 
-    /* Submission release should only be paired with an execute command.
-     * Such execute commands can be paired with a d3d12_fence_dec_ref(),
-     * but no signalling operation. */
-    assert(!fence->num_submission_counts || !fence->signal);
-    vkd3d_waiting_fence_release_submissions(fence);
+    list->semaphores[list->count] = semaphore;
+    list->values[list->count] = value;
+    list->count++;
+    return true;
+}
+
+/* Waits until at least one pending fence, or the wake timeline, has completed,
+ * and retires every pending fence which has completed by then. */
+static void vkd3d_fence_worker_wait_any(struct vkd3d_fence_worker *worker,
+        struct vkd3d_fence_worker_wait_list *list, uint64_t wake_value,
+        struct vkd3d_waiting_fence *fences, size_t *fence_count)
+{
+    struct d3d12_device *device = worker->device;
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
+    VkSemaphoreWaitInfoKHR wait_info;
+    size_t i, retired_count, count;
+    uint32_t j;
+    int vr;
+
+    list->count = 0;
+    count = *fence_count;
+
+    for (i = 0; i < count; i++)
+        if (!vkd3d_fence_worker_wait_list_add(list, fences[i].submission_timeline, fences[i].value))
+            break;
+
+    /* The wake timeline is always the last entry. */
+    if (i < count || !vkd3d_fence_worker_wait_list_add(list, worker->wake_timeline, wake_value))
+    {
+        ERR("Failed to allocate wait list, falling back to blocking wait.\n");
+        for (i = 0; i < count; i++)
+            vkd3d_wait_for_gpu_timeline_semaphore(worker, &fences[i]);
+        *fence_count = 0;
+        return;
+    }
+
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    wait_info.pNext = NULL;
+    wait_info.flags = VK_SEMAPHORE_WAIT_ANY_BIT_KHR;
+    wait_info.semaphoreCount = list->count;
+    wait_info.pSemaphores = list->semaphores;
+    wait_info.pValues = list->values;
+
+    if ((vr = VK_CALL(vkWaitSemaphoresKHR(device->vk_device, &wait_info, vkd3d_fence_worker_get_wait_timeout()))))
+    {
+        ERR("Failed to wait for Vulkan timeline semaphores, vr %d.\n", vr);
+        VKD3D_DEVICE_REPORT_BREADCRUMB_IF(device, vr == VK_ERROR_DEVICE_LOST || vr == VK_TIMEOUT);
+        for (i = 0; i < count; i++)
+            vkd3d_waiting_fence_release_submissions(&fences[i]);
+        *fence_count = 0;
+        return;
+    }
+
+    /* Replace the wait values with the current counter values, so we can retire
+     * everything that has completed in one go, regardless of enqueue order. */
+    for (j = 0; j + 1 < list->count; j++)
+    {
+        if ((vr = VK_CALL(vkGetSemaphoreCounterValueKHR(device->vk_device, list->semaphores[j], &list->values[j]))))
+        {
+            ERR("Failed to query timeline semaphore value, vr %d.\n", vr);
+            list->values[j] = 0;
+        }
+    }
+
+    for (i = 0, retired_count = 0; i < count; i++)
+    {
+        for (j = 0; list->semaphores[j] != fences[i].submission_timeline; j++)
+            continue;
+
+        if (fences[i].value <= list->values[j])
+        {
+            vkd3d_waiting_fence_complete(&fences[i]);
+            retired_count++;
+        }
+        else
+            fences[i - retired_count] = fences[i];
+    }
+
+    *fence_count = count - retired_count;
+
+    if (retired_count)
+    {
+        /* This is a good time to kick the debug threads into action. */
+        vkd3d_shader_debug_ring_kick(&device->debug_ring, device, false);
+        vkd3d_descriptor_debug_kick_qa_check(device->descriptor_qa_global_info);
+    }
 }
 
 static void *vkd3d_fence_worker_main(void *arg)
 {
-    struct vkd3d_waiting_fence *cur_fences, *old_fences;
+    struct vkd3d_fence_worker_wait_list wait_list;
+    struct vkd3d_waiting_fence *pending_fences;
     struct vkd3d_fence_worker *worker = arg;
-    size_t cur_fences_size, old_fences_size;
-    uint32_t cur_fence_count;
-    uint32_t i;
+    size_t pending_fences_size;
+    size_t pending_fence_count;
+    uint64_t wake_value;
+    size_t i;
     bool do_exit;
     int rc;
 
     vkd3d_set_thread_name("vkd3d_fence");
 
-    cur_fence_count = 0;
-    cur_fences_size = 0;
-    cur_fences = NULL;
+    memset(&wait_list, 0, sizeof(wait_list));
+    pending_fence_count = 0;
+    pending_fences_size = 0;
+    pending_fences = NULL;
 
     for (;;)
     {
@@ -571,7 +718,7 @@ static void *vkd3d_fence_worker_main(void *arg)
             break;
         }
 
-        if (!worker->enqueued_fence_count && !worker->should_exit)
+        if (!worker->enqueued_fence_count && !pending_fence_count && !worker->should_exit)
         {
             if ((rc = pthread_cond_wait(&worker->cond, &worker->mutex)))
             {
@@ -581,34 +728,55 @@ static void *vkd3d_fence_worker_main(void *arg)
             }
         }
 
-        old_fences_size = cur_fences_size;
-        old_fences = cur_fences;
+        if (worker->enqueued_fence_count)
+        {
+            if (vkd3d_array_reserve((void **)&pending_fences, &pending_fences_size,
+                    pending_fence_count + worker->enqueued_fence_count, sizeof(*pending_fences)))
+            {
+                memcpy(pending_fences + pending_fence_count, worker->enqueued_fences,
+                        worker->enqueued_fence_count * sizeof(*pending_fences));
+                pending_fence_count += worker->enqueued_fence_count;
+                worker->enqueued_fence_count = 0;
+            }
+            else
+                ERR("Failed to allocate pending fences.\n");
+        }
 
-        cur_fence_count = worker->enqueued_fence_count;
-        cur_fences_size = worker->enqueued_fences_size;
-        cur_fences = worker->enqueued_fences;
         do_exit = worker->should_exit;
 
-        worker->enqueued_fence_count = 0;
-        worker->enqueued_fences_size = old_fences_size;
-        worker->enqueued_fences = old_fences;
+        /* From here on, enqueuing a fence has to interrupt our wait through the wake timeline. */
+        wake_value = worker->wake_timeline_value + 1;
+        worker->waiting_on_gpu = pending_fence_count && !do_exit;
 
         pthread_mutex_unlock(&worker->mutex);
 
-        for (i = 0; i < cur_fence_count; i++)
-            vkd3d_wait_for_gpu_timeline_semaphore(worker, &cur_fences[i]);
-
         if (do_exit)
+        {
+            for (i = 0; i < pending_fence_count; i++)
+                vkd3d_wait_for_gpu_timeline_semaphore(worker, &pending_fences[i]);
             break;
+        }
+
+        if (pending_fence_count)
+        {
+            vkd3d_fence_worker_wait_any(worker, &wait_list, wake_value, pending_fences, &pending_fence_count);
+
+            pthread_mutex_lock(&worker->mutex);
+            worker->waiting_on_gpu = false;
+            pthread_mutex_unlock(&worker->mutex);
+        }
     }
 
-    vkd3d_free(cur_fences);
+    vkd3d_free(wait_list.semaphores);
+    vkd3d_free(wait_list.values);
+    vkd3d_free(pending_fences);
     return NULL;
 }
 
 HRESULT vkd3d_fence_worker_start(struct vkd3d_fence_worker *worker,
         struct d3d12_device *device)
 {
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     HRESULT hr;
     int rc;
 
@@ -621,9 +789,19 @@ HRESULT vkd3d_fence_worker_start(struct vkd3d_fence_worker *worker,
     worker->enqueued_fences = NULL;
     worker->enqueued_fences_size = 0;
 
+    worker->wake_timeline_value = 0;
+    worker->waiting_on_gpu = false;
+
+    if (FAILED(hr = vkd3d_create_timeline_semaphore(device, 0, false, &worker->wake_timeline)))
+    {
+        ERR("Failed to create wake timeline semaphore, hr %#x.\n", hr);
+        return hr;
+    }
+
     if ((rc = pthread_mutex_init(&worker->mutex, NULL)))
     {
         ERR("Failed to initialize mutex, error %d.\n", rc);
+        VK_CALL(vkDestroySemaphore(device->vk_device, worker->wake_timeline, NULL));
         return hresult_from_errno(rc);
     }
 
@@ -631,6 +809,7 @@ HRESULT vkd3d_fence_worker_start(struct vkd3d_fence_worker *worker,
     {
         ERR("Failed to initialize condition variable, error %d.\n", rc);
         pthread_mutex_destroy(&worker->mutex);
+        VK_CALL(vkDestroySemaphore(device->vk_device, worker->wake_timeline, NULL));
         return hresult_from_errno(rc);
     }
 
@@ -639,6 +818,7 @@ HRESULT vkd3d_fence_worker_start(struct vkd3d_fence_worker *worker,
     {
         pthread_mutex_destroy(&worker->mutex);
         pthread_cond_destroy(&worker->cond);
+        VK_CALL(vkDestroySemaphore(device->vk_device, worker->wake_timeline, NULL));
     }
 
     return hr;
@@ -647,6 +827,7 @@ HRESULT vkd3d_fence_worker_start(struct vkd3d_fence_worker *worker,
 HRESULT vkd3d_fence_worker_stop(struct vkd3d_fence_worker *worker,
         struct d3d12_device *device)
 {
+    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     HRESULT hr;
     int rc;
 
@@ -659,7 +840,7 @@ HRESULT vkd3d_fence_worker_stop(struct vkd3d_fence_worker *worker,
     }
 
     worker->should_exit = true;
-    pthread_cond_signal(&worker->cond);
+    vkd3d_fence_worker_wake_locked(worker);
 
     pthread_mutex_unlock(&worker->mutex);
 
@@ -668,6 +849,7 @@ HRESULT vkd3d_fence_worker_stop(struct vkd3d_fence_worker *worker,
 
     pthread_mutex_destroy(&worker->mutex);
     pthread_cond_destroy(&worker->cond);
+    VK_CALL(vkDestroySemaphore(device->vk_device, worker->wake_timeline, NULL));
 
     vkd3d_free(worker->enqueued_fences);
     return S_OK;
@@ -2752,12 +2934,57 @@ static void d3d12_command_list_reset_buffer_copy_tracking(struct d3d12_command_l
     list->tracked_copy_buffer_count = 0;
 }
 
+/* Returns the tracked write range which aliases with a write to vk_buffer, or NULL.
+ * A null buffer stands for a sparse buffer, which is considered to alias with any other resource.
+ * *overlaps is set if [offset, range_end) intersects the tracked range, i.e. a barrier is needed. */
+static struct d3d12_buffer_copy_tracked_buffer *d3d12_command_list_find_tracked_copy_buffer(
+        struct d3d12_command_list *list, VkBuffer vk_buffer, VkDeviceSize offset, VkDeviceSize range_end,
+        bool *overlaps)
+{
+    struct d3d12_buffer_copy_tracked_buffer *tracked_buffer;
+    unsigned int i;
+
+    for (i = 0; i < list->tracked_copy_buffer_count; i++)
+    {
+        tracked_buffer = &list->tracked_copy_buffers[i];
+
+        if (tracked_buffer->vk_buffer == vk_buffer || tracked_buffer->vk_buffer == VK_NULL_HANDLE ||
+                vk_buffer == VK_NULL_HANDLE)
+        {
+            *overlaps = range_end > tracked_buffer->hazard_begin && offset < tracked_buffer->hazard_end;
+            return tracked_buffer;
+        }
+    }
+
+    *overlaps = false;
+    return NULL;
+}
+
+/* Returns true if d3d12_command_list_mark_copy_buffer_write() would have to inject a barrier for this write. */
+static bool d3d12_command_list_copy_buffer_write_has_hazard(struct d3d12_command_list *list,
+        VkBuffer vk_buffer, VkDeviceSize offset, VkDeviceSize size, bool sparse)
+{
+    bool overlaps;
+
+    if (sparse)
+    {
+        vk_buffer = VK_NULL_HANDLE;
+        offset = 0;
+        size = VK_WHOLE_SIZE;
+    }
+
+    if (d3d12_command_list_find_tracked_copy_buffer(list, vk_buffer, offset, offset + size, &overlaps))
+        return overlaps;
+
+    return list->tracked_copy_buffer_count == ARRAY_SIZE(list->tracked_copy_buffers);
+}
+
 static void d3d12_command_list_mark_copy_buffer_write(struct d3d12_command_list *list, VkBuffer vk_buffer,
         VkDeviceSize offset, VkDeviceSize size, bool sparse)
 {
     struct d3d12_buffer_copy_tracked_buffer *tracked_buffer;
     VkDeviceSize range_end;
-    unsigned int i;
+    bool overlaps;
 
     if (sparse)
     {
@@ -2768,30 +2995,24 @@ static void d3d12_command_list_mark_copy_buffer_write(struct d3d12_command_list
 
     range_end = offset + size;
 
-    for (i = 0; i < list->tracked_copy_buffer_count; i++)
+    if ((tracked_buffer = d3d12_command_list_find_tracked_copy_buffer(list, vk_buffer, offset, range_end, &overlaps)))
     {
-        tracked_buffer = &list->tracked_copy_buffers[i];
-
-        /* Any write to a sparse buffer will be considered to be aliasing with any other resource. */
-        if (tracked_buffer->vk_buffer == vk_buffer || tracked_buffer->vk_buffer == VK_NULL_HANDLE || sparse)
+        if (overlaps)
         {
-            if (range_end > tracked_buffer->hazard_begin && offset < tracked_buffer->hazard_end)
-            {
-                /* Hazard. Inject barrier. */
-                d3d12_command_list_resolve_buffer_copy_writes(list);
-                tracked_buffer = &list->tracked_copy_buffers[0];
-                tracked_buffer->vk_buffer = vk_buffer;
-                tracked_buffer->hazard_begin = offset;
-                tracked_buffer->hazard_end = range_end;
-                list->tracked_copy_buffer_count = 1;
-            }
-            else
-            {
-                tracked_buffer->hazard_begin = min(offset, tracked_buffer->hazard_begin);
-                tracked_buffer->hazard_end = max(range_end, tracked_buffer->hazard_end);
-            }
-            return;
+            /* Hazard. Inject barrier. */
+            d3d12_command_list_resolve_buffer_copy_writes(list);
+            tracked_buffer = &list->tracked_copy_buffers[0];
+            tracked_buffer->vk_buffer = vk_buffer;
+            tracked_buffer->hazard_begin = offset;
+            tracked_buffer->hazard_end = range_end;
+            list->tracked_copy_buffer_count = 1;
+        }
+        else
+        {
+            tracked_buffer->hazard_begin = min(offset, tracked_buffer->hazard_begin);
+            tracked_buffer->hazard_end = max(range_end, tracked_buffer->hazard_end);
         }
+        return;
     }
 
     /* Keep the tracking data structures lean and mean. If we have decent overlap, this isn't a real problem. */
@@ -4098,7 +4319,14 @@ cleanup:
     return result;
 }
 
-static void d3d12_command_list_end_current_render_pass(struct d3d12_command_list *list, bool suspend)
+void d3d12_command_list_flush_pending_barriers(struct d3d12_command_list *list)
+{
+    d3d12_command_list_barrier_batch_end(list, &list->pending_barriers);
+}
+
+/* For state-only calls which must break the render pass, but record nothing
+ * which depends on barriers deferred by ResourceBarrier(). */
+static void d3d12_command_list_end_current_render_pass_keep_barriers(struct d3d12_command_list *list, bool suspend)
 {
     const struct vkd3d_vk_device_procs *vk_procs = &list->device->vk_procs;
 
@@ -4141,6 +4369,13 @@ static void d3d12_command_list_end_current_render_pass(struct d3d12_command_list
     }
 }
 
+static void d3d12_command_list_end_current_render_pass(struct d3d12_command_list *list, bool suspend)
+{
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, suspend);
+    /* Everything which ends the render pass goes on to record work outside of it. */
+    d3d12_command_list_flush_pending_barriers(list);
+}
+
 static void d3d12_command_list_invalidate_push_constants(struct vkd3d_pipeline_bindings *bindings)
 {
     if (bindings->root_signature->descriptor_table_count)
@@ -4618,6 +4853,9 @@ static HRESULT STDMETHODCALLTYPE d3d12_command_list_Close(d3d12_command_list_ifa
     VkResult vr;
     HRESULT hr;
 
+    VKD3D_REGION_DECL(state_filtered);
+    VKD3D_REGION_DECL(state_effective);
+
     TRACE("iface %p.\n", iface);
 
     if (!list->is_recording)
@@ -4629,6 +4867,25 @@ static HRESULT STDMETHODCALLTYPE d3d12_command_list_Close(d3d12_command_list_ifa
     d3d12_command_list_end_current_render_pass(list, false);
     d3d12_command_list_end_transfer_batch(list);
 
+    TRACE("Merged %u resource barriers into %u pipeline barriers.\n",
+            list->resource_barrier_count, list->pending_barriers.pipeline_barrier_count);
+    TRACE("Filtered %u redundant state changes, %u effective state changes.\n",
+            list->filtered_state_count, list->effective_state_count);
+
+    /* There is no counter interface in the profiler, so these are reported as empty regions.
+     * Their iteration counts accumulate over all command lists, the TRACE above is per list. */
+    if (list->filtered_state_count)
+    {
+        VKD3D_REGION_BEGIN(state_filtered);
+        VKD3D_REGION_END_ITERATIONS(state_filtered, list->filtered_state_count);
+    }
+
+    if (list->effective_state_count)
+    {
+        VKD3D_REGION_BEGIN(state_effective);
+        VKD3D_REGION_END_ITERATIONS(state_effective, list->effective_state_count);
+    }
+
     if (list->predicate_enabled)
         VK_CALL(vkCmdEndConditionalRenderingEXT(list->vk_command_buffer));
 
@@ -4905,6 +5162,12 @@ static void d3d12_command_list_reset_internal_state(struct d3d12_command_list *l
     list->dsv_resource_tracking_count = 0;
     list->tracked_copy_buffer_count = 0;
 
+    d3d12_command_list_barrier_batch_init(&list->pending_barriers);
+    list->resource_barrier_count = 0;
+
+    list->filtered_state_count = 0;
+    list->effective_state_count = 0;
+
     list->rendering_info.state_flags = 0;
     list->execute_indirect.has_emitted_indirect_to_compute_barrier = false;
     list->execute_indirect.has_observed_transition_to_indirect = false;
@@ -4961,7 +5224,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_ClearState(d3d12_command_list_i
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     TRACE("iface %p, pipline_state %p!\n", iface, pipeline_state);
-    d3d12_command_list_end_current_render_pass(list, false);
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, false);
     d3d12_command_list_reset_api_state(list, pipeline_state);
 }
 
@@ -5085,6 +5348,12 @@ static bool d3d12_command_list_update_compute_pipeline(struct d3d12_command_list
         return false;
     }
 
+    if (!list->state->compute.vk_pipeline)
+    {
+        WARN("Pipeline state %p has no compute pipeline, skipping dispatch.\n", list->state);
+        return false;
+    }
+
     if (list->command_buffer_pipeline != list->state->compute.vk_pipeline)
     {
         VK_CALL(vkCmdBindPipeline(list->vk_command_buffer,
@@ -5208,7 +5477,7 @@ static bool d3d12_command_list_update_graphics_pipeline(struct d3d12_command_lis
             (dsv_layout != list->rendering_info.dsv.imageLayout))
     {
         d3d12_command_list_invalidate_rendering_info(list);
-        d3d12_command_list_end_current_render_pass(list, false);
+        d3d12_command_list_end_current_render_pass_keep_barriers(list, false);
     }
 
     list->dsv_plane_optimal_mask = dsv_plane_optimal_mask;
@@ -5864,6 +6133,7 @@ static bool d3d12_command_list_begin_render_pass(struct d3d12_command_list *list
     struct d3d12_graphics_pipeline_state *graphics;
 
     d3d12_command_list_end_transfer_batch(list);
+    d3d12_command_list_flush_pending_barriers(list);
 
     d3d12_command_list_promote_dsv_layout(list);
     if (!d3d12_command_list_update_graphics_pipeline(list, pipeline_type))
@@ -6139,21 +6409,43 @@ static void STDMETHODCALLTYPE d3d12_command_list_Dispatch(d3d12_command_list_ifa
     VKD3D_BREADCRUMB_COMMAND(DISPATCH);
 }
 
+static bool d3d12_transfer_batch_buffer_copy_overlaps(const struct d3d12_transfer_batch_state *batch,
+        const VkBufferCopy2KHR *copy)
+{
+    const VkBufferCopy2KHR *other;
+    size_t i;
+
+    /* Source and destination regions of a single copy command must not overlap.
+     * Overlapping writes are already caught by the copy hazard tracking. */
+    if (batch->src_buffer != batch->dst_buffer)
+        return false;
+
+    for (i = 0; i < batch->batch_len; i++)
+    {
+        other = &batch->buffer_copies[i];
+
+        if (copy->srcOffset < other->dstOffset + other->size && other->dstOffset < copy->srcOffset + copy->size)
+            return true;
+        if (copy->dstOffset < other->srcOffset + other->size && other->srcOffset < copy->dstOffset + copy->size)
+            return true;
+    }
+
+    return false;
+}
+
 static void STDMETHODCALLTYPE d3d12_command_list_CopyBufferRegion(d3d12_command_list_iface *iface,
         ID3D12Resource *dst, UINT64 dst_offset, ID3D12Resource *src, UINT64 src_offset, UINT64 byte_count)
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
+    struct d3d12_transfer_batch_state *batch = &list->transfer_batch;
     struct d3d12_resource *dst_resource, *src_resource;
-    const struct vkd3d_vk_device_procs *vk_procs;
-    VkCopyBufferInfo2KHR copy_info;
     VkBufferCopy2KHR buffer_copy;
+    bool sparse;
 
     TRACE("iface %p, dst_resource %p, dst_offset %#"PRIx64", src_resource %p, "
             "src_offset %#"PRIx64", byte_count %#"PRIx64".\n",
             iface, dst, dst_offset, src, src_offset, byte_count);
 
-    vk_procs = &list->device->vk_procs;
-
     dst_resource = impl_from_ID3D12Resource(dst);
     assert(d3d12_resource_is_buffer(dst_resource));
     src_resource = impl_from_ID3D12Resource(src);
@@ -6163,7 +6455,6 @@ static void STDMETHODCALLTYPE d3d12_command_list_CopyBufferRegion(d3d12_command_
     d3d12_command_list_track_resource_usage(list, src_resource, true);
 
     d3d12_command_list_end_current_render_pass(list, true);
-    d3d12_command_list_end_transfer_batch(list);
 
     buffer_copy.sType = VK_STRUCTURE_TYPE_BUFFER_COPY_2_KHR;
     buffer_copy.pNext = NULL;
@@ -6171,16 +6462,28 @@ static void STDMETHODCALLTYPE d3d12_command_list_CopyBufferRegion(d3d12_command_
     buffer_copy.dstOffset = dst_offset + dst_resource->mem.offset;
     buffer_copy.size = byte_count;
 
-    copy_info.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2_KHR;
-    copy_info.pNext = NULL;
-    copy_info.srcBuffer = src_resource->res.vk_buffer;
-    copy_info.dstBuffer = dst_resource->res.vk_buffer;
-    copy_info.regionCount = 1;
-    copy_info.pRegions = &buffer_copy;
+    sparse = !!(dst_resource->flags & VKD3D_RESOURCE_RESERVED);
 
-    d3d12_command_list_mark_copy_buffer_write(list, copy_info.dstBuffer, buffer_copy.dstOffset, buffer_copy.size,
-            !!(dst_resource->flags & VKD3D_RESOURCE_RESERVED));
-    VK_CALL(vkCmdCopyBuffer2KHR(list->vk_command_buffer, &copy_info));
+    /* Copies between the same pair of buffers are recorded as one multi-region copy.
+     * If this write needs a barrier against earlier copies, the batch must be emitted
+     * before the barrier, so that the barrier actually separates the two. */
+    if (batch->batch_type != VKD3D_BATCH_TYPE_COPY_BUFFER ||
+            batch->src_buffer != src_resource->res.vk_buffer ||
+            batch->dst_buffer != dst_resource->res.vk_buffer ||
+            batch->batch_len == ARRAY_SIZE(batch->buffer_copies) ||
+            d3d12_transfer_batch_buffer_copy_overlaps(batch, &buffer_copy) ||
+            d3d12_command_list_copy_buffer_write_has_hazard(list, dst_resource->res.vk_buffer,
+                    buffer_copy.dstOffset, buffer_copy.size, sparse))
+    {
+        d3d12_command_list_end_transfer_batch(list);
+        batch->batch_type = VKD3D_BATCH_TYPE_COPY_BUFFER;
+        batch->src_buffer = src_resource->res.vk_buffer;
+        batch->dst_buffer = dst_resource->res.vk_buffer;
+    }
+
+    d3d12_command_list_mark_copy_buffer_write(list, batch->dst_buffer,
+            buffer_copy.dstOffset, buffer_copy.size, sparse);
+    batch->buffer_copies[batch->batch_len++] = buffer_copy;
 
     VKD3D_BREADCRUMB_COMMAND(COPY);
 }
@@ -7030,7 +7333,9 @@ static void STDMETHODCALLTYPE d3d12_command_list_CopyResource(d3d12_command_list
 
 static void d3d12_command_list_end_transfer_batch(struct d3d12_command_list *list)
 {
+    const struct vkd3d_vk_device_procs *vk_procs = &list->device->vk_procs;
     struct d3d12_command_list_barrier_batch barriers;
+    VkCopyBufferInfo2KHR copy_info;
     size_t i;
 
     switch (list->transfer_batch.batch_type)
@@ -7051,6 +7356,16 @@ static void d3d12_command_list_end_transfer_batch(struct d3d12_command_list *lis
             d3d12_command_list_barrier_batch_end(list, &barriers);
             list->transfer_batch.batch_len = 0;
             break;
+        case VKD3D_BATCH_TYPE_COPY_BUFFER:
+            copy_info.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_INFO_2_KHR;
+            copy_info.pNext = NULL;
+            copy_info.srcBuffer = list->transfer_batch.src_buffer;
+            copy_info.dstBuffer = list->transfer_batch.dst_buffer;
+            copy_info.regionCount = list->transfer_batch.batch_len;
+            copy_info.pRegions = list->transfer_batch.buffer_copies;
+            VK_CALL(vkCmdCopyBuffer2KHR(list->vk_command_buffer, &copy_info));
+            list->transfer_batch.batch_len = 0;
+            break;
         default:
             break;
     }
@@ -7400,6 +7715,22 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResolveSubresource(d3d12_comman
             D3D12_RESOLVE_MODE_AVERAGE);
 }
 
+static void d3d12_command_list_count_state_change(struct d3d12_command_list *list, bool changed)
+{
+    /* Applications tend to set the same state over and over, keep track of how much of it we can skip.
+     * Only count state set through the API here, not state we reset internally. */
+    if (changed)
+        list->effective_state_count++;
+    else
+        list->filtered_state_count++;
+}
+
+static bool d3d12_command_list_state_is_redundant(struct d3d12_command_list *list, bool redundant)
+{
+    d3d12_command_list_count_state_change(list, !redundant);
+    return redundant;
+}
+
 static void STDMETHODCALLTYPE d3d12_command_list_IASetPrimitiveTopology(d3d12_command_list_iface *iface,
         D3D12_PRIMITIVE_TOPOLOGY topology)
 {
@@ -7414,7 +7745,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_IASetPrimitiveTopology(d3d12_co
         return;
     }
 
-    if (dyn_state->primitive_topology == topology)
+    if (d3d12_command_list_state_is_redundant(list, dyn_state->primitive_topology == topology))
         return;
 
     dyn_state->primitive_topology = topology;
@@ -7428,6 +7759,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetViewports(d3d12_command_li
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     struct vkd3d_dynamic_state *dyn_state = &list->dynamic_state;
+    VkViewport vk_viewports[ARRAY_SIZE(dyn_state->viewports)];
     unsigned int i;
 
     TRACE("iface %p, viewport_count %u, viewports %p.\n", iface, viewport_count, viewports);
@@ -7440,7 +7772,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetViewports(d3d12_command_li
 
     for (i = 0; i < viewport_count; ++i)
     {
-        VkViewport *vk_viewport = &dyn_state->viewports[i];
+        VkViewport *vk_viewport = &vk_viewports[i];
         vk_viewport->x = viewports[i].TopLeftX;
         vk_viewport->y = viewports[i].TopLeftY + viewports[i].Height;
         vk_viewport->width = viewports[i].Width;
@@ -7455,6 +7787,12 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetViewports(d3d12_command_li
         }
     }
 
+    if (d3d12_command_list_state_is_redundant(list, dyn_state->viewport_count == viewport_count &&
+            !memcmp(dyn_state->viewports, vk_viewports, viewport_count * sizeof(*vk_viewports))))
+        return;
+
+    memcpy(dyn_state->viewports, vk_viewports, viewport_count * sizeof(*vk_viewports));
+
     if (dyn_state->viewport_count != viewport_count)
     {
         dyn_state->viewport_count = viewport_count;
@@ -7470,6 +7808,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetScissorRects(d3d12_command
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     struct vkd3d_dynamic_state *dyn_state = &list->dynamic_state;
+    VkRect2D vk_rects[ARRAY_SIZE(dyn_state->scissors)];
     unsigned int i;
 
     TRACE("iface %p, rect_count %u, rects %p.\n", iface, rect_count, rects);
@@ -7482,13 +7821,18 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetScissorRects(d3d12_command
 
     for (i = 0; i < rect_count; ++i)
     {
-        VkRect2D *vk_rect = &dyn_state->scissors[i];
+        VkRect2D *vk_rect = &vk_rects[i];
         vk_rect->offset.x = rects[i].left;
         vk_rect->offset.y = rects[i].top;
         vk_rect->extent.width = rects[i].right - rects[i].left;
         vk_rect->extent.height = rects[i].bottom - rects[i].top;
     }
 
+    if (d3d12_command_list_state_is_redundant(list,
+            !memcmp(dyn_state->scissors, vk_rects, rect_count * sizeof(*vk_rects))))
+        return;
+
+    memcpy(dyn_state->scissors, vk_rects, rect_count * sizeof(*vk_rects));
     dyn_state->dirty_flags |= VKD3D_DYNAMIC_STATE_SCISSOR;
 }
 
@@ -7500,7 +7844,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetBlendFactor(d3d12_command_
 
     TRACE("iface %p, blend_factor %p.\n", iface, blend_factor);
 
-    if (memcmp(dyn_state->blend_constants, blend_factor, sizeof(dyn_state->blend_constants)) != 0)
+    if (!d3d12_command_list_state_is_redundant(list,
+            !memcmp(dyn_state->blend_constants, blend_factor, sizeof(dyn_state->blend_constants))))
     {
         memcpy(dyn_state->blend_constants, blend_factor, sizeof(dyn_state->blend_constants));
         dyn_state->dirty_flags |= VKD3D_DYNAMIC_STATE_BLEND_CONSTANTS;
@@ -7515,7 +7860,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetStencilRef(d3d12_command_l
 
     TRACE("iface %p, stencil_ref %u.\n", iface, stencil_ref);
 
-    if (dyn_state->stencil_reference != stencil_ref)
+    if (!d3d12_command_list_state_is_redundant(list, dyn_state->stencil_reference == stencil_ref))
     {
         dyn_state->stencil_reference = stencil_ref;
         dyn_state->dirty_flags |= VKD3D_DYNAMIC_STATE_STENCIL_REFERENCE;
@@ -7585,9 +7930,13 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetPipelineState(d3d12_command_
     vkd3d_renderdoc_command_list_check_capture(list, state);
 #endif
 
-    if (list->state == state)
+    if (d3d12_command_list_state_is_redundant(list, list->state == state))
         return;
 
+    /* Pipeline might still be in flight in the compile pool. */
+    if (state)
+        d3d12_pipeline_state_wait_async_compile(state);
+
     d3d12_command_list_invalidate_current_pipeline(list, false);
     /* SetPSO and SetPSO1 alias the same internal active pipeline state even if they are completely different types. */
     list->state = state;
@@ -7729,6 +8078,7 @@ static void d3d12_command_list_barrier_batch_init(struct d3d12_command_list_barr
     batch->vk_memory_barrier.dstAccessMask = 0;
     batch->dst_stage_mask = 0;
     batch->src_stage_mask = 0;
+    batch->pipeline_barrier_count = 0;
 }
 
 static void d3d12_command_list_barrier_batch_end(struct d3d12_command_list *list,
@@ -7743,6 +8093,7 @@ static void d3d12_command_list_barrier_batch_end(struct d3d12_command_list *list
                 1, &batch->vk_memory_barrier, 0, NULL,
                 batch->image_barrier_count, batch->vk_image_barriers));
 
+        batch->pipeline_barrier_count++;
         batch->src_stage_mask = 0;
         batch->dst_stage_mask = 0;
         batch->vk_memory_barrier.srcAccessMask = 0;
@@ -7843,16 +8194,18 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
         UINT barrier_count, const D3D12_RESOURCE_BARRIER *barriers)
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
-    struct d3d12_command_list_barrier_batch batch;
+    struct d3d12_command_list_barrier_batch *batch = &list->pending_barriers;
     bool have_split_barriers = false;
 
     unsigned int i;
 
     TRACE("iface %p, barrier_count %u, barriers %p.\n", iface, barrier_count, barriers);
 
-    d3d12_command_list_end_current_render_pass(list, false);
+    /* Barriers are only recorded into the pending batch here. Commands which depend on them
+     * flush it first, so consecutive ResourceBarrier() calls end up in one vkCmdPipelineBarrier. */
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, false);
     d3d12_command_list_end_transfer_batch(list);
-    d3d12_command_list_barrier_batch_init(&batch);
+    list->resource_barrier_count += barrier_count;
 
     for (i = 0; i < barrier_count; ++i)
     {
@@ -7912,10 +8265,10 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
                         transition->StateAfter == D3D12_RESOURCE_STATE_COPY_DEST))
                 {
                     d3d12_command_list_reset_buffer_copy_tracking(list);
-                    batch.src_stage_mask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
-                    batch.dst_stage_mask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
-                    batch.vk_memory_barrier.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
-                    batch.vk_memory_barrier.dstAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+                    batch->src_stage_mask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+                    batch->dst_stage_mask |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+                    batch->vk_memory_barrier.srcAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
+                    batch->vk_memory_barrier.dstAccessMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
                 }
 
                 vk_access_and_stage_flags_from_d3d12_resource_state(list, preserve_resource,
@@ -7948,18 +8301,18 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
                             transition->Subresource, old_layout, new_layout,
                             transition_src_access, transition_dst_access,
                             dsv_decay_mask);
-                    d3d12_command_list_barrier_batch_add_layout_transition(list, &batch, &vk_transition);
+                    d3d12_command_list_barrier_batch_add_layout_transition(list, batch, &vk_transition);
                 }
                 else
                 {
-                    batch.vk_memory_barrier.srcAccessMask |= transition_src_access;
-                    batch.vk_memory_barrier.dstAccessMask |= transition_dst_access;
+                    batch->vk_memory_barrier.srcAccessMask |= transition_src_access;
+                    batch->vk_memory_barrier.dstAccessMask |= transition_dst_access;
                 }
 
                 /* In case add_layout_transition triggers a batch flush,
                  * make sure we add stage masks after that happens. */
-                batch.src_stage_mask |= transition_src_stage_mask;
-                batch.dst_stage_mask |= transition_dst_stage_mask;
+                batch->src_stage_mask |= transition_src_stage_mask;
+                batch->dst_stage_mask |= transition_dst_stage_mask;
 
                 TRACE("Transition barrier (resource %p, subresource %#x, before %#x, after %#x).\n",
                         preserve_resource, transition->Subresource, transition->StateBefore, transition->StateAfter);
@@ -7986,11 +8339,11 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
                 assert(state_mask);
 
                 vk_access_and_stage_flags_from_d3d12_resource_state(list, preserve_resource,
-                        state_mask, list->vk_queue_flags, &batch.src_stage_mask,
-                        &batch.vk_memory_barrier.srcAccessMask);
+                        state_mask, list->vk_queue_flags, &batch->src_stage_mask,
+                        &batch->vk_memory_barrier.srcAccessMask);
                 vk_access_and_stage_flags_from_d3d12_resource_state(list, preserve_resource,
-                        state_mask, list->vk_queue_flags, &batch.dst_stage_mask,
-                        &batch.vk_memory_barrier.dstAccessMask);
+                        state_mask, list->vk_queue_flags, &batch->dst_stage_mask,
+                        &batch->vk_memory_barrier.dstAccessMask);
 
                 TRACE("UAV barrier (resource %p).\n", preserve_resource);
                 break;
@@ -8031,10 +8384,10 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
                         alias_dst_access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
                     }
 
-                    batch.src_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-                    batch.dst_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-                    batch.vk_memory_barrier.srcAccessMask |= alias_src_access;
-                    batch.vk_memory_barrier.dstAccessMask |= alias_dst_access;
+                    batch->src_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                    batch->dst_stage_mask |= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+                    batch->vk_memory_barrier.srcAccessMask |= alias_src_access;
+                    batch->vk_memory_barrier.dstAccessMask |= alias_dst_access;
                 }
                 break;
             }
@@ -8048,8 +8401,6 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResourceBarrier(d3d12_command_l
             d3d12_command_list_track_resource_usage(list, preserve_resource, true);
     }
 
-    d3d12_command_list_barrier_batch_end(list, &batch);
-
     /* Vulkan doesn't support split barriers. */
     if (have_split_barriers)
         WARN("Issuing split barrier(s) on D3D12_RESOURCE_BARRIER_FLAG_END_ONLY.\n");
@@ -8079,12 +8430,20 @@ static void vkd3d_pipeline_bindings_set_dirty_sets(struct vkd3d_pipeline_binding
     bindings->dirty_flags |= VKD3D_PIPELINE_DIRTY_HOISTED_DESCRIPTORS;
 }
 
+static bool d3d12_command_list_uses_hoisted_descriptors(const struct d3d12_command_list *list)
+{
+    return (list->graphics_bindings.root_signature && list->graphics_bindings.root_signature->hoist_info.num_desc) ||
+            (list->compute_bindings.root_signature && list->compute_bindings.root_signature->hoist_info.num_desc);
+}
+
 static void STDMETHODCALLTYPE d3d12_command_list_SetDescriptorHeaps(d3d12_command_list_iface *iface,
         UINT heap_count, ID3D12DescriptorHeap *const *heaps)
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     struct vkd3d_bindless_state *bindless_state = &list->device->bindless_state;
     uint64_t dirty_mask = 0;
+    bool changed = false;
+    VkDescriptorSet vk_set;
     unsigned int i, j;
 
     TRACE("iface %p, heap_count %u, heaps %p.\n", iface, heap_count, heaps);
@@ -8102,7 +8461,9 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetDescriptorHeaps(d3d12_comman
             if (bindless_state->set_info[j].heap_type != heap->desc.Type)
                 continue;
 
-            list->descriptor_heaps[j] = heap->sets[set_index++].vk_descriptor_set;
+            vk_set = heap->sets[set_index++].vk_descriptor_set;
+            changed |= list->descriptor_heaps[j] != vk_set;
+            list->descriptor_heaps[j] = vk_set;
             dirty_mask |= 1ull << j;
         }
 
@@ -8111,28 +8472,38 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetDescriptorHeaps(d3d12_comman
         {
             struct d3d12_desc_split d;
             d = d3d12_desc_decode_va(heap->cpu_va.ptr);
+            changed |= list->cbv_srv_uav_descriptors_view != d.view;
             list->cbv_srv_uav_descriptors_types = d.types;
             list->cbv_srv_uav_descriptors_view = d.view;
         }
     }
 
+    /* Rebinding the same heaps must not drop pending dirty sets from e.g. a root signature change,
+     * so only update dirty state if any set actually changed. Hoisted descriptors are re-read from
+     * the heap when it is bound though, the same as for descriptor tables. */
+    if (d3d12_command_list_state_is_redundant(list, !changed &&
+            !d3d12_command_list_uses_hoisted_descriptors(list)))
+        return;
+
     vkd3d_pipeline_bindings_set_dirty_sets(&list->graphics_bindings, dirty_mask);
     vkd3d_pipeline_bindings_set_dirty_sets(&list->compute_bindings, dirty_mask);
 }
 
-static void d3d12_command_list_set_root_signature(struct d3d12_command_list *list,
+static bool d3d12_command_list_set_root_signature(struct d3d12_command_list *list,
         struct vkd3d_pipeline_bindings *bindings, const struct d3d12_root_signature *root_signature)
 {
     if (bindings->root_signature == root_signature)
-        return;
+        return false;
 
     bindings->root_signature = root_signature;
     bindings->static_sampler_set = VK_NULL_HANDLE;
+    bindings->root_descriptor_va_mask = 0;
 
     if (root_signature && root_signature->vk_sampler_set)
         bindings->static_sampler_set = root_signature->vk_sampler_set;
 
     d3d12_command_list_invalidate_root_parameters(list, bindings, true);
+    return true;
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootSignature(d3d12_command_list_iface *iface,
@@ -8142,8 +8513,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootSignature(d3d12_c
 
     TRACE("iface %p, root_signature %p.\n", iface, root_signature);
 
-    d3d12_command_list_set_root_signature(list, &list->compute_bindings,
-            impl_from_ID3D12RootSignature(root_signature));
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_signature(list,
+            &list->compute_bindings, impl_from_ID3D12RootSignature(root_signature)));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootSignature(d3d12_command_list_iface *iface,
@@ -8153,26 +8524,37 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootSignature(d3d12_
 
     TRACE("iface %p, root_signature %p.\n", iface, root_signature);
 
-    d3d12_command_list_set_root_signature(list, &list->graphics_bindings,
-            impl_from_ID3D12RootSignature(root_signature));
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_signature(list,
+            &list->graphics_bindings, impl_from_ID3D12RootSignature(root_signature)));
 }
 
-static void d3d12_command_list_set_descriptor_table(struct d3d12_command_list *list,
+static bool d3d12_command_list_set_descriptor_table(struct d3d12_command_list *list,
         struct vkd3d_pipeline_bindings *bindings, unsigned int index, D3D12_GPU_DESCRIPTOR_HANDLE base_descriptor)
 {
     const struct d3d12_root_signature *root_signature = bindings->root_signature;
     const struct vkd3d_shader_descriptor_table *table;
+    uint32_t offset;
 
     table = root_signature_get_descriptor_table(root_signature, index);
 
     assert(table && index < ARRAY_SIZE(bindings->descriptor_tables));
-    bindings->descriptor_tables[index] = d3d12_desc_heap_offset_from_gpu_handle(base_descriptor);
+    offset = d3d12_desc_heap_offset_from_gpu_handle(base_descriptor);
+
+    /* Hoisted descriptors are read from the heap when the table is set,
+     * so setting the same table again is not necessarily redundant. */
+    if (!root_signature->hoist_info.num_desc &&
+            (bindings->descriptor_table_active_mask & ((uint64_t)1 << index)) &&
+            bindings->descriptor_tables[index] == offset)
+        return false;
+
+    bindings->descriptor_tables[index] = offset;
     bindings->descriptor_table_active_mask |= (uint64_t)1 << index;
 
     if (root_signature->descriptor_table_count)
         bindings->dirty_flags |= VKD3D_PIPELINE_DIRTY_DESCRIPTOR_TABLE_OFFSETS;
     if (root_signature->hoist_info.num_desc)
         bindings->dirty_flags |= VKD3D_PIPELINE_DIRTY_HOISTED_DESCRIPTORS;
+    return true;
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootDescriptorTable(d3d12_command_list_iface *iface,
@@ -8183,8 +8565,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootDescriptorTable(d
     TRACE("iface %p, root_parameter_index %u, base_descriptor %#"PRIx64".\n",
             iface, root_parameter_index, base_descriptor.ptr);
 
-    d3d12_command_list_set_descriptor_table(list, &list->compute_bindings,
-            root_parameter_index, base_descriptor);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_descriptor_table(list,
+            &list->compute_bindings, root_parameter_index, base_descriptor));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootDescriptorTable(d3d12_command_list_iface *iface,
@@ -8195,11 +8577,11 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootDescriptorTable(
     TRACE("iface %p, root_parameter_index %u, base_descriptor %#"PRIx64".\n",
             iface, root_parameter_index, base_descriptor.ptr);
 
-    d3d12_command_list_set_descriptor_table(list, &list->graphics_bindings,
-            root_parameter_index, base_descriptor);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_descriptor_table(list,
+            &list->graphics_bindings, root_parameter_index, base_descriptor));
 }
 
-static void d3d12_command_list_set_root_constants(struct d3d12_command_list *list,
+static bool d3d12_command_list_set_root_constants(struct d3d12_command_list *list,
         struct vkd3d_pipeline_bindings *bindings, unsigned int index, unsigned int offset,
         unsigned int count, const void *data)
 {
@@ -8208,6 +8590,10 @@ static void d3d12_command_list_set_root_constants(struct d3d12_command_list *lis
     VKD3D_UNUSED unsigned int i;
 
     c = root_signature_get_32bit_constants(root_signature, index);
+
+    if (!memcmp(&bindings->root_constants[c->constant_index + offset], data, count * sizeof(uint32_t)))
+        return false;
+
     memcpy(&bindings->root_constants[c->constant_index + offset], data, count * sizeof(uint32_t));
 
     bindings->root_constant_dirty_mask |= 1ull << index;
@@ -8221,6 +8607,8 @@ static void d3d12_command_list_set_root_constants(struct d3d12_command_list *lis
         VKD3D_BREADCRUMB_COMMAND_STATE(ROOT_CONST);
     }
 #endif
+
+    return true;
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRoot32BitConstant(d3d12_command_list_iface *iface,
@@ -8231,8 +8619,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRoot32BitConstant(d3d
     TRACE("iface %p, root_parameter_index %u, data 0x%08x, dst_offset %u.\n",
             iface, root_parameter_index, data, dst_offset);
 
-    d3d12_command_list_set_root_constants(list, &list->compute_bindings,
-            root_parameter_index, dst_offset, 1, &data);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_constants(list,
+            &list->compute_bindings, root_parameter_index, dst_offset, 1, &data));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRoot32BitConstant(d3d12_command_list_iface *iface,
@@ -8243,8 +8631,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRoot32BitConstant(d3
     TRACE("iface %p, root_parameter_index %u, data 0x%08x, dst_offset %u.\n",
             iface, root_parameter_index, data, dst_offset);
 
-    d3d12_command_list_set_root_constants(list, &list->graphics_bindings,
-            root_parameter_index, dst_offset, 1, &data);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_constants(list,
+            &list->graphics_bindings, root_parameter_index, dst_offset, 1, &data));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRoot32BitConstants(d3d12_command_list_iface *iface,
@@ -8255,8 +8643,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRoot32BitConstants(d3
     TRACE("iface %p, root_parameter_index %u, constant_count %u, data %p, dst_offset %u.\n",
             iface, root_parameter_index, constant_count, data, dst_offset);
 
-    d3d12_command_list_set_root_constants(list, &list->compute_bindings,
-            root_parameter_index, dst_offset, constant_count, data);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_constants(list,
+            &list->compute_bindings, root_parameter_index, dst_offset, constant_count, data));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRoot32BitConstants(d3d12_command_list_iface *iface,
@@ -8267,8 +8655,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRoot32BitConstants(d
     TRACE("iface %p, root_parameter_index %u, constant_count %u, data %p, dst_offset %u.\n",
             iface, root_parameter_index, constant_count, data, dst_offset);
 
-    d3d12_command_list_set_root_constants(list, &list->graphics_bindings,
-            root_parameter_index, dst_offset, constant_count, data);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_constants(list,
+            &list->graphics_bindings, root_parameter_index, dst_offset, constant_count, data));
 }
 
 static void d3d12_command_list_set_push_descriptor_info(struct d3d12_command_list *list,
@@ -8345,11 +8733,19 @@ static void d3d12_command_list_set_root_descriptor_va(struct d3d12_command_list
     descriptor->info.va = gpu_address;
 }
 
-static void d3d12_command_list_set_root_descriptor(struct d3d12_command_list *list,
+static bool d3d12_command_list_set_root_descriptor(struct d3d12_command_list *list,
         struct vkd3d_pipeline_bindings *bindings, unsigned int index, D3D12_GPU_VIRTUAL_ADDRESS gpu_address)
 {
     struct vkd3d_root_descriptor_info *descriptor = &bindings->root_descriptors[index];
 
+    /* Avoids creating another buffer view for the same address, too. */
+    if ((bindings->root_descriptor_va_mask & (1ull << index)) &&
+            bindings->root_descriptor_vas[index] == gpu_address)
+        return false;
+
+    bindings->root_descriptor_vas[index] = gpu_address;
+    bindings->root_descriptor_va_mask |= 1ull << index;
+
     if (bindings->root_signature->root_descriptor_raw_va_mask & (1ull << index))
         d3d12_command_list_set_root_descriptor_va(list, descriptor, gpu_address);
     else
@@ -8361,6 +8757,7 @@ static void d3d12_command_list_set_root_descriptor(struct d3d12_command_list *li
     VKD3D_BREADCRUMB_AUX32(index);
     VKD3D_BREADCRUMB_AUX64(gpu_address);
     VKD3D_BREADCRUMB_COMMAND_STATE(ROOT_DESC);
+    return true;
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootConstantBufferView(
@@ -8371,8 +8768,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootConstantBufferVie
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->compute_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->compute_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootConstantBufferView(
@@ -8383,8 +8780,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootConstantBufferVi
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->graphics_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->graphics_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootShaderResourceView(
@@ -8395,8 +8792,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootShaderResourceVie
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->compute_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->compute_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootShaderResourceView(
@@ -8407,8 +8804,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootShaderResourceVi
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->graphics_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->graphics_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootUnorderedAccessView(
@@ -8419,8 +8816,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetComputeRootUnorderedAccessVi
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->compute_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->compute_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootUnorderedAccessView(
@@ -8431,8 +8828,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetGraphicsRootUnorderedAccessV
     TRACE("iface %p, root_parameter_index %u, address %#"PRIx64".\n",
             iface, root_parameter_index, address);
 
-    d3d12_command_list_set_root_descriptor(list, &list->graphics_bindings,
-            root_parameter_index, address);
+    d3d12_command_list_count_state_change(list, d3d12_command_list_set_root_descriptor(list,
+            &list->graphics_bindings, root_parameter_index, address));
 }
 
 static void STDMETHODCALLTYPE d3d12_command_list_IASetIndexBuffer(d3d12_command_list_iface *iface,
@@ -8440,12 +8837,15 @@ static void STDMETHODCALLTYPE d3d12_command_list_IASetIndexBuffer(d3d12_command_
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     const struct vkd3d_unique_resource *resource;
+    VkBuffer buffer = VK_NULL_HANDLE;
     enum VkIndexType index_type;
+    VkDeviceSize offset = 0;
 
     TRACE("iface %p, view %p.\n", iface, view);
 
     if (!view)
     {
+        d3d12_command_list_state_is_redundant(list, !list->index_buffer.buffer);
         list->index_buffer.buffer = VK_NULL_HANDLE;
         VKD3D_BREADCRUMB_AUX32(0);
         VKD3D_BREADCRUMB_COMMAND_STATE(IBO);
@@ -8467,17 +8867,27 @@ static void STDMETHODCALLTYPE d3d12_command_list_IASetIndexBuffer(d3d12_command_
             break;
     }
 
-    list->index_buffer.dxgi_format = view->Format;
-    list->index_buffer.vk_type = index_type;
     if (view->BufferLocation != 0)
     {
         resource = vkd3d_va_map_deref(&list->device->memory_allocator.va_map, view->BufferLocation);
-        list->index_buffer.buffer = resource->vk_buffer;
-        list->index_buffer.offset = view->BufferLocation - resource->va;
+        buffer = resource->vk_buffer;
+        offset = view->BufferLocation - resource->va;
+    }
+
+    if (d3d12_command_list_state_is_redundant(list, list->index_buffer.buffer == buffer &&
+            (!buffer || list->index_buffer.offset == offset) &&
+            list->index_buffer.dxgi_format == view->Format &&
+            list->index_buffer.vk_type == index_type))
+        return;
+
+    list->index_buffer.dxgi_format = view->Format;
+    list->index_buffer.vk_type = index_type;
+    list->index_buffer.buffer = buffer;
+    if (buffer)
+    {
+        list->index_buffer.offset = offset;
         list->index_buffer.is_dirty = true;
     }
-    else
-        list->index_buffer.buffer = VK_NULL_HANDLE;
 
     VKD3D_BREADCRUMB_AUX32(index_type == VK_INDEX_TYPE_UINT32 ? 32 : 16);
     VKD3D_BREADCRUMB_AUX64(view->BufferLocation);
@@ -8491,7 +8901,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_IASetVertexBuffers(d3d12_comman
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     struct vkd3d_dynamic_state *dyn_state = &list->dynamic_state;
     const struct vkd3d_unique_resource *resource;
-    uint32_t vbo_invalidate_mask;
+    uint32_t vbo_invalidate_mask = 0;
     bool invalidate = false;
     unsigned int i;
 
@@ -8548,16 +8958,25 @@ static void STDMETHODCALLTYPE d3d12_command_list_IASetVertexBuffers(d3d12_comman
             stride = VKD3D_NULL_BUFFER_SIZE;
         }
 
+        if (dyn_state->vertex_strides[start_slot + i] == stride &&
+                dyn_state->vertex_buffers[start_slot + i] == buffer &&
+                dyn_state->vertex_offsets[start_slot + i] == offset &&
+                dyn_state->vertex_sizes[start_slot + i] == size)
+            continue;
+
         invalidate |= dyn_state->vertex_strides[start_slot + i] != stride;
         dyn_state->vertex_strides[start_slot + i] = stride;
         dyn_state->vertex_buffers[start_slot + i] = buffer;
         dyn_state->vertex_offsets[start_slot + i] = offset;
         dyn_state->vertex_sizes[start_slot + i] = size;
+        vbo_invalidate_mask |= 1u << (start_slot + i);
     }
 
+    if (d3d12_command_list_state_is_redundant(list, !vbo_invalidate_mask))
+        return;
+
     dyn_state->dirty_flags |= VKD3D_DYNAMIC_STATE_VERTEX_BUFFER | VKD3D_DYNAMIC_STATE_VERTEX_BUFFER_STRIDE;
 
-    vbo_invalidate_mask = ((1u << view_count) - 1u) << start_slot;
     dyn_state->dirty_vbos |= vbo_invalidate_mask;
     dyn_state->dirty_vbo_strides |= vbo_invalidate_mask;
 
@@ -8578,7 +8997,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_SOSetTargets(d3d12_command_list
 
     TRACE("iface %p, start_slot %u, view_count %u, views %p.\n", iface, start_slot, view_count, views);
 
-    d3d12_command_list_end_current_render_pass(list, true);
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, true);
 
     if (!list->device->vk_info.EXT_transform_feedback)
     {
@@ -8632,9 +9051,12 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
 {
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     const VkPhysicalDeviceLimits *limits = &list->device->vk_info.device_limits;
+    uint32_t fb_width, fb_height, fb_layer_count;
+    struct d3d12_rtv_desc rtvs[ARRAY_SIZE(list->rtvs)];
     const struct d3d12_graphics_pipeline_state *graphics;
     VkFormat prev_dsv_format, next_dsv_format;
     const struct d3d12_rtv_desc *rtv_desc;
+    struct d3d12_rtv_desc dsv;
     unsigned int i;
 
     TRACE("iface %p, render_target_descriptor_count %u, render_target_descriptors %p, "
@@ -8642,9 +9064,6 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
             iface, render_target_descriptor_count, render_target_descriptors,
             single_descriptor_handle, depth_stencil_descriptor);
 
-    d3d12_command_list_invalidate_rendering_info(list);
-    d3d12_command_list_end_current_render_pass(list, false);
-
     if (render_target_descriptor_count > ARRAY_SIZE(list->rtvs))
     {
         WARN("Descriptor count %u > %zu, ignoring extra descriptors.\n",
@@ -8652,18 +9071,14 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
         render_target_descriptor_count = ARRAY_SIZE(list->rtvs);
     }
 
-    list->fb_width = limits->maxFramebufferWidth;
-    list->fb_height = limits->maxFramebufferHeight;
-    list->fb_layer_count = limits->maxFramebufferLayers;
+    fb_width = limits->maxFramebufferWidth;
+    fb_height = limits->maxFramebufferHeight;
+    fb_layer_count = limits->maxFramebufferLayers;
 
-    prev_dsv_format = list->dsv.format ? list->dsv.format->vk_format : VK_FORMAT_UNDEFINED;
     next_dsv_format = VK_FORMAT_UNDEFINED;
 
-    memset(list->rtvs, 0, sizeof(list->rtvs));
-    memset(&list->dsv, 0, sizeof(list->dsv));
-    /* Need to deduce DSV layouts again. */
-    list->dsv_layout = VK_IMAGE_LAYOUT_UNDEFINED;
-    list->dsv_plane_optimal_mask = 0;
+    memset(rtvs, 0, sizeof(rtvs));
+    memset(&dsv, 0, sizeof(dsv));
 
     for (i = 0; i < render_target_descriptor_count; ++i)
     {
@@ -8683,10 +9098,10 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
             continue;
         }
 
-        list->rtvs[i] = *rtv_desc;
-        list->fb_width = min(list->fb_width, rtv_desc->width);
-        list->fb_height = min(list->fb_height, rtv_desc->height);
-        list->fb_layer_count = min(list->fb_layer_count, rtv_desc->layer_count);
+        rtvs[i] = *rtv_desc;
+        fb_width = min(fb_width, rtv_desc->width);
+        fb_height = min(fb_height, rtv_desc->height);
+        fb_layer_count = min(fb_layer_count, rtv_desc->layer_count);
     }
 
     if (depth_stencil_descriptor)
@@ -8694,10 +9109,10 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
         if ((rtv_desc = d3d12_rtv_desc_from_cpu_handle(*depth_stencil_descriptor))
                 && rtv_desc->resource)
         {
-            list->dsv = *rtv_desc;
-            list->fb_width = min(list->fb_width, rtv_desc->width);
-            list->fb_height = min(list->fb_height, rtv_desc->height);
-            list->fb_layer_count = min(list->fb_layer_count, rtv_desc->layer_count);
+            dsv = *rtv_desc;
+            fb_width = min(fb_width, rtv_desc->width);
+            fb_height = min(fb_height, rtv_desc->height);
+            fb_layer_count = min(fb_layer_count, rtv_desc->layer_count);
             next_dsv_format = rtv_desc->format->vk_format;
         }
         else
@@ -8706,6 +9121,28 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetRenderTargets(d3d12_comman
         }
     }
 
+    /* Descriptors are compared by value since the application may have rewritten them in place.
+     * Rebinding the same attachments must not end the current render pass. */
+    if (d3d12_command_list_state_is_redundant(list,
+            list->fb_width == fb_width && list->fb_height == fb_height &&
+            list->fb_layer_count == fb_layer_count &&
+            !memcmp(list->rtvs, rtvs, sizeof(rtvs)) && !memcmp(&list->dsv, &dsv, sizeof(dsv))))
+        return;
+
+    d3d12_command_list_invalidate_rendering_info(list);
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, false);
+
+    prev_dsv_format = list->dsv.format ? list->dsv.format->vk_format : VK_FORMAT_UNDEFINED;
+
+    memcpy(list->rtvs, rtvs, sizeof(rtvs));
+    list->dsv = dsv;
+    list->fb_width = fb_width;
+    list->fb_height = fb_height;
+    list->fb_layer_count = fb_layer_count;
+    /* Need to deduce DSV layouts again. */
+    list->dsv_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    list->dsv_plane_optimal_mask = 0;
+
     if (d3d12_pipeline_state_is_graphics(list->state))
     {
         graphics = &list->state->graphics;
@@ -9755,6 +10192,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_EndQuery(d3d12_command_list_ifa
             VK_CALL(vkCmdResetQueryPool(list->vk_command_buffer, query_heap->vk_query_pool, index, 1));
         }
 
+        d3d12_command_list_flush_pending_barriers(list);
         VK_CALL(vkCmdWriteTimestamp(list->vk_command_buffer,
                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_heap->vk_query_pool, index));
     }
@@ -9876,6 +10314,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_ResolveQueryData(d3d12_command_
 
     d3d12_command_list_track_query_heap(list, query_heap);
     d3d12_command_list_end_current_render_pass(list, true);
+    d3d12_command_list_end_transfer_batch(list);
 
     if (d3d12_query_heap_type_is_inline(query_heap->desc.Type))
     {
@@ -10771,7 +11210,8 @@ static void STDMETHODCALLTYPE d3d12_command_list_OMSetDepthBounds(d3d12_command_
 
     TRACE("iface %p, min %.8e, max %.8e.\n", iface, min, max);
 
-    if (dyn_state->min_depth_bounds != min || dyn_state->max_depth_bounds != max)
+    if (!d3d12_command_list_state_is_redundant(list,
+            dyn_state->min_depth_bounds == min && dyn_state->max_depth_bounds == max))
     {
         dyn_state->min_depth_bounds = min;
         dyn_state->max_depth_bounds = max;
@@ -10942,6 +11382,11 @@ static void STDMETHODCALLTYPE d3d12_command_list_WriteBufferImmediate(d3d12_comm
 
     TRACE("iface %p, count %u, parameters %p, modes %p.\n", iface, count, parameters, modes);
 
+    /* Writes are ordered against earlier copies to the same buffer. Markers are
+     * recorded without ending the render pass, so flush deferred barriers here. */
+    d3d12_command_list_end_transfer_batch(list);
+    d3d12_command_list_flush_pending_barriers(list);
+
     curr_buffer = VK_NULL_HANDLE;
     curr_offset = 0;
     dword_count = 0;
@@ -11168,7 +11613,7 @@ static void STDMETHODCALLTYPE d3d12_command_list_SetPipelineState1(d3d12_command
     struct d3d12_command_list *list = impl_from_ID3D12GraphicsCommandList(iface);
     TRACE("iface %p, state_object %p\n", iface, state_object);
 
-    if (list->rt_state == state)
+    if (d3d12_command_list_state_is_redundant(list, list->rt_state == state))
         return;
 
     d3d12_command_list_invalidate_current_pipeline(list, false);
@@ -11325,8 +11770,9 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetShadingRate(d3d12_command_
                 VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
     }
 
-    if (memcmp(&fragment_size, &dyn_state->fragment_shading_rate.fragment_size, sizeof(fragment_size)) != 0 ||
-            memcmp(combiner_ops, dyn_state->fragment_shading_rate.combiner_ops, sizeof(combiner_ops)) != 0)
+    if (!d3d12_command_list_state_is_redundant(list,
+            !memcmp(&fragment_size, &dyn_state->fragment_shading_rate.fragment_size, sizeof(fragment_size)) &&
+            !memcmp(combiner_ops, dyn_state->fragment_shading_rate.combiner_ops, sizeof(combiner_ops))))
     {
         dyn_state->fragment_shading_rate.fragment_size = fragment_size;
         memcpy(dyn_state->fragment_shading_rate.combiner_ops, combiner_ops, sizeof(combiner_ops));
@@ -11349,13 +11795,13 @@ static void STDMETHODCALLTYPE d3d12_command_list_RSSetShadingRateImage(d3d12_com
         vrs_image = NULL;
     }
 
-    if (vrs_image == list->vrs_image)
+    if (d3d12_command_list_state_is_redundant(list, vrs_image == list->vrs_image))
         return;
 
     /* Need to end the renderpass if we have one to make
      * way for the new VRS attachment */
     d3d12_command_list_invalidate_rendering_info(list);
-    d3d12_command_list_end_current_render_pass(list, false);
+    d3d12_command_list_end_current_render_pass_keep_barriers(list, false);
 
     if (vrs_image)
         d3d12_command_list_track_resource_usage(list, vrs_image, true);
@@ -11684,8 +12130,9 @@ static ULONG STDMETHODCALLTYPE d3d12_command_queue_Release(ID3D12CommandQueue *i
         pthread_join(command_queue->submission_thread, NULL);
         pthread_mutex_destroy(&command_queue->queue_lock);
         pthread_cond_destroy(&command_queue->queue_cond);
+        pthread_cond_destroy(&command_queue->drain_cond);
 
-        vkd3d_free(command_queue->submissions);
+        vkd3d_free(command_queue->overflow_submissions);
         vkd3d_free(command_queue);
 
         d3d12_device_release(device);
@@ -12717,78 +13164,154 @@ static void d3d12_command_queue_transition_pool_build(struct d3d12_command_queue
     *timeline_value = pool->timeline_value;
 }
 
+/* Must not exceed VKD3D_COMMAND_QUEUE_NUM_TRANSITION_BUFFERS, since every batched execute may
+ * need its own transition command buffer before the batch is submitted. */
+#define VKD3D_MAX_COALESCED_SUBMISSIONS 8
+
+struct d3d12_command_queue_execute_batch
+{
+    struct d3d12_command_queue_submission_execute execute[VKD3D_MAX_COALESCED_SUBMISSIONS];
+    VkCommandBuffer transition_cmd[VKD3D_MAX_COALESCED_SUBMISSIONS];
+    uint64_t transition_timeline_value[VKD3D_MAX_COALESCED_SUBMISSIONS];
+    unsigned int count;
+};
+
+static void d3d12_command_queue_execute_batch_add(struct d3d12_command_queue_execute_batch *batch,
+        struct d3d12_command_queue_transition_pool *pool, struct d3d12_device *device,
+        const struct d3d12_command_queue_submission_execute *execute)
+{
+    unsigned int index = batch->count++;
+
+    assert(index < VKD3D_MAX_COALESCED_SUBMISSIONS);
+    batch->execute[index] = *execute;
+    batch->transition_timeline_value[index] = 0;
+    d3d12_command_queue_transition_pool_build(pool, device,
+            execute->transitions, execute->transition_count,
+            &batch->transition_cmd[index], &batch->transition_timeline_value[index]);
+}
+
+static bool d3d12_command_queue_execute_can_coalesce(const struct d3d12_command_queue_submission_execute *execute)
+{
+    /* Captures are decided per submission, so keep those in their own vkQueueSubmit. */
+    return !execute->debug_capture;
+}
+
 static void d3d12_command_queue_execute(struct d3d12_command_queue *command_queue,
-        VkCommandBuffer *cmd, UINT count,
-        VkCommandBuffer transition_cmd, VkSemaphore transition_timeline, uint64_t transition_timeline_value,
-        LONG **submission_counters, size_t num_submission_counters,
-        bool debug_capture)
+        const struct d3d12_command_queue_execute_batch *batch, VkSemaphore transition_timeline,
+        struct d3d12_fence *signal_fence, UINT64 signal_value)
 {
     static const VkPipelineStageFlags wait_stage_mask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info[2 * VKD3D_MAX_COALESCED_SUBMISSIONS];
+    uint64_t submission_timeline_count[VKD3D_MAX_COALESCED_SUBMISSIONS];
     const struct vkd3d_vk_device_procs *vk_procs = &command_queue->device->vk_procs;
+    VkSubmitInfo submit_desc[2 * VKD3D_MAX_COALESCED_SUBMISSIONS];
     struct vkd3d_queue *vkd3d_queue = command_queue->vkd3d_queue;
-    VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info[2];
-    uint64_t submission_timeline_count;
-    VkSubmitInfo submit_desc[2];
+    const struct d3d12_command_queue_submission_execute *execute;
+    uint32_t execute_submit_index[VKD3D_MAX_COALESCED_SUBMISSIONS];
+    VkSemaphore signal_semaphores[2];
+    uint64_t physical_signal_value;
+    uint64_t signal_values[2];
+    bool debug_capture = false;
     uint32_t num_submits;
+    unsigned int i, j;
     VkQueue vk_queue;
-    unsigned int i;
     VkResult vr;
     HRESULT hr;
 
-    TRACE("queue %p, command_list_count %u, command_lists %p.\n",
-          command_queue, count, cmd);
-
     memset(timeline_submit_info, 0, sizeof(timeline_submit_info));
     memset(submit_desc, 0, sizeof(submit_desc));
+    num_submits = 0;
 
-    if (transition_cmd)
+    for (i = 0; i < batch->count; i++)
     {
-        /* The transition cmd must happen in-order, since with the advanced aliasing model in D3D12,
-         * it is enough to separate aliases with an ExecuteCommandLists.
-         * A clear-like operation must still happen though in the application which would acquire the alias,
-         * but we must still be somewhat careful about when we emit initial state transitions.
-         * The clear requirement only exists for render targets. */
-        num_submits = 2;
+        execute = &batch->execute[i];
 
-        submit_desc[0].signalSemaphoreCount = 1;
-        submit_desc[0].pSignalSemaphores = &transition_timeline;
-        submit_desc[0].commandBufferCount = 1;
-        submit_desc[0].pCommandBuffers = &transition_cmd;
+        TRACE("queue %p, command_list_count %u, command_lists %p.\n",
+                command_queue, execute->cmd_count, execute->cmd);
 
-        timeline_submit_info[0].signalSemaphoreValueCount = 1;
-        /* Could use the serializing binary semaphore here,
-         * but we need to keep track of the timeline on CPU as well
-         * to know when we can reset the barrier command buffer. */
-        timeline_submit_info[0].pSignalSemaphoreValues = &transition_timeline_value;
+        if (execute->debug_capture)
+            debug_capture = true;
+
+        if (batch->transition_cmd[i])
+        {
+            /* The transition cmd must happen in-order, since with the advanced aliasing model in D3D12,
+             * it is enough to separate aliases with an ExecuteCommandLists.
+             * A clear-like operation must still happen though in the application which would acquire the alias,
+             * but we must still be somewhat careful about when we emit initial state transitions.
+             * The clear requirement only exists for render targets. */
+            submit_desc[num_submits].signalSemaphoreCount = 1;
+            submit_desc[num_submits].pSignalSemaphores = &transition_timeline;
+            submit_desc[num_submits].commandBufferCount = 1;
+            submit_desc[num_submits].pCommandBuffers = &batch->transition_cmd[i];
+
+            timeline_submit_info[num_submits].signalSemaphoreValueCount = 1;
+            /* Could use the serializing binary semaphore here,
+             * but we need to keep track of the timeline on CPU as well
+             * to know when we can reset the barrier command buffer. */
+            timeline_submit_info[num_submits].pSignalSemaphoreValues = &batch->transition_timeline_value[i];
+            num_submits++;
+
+            submit_desc[num_submits].waitSemaphoreCount = 1;
+            timeline_submit_info[num_submits].waitSemaphoreValueCount = 1;
+            timeline_submit_info[num_submits].pWaitSemaphoreValues = &batch->transition_timeline_value[i];
+            submit_desc[num_submits].pWaitSemaphores = &transition_timeline;
+            submit_desc[num_submits].pWaitDstStageMask = &wait_stage_mask;
+        }
 
-        submit_desc[1].waitSemaphoreCount = 1;
-        timeline_submit_info[1].waitSemaphoreValueCount = 1;
-        timeline_submit_info[1].pWaitSemaphoreValues = &transition_timeline_value;
-        submit_desc[1].pWaitSemaphores = &transition_timeline;
-        submit_desc[1].pWaitDstStageMask = &wait_stage_mask;
+        submit_desc[num_submits].commandBufferCount = execute->cmd_count;
+        submit_desc[num_submits].pCommandBuffers = execute->cmd;
+        execute_submit_index[i] = num_submits++;
     }
-    else
+
+    /* Need to hold the fence lock while we're submitting, since another thread could come in and signal the semaphore
+     * to a higher value before we call vkQueueSubmit, which creates a non-monotonically increasing value. */
+    if (signal_fence)
     {
-        num_submits = 1;
+        d3d12_fence_lock(signal_fence);
+        TRACE("queue %p, fence %p, value %#"PRIx64".\n", command_queue, signal_fence, signal_value);
+        physical_signal_value = d3d12_fence_add_pending_signal_locked(signal_fence, signal_value, vkd3d_queue);
     }
+    else
+        physical_signal_value = 0;
 
     if (!(vk_queue = vkd3d_queue_acquire(vkd3d_queue)))
     {
         ERR("Failed to acquire queue %p.\n", vkd3d_queue);
-        for (i = 0; i < num_submission_counters; i++)
-            InterlockedDecrement(submission_counters[i]);
-        vkd3d_free(submission_counters);
+        if (signal_fence)
+            d3d12_fence_unlock(signal_fence);
+        for (i = 0; i < batch->count; i++)
+        {
+            execute = &batch->execute[i];
+            for (j = 0; j < execute->outstanding_submissions_counter_count; j++)
+                InterlockedDecrement(execute->outstanding_submissions_counters[j]);
+            vkd3d_free(execute->outstanding_submissions_counters);
+        }
         return;
     }
 
-    submit_desc[num_submits - 1].commandBufferCount = count;
-    submit_desc[num_submits - 1].pCommandBuffers = cmd;
+    for (i = 0; i < batch->count; i++)
+    {
+        j = execute_submit_index[i];
+        submission_timeline_count[i] = ++vkd3d_queue->submission_timeline_count;
+        submit_desc[j].signalSemaphoreCount = 1;
+        timeline_submit_info[j].signalSemaphoreValueCount = 1;
+        submit_desc[j].pSignalSemaphores = &vkd3d_queue->submission_timeline;
+        timeline_submit_info[j].pSignalSemaphoreValues = &submission_timeline_count[i];
+    }
 
-    submission_timeline_count = ++vkd3d_queue->submission_timeline_count;
-    submit_desc[num_submits - 1].signalSemaphoreCount = 1;
-    timeline_submit_info[num_submits - 1].signalSemaphoreValueCount = 1;
-    submit_desc[num_submits - 1].pSignalSemaphores = &vkd3d_queue->submission_timeline;
-    timeline_submit_info[num_submits - 1].pSignalSemaphoreValues = &submission_timeline_count;
+    if (signal_fence)
+    {
+        /* Fold the fence signal into the last execute. */
+        j = execute_submit_index[batch->count - 1];
+        signal_semaphores[0] = vkd3d_queue->submission_timeline;
+        signal_semaphores[1] = signal_fence->timeline_semaphore;
+        signal_values[0] = submission_timeline_count[batch->count - 1];
+        signal_values[1] = physical_signal_value;
+        submit_desc[j].signalSemaphoreCount = 2;
+        timeline_submit_info[j].signalSemaphoreValueCount = 2;
+        submit_desc[j].pSignalSemaphores = signal_semaphores;
+        timeline_submit_info[j].pSignalSemaphoreValues = signal_values;
+    }
 
     for (i = 0; i < num_submits; i++)
     {
@@ -12823,6 +13346,13 @@ static void d3d12_command_queue_execute(struct d3d12_command_queue *command_queu
         vkd3d_renderdoc_command_queue_end_capture(command_queue);
 #endif
 
+    if (signal_fence)
+    {
+        if (vr == VK_SUCCESS)
+            d3d12_fence_update_pending_value_locked(signal_fence);
+        d3d12_fence_unlock(signal_fence);
+    }
+
     vkd3d_queue_release(vkd3d_queue);
 
     /* After a proper submit we have to queue up some work which is tied to this submission:
@@ -12832,14 +13362,32 @@ static void d3d12_command_queue_execute(struct d3d12_command_queue *command_queu
      *   If there are pending submissions waiting, we are expected to ignore the reset.
      *   We will report a failure in this case. Some games run into this.
      */
-    if (vr == VK_SUCCESS && num_submission_counters)
+    if (vr == VK_SUCCESS)
     {
-        if (FAILED(hr = vkd3d_enqueue_timeline_semaphore(&command_queue->fence_worker,
-                NULL, vkd3d_queue->submission_timeline,
-                submission_timeline_count, false,
-                submission_counters, num_submission_counters)))
+        for (i = 0; i < batch->count; i++)
         {
-            ERR("Failed to enqueue timeline semaphore.\n");
+            execute = &batch->execute[i];
+            if (!execute->outstanding_submissions_counter_count)
+                continue;
+
+            if (FAILED(hr = vkd3d_enqueue_timeline_semaphore(&command_queue->fence_worker,
+                    NULL, vkd3d_queue->submission_timeline,
+                    submission_timeline_count[i], false,
+                    execute->outstanding_submissions_counters,
+                    execute->outstanding_submissions_counter_count)))
+            {
+                ERR("Failed to enqueue timeline semaphore.\n");
+            }
+        }
+
+        if (signal_fence)
+        {
+            if (FAILED(hr = vkd3d_enqueue_timeline_semaphore(&command_queue->fence_worker,
+                    &signal_fence->ID3D12Fence_iface, signal_fence->timeline_semaphore,
+                    physical_signal_value, true, NULL, 0)))
+            {
+                ERR("Failed to enqueue timeline semaphore, hr #%x.\n", hr);
+            }
         }
     }
 }
@@ -13155,58 +13703,253 @@ void d3d12_command_queue_submit_stop(struct d3d12_command_queue *queue)
     d3d12_command_queue_add_submission(queue, &sub);
 }
 
-static void d3d12_command_queue_add_submission_locked(struct d3d12_command_queue *queue,
-                                                      const struct d3d12_command_queue_submission *sub)
+static void d3d12_command_queue_submission_ring_init(struct d3d12_command_queue_submission_ring *ring)
 {
-    vkd3d_array_reserve((void**)&queue->submissions, &queue->submissions_size,
-                        queue->submissions_count + 1, sizeof(*queue->submissions));
-    queue->submissions[queue->submissions_count++] = *sub;
-    pthread_cond_signal(&queue->queue_cond);
+    uint32_t i;
+
+    ring->write_index = 0;
+    ring->read_index = 0;
+    for (i = 0; i < VKD3D_SUBMISSION_RING_SIZE; i++)
+        ring->slots[i].sequence = i;
+}
+
+static bool d3d12_command_queue_submission_ring_push(struct d3d12_command_queue_submission_ring *ring,
+        const struct d3d12_command_queue_submission *sub)
+{
+    struct d3d12_command_queue_submission_slot *slot;
+    uint32_t pos, seq, old_pos;
+    int32_t diff;
+
+    pos = vkd3d_atomic_uint32_load_explicit(&ring->write_index, vkd3d_memory_order_relaxed);
+
+    for (;;)
+    {
+        slot = &ring->slots[pos & (VKD3D_SUBMISSION_RING_SIZE - 1)];
+        seq = vkd3d_atomic_uint32_load_explicit(&slot->sequence, vkd3d_memory_order_acquire);
+        diff = (int32_t)(seq - pos);
+
+        if (diff == 0)
+        {
+            old_pos = vkd3d_atomic_uint32_compare_exchange(&ring->write_index, pos, pos + 1,
+                    vkd3d_memory_order_seq_cst, vkd3d_memory_order_relaxed);
+            if (old_pos == pos)
+                break;
+            pos = old_pos;
+        }
+        else if (diff < 0)
+        {
+            /* The consumer has not released this slot yet, so the ring is full. */
+            return false;
+        }
+        else
+            pos = vkd3d_atomic_uint32_load_explicit(&ring->write_index, vkd3d_memory_order_relaxed);
+    }
+
+    slot->submission = *sub;
+    vkd3d_atomic_uint32_store_explicit(&slot->sequence, pos + 1, vkd3d_memory_order_seq_cst);
+    return true;
+}
+
+static bool d3d12_command_queue_submission_ring_pop(struct d3d12_command_queue_submission_ring *ring,
+        struct d3d12_command_queue_submission *sub)
+{
+    struct d3d12_command_queue_submission_slot *slot;
+    uint32_t pos = ring->read_index;
+
+    slot = &ring->slots[pos & (VKD3D_SUBMISSION_RING_SIZE - 1)];
+
+    while (vkd3d_atomic_uint32_load_explicit(&slot->sequence, vkd3d_memory_order_seq_cst) != pos + 1)
+    {
+        /* If a producer has claimed the slot, but not yet published it, we have to wait for it
+         * rather than report empty, otherwise we could reorder against the overflow list. */
+        if (vkd3d_atomic_uint32_load_explicit(&ring->write_index, vkd3d_memory_order_seq_cst) == pos)
+            return false;
+        vkd3d_pause();
+    }
+
+    *sub = slot->submission;
+    vkd3d_atomic_uint32_store_explicit(&slot->sequence, pos + VKD3D_SUBMISSION_RING_SIZE, vkd3d_memory_order_release);
+    ring->read_index = pos + 1;
+    return true;
+}
+
+static bool d3d12_command_queue_submission_ring_is_empty(struct d3d12_command_queue_submission_ring *ring)
+{
+    return vkd3d_atomic_uint32_load_explicit(&ring->write_index, vkd3d_memory_order_seq_cst) == ring->read_index;
+}
+
+static void d3d12_command_queue_wake_worker_locked(struct d3d12_command_queue *queue)
+{
+    if (vkd3d_atomic_uint32_load_explicit(&queue->worker_sleeping, vkd3d_memory_order_relaxed))
+    {
+        vkd3d_atomic_uint32_store_explicit(&queue->worker_sleeping, 0, vkd3d_memory_order_relaxed);
+        pthread_cond_signal(&queue->queue_cond);
+    }
+}
+
+static void d3d12_command_queue_add_submission_unserialized(struct d3d12_command_queue *queue,
+        const struct d3d12_command_queue_submission *sub)
+{
+    /* Once we have spilled into the overflow list, everything must go there until the submission thread
+     * has caught up, otherwise a later submission from the same thread could overtake an earlier one. */
+    if (!vkd3d_atomic_uint32_load_explicit(&queue->overflow_active, vkd3d_memory_order_seq_cst) &&
+            d3d12_command_queue_submission_ring_push(&queue->submission_ring, sub))
+    {
+        /* Common case: the worker is busy draining the ring, so no syscall is needed to wake it up. */
+        if (vkd3d_atomic_uint32_load_explicit(&queue->worker_sleeping, vkd3d_memory_order_seq_cst))
+        {
+            pthread_mutex_lock(&queue->queue_lock);
+            d3d12_command_queue_wake_worker_locked(queue);
+            pthread_mutex_unlock(&queue->queue_lock);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&queue->queue_lock);
+    if (!vkd3d_array_reserve((void **)&queue->overflow_submissions, &queue->overflow_submissions_size,
+            queue->overflow_submissions_count + 1, sizeof(*queue->overflow_submissions)))
+    {
+        ERR("Failed to allocate overflow submission.\n");
+        pthread_mutex_unlock(&queue->queue_lock);
+        return;
+    }
+    queue->overflow_submissions[queue->overflow_submissions_count++] = *sub;
+    vkd3d_atomic_uint32_store_explicit(&queue->overflow_active, 1, vkd3d_memory_order_seq_cst);
+    d3d12_command_queue_wake_worker_locked(queue);
+    pthread_mutex_unlock(&queue->queue_lock);
 }
 
 static void d3d12_command_queue_add_submission(struct d3d12_command_queue *queue,
         const struct d3d12_command_queue_submission *sub)
 {
+    /* While an external user holds the VkQueue, new work has to wait until it is released. */
+    if (vkd3d_atomic_uint32_load_explicit(&queue->serialized, vkd3d_memory_order_seq_cst))
+    {
+        pthread_mutex_lock(&queue->queue_lock);
+        while (queue->serialized_drain)
+            pthread_cond_wait(&queue->drain_cond, &queue->queue_lock);
+        pthread_mutex_unlock(&queue->queue_lock);
+    }
+
+    d3d12_command_queue_add_submission_unserialized(queue, sub);
+}
+
+static bool d3d12_command_queue_pop_overflow_submission(struct d3d12_command_queue *queue,
+        struct d3d12_command_queue_submission *sub)
+{
+    bool ret = false;
+
     pthread_mutex_lock(&queue->queue_lock);
-    d3d12_command_queue_add_submission_locked(queue, sub);
+
+    /* Any ring submission which was pushed before an overflow submission is visible once we hold the lock,
+     * and must be consumed first. */
+    if (d3d12_command_queue_submission_ring_is_empty(&queue->submission_ring) &&
+            queue->overflow_submissions_read < queue->overflow_submissions_count)
+    {
+        *sub = queue->overflow_submissions[queue->overflow_submissions_read++];
+        if (queue->overflow_submissions_read == queue->overflow_submissions_count)
+        {
+            queue->overflow_submissions_read = 0;
+            queue->overflow_submissions_count = 0;
+            vkd3d_atomic_uint32_store_explicit(&queue->overflow_active, 0, vkd3d_memory_order_seq_cst);
+        }
+        ret = true;
+    }
+
     pthread_mutex_unlock(&queue->queue_lock);
+    return ret;
+}
+
+static bool d3d12_command_queue_has_pending_submissions(struct d3d12_command_queue *queue)
+{
+    return !d3d12_command_queue_submission_ring_is_empty(&queue->submission_ring) ||
+            vkd3d_atomic_uint32_load_explicit(&queue->overflow_active, vkd3d_memory_order_seq_cst);
+}
+
+static bool d3d12_command_queue_try_pop_submission(struct d3d12_command_queue *queue,
+        struct d3d12_command_queue_submission *sub)
+{
+    if (d3d12_command_queue_submission_ring_pop(&queue->submission_ring, sub))
+        return true;
+
+    return vkd3d_atomic_uint32_load_explicit(&queue->overflow_active, vkd3d_memory_order_seq_cst) &&
+            d3d12_command_queue_pop_overflow_submission(queue, sub);
+}
+
+static void d3d12_command_queue_pop_submission(struct d3d12_command_queue *queue,
+        struct d3d12_command_queue_submission *sub)
+{
+    for (;;)
+    {
+        if (d3d12_command_queue_try_pop_submission(queue, sub))
+            return;
+
+        /* Announce that we are going to sleep before checking for work one last time.
+         * Producers only take the lock and signal if they observe this flag. */
+        vkd3d_atomic_uint32_store_explicit(&queue->worker_sleeping, 1, vkd3d_memory_order_seq_cst);
+
+        pthread_mutex_lock(&queue->queue_lock);
+        while (vkd3d_atomic_uint32_load_explicit(&queue->worker_sleeping, vkd3d_memory_order_relaxed) &&
+                !d3d12_command_queue_has_pending_submissions(queue))
+            pthread_cond_wait(&queue->queue_cond, &queue->queue_lock);
+        vkd3d_atomic_uint32_store_explicit(&queue->worker_sleeping, 0, vkd3d_memory_order_relaxed);
+        pthread_mutex_unlock(&queue->queue_lock);
+    }
 }
 
 static void d3d12_command_queue_acquire_serialized(struct d3d12_command_queue *queue)
 {
     /* In order to make sure all pending operations queued so far have been submitted,
-     * we build a drain task which will increment the queue_drain_count once the thread has finished all its work. */
+     * we build a drain task which will increment the queue_drain_count once the thread has finished all its work.
+     * Until d3d12_command_queue_release_serialized(), new submissions block in add_submission,
+     * and the submission thread parks after the drain, so nothing can be submitted behind the caller's back.
+     * Submissions which raced with us and made it into the ring after the drain are submitted after release. */
     struct d3d12_command_queue_submission sub;
     uint64_t current_drain;
 
     sub.type = VKD3D_SUBMISSION_DRAIN;
 
     pthread_mutex_lock(&queue->queue_lock);
-
+    while (queue->serialized_drain)
+        pthread_cond_wait(&queue->drain_cond, &queue->queue_lock);
     current_drain = ++queue->drain_count;
-    d3d12_command_queue_add_submission_locked(queue, &sub);
+    queue->serialized_drain = current_drain;
+    vkd3d_atomic_uint32_store_explicit(&queue->serialized, 1, vkd3d_memory_order_seq_cst);
+    pthread_mutex_unlock(&queue->queue_lock);
 
-    while (current_drain != queue->queue_drain_count)
-        pthread_cond_wait(&queue->queue_cond, &queue->queue_lock);
+    d3d12_command_queue_add_submission_unserialized(queue, &sub);
+
+    pthread_mutex_lock(&queue->queue_lock);
+    while (current_drain > queue->queue_drain_count)
+        pthread_cond_wait(&queue->drain_cond, &queue->queue_lock);
+    pthread_mutex_unlock(&queue->queue_lock);
 }
 
 static void d3d12_command_queue_release_serialized(struct d3d12_command_queue *queue)
 {
+    pthread_mutex_lock(&queue->queue_lock);
+    queue->serialized_drain = 0;
+    vkd3d_atomic_uint32_store_explicit(&queue->serialized, 0, vkd3d_memory_order_seq_cst);
+    pthread_cond_broadcast(&queue->drain_cond);
     pthread_mutex_unlock(&queue->queue_lock);
 }
 
 static void *d3d12_command_queue_submission_worker_main(void *userdata)
 {
-    struct d3d12_command_queue_submission submission;
+    struct d3d12_command_queue_submission submission, next_submission;
     struct d3d12_command_queue_transition_pool pool;
+    struct d3d12_command_queue_execute_batch batch;
     struct d3d12_command_queue *queue = userdata;
-    uint64_t transition_timeline_value = 0;
-    VkCommandBuffer transition_cmd;
+    bool has_next_submission = false;
+    unsigned int coalesced_count;
+    struct d3d12_fence *signal_fence;
+    unsigned int i;
     HRESULT hr;
 
     VKD3D_REGION_DECL(queue_wait);
     VKD3D_REGION_DECL(queue_signal);
     VKD3D_REGION_DECL(queue_execute);
+    VKD3D_REGION_DECL(queue_coalesced);
 
     vkd3d_set_thread_name("vkd3d_queue");
 
@@ -13215,14 +13958,13 @@ static void *d3d12_command_queue_submission_worker_main(void *userdata)
 
     for (;;)
     {
-        pthread_mutex_lock(&queue->queue_lock);
-        while (queue->submissions_count == 0)
-            pthread_cond_wait(&queue->queue_cond, &queue->queue_lock);
-
-        queue->submissions_count--;
-        submission = queue->submissions[0];
-        memmove(queue->submissions, queue->submissions + 1, queue->submissions_count * sizeof(submission));
-        pthread_mutex_unlock(&queue->queue_lock);
+        if (has_next_submission)
+        {
+            submission = next_submission;
+            has_next_submission = false;
+        }
+        else
+            d3d12_command_queue_pop_submission(queue, &submission);
 
         if (submission.type != VKD3D_SUBMISSION_WAIT)
         {
@@ -13261,22 +14003,54 @@ static void *d3d12_command_queue_submission_worker_main(void *userdata)
 
         case VKD3D_SUBMISSION_EXECUTE:
             VKD3D_REGION_BEGIN(queue_execute);
-            d3d12_command_queue_transition_pool_build(&pool, queue->device,
-                    submission.execute.transitions,
-                    submission.execute.transition_count,
-                    &transition_cmd, &transition_timeline_value);
-            d3d12_command_queue_execute(queue, submission.execute.cmd,
-                    submission.execute.cmd_count,
-                    transition_cmd, pool.timeline, transition_timeline_value,
-                    submission.execute.outstanding_submissions_counters,
-                    submission.execute.outstanding_submissions_counter_count,
-                    submission.execute.debug_capture);
+            batch.count = 0;
+            signal_fence = NULL;
+            d3d12_command_queue_execute_batch_add(&batch, &pool, queue->device, &submission.execute);
+
+            /* Merge any back-to-back executes which are already queued up into one vkQueueSubmit.
+             * A trailing non-shared Signal can be folded into the last execute as well.
+             * Waits break the batch since they have to be resolved through the fence before submitting. */
+            while (batch.count < VKD3D_MAX_COALESCED_SUBMISSIONS &&
+                    d3d12_command_queue_execute_can_coalesce(&submission.execute) &&
+                    d3d12_command_queue_try_pop_submission(queue, &next_submission))
+            {
+                if (next_submission.type == VKD3D_SUBMISSION_EXECUTE &&
+                        d3d12_command_queue_execute_can_coalesce(&next_submission.execute))
+                {
+                    d3d12_command_queue_execute_batch_add(&batch, &pool, queue->device, &next_submission.execute);
+                }
+                else
+                {
+                    if (next_submission.type == VKD3D_SUBMISSION_SIGNAL && !is_shared_ID3D12Fence1(next_submission.signal.fence))
+                        signal_fence = impl_from_ID3D12Fence1(next_submission.signal.fence);
+                    else
+                        has_next_submission = true;
+                    break;
+                }
+            }
+
+            d3d12_command_queue_execute(queue, &batch, pool.timeline,
+                    signal_fence, signal_fence ? next_submission.signal.value : 0);
+
             /* command_queue_execute takes ownership of the outstanding_submission_counters allocation.
              * The atomic counters are decremented when the submission is observed to be freed.
              * On error, the counters are freed early, so there is no risk of leak. */
-            vkd3d_free(submission.execute.cmd);
-            vkd3d_free(submission.execute.transitions);
-            VKD3D_REGION_END(queue_execute);
+            for (i = 0; i < batch.count; i++)
+            {
+                vkd3d_free(batch.execute[i].cmd);
+                vkd3d_free(batch.execute[i].transitions);
+            }
+
+            if (signal_fence)
+                d3d12_fence_iface_dec_ref(next_submission.signal.fence);
+            VKD3D_REGION_END_ITERATIONS(queue_execute, batch.count);
+
+            coalesced_count = batch.count - 1 + (signal_fence ? 1 : 0);
+            if (coalesced_count)
+            {
+                VKD3D_REGION_BEGIN(queue_coalesced);
+                VKD3D_REGION_END_ITERATIONS(queue_coalesced, coalesced_count);
+            }
             break;
 
         case VKD3D_SUBMISSION_BIND_SPARSE:
@@ -13290,7 +14064,11 @@ static void *d3d12_command_queue_submission_worker_main(void *userdata)
         {
             pthread_mutex_lock(&queue->queue_lock);
             queue->queue_drain_count++;
-            pthread_cond_signal(&queue->queue_cond);
+            pthread_cond_broadcast(&queue->drain_cond);
+            /* The caller of acquire_serialized owns the VkQueue now, don't submit anything until it is released.
+             * Another caller may serialize again right after release, but that is a different drain. */
+            while (queue->serialized_drain == queue->queue_drain_count)
+                pthread_cond_wait(&queue->drain_cond, &queue->queue_lock);
             pthread_mutex_unlock(&queue->queue_lock);
             break;
         }
@@ -13323,11 +14101,17 @@ static HRESULT d3d12_command_queue_init(struct d3d12_command_queue *queue,
 
     queue->vkd3d_queue = d3d12_device_allocate_vkd3d_queue(device,
             d3d12_device_get_vkd3d_queue_family(device, desc->Type));
-    queue->submissions = NULL;
-    queue->submissions_count = 0;
-    queue->submissions_size = 0;
+    d3d12_command_queue_submission_ring_init(&queue->submission_ring);
+    queue->worker_sleeping = 0;
+    queue->overflow_submissions = NULL;
+    queue->overflow_submissions_count = 0;
+    queue->overflow_submissions_size = 0;
+    queue->overflow_submissions_read = 0;
+    queue->overflow_active = 0;
     queue->drain_count = 0;
     queue->queue_drain_count = 0;
+    queue->serialized = 0;
+    queue->serialized_drain = 0;
 
     if ((rc = pthread_mutex_init(&queue->queue_lock, NULL)) < 0)
     {
@@ -13341,6 +14125,12 @@ static HRESULT d3d12_command_queue_init(struct d3d12_command_queue *queue,
         goto fail_pthread_cond;
     }
 
+    if ((rc = pthread_cond_init(&queue->drain_cond, NULL)) < 0)
+    {
+        hr = hresult_from_errno(rc);
+        goto fail_pthread_drain_cond;
+    }
+
     if (desc->Priority == D3D12_COMMAND_QUEUE_PRIORITY_GLOBAL_REALTIME)
         FIXME("Global realtime priority is not implemented.\n");
     if (desc->Priority)
@@ -13378,6 +14168,8 @@ fail_swapchain_factory:
     vkd3d_private_store_destroy(&queue->private_store);
 #endif
 fail_private_store:
+    pthread_cond_destroy(&queue->drain_cond);
+fail_pthread_drain_cond:
     pthread_cond_destroy(&queue->queue_cond);
 fail_pthread_cond:
     pthread_mutex_destroy(&queue->queue_lock);
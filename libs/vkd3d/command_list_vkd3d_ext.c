@@ -60,6 +60,8 @@ static HRESULT STDMETHODCALLTYPE d3d12_command_list_vkd3d_ext_GetVulkanHandle(ID
     if (!pVkCommandBuffer)
         return E_INVALIDARG;
 
+    /* The application records into the command buffer directly from here on. */
+    d3d12_command_list_flush_pending_barriers(command_list);
     *pVkCommandBuffer = command_list->vk_command_buffer;
     return S_OK;
 }
@@ -98,6 +100,7 @@ static HRESULT STDMETHODCALLTYPE d3d12_command_list_vkd3d_ext_LaunchCubinShader(
     launchInfo.pExtras = config;
     
     vk_procs = &command_list->device->vk_procs;
+    d3d12_command_list_flush_pending_barriers(command_list);
     VK_CALL(vkCmdCuLaunchKernelNVX(command_list->vk_command_buffer, &launchInfo));
     return S_OK;
 }
@@ -725,6 +725,8 @@ static const struct vkd3d_debug_option vkd3d_config_options[] =
     {"host_import_fallback", VKD3D_CONFIG_FLAG_USE_HOST_IMPORT_FALLBACK},
     {"preallocate_srv_mip_clamps", VKD3D_CONFIG_FLAG_PREALLOCATE_SRV_MIP_CLAMPS},
     {"force_initial_transition", VKD3D_CONFIG_FLAG_FORCE_INITIAL_TRANSITION},
+    {"async_pipeline_compile", VKD3D_CONFIG_FLAG_ASYNC_PIPELINE_COMPILE},
+    {"shader_cache_no_compression", VKD3D_CONFIG_FLAG_SHADER_CACHE_NO_COMPRESSION},
 };
 
 static void vkd3d_config_flags_init_once(void)
@@ -2912,6 +2914,23 @@ void d3d12_device_return_query_pool(struct d3d12_device *device, const struct vk
     }
 }
 
+void *d3d12_device_alloc_bundle_chunk(struct d3d12_device *device)
+{
+    void *chunk;
+
+    pthread_mutex_lock(&device->mutex);
+    chunk = vkd3d_chunk_pool_alloc(&device->bundle_chunk_pool);
+    pthread_mutex_unlock(&device->mutex);
+    return chunk;
+}
+
+void d3d12_device_free_bundle_chunk(struct d3d12_device *device, void *chunk)
+{
+    pthread_mutex_lock(&device->mutex);
+    vkd3d_chunk_pool_free(&device->bundle_chunk_pool, chunk);
+    pthread_mutex_unlock(&device->mutex);
+}
+
 /* ID3D12Device */
 extern ULONG STDMETHODCALLTYPE d3d12_device_vkd3d_ext_AddRef(ID3D12DeviceExt *iface);
 
@@ -2967,6 +2986,9 @@ static void d3d12_device_destroy(struct d3d12_device *device)
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     size_t i, j;
 
+    /* Pending pipelines still need most of the device, and may push work to the disk cache. */
+    vkd3d_pipeline_compile_pool_cleanup(&device->pipeline_compile_pool, device);
+
     for (i = 0; i < VKD3D_SCRATCH_POOL_KIND_COUNT; i++)
         for (j = 0; j < device->scratch_pools[i].scratch_buffer_count; j++)
             d3d12_device_destroy_scratch_buffer(device, &device->scratch_pools[i].scratch_buffers[j]);
@@ -2977,6 +2999,9 @@ static void d3d12_device_destroy(struct d3d12_device *device)
     for (i = 0; i < device->cached_command_allocator_count; i++)
         VK_CALL(vkDestroyCommandPool(device->vk_device, device->cached_command_allocators[i].vk_command_pool, NULL));
 
+    TRACE("Allocated %zu bundle chunks from the heap.\n", device->bundle_chunk_pool.heap_alloc_count);
+    vkd3d_chunk_pool_cleanup(&device->bundle_chunk_pool);
+
     vkd3d_free(device->descriptor_heap_gpu_vas);
 
     vkd3d_private_store_destroy(&device->private_store);
@@ -2989,6 +3014,8 @@ static void d3d12_device_destroy(struct d3d12_device *device)
         vkd3d_breadcrumb_tracer_cleanup(&device->breadcrumb_tracer, device);
 #endif
     vkd3d_pipeline_library_flush_disk_cache(&device->disk_cache);
+    vkd3d_shader_memo_cache_cleanup(&device->shader_memo_cache);
+    vkd3d_shader_intern_table_cleanup(&device->shader_intern_table, device);
     vkd3d_sampler_state_cleanup(&device->sampler_state, device);
     vkd3d_view_map_destroy(&device->sampler_map, device);
     vkd3d_meta_ops_cleanup(&device->meta_ops, device);
@@ -6591,7 +6618,9 @@ static HRESULT d3d12_device_init(struct d3d12_device *device,
         hr = hresult_from_errno(rc);
         goto out_free_instance;
     }
-    
+
+    vkd3d_chunk_pool_init(&device->bundle_chunk_pool, VKD3D_BUNDLE_CHUNK_SIZE, VKD3D_CACHED_BUNDLE_CHUNK_COUNT);
+
     device->ID3D12DeviceExt_iface.lpVtbl = &d3d12_device_vkd3d_ext_vtbl;
 
     if (FAILED(hr = vkd3d_create_vk_device(device, create_info)))
@@ -6645,9 +6674,18 @@ static HRESULT d3d12_device_init(struct d3d12_device *device,
     vkd3d_init_shader_extensions(device);
     vkd3d_compute_shader_interface_key(device);
 
+    if (FAILED(hr = vkd3d_shader_memo_cache_init(&device->shader_memo_cache)))
+        goto out_cleanup_descriptor_qa_global_info;
+
+    if (FAILED(hr = vkd3d_shader_intern_table_init(&device->shader_intern_table)))
+        goto out_cleanup_shader_memo_cache;
+
+    if (FAILED(hr = vkd3d_pipeline_compile_pool_init(&device->pipeline_compile_pool, device)))
+        goto out_cleanup_shader_intern_table;
+
     /* Make sure all extensions and shader interface keys are computed. */
     if (FAILED(hr = vkd3d_pipeline_library_init_disk_cache(&device->disk_cache, device)))
-        goto out_cleanup_descriptor_qa_global_info;
+        goto out_cleanup_pipeline_compile_pool;
 
 #ifdef VKD3D_ENABLE_RENDERDOC
     if (vkd3d_renderdoc_active() && vkd3d_renderdoc_global_capture_enabled())
@@ -6656,6 +6694,12 @@ static HRESULT d3d12_device_init(struct d3d12_device *device,
 
     return S_OK;
 
+out_cleanup_pipeline_compile_pool:
+    vkd3d_pipeline_compile_pool_cleanup(&device->pipeline_compile_pool, device);
+out_cleanup_shader_intern_table:
+    vkd3d_shader_intern_table_cleanup(&device->shader_intern_table, device);
+out_cleanup_shader_memo_cache:
+    vkd3d_shader_memo_cache_cleanup(&device->shader_memo_cache);
 out_cleanup_descriptor_qa_global_info:
     vkd3d_descriptor_debug_free_global_info(device->descriptor_qa_global_info, device);
 out_cleanup_breadcrumb_tracer:
@@ -138,11 +138,60 @@ static HRESULT vkd3d_create_global_buffer(struct d3d12_device *device, VkDeviceS
     return vkd3d_create_buffer(device, heap_properties, heap_flags, &resource_desc, vk_buffer);
 }
 
+static bool vkd3d_memory_info_try_reserve_budget(struct vkd3d_memory_info *info,
+        uint32_t type_index, VkDeviceSize size, uint64_t *new_total)
+{
+    UINT64 *type_current = &info->type_current[type_index];
+    uint64_t old_value, expected;
+
+    old_value = vkd3d_atomic_uint64_load_explicit(type_current, vkd3d_memory_order_relaxed);
+
+    do
+    {
+        expected = old_value;
+
+        if (expected + size > info->type_budget[type_index])
+        {
+            if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
+            {
+                INFO("Attempting to allocate from memory type %u, but exceeding fixed budget: %"PRIu64" + %"PRIu64" > %"PRIu64".\n",
+                        type_index, expected, size, info->type_budget[type_index]);
+            }
+            return false;
+        }
+
+        old_value = vkd3d_atomic_uint64_compare_exchange(type_current, expected, expected + size,
+                vkd3d_memory_order_relaxed, vkd3d_memory_order_relaxed);
+    } while (old_value != expected);
+
+    *new_total = expected + size;
+    return true;
+}
+
+static uint64_t vkd3d_memory_info_release_budget(struct vkd3d_memory_info *info,
+        uint32_t type_index, VkDeviceSize size)
+{
+    UINT64 *type_current = &info->type_current[type_index];
+    uint64_t old_value, expected;
+
+    old_value = vkd3d_atomic_uint64_load_explicit(type_current, vkd3d_memory_order_relaxed);
+
+    do
+    {
+        expected = old_value;
+        assert(expected >= size);
+        old_value = vkd3d_atomic_uint64_compare_exchange(type_current, expected, expected - size,
+                vkd3d_memory_order_relaxed, vkd3d_memory_order_relaxed);
+    } while (old_value != expected);
+
+    return expected - size;
+}
+
 void vkd3d_free_device_memory(struct d3d12_device *device, const struct vkd3d_device_memory_allocation *allocation)
 {
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
-    VkDeviceSize *type_current;
     bool budget_sensitive;
+    uint64_t new_total;
 
     if (allocation->vk_memory == VK_NULL_HANDLE)
     {
@@ -154,16 +203,13 @@ void vkd3d_free_device_memory(struct d3d12_device *device, const struct vkd3d_de
     budget_sensitive = !!(device->memory_info.budget_sensitive_mask & (1u << allocation->vk_memory_type));
     if (budget_sensitive)
     {
-        type_current = &device->memory_info.type_current[allocation->vk_memory_type];
-        pthread_mutex_lock(&device->memory_info.budget_lock);
-        assert(*type_current >= allocation->size);
-        *type_current -= allocation->size;
+        new_total = vkd3d_memory_info_release_budget(&device->memory_info,
+                allocation->vk_memory_type, allocation->size);
         if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
         {
             INFO("Freeing memory of type %u, new total allocated size %"PRIu64" MiB.\n",
-                    allocation->vk_memory_type, *type_current / (1024 * 1024));
+                    allocation->vk_memory_type, new_total / (1024 * 1024));
         }
-        pthread_mutex_unlock(&device->memory_info.budget_lock);
     }
     else if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
     {
@@ -184,9 +230,8 @@ static HRESULT vkd3d_try_allocate_device_memory(struct d3d12_device *device,
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     struct vkd3d_memory_info *memory_info = &device->memory_info;
     VkMemoryAllocateInfo allocate_info;
-    VkDeviceSize *type_current;
-    VkDeviceSize *type_budget;
     bool budget_sensitive;
+    uint64_t new_total;
     uint32_t type_mask;
     VkResult vr;
 
@@ -209,26 +254,14 @@ static HRESULT vkd3d_try_allocate_device_memory(struct d3d12_device *device,
         allocate_info.memoryTypeIndex = type_index;
 
         budget_sensitive = !!(device->memory_info.budget_sensitive_mask & (1u << type_index));
-        if (budget_sensitive)
+        /* Reserve budget up front so that concurrent allocations cannot overshoot it. */
+        if (budget_sensitive && !vkd3d_memory_info_try_reserve_budget(memory_info, type_index, size, &new_total))
         {
-            type_budget = &memory_info->type_budget[type_index];
-            type_current = &memory_info->type_current[type_index];
-            pthread_mutex_lock(&memory_info->budget_lock);
-            if (*type_current + size > *type_budget)
-            {
-                if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
-                {
-                    INFO("Attempting to allocate from memory type %u, but exceeding fixed budget: %"PRIu64" + %"PRIu64" > %"PRIu64".\n",
-                            type_index, *type_current, size, *type_budget);
-                }
-                pthread_mutex_unlock(&memory_info->budget_lock);
-
-                /* If we're out of DEVICE budget, don't try other types. */
-                if (type_flags & optional_flags)
-                    return E_OUTOFMEMORY;
-                else
-                    continue;
-            }
+            /* If we're out of DEVICE budget, don't try other types. */
+            if (type_flags & optional_flags)
+                return E_OUTOFMEMORY;
+            else
+                continue;
         }
 
         vr = VK_CALL(vkAllocateMemory(device->vk_device, &allocate_info, NULL, &allocation->vk_memory));
@@ -237,14 +270,14 @@ static HRESULT vkd3d_try_allocate_device_memory(struct d3d12_device *device,
         {
             if (vr == VK_SUCCESS)
             {
-                *type_current += size;
                 if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
                 {
                     INFO("Allocated memory of type %u, new total allocated size %"PRIu64" MiB.\n",
-                            type_index, *type_current / (1024 * 1024));
+                            type_index, new_total / (1024 * 1024));
                 }
             }
-            pthread_mutex_unlock(&memory_info->budget_lock);
+            else
+                vkd3d_memory_info_release_budget(memory_info, type_index, size);
         }
         else if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_LOG_MEMORY_BUDGET)
         {
@@ -660,178 +693,125 @@ static HRESULT vkd3d_memory_allocation_init(struct vkd3d_memory_allocation *allo
     return S_OK;
 }
 
-static void vkd3d_memory_chunk_insert_range(struct vkd3d_memory_chunk *chunk,
-        size_t index, VkDeviceSize offset, VkDeviceSize length)
+static void vkd3d_memory_pool_lock(struct vkd3d_memory_pool *pool)
 {
-    if (!vkd3d_array_reserve((void**)&chunk->free_ranges, &chunk->free_ranges_size,
-            chunk->free_ranges_count + 1, sizeof(*chunk->free_ranges)))
-    {
-        ERR("Failed to insert free range.\n");
+#ifdef VKD3D_ENABLE_PROFILING
+    unsigned int region_index;
+    uint64_t start_ticks;
+
+    if (!pthread_mutex_trylock(&pool->mutex))
         return;
-    }
 
-    memmove(&chunk->free_ranges[index + 1], &chunk->free_ranges[index],
-            sizeof(*chunk->free_ranges) * (chunk->free_ranges_count - index));
+    start_ticks = vkd3d_get_current_time_ticks();
+    pthread_mutex_lock(&pool->mutex);
 
-    chunk->free_ranges[index].offset = offset;
-    chunk->free_ranges[index].length = length;
-    chunk->free_ranges_count++;
+    if (!(region_index = vkd3d_atomic_uint32_load_explicit(&pool->profiling_latch, vkd3d_memory_order_acquire)))
+        region_index = vkd3d_profiling_register_region(pool->profiling_name, &pool->profiling_lock, &pool->profiling_latch);
+    vkd3d_profiling_notify_work(region_index, start_ticks, vkd3d_get_current_time_ticks(), 1);
+#else
+    pthread_mutex_lock(&pool->mutex);
+#endif
 }
 
-static void vkd3d_memory_chunk_remove_range(struct vkd3d_memory_chunk *chunk, size_t index)
+static void vkd3d_memory_pool_unlock(struct vkd3d_memory_pool *pool)
 {
-    chunk->free_ranges_count--;
-
-    memmove(&chunk->free_ranges[index], &chunk->free_ranges[index + 1],
-            sizeof(*chunk->free_ranges) * (chunk->free_ranges_count - index));
+    pthread_mutex_unlock(&pool->mutex);
 }
 
-static HRESULT vkd3d_memory_chunk_allocate_range(struct vkd3d_memory_chunk *chunk, const VkMemoryRequirements *memory_requirements,
+static HRESULT vkd3d_memory_pool_allocate_range_locked(struct vkd3d_memory_pool *pool, const VkMemoryRequirements *memory_requirements,
         struct vkd3d_memory_allocation *allocation)
 {
-    struct vkd3d_memory_free_range *pick_range;
-    VkDeviceSize l_length, r_length;
-    size_t i, pick_index;
-
-    if (!chunk->free_ranges_count)
-        return E_OUTOFMEMORY;
-
-    pick_index = chunk->free_ranges_count;
-    pick_range = NULL;
-
-    for (i = 0; i < chunk->free_ranges_count; i++)
-    {
-        struct vkd3d_memory_free_range *range = &chunk->free_ranges[i];
-
-        if (range->offset + range->length < align(range->offset, memory_requirements->alignment) + memory_requirements->size)
-            continue;
-
-        /* Exact fit leaving no gaps */
-        if (range->length == memory_requirements->size)
-        {
-            pick_index = i;
-            pick_range = range;
-            break;
-        }
-
-        /* Alignment is almost always going to be 64 KiB, so
-         * don't worry too much about misalignment gaps here */
-        if (!pick_range || range->length > pick_range->length)
-        {
-            pick_index = i;
-            pick_range = range;
-        }
-    }
+    struct vkd3d_tlsf_allocation range;
+    struct vkd3d_memory_chunk *chunk;
 
-    if (!pick_range)
+    if (!vkd3d_tlsf_allocate(&pool->tlsf, memory_requirements->size, memory_requirements->alignment, &range))
         return E_OUTOFMEMORY;
 
     /* Adjust offsets and addresses of the base allocation */
+    chunk = range.region;
     vkd3d_memory_allocation_slice(allocation, &chunk->allocation,
-            align(pick_range->offset, memory_requirements->alignment),
-            memory_requirements->size);
+            range.offset, memory_requirements->size);
     allocation->chunk = chunk;
+    allocation->chunk_block_index = range.block_index;
+    return S_OK;
+}
 
-    /* Remove allocated range from the free list */
-    l_length = allocation->offset - pick_range->offset;
-    r_length = pick_range->offset + pick_range->length
-            - allocation->offset - allocation->resource.size;
+static struct vkd3d_memory_pool *vkd3d_memory_allocator_find_pool_locked(struct vkd3d_memory_allocator *allocator,
+        D3D12_HEAP_TYPE heap_type, D3D12_HEAP_FLAGS heap_flags, uint32_t vk_memory_type)
+{
+    struct vkd3d_memory_pool *pool;
+    size_t i;
 
-    if (l_length)
+    for (i = 0; i < allocator->pools_count; i++)
     {
-        pick_range->length = l_length;
+        pool = allocator->pools[i];
 
-        if (r_length)
-        {
-            vkd3d_memory_chunk_insert_range(chunk, pick_index + 1,
-                allocation->offset + allocation->resource.size, r_length);
-        }
-    }
-    else if (r_length)
-    {
-        pick_range->offset = allocation->offset + allocation->resource.size;
-        pick_range->length = r_length;
-    }
-    else
-    {
-        vkd3d_memory_chunk_remove_range(chunk, pick_index);
+        if (pool->heap_type == heap_type && pool->heap_flags == heap_flags &&
+                pool->vk_memory_type == vk_memory_type)
+            return pool;
     }
 
-    return S_OK;
+    return NULL;
 }
 
-static size_t vkd3d_memory_chunk_find_range(struct vkd3d_memory_chunk *chunk, VkDeviceSize offset)
+static struct vkd3d_memory_pool *vkd3d_memory_allocator_get_pool(struct vkd3d_memory_allocator *allocator,
+        D3D12_HEAP_TYPE heap_type, D3D12_HEAP_FLAGS heap_flags, uint32_t vk_memory_type)
 {
-    struct vkd3d_memory_free_range *range;
-    size_t index, hi, lo;
+    struct vkd3d_memory_pool *pool;
 
-    lo = 0;
-    hi = chunk->free_ranges_count;
-
-    while (lo < hi)
-    {
-        index = lo + (hi - lo) / 2;
-        range = &chunk->free_ranges[index];
+    rwlock_lock_read(&allocator->pools_lock);
+    pool = vkd3d_memory_allocator_find_pool_locked(allocator, heap_type, heap_flags, vk_memory_type);
+    rwlock_unlock_read(&allocator->pools_lock);
 
-        if (range->offset > offset)
-            hi = index;
-        else
-            lo = index + 1;
-    }
+    if (pool)
+        return pool;
 
-    return lo;
-}
+    rwlock_lock_write(&allocator->pools_lock);
 
-static void vkd3d_memory_chunk_free_range(struct vkd3d_memory_chunk *chunk, const struct vkd3d_memory_allocation *allocation)
-{
-    struct vkd3d_memory_free_range *range;
-    bool adjacent_l, adjacent_r;
-    size_t index;
+    /* Another thread may have created the pool in the meantime. */
+    if ((pool = vkd3d_memory_allocator_find_pool_locked(allocator, heap_type, heap_flags, vk_memory_type)))
+        goto out;
 
-    index = vkd3d_memory_chunk_find_range(chunk, allocation->offset);
+    if (!vkd3d_array_reserve((void**)&allocator->pools, &allocator->pools_size,
+            allocator->pools_count + 1, sizeof(*allocator->pools)))
+        goto out;
 
-    adjacent_l = false;
-    adjacent_r = false;
+    if (!(pool = vkd3d_calloc(1, sizeof(*pool))))
+        goto out;
 
-    if (index > 0)
+    if (pthread_mutex_init(&pool->mutex, NULL))
     {
-        range = &chunk->free_ranges[index - 1];
-        adjacent_l = range->offset + range->length == allocation->offset;
+        vkd3d_free(pool);
+        pool = NULL;
+        goto out;
     }
 
-    if (index < chunk->free_ranges_count)
-    {
-        range = &chunk->free_ranges[index];
-        adjacent_r = range->offset == allocation->offset + allocation->resource.size;
-    }
+    pool->heap_type = heap_type;
+    pool->heap_flags = heap_flags;
+    pool->vk_memory_type = vk_memory_type;
+    vkd3d_tlsf_init(&pool->tlsf);
 
-    if (adjacent_l)
-    {
-        range = &chunk->free_ranges[index - 1];
-        range->length += allocation->resource.size;
+#ifdef VKD3D_ENABLE_PROFILING
+    snprintf(pool->profiling_name, sizeof(pool->profiling_name), "memory_pool_contention_%u_%#x_%u",
+            heap_type, heap_flags, vk_memory_type);
+#endif
 
-        if (adjacent_r)
-        {
-            range->length += chunk->free_ranges[index].length;
-            vkd3d_memory_chunk_remove_range(chunk, index);
-        }
-    }
-    else if (adjacent_r)
-    {
-        range = &chunk->free_ranges[index];
-        range->offset = allocation->offset;
-        range->length += allocation->resource.size;
-    }
-    else
-    {
-        vkd3d_memory_chunk_insert_range(chunk, index,
-                allocation->offset, allocation->resource.size);
-    }
+    allocator->pools[allocator->pools_count++] = pool;
+
+out:
+    rwlock_unlock_write(&allocator->pools_lock);
+    return pool;
 }
 
-static bool vkd3d_memory_chunk_is_free(struct vkd3d_memory_chunk *chunk)
+static void vkd3d_memory_chunk_destroy(struct vkd3d_memory_chunk *chunk, struct d3d12_device *device, struct vkd3d_memory_allocator *allocator)
 {
-    return chunk->free_ranges_count == 1 && chunk->free_ranges[0].length == chunk->allocation.resource.size;
+    TRACE("chunk %p, device %p, allocator %p.\n", chunk, device, allocator);
+
+    if (chunk->allocation.clear_semaphore_value)
+        vkd3d_memory_allocator_wait_allocation(allocator, device, &chunk->allocation);
+
+    vkd3d_memory_allocation_free(&chunk->allocation, device, allocator);
+    vkd3d_free(chunk);
 }
 
 static HRESULT vkd3d_memory_chunk_create(struct d3d12_device *device, struct vkd3d_memory_allocator *allocator,
@@ -853,39 +833,92 @@ static HRESULT vkd3d_memory_chunk_create(struct d3d12_device *device, struct vkd
         return hr;
     }
 
-    vkd3d_memory_chunk_insert_range(object, 0, 0, object->allocation.resource.size);
+    if (!(object->pool = vkd3d_memory_allocator_get_pool(allocator, object->allocation.heap_type,
+            object->allocation.heap_flags, object->allocation.device_allocation.vk_memory_type)))
+    {
+        ERR("Failed to allocate memory pool.\n");
+        vkd3d_memory_chunk_destroy(object, device, allocator);
+        return E_OUTOFMEMORY;
+    }
+
     *chunk = object;
 
     TRACE("Created chunk %p (allocation %p).\n", object, &object->allocation);
     return S_OK;
 }
 
-static void vkd3d_memory_chunk_destroy(struct vkd3d_memory_chunk *chunk, struct d3d12_device *device, struct vkd3d_memory_allocator *allocator)
+static HRESULT vkd3d_memory_pool_add_chunk_locked(struct vkd3d_memory_pool *pool, struct vkd3d_memory_chunk *chunk)
 {
-    TRACE("chunk %p, device %p, allocator %p.\n", chunk, device, allocator);
+    if (!vkd3d_array_reserve((void**)&pool->chunks, &pool->chunks_size,
+            pool->chunks_count + 1, sizeof(*pool->chunks)))
+    {
+        ERR("Failed to allocate space for new chunk.\n");
+        return E_OUTOFMEMORY;
+    }
 
-    if (chunk->allocation.clear_semaphore_value)
-        vkd3d_memory_allocator_wait_allocation(allocator, device, &chunk->allocation);
+    if ((chunk->region_block_index = vkd3d_tlsf_add_region(&pool->tlsf, chunk,
+            chunk->allocation.resource.size)) == VKD3D_TLSF_INVALID_BLOCK)
+    {
+        ERR("Failed to add chunk to memory pool.\n");
+        return E_OUTOFMEMORY;
+    }
 
-    vkd3d_memory_allocation_free(&chunk->allocation, device, allocator);
-    vkd3d_free(chunk->free_ranges);
-    vkd3d_free(chunk);
+    pool->chunks[pool->chunks_count++] = chunk;
+    return S_OK;
 }
 
-static void vkd3d_memory_allocator_remove_chunk(struct vkd3d_memory_allocator *allocator, struct d3d12_device *device, struct vkd3d_memory_chunk *chunk)
+static void vkd3d_memory_pool_remove_chunk_locked(struct vkd3d_memory_pool *pool, struct vkd3d_memory_chunk *chunk)
 {
     size_t i;
 
-    for (i = 0; i < allocator->chunks_count; i++)
+    for (i = 0; i < pool->chunks_count; i++)
     {
-        if (allocator->chunks[i] == chunk)
+        if (pool->chunks[i] == chunk)
         {
-            allocator->chunks[i] = allocator->chunks[--allocator->chunks_count];
+            pool->chunks[i] = pool->chunks[--pool->chunks_count];
             break;
         }
     }
 
-    vkd3d_memory_chunk_destroy(chunk, device, allocator);
+    vkd3d_tlsf_remove_region(&pool->tlsf, chunk->region_block_index);
+}
+
+static void vkd3d_memory_pool_free_range(struct vkd3d_memory_pool *pool, struct d3d12_device *device,
+        struct vkd3d_memory_allocator *allocator, const struct vkd3d_memory_allocation *allocation)
+{
+    struct vkd3d_memory_chunk *chunk = allocation->chunk;
+    uint32_t block_index;
+    bool chunk_is_free;
+
+    vkd3d_memory_pool_lock(pool);
+    block_index = vkd3d_tlsf_free(&pool->tlsf, allocation->chunk_block_index);
+
+    /* Release the chunk as soon as the last suballocation goes away. */
+    if ((chunk_is_free = vkd3d_tlsf_block_is_region(&pool->tlsf, block_index)))
+    {
+        assert(block_index == chunk->region_block_index);
+        vkd3d_memory_pool_remove_chunk_locked(pool, chunk);
+    }
+    vkd3d_memory_pool_unlock(pool);
+
+    /* The chunk is no longer reachable from the pool, so
+     * the device memory can be freed without holding the lock. */
+    if (chunk_is_free)
+        vkd3d_memory_chunk_destroy(chunk, device, allocator);
+}
+
+static void vkd3d_memory_pool_destroy(struct vkd3d_memory_pool *pool, struct d3d12_device *device,
+        struct vkd3d_memory_allocator *allocator)
+{
+    size_t i;
+
+    for (i = 0; i < pool->chunks_count; i++)
+        vkd3d_memory_chunk_destroy(pool->chunks[i], device, allocator);
+
+    vkd3d_free(pool->chunks);
+    vkd3d_tlsf_cleanup(&pool->tlsf);
+    pthread_mutex_destroy(&pool->mutex);
+    vkd3d_free(pool);
 }
 
 static void vkd3d_memory_allocator_cleanup_clear_queue(struct vkd3d_memory_allocator *allocator, struct d3d12_device *device)
@@ -917,7 +950,7 @@ static HRESULT vkd3d_memory_allocator_init_clear_queue(struct vkd3d_memory_alloc
     clear_queue->last_known_value = VKD3D_MEMORY_CLEAR_COMMAND_BUFFER_COUNT;
     clear_queue->next_signal_value = VKD3D_MEMORY_CLEAR_COMMAND_BUFFER_COUNT + 1;
 
-    if ((rc = pthread_mutex_init(&allocator->mutex, NULL)))
+    if ((rc = pthread_mutex_init(&clear_queue->mutex, NULL)))
         return hresult_from_errno(rc);
 
     command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -978,12 +1011,12 @@ HRESULT vkd3d_memory_allocator_init(struct vkd3d_memory_allocator *allocator, st
 
     memset(allocator, 0, sizeof(*allocator));
 
-    if ((rc = pthread_mutex_init(&allocator->mutex, NULL)))
+    if ((rc = rwlock_init(&allocator->pools_lock)))
         return hresult_from_errno(rc);
 
     if (FAILED(hr = vkd3d_memory_allocator_init_clear_queue(allocator, device)))
     {
-        pthread_mutex_destroy(&allocator->mutex);
+        rwlock_destroy(&allocator->pools_lock);
         return hr;
     }
 
@@ -998,13 +1031,13 @@ void vkd3d_memory_allocator_cleanup(struct vkd3d_memory_allocator *allocator, st
 {
     size_t i;
 
-    for (i = 0; i < allocator->chunks_count; i++)
-        vkd3d_memory_chunk_destroy(allocator->chunks[i], device, allocator);
+    for (i = 0; i < allocator->pools_count; i++)
+        vkd3d_memory_pool_destroy(allocator->pools[i], device, allocator);
 
-    vkd3d_free(allocator->chunks);
+    vkd3d_free(allocator->pools);
     vkd3d_va_map_cleanup(&allocator->va_map);
     vkd3d_memory_allocator_cleanup_clear_queue(allocator, device);
-    pthread_mutex_destroy(&allocator->mutex);
+    rwlock_destroy(&allocator->pools_lock);
 }
 
 static bool vkd3d_memory_allocator_wait_clear_semaphore(struct vkd3d_memory_allocator *allocator,
@@ -1294,8 +1327,6 @@ static HRESULT vkd3d_memory_allocator_try_add_chunk(struct vkd3d_memory_allocato
         VkMemoryPropertyFlags optional_properties, struct vkd3d_memory_chunk **chunk)
 {
     struct vkd3d_allocate_memory_info alloc_info;
-    struct vkd3d_memory_chunk *object;
-    HRESULT hr;
 
     memset(&alloc_info, 0, sizeof(alloc_info));
     alloc_info.memory_requirements.size = VKD3D_MEMORY_CHUNK_SIZE;
@@ -1309,18 +1340,7 @@ static HRESULT vkd3d_memory_allocator_try_add_chunk(struct vkd3d_memory_allocato
     if (!(heap_flags & D3D12_HEAP_FLAG_DENY_BUFFERS))
         alloc_info.flags |= VKD3D_ALLOCATION_FLAG_GLOBAL_BUFFER;
 
-    if (!vkd3d_array_reserve((void**)&allocator->chunks, &allocator->chunks_size,
-            allocator->chunks_count + 1, sizeof(*allocator->chunks)))
-    {
-        ERR("Failed to allocate space for new chunk.\n");
-        return E_OUTOFMEMORY;
-    }
-
-    if (FAILED(hr = vkd3d_memory_chunk_create(device, allocator, &alloc_info, &object)))
-        return hr;
-
-    allocator->chunks[allocator->chunks_count++] = *chunk = object;
-    return S_OK;
+    return vkd3d_memory_chunk_create(device, allocator, &alloc_info, chunk);
 }
 
 static HRESULT vkd3d_memory_allocator_try_suballocate_memory(struct vkd3d_memory_allocator *allocator,
@@ -1331,37 +1351,63 @@ static HRESULT vkd3d_memory_allocator_try_suballocate_memory(struct vkd3d_memory
 {
     const D3D12_HEAP_FLAGS heap_flag_mask = ~(D3D12_HEAP_FLAG_CREATE_NOT_ZEROED | D3D12_HEAP_FLAG_CREATE_NOT_RESIDENT);
     struct vkd3d_memory_chunk *chunk;
+    struct vkd3d_memory_pool *pool;
     HRESULT hr;
     size_t i;
 
     type_mask &= device->memory_info.global_mask;
     type_mask &= memory_requirements->memoryTypeBits;
 
-    for (i = 0; i < allocator->chunks_count; i++)
+    rwlock_lock_read(&allocator->pools_lock);
+
+    for (i = 0; i < allocator->pools_count; i++)
     {
-        chunk = allocator->chunks[i];
+        pool = allocator->pools[i];
 
         /* Match flags since otherwise the backing buffer
          * may not support our required usage flags */
-        if (chunk->allocation.heap_type != heap_properties->Type ||
-                chunk->allocation.heap_flags != (heap_flags & heap_flag_mask))
+        if (pool->heap_type != heap_properties->Type ||
+                pool->heap_flags != (heap_flags & heap_flag_mask))
             continue;
 
         /* Filter out unsupported memory types */
-        if (!(type_mask & (1u << chunk->allocation.device_allocation.vk_memory_type)))
+        if (!(type_mask & (1u << pool->vk_memory_type)))
             continue;
 
-        if (SUCCEEDED(hr = vkd3d_memory_chunk_allocate_range(chunk, memory_requirements, allocation)))
+        vkd3d_memory_pool_lock(pool);
+        hr = vkd3d_memory_pool_allocate_range_locked(pool, memory_requirements, allocation);
+        vkd3d_memory_pool_unlock(pool);
+
+        if (SUCCEEDED(hr))
+        {
+            rwlock_unlock_read(&allocator->pools_lock);
             return hr;
+        }
     }
 
+    rwlock_unlock_read(&allocator->pools_lock);
+
     /* Try allocating a new chunk on one of the supported memory type
-     * before the caller falls back to potentially slower memory */
+     * before the caller falls back to potentially slower memory.
+     * No locks are held here, so concurrent threads may end up
+     * creating a chunk each, which is harmless. */
     if (FAILED(hr = vkd3d_memory_allocator_try_add_chunk(allocator, device, heap_properties,
             heap_flags & heap_flag_mask, type_mask, optional_properties, &chunk)))
         return hr;
 
-    return vkd3d_memory_chunk_allocate_range(chunk, memory_requirements, allocation);
+    pool = chunk->pool;
+    vkd3d_memory_pool_lock(pool);
+
+    if (FAILED(hr = vkd3d_memory_pool_add_chunk_locked(pool, chunk)))
+    {
+        vkd3d_memory_pool_unlock(pool);
+        vkd3d_memory_chunk_destroy(chunk, device, allocator);
+        return hr;
+    }
+
+    hr = vkd3d_memory_pool_allocate_range_locked(pool, memory_requirements, allocation);
+    vkd3d_memory_pool_unlock(pool);
+    return hr;
 }
 
 void vkd3d_free_memory(struct d3d12_device *device, struct vkd3d_memory_allocator *allocator,
@@ -1374,14 +1420,7 @@ void vkd3d_free_memory(struct d3d12_device *device, struct vkd3d_memory_allocato
         vkd3d_memory_allocator_wait_allocation(allocator, device, allocation);
 
     if (allocation->chunk)
-    {
-        pthread_mutex_lock(&allocator->mutex);
-        vkd3d_memory_chunk_free_range(allocation->chunk, allocation);
-
-        if (vkd3d_memory_chunk_is_free(allocation->chunk))
-            vkd3d_memory_allocator_remove_chunk(allocator, device, allocation->chunk);
-        pthread_mutex_unlock(&allocator->mutex);
-    }
+        vkd3d_memory_pool_free_range(allocation->chunk->pool, device, allocator, allocation);
     else
         vkd3d_memory_allocation_free(allocation, device, allocator);
 }
@@ -1402,8 +1441,6 @@ static HRESULT vkd3d_suballocate_memory(struct d3d12_device *device, struct vkd3
     required_mask = vkd3d_find_memory_types_with_flags(device, type_flags & ~optional_flags);
     optional_mask = vkd3d_find_memory_types_with_flags(device, type_flags);
 
-    pthread_mutex_lock(&allocator->mutex);
-
     hr = vkd3d_memory_allocator_try_suballocate_memory(allocator, device,
             &memory_requirements, optional_mask, 0, &info->heap_properties,
             info->heap_flags, allocation);
@@ -1416,7 +1453,6 @@ static HRESULT vkd3d_suballocate_memory(struct d3d12_device *device, struct vkd3
                 &info->heap_properties, info->heap_flags, allocation);
     }
 
-    pthread_mutex_unlock(&allocator->mutex);
     return hr;
 }
 
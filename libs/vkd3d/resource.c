@@ -6590,7 +6590,6 @@ static void vkd3d_memory_info_init_budgets(struct vkd3d_memory_info *info,
 void vkd3d_memory_info_cleanup(struct vkd3d_memory_info *info,
         struct d3d12_device *device)
 {
-    pthread_mutex_destroy(&info->budget_lock);
 }
 
 HRESULT vkd3d_memory_info_init(struct vkd3d_memory_info *info,
@@ -6615,9 +6614,6 @@ HRESULT vkd3d_memory_info_init(struct vkd3d_memory_info *info,
     info->global_mask = vkd3d_memory_info_find_global_mask(&topology, device);
     vkd3d_memory_info_init_budgets(info, &topology, device);
 
-    if (pthread_mutex_init(&info->budget_lock, NULL) != 0)
-        return E_OUTOFMEMORY;
-
     buffer_requirement_info.sType = VK_STRUCTURE_TYPE_DEVICE_BUFFER_MEMORY_REQUIREMENTS_KHR;
     buffer_requirement_info.pNext = NULL;
     buffer_requirement_info.pCreateInfo = &buffer_info;
@@ -1858,12 +1858,40 @@ HRESULT vkd3d_pipeline_state_desc_from_d3d12_stream_desc(struct d3d12_pipeline_s
 
 struct vkd3d_compiled_pipeline
 {
-    struct list entry;
+    struct hash_map_entry entry;
     struct vkd3d_pipeline_key key;
     VkPipeline vk_pipeline;
     uint32_t dynamic_state_flags;
 };
 
+static uint32_t vkd3d_compiled_pipeline_hash(const void *key)
+{
+    const struct vkd3d_pipeline_key *k = key;
+    uint64_t hash = hash_fnv1_init();
+    unsigned int i;
+
+    hash = hash_fnv1_iterate_u32(hash, k->topology);
+    hash = hash_fnv1_iterate_u32(hash, k->viewport_count);
+    hash = hash_fnv1_iterate_u32(hash, k->dsv_format);
+    hash = hash_fnv1_iterate_u8(hash, k->dynamic_stride);
+    hash = hash_fnv1_iterate_u8(hash, k->dynamic_topology);
+
+    if (!k->dynamic_stride)
+    {
+        for (i = 0; i < ARRAY_SIZE(k->strides); i++)
+            hash = hash_fnv1_iterate_u32(hash, k->strides[i]);
+    }
+
+    return hash_uint64(hash);
+}
+
+static bool vkd3d_compiled_pipeline_compare(const void *key, const struct hash_map_entry *entry)
+{
+    const struct vkd3d_compiled_pipeline *pipeline = (const struct vkd3d_compiled_pipeline *)entry;
+    /* Keys are always zero-initialized, so padding compares equal. */
+    return !memcmp(&pipeline->key, key, sizeof(pipeline->key));
+}
+
 /* ID3D12PipelineState */
 static HRESULT STDMETHODCALLTYPE d3d12_pipeline_state_QueryInterface(ID3D12PipelineState *iface,
         REFIID riid, void **object)
@@ -1911,65 +1939,49 @@ static ULONG STDMETHODCALLTYPE d3d12_pipeline_state_AddRef(ID3D12PipelineState *
     return d3d12_pipeline_state_inc_public_ref(state);
 }
 
+/* Modules are shared between PSOs with identical SPIR-V, so they must be released through
+ * d3d12_pipeline_state_release_shader_module() rather than destroyed directly. */
 static HRESULT d3d12_pipeline_state_create_shader_module(struct d3d12_device *device,
         VkShaderModule *vk_module, const struct vkd3d_shader_code *code)
 {
-    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
-    VkShaderModuleCreateInfo shader_desc;
-    char hash_str[16 + 1];
-    VkResult vr;
-
-    shader_desc.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shader_desc.pNext = NULL;
-    shader_desc.flags = 0;
-    shader_desc.codeSize = code->size;
-    shader_desc.pCode = code->code;
+    return vkd3d_shader_intern_table_acquire_module(&device->shader_intern_table, device, code, vk_module);
+}
 
-    vr = VK_CALL(vkCreateShaderModule(device->vk_device, &shader_desc, NULL, vk_module));
-    if (vr < 0)
-    {
-        WARN("Failed to create Vulkan shader module, vr %d.\n", vr);
-        return hresult_from_vk_result(vr);
-    }
+static void d3d12_pipeline_state_release_shader_module(struct d3d12_device *device, VkShaderModule vk_module)
+{
+    vkd3d_shader_intern_table_release_module(&device->shader_intern_table, device, vk_module);
+}
 
-    /* Helpful for tooling like RenderDoc. */
-    sprintf(hash_str, "%016"PRIx64, code->meta.hash);
-    vkd3d_set_vk_object_name(device, (uint64_t)*vk_module, VK_OBJECT_TYPE_SHADER_MODULE, hash_str);
-    return S_OK;
+/* SPIR-V stored in a PSO is interned as soon as it is produced, so it must be released
+ * through the intern table as well. Meta is kept. */
+static void d3d12_pipeline_state_release_spirv_code(struct d3d12_device *device, struct vkd3d_shader_code *code)
+{
+    vkd3d_shader_intern_table_release_code(&device->shader_intern_table, code);
 }
 
-static void d3d12_pipeline_state_free_spirv_code(struct d3d12_pipeline_state *state)
+static void d3d12_pipeline_state_free_spirv_code(struct d3d12_pipeline_state *state, struct d3d12_device *device)
 {
     unsigned int i;
     if (d3d12_pipeline_state_is_graphics(state))
     {
         for (i = 0; i < state->graphics.stage_count; i++)
-        {
-            vkd3d_shader_free_shader_code(&state->graphics.code[i]);
-            /* Keep meta. */
-            state->graphics.code[i].code = NULL;
-            state->graphics.code[i].size = 0;
-        }
+            d3d12_pipeline_state_release_spirv_code(device, &state->graphics.code[i]);
     }
     else if (d3d12_pipeline_state_is_compute(state))
     {
-        vkd3d_shader_free_shader_code(&state->compute.code);
-        /* Keep meta. */
-        state->compute.code.code = NULL;
-        state->compute.code.size = 0;
+        d3d12_pipeline_state_release_spirv_code(device, &state->compute.code);
     }
 }
 
 static void d3d12_pipeline_state_destroy_shader_modules(struct d3d12_pipeline_state *state, struct d3d12_device *device)
 {
-    const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
     unsigned int i;
 
     if (d3d12_pipeline_state_is_graphics(state))
     {
         for (i = 0; i < state->graphics.stage_count; i++)
         {
-            VK_CALL(vkDestroyShaderModule(device->vk_device, state->graphics.stages[i].module, NULL));
+            d3d12_pipeline_state_release_shader_module(device, state->graphics.stages[i].module);
             state->graphics.stages[i].module = VK_NULL_HANDLE;
         }
     }
@@ -1980,21 +1992,27 @@ static void d3d12_pipeline_state_destroy_graphics(struct d3d12_pipeline_state *s
 {
     struct d3d12_graphics_pipeline_state *graphics = &state->graphics;
     const struct vkd3d_vk_device_procs *vk_procs = &device->vk_procs;
-    struct vkd3d_compiled_pipeline *current, *e;
+    struct vkd3d_compiled_pipeline *current;
+    uint32_t i;
 
     d3d12_pipeline_state_destroy_shader_modules(state, device);
 
-    LIST_FOR_EACH_ENTRY_SAFE(current, e, &graphics->compiled_fallback_pipelines, struct vkd3d_compiled_pipeline, entry)
+    for (i = 0; i < graphics->compiled_fallback_pipelines.entry_count; i++)
     {
-        VK_CALL(vkDestroyPipeline(device->vk_device, current->vk_pipeline, NULL));
-        vkd3d_free(current);
+        current = (struct vkd3d_compiled_pipeline *)hash_map_get_entry(&graphics->compiled_fallback_pipelines, i);
+        if (current->entry.flags & HASH_MAP_ENTRY_OCCUPIED)
+            VK_CALL(vkDestroyPipeline(device->vk_device, current->vk_pipeline, NULL));
     }
 
+    hash_map_clear(&graphics->compiled_fallback_pipelines);
+
     VK_CALL(vkDestroyPipeline(device->vk_device, graphics->pipeline, NULL));
 }
 
 static void d3d12_pipeline_state_set_name(struct d3d12_pipeline_state *state, const char *name)
 {
+    d3d12_pipeline_state_wait_async_compile(state);
+
     if (d3d12_pipeline_state_is_compute(state))
     {
         vkd3d_set_vk_object_name(state->device, (uint64_t)state->compute.vk_pipeline,
@@ -2081,7 +2099,7 @@ void d3d12_pipeline_state_dec_ref(struct d3d12_pipeline_state *state)
     {
         vkd3d_private_store_destroy(&state->private_store);
 
-        d3d12_pipeline_state_free_spirv_code(state);
+        d3d12_pipeline_state_free_spirv_code(state, device);
         if (d3d12_pipeline_state_is_graphics(state))
             d3d12_pipeline_state_destroy_graphics(state, device);
         else if (d3d12_pipeline_state_is_compute(state))
@@ -2171,6 +2189,8 @@ static HRESULT STDMETHODCALLTYPE d3d12_pipeline_state_GetCachedBlob(ID3D12Pipeli
 
     TRACE("iface %p, blob %p.\n", iface, blob);
 
+    d3d12_pipeline_state_wait_async_compile(state);
+
     if ((vr = vkd3d_serialize_pipeline_state(NULL, state, &cache_size, NULL)))
         return hresult_from_vk_result(vr);
 
@@ -2237,6 +2257,8 @@ static HRESULT vkd3d_load_spirv_from_cached_state(struct d3d12_device *device,
         return E_FAIL;
 
     hr = vkd3d_get_cached_spirv_code_from_d3d12_desc(cached_state, stage, spirv_code, identifier);
+    if (SUCCEEDED(hr))
+        vkd3d_shader_intern_table_intern_code(&device->shader_intern_table, spirv_code);
 
     if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
     {
@@ -2385,6 +2407,54 @@ static HRESULT vkd3d_setup_shader_stage(struct d3d12_pipeline_state *state, stru
         return S_OK;
 }
 
+static bool vkd3d_shader_memo_key_init(struct vkd3d_shader_memo_key *key,
+        struct d3d12_pipeline_state *state, struct d3d12_device *device,
+        const struct vkd3d_shader_code *dxbc,
+        const struct vkd3d_shader_interface_info *shader_interface,
+        const struct vkd3d_shader_compile_arguments *compile_args)
+{
+    uint64_t h;
+    unsigned int i;
+
+    /* The root signature hash is the only thing which identifies the bindings.
+     * Anything which depends on per-PSO state beyond the compile arguments
+     * (stream-out, mesh -> fragment IO maps) is not worth memoizing. */
+    if (!state->root_signature->compatibility_hash)
+        return false;
+    if (shader_interface->xfb_info || shader_interface->stage_input_map || shader_interface->stage_output_map)
+        return false;
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_SANITIZE_SPIRV)
+        return false;
+
+    h = hash_fnv1_init();
+    h = hash_fnv1_iterate_u32(h, shader_interface->stage);
+    h = hash_fnv1_iterate_u32(h, shader_interface->flags);
+    h = hash_fnv1_iterate_u32(h, shader_interface->min_ssbo_alignment);
+    h = hash_fnv1_iterate_u32(h, shader_interface->descriptor_tables.offset);
+    h = hash_fnv1_iterate_u32(h, shader_interface->descriptor_tables.count);
+    h = hash_fnv1_iterate_u32(h, compile_args->target);
+    h = hash_fnv1_iterate_u32(h, compile_args->dual_source_blending);
+
+    for (i = 0; i < compile_args->parameter_count; i++)
+    {
+        h = hash_fnv1_iterate_u32(h, compile_args->parameters[i].name);
+        h = hash_fnv1_iterate_u32(h, compile_args->parameters[i].type);
+        h = hash_fnv1_iterate_u32(h, compile_args->parameters[i].data_type);
+        h = hash_fnv1_iterate_u32(h, compile_args->parameters[i].immediate_constant.u32);
+    }
+
+    h = hash_fnv1_iterate_u32(h, compile_args->output_swizzle_count);
+    for (i = 0; i < compile_args->output_swizzle_count; i++)
+        h = hash_fnv1_iterate_u32(h, compile_args->output_swizzles[i]);
+
+    memset(key, 0, sizeof(*key));
+    key->dxbc_hash = vkd3d_hash64(dxbc->code, dxbc->size);
+    key->shader_interface_key = device->shader_interface_key;
+    key->root_signature_hash = state->root_signature->compatibility_hash;
+    key->compile_args_hash = h;
+    return true;
+}
+
 static HRESULT vkd3d_compile_shader_stage(struct d3d12_pipeline_state *state, struct d3d12_device *device,
         VkShaderStageFlagBits stage, const D3D12_SHADER_BYTECODE *code, struct vkd3d_shader_code *spirv_code)
 {
@@ -2393,12 +2463,14 @@ static HRESULT vkd3d_compile_shader_stage(struct d3d12_pipeline_state *state, st
     struct vkd3d_shader_compile_arguments compile_args;
     vkd3d_shader_hash_t recovered_hash = 0;
     vkd3d_shader_hash_t compiled_hash = 0;
+    struct vkd3d_shader_memo_key memo_key;
+    bool use_memo_cache;
     int ret;
 
     if (spirv_code->code && (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_SANITIZE_SPIRV))
     {
         recovered_hash = vkd3d_shader_hash(spirv_code);
-        vkd3d_shader_free_shader_code(spirv_code);
+        d3d12_pipeline_state_release_spirv_code(device, spirv_code);
         memset(spirv_code, 0, sizeof(*spirv_code));
     }
 
@@ -2409,12 +2481,27 @@ static HRESULT vkd3d_compile_shader_stage(struct d3d12_pipeline_state *state, st
         d3d12_pipeline_state_init_shader_interface(state, device, stage, &shader_interface);
         d3d12_pipeline_state_init_compile_arguments(state, device, stage, &compile_args);
 
-        if ((ret = vkd3d_shader_compile_dxbc(&dxbc, spirv_code, 0, &shader_interface, &compile_args)) < 0)
+        use_memo_cache = device->shader_memo_cache.max_size &&
+                vkd3d_shader_memo_key_init(&memo_key, state, device, &dxbc, &shader_interface, &compile_args);
+
+        if (use_memo_cache && vkd3d_shader_memo_cache_lookup(&device->shader_memo_cache, &memo_key, spirv_code))
         {
-            WARN("Failed to compile shader, vkd3d result %d.\n", ret);
-            return hresult_from_vkd3d_result(ret);
+            TRACE("Found SPIR-V in memo cache.\n");
+        }
+        else
+        {
+            if ((ret = vkd3d_shader_compile_dxbc(&dxbc, spirv_code, 0, &shader_interface, &compile_args)) < 0)
+            {
+                WARN("Failed to compile shader, vkd3d result %d.\n", ret);
+                return hresult_from_vkd3d_result(ret);
+            }
+            TRACE("Called vkd3d_shader_compile_dxbc.\n");
+
+            if (use_memo_cache)
+                vkd3d_shader_memo_cache_insert(&device->shader_memo_cache, &memo_key, spirv_code);
         }
-        TRACE("Called vkd3d_shader_compile_dxbc.\n");
+
+        vkd3d_shader_intern_table_intern_code(&device->shader_intern_table, spirv_code);
 
         if (stage == VK_SHADER_STAGE_FRAGMENT_BIT)
         {
@@ -2502,9 +2589,7 @@ static HRESULT vkd3d_late_compile_shader_stages(struct d3d12_pipeline_state *sta
         /* We'll keep the module around here, no need to keep code/size pairs around for this.
          * If we're in a situation where late compile is relevant, we're using PSO cached blobs,
          * so we never expect to serialize out SPIR-V either way. */
-        vkd3d_shader_free_shader_code(&graphics->code[i]);
-        graphics->code[i].code = NULL;
-        graphics->code[i].size = 0;
+        d3d12_pipeline_state_release_spirv_code(state->device, &graphics->code[i]);
 
         /* Don't need the DXBC blob anymore either. */
         if (graphics->cached_desc.bytecode_duped_mask & (1u << i))
@@ -2561,6 +2646,11 @@ static void vkd3d_report_pipeline_creation_feedback_results(const VkPipelineCrea
     }
 }
 
+static bool d3d12_device_use_async_pipeline_compile(struct d3d12_device *device)
+{
+    return device->pipeline_compile_pool.async_pipelines;
+}
+
 static HRESULT vkd3d_create_compute_pipeline(struct d3d12_pipeline_state *state,
         struct d3d12_device *device,
         const D3D12_SHADER_BYTECODE *code)
@@ -2671,7 +2761,7 @@ static HRESULT vkd3d_create_compute_pipeline(struct d3d12_pipeline_state *state,
     }
 
     TRACE("Called vkCreateComputePipelines.\n");
-    VK_CALL(vkDestroyShaderModule(device->vk_device, pipeline_info.stage.module, NULL));
+    d3d12_pipeline_state_release_shader_module(device, pipeline_info.stage.module);
     if (vr < 0)
     {
         WARN("Failed to create Vulkan compute pipeline, hr %#x.", hr);
@@ -2700,7 +2790,22 @@ static HRESULT d3d12_pipeline_state_init_compute(struct d3d12_pipeline_state *st
             VK_SHADER_STAGE_COMPUTE_BIT, &state->compute.code,
             &state->compute.identifier_create_info);
 
-    hr = vkd3d_create_compute_pipeline(state, device, &desc->cs);
+    /* Creating from an identifier is cheap, and may need the DXBC for fallback, so keep that synchronous.
+     * Otherwise, compile SPIR-V here so that we can report invalid shaders, and defer the pipeline. */
+    if (d3d12_device_use_async_pipeline_compile(device) &&
+            !state->compute.identifier_create_info.identifierSize &&
+            !(vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_SANITIZE_SPIRV))
+    {
+        if (SUCCEEDED(hr = vkd3d_compile_shader_stage(state, device,
+                VK_SHADER_STAGE_COMPUTE_BIT, &desc->cs, &state->compute.code)) &&
+                !d3d12_device_validate_shader_meta(device, &state->compute.code.meta))
+            hr = E_INVALIDARG;
+
+        if (SUCCEEDED(hr))
+            state->async_compile_status = VKD3D_PIPELINE_ASYNC_COMPILE_QUEUED;
+    }
+    else
+        hr = vkd3d_create_compute_pipeline(state, device, &desc->cs);
 
     if (FAILED(hr))
     {
@@ -3386,7 +3491,7 @@ static void d3d12_pipeline_state_graphics_load_spirv_from_cached_state(
             {
                 if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
                     INFO("Discarding cached SPIR-V for stage #%x.\n", graphics->cached_desc.bytecode_stages[j]);
-                vkd3d_shader_free_shader_code(&graphics->code[j]);
+                d3d12_pipeline_state_release_spirv_code(device, &graphics->code[j]);
                 memset(&graphics->code[j], 0, sizeof(graphics->code[j]));
             }
             break;
@@ -4013,7 +4118,15 @@ static HRESULT d3d12_pipeline_state_init_static_pipeline(struct d3d12_pipeline_s
 
     graphics->pipeline = VK_NULL_HANDLE;
 
-    if (can_compile_pipeline_early)
+    if (can_compile_pipeline_early && d3d12_device_use_async_pipeline_compile(state->device))
+    {
+        /* Pipeline is created by the compile pool. If that fails, we'll end up with a fallback pipeline
+         * at draw time instead. */
+        graphics->dsv_plane_optimal_mask = d3d12_graphics_pipeline_state_get_plane_optimal_mask(
+                graphics, graphics->dsv_format);
+        state->async_compile_status = VKD3D_PIPELINE_ASYNC_COMPILE_QUEUED;
+    }
+    else if (can_compile_pipeline_early)
     {
         if (!(graphics->pipeline = d3d12_pipeline_state_create_pipeline_variant(state, NULL, graphics->dsv_format,
                 state->vk_pso_cache, &graphics->dynamic_state_flags)))
@@ -4053,7 +4166,8 @@ static HRESULT d3d12_pipeline_state_finish_graphics(struct d3d12_pipeline_state
         graphics->cached_desc.bytecode_duped_mask |= 1u << i;
     }
 
-    list_init(&graphics->compiled_fallback_pipelines);
+    hash_map_init(&graphics->compiled_fallback_pipelines, vkd3d_compiled_pipeline_hash,
+            vkd3d_compiled_pipeline_compare, sizeof(struct vkd3d_compiled_pipeline));
     if (FAILED(hr = vkd3d_private_store_init(&state->private_store)))
         return hr;
     d3d12_device_add_ref(state->device);
@@ -4106,6 +4220,314 @@ static HRESULT d3d12_pipeline_create_private_root_signature(struct d3d12_device
     return hr;
 }
 
+static void d3d12_pipeline_state_finish_creation(struct d3d12_pipeline_state *state)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &state->device->vk_procs;
+    struct d3d12_device *device = state->device;
+
+    /* The strategy here is that we need to keep the SPIR-V alive somehow.
+     * If we don't need to serialize SPIR-V from the PSO, then we don't need to keep the code alive as pointer/size pairs.
+     * The scenarios for this case is:
+     * - When we choose to not serialize SPIR-V at all with VKD3D_CONFIG
+     * - PSO was loaded from a cached blob. It's extremely unlikely that anyone is going to try
+     *   serializing that PSO again, so there should be no need to keep it alive.
+     * - We are using a disk cache with SHADER_IDENTIFIER support.
+     *   In this case, we'll never store the SPIR-V itself, but the identifier, so we don't need to keep the code around.
+     *
+     * The worst that would happen is a performance loss should that entry be reloaded later.
+     * For graphics pipelines, we have to keep VkShaderModules around in case we need fallback pipelines.
+     * If we keep the SPIR-V around in memory, we can always create shader modules on-demand in case we
+     * need to actually create fallback pipelines. This avoids unnecessary memory bloat. */
+    if (state->pso_is_loaded_from_cached_blob ||
+            (device->disk_cache.library && (device->disk_cache.library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_SHADER_IDENTIFIER)) ||
+            (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_NO_SERIALIZE_SPIRV))
+        d3d12_pipeline_state_free_spirv_code(state, device);
+    else
+        d3d12_pipeline_state_destroy_shader_modules(state, device);
+
+    if (state->pso_is_loaded_from_cached_blob)
+    {
+        /* Free the cache now to save on memory. */
+        VK_CALL(vkDestroyPipelineCache(device->vk_device, state->vk_pso_cache, NULL));
+        state->vk_pso_cache = VK_NULL_HANDLE;
+    }
+    else if (device->disk_cache.library)
+    {
+        /* We compiled this PSO without any cache (internal or app-provided),
+         * so we should serialize this to internal disk cache.
+         * Pushes work to disk$ thread. */
+        vkd3d_pipeline_library_store_pipeline_to_disk_cache(&device->disk_cache, state);
+    }
+}
+
+static void d3d12_pipeline_state_precompile_variants(struct d3d12_pipeline_state *state);
+
+static void d3d12_pipeline_state_run_async_compile(struct d3d12_pipeline_state *state)
+{
+    struct d3d12_graphics_pipeline_state *graphics = &state->graphics;
+    D3D12_SHADER_BYTECODE dummy_code;
+    HRESULT hr;
+
+    if (d3d12_pipeline_state_is_graphics(state))
+    {
+        if (!(graphics->pipeline = d3d12_pipeline_state_create_pipeline_variant(state, NULL, graphics->dsv_format,
+                state->vk_pso_cache, &graphics->dynamic_state_flags)))
+            WARN("Failed to create pipeline for %p, will compile a fallback pipeline on use.\n", state);
+    }
+    else
+    {
+        /* SPIR-V is already compiled at this point, so DXBC is not needed. */
+        memset(&dummy_code, 0, sizeof(dummy_code));
+        if (FAILED(hr = vkd3d_create_compute_pipeline(state, state->device, &dummy_code)))
+            ERR("Failed to create compute pipeline for %p, hr #%x.\n", state, hr);
+    }
+
+    d3d12_pipeline_state_precompile_variants(state);
+    d3d12_pipeline_state_finish_creation(state);
+}
+
+static void vkd3d_pipeline_compile_pool_execute(struct vkd3d_pipeline_compile_pool *pool,
+        struct d3d12_pipeline_state *state)
+{
+    d3d12_pipeline_state_run_async_compile(state);
+
+    pthread_mutex_lock(&pool->lock);
+    vkd3d_atomic_uint32_store_explicit(&state->async_compile_status,
+            VKD3D_PIPELINE_ASYNC_COMPILE_DONE, vkd3d_memory_order_release);
+    pthread_cond_broadcast(&pool->done_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Drop the reference held by the queue. */
+    d3d12_pipeline_state_dec_ref(state);
+}
+
+static void vkd3d_pipeline_compile_pool_enqueue(struct vkd3d_pipeline_compile_pool *pool,
+        struct d3d12_pipeline_state *state)
+{
+    d3d12_pipeline_state_inc_ref(state);
+
+    pthread_mutex_lock(&pool->lock);
+    list_add_tail(&pool->jobs, &state->async_compile_entry);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void vkd3d_pipeline_compile_pool_enqueue_variants(struct vkd3d_pipeline_compile_pool *pool,
+        struct d3d12_pipeline_state *state)
+{
+    /* The PSO is fully created at this point, and draws can race with us to create variants,
+     * which put_pipeline_to_cache deals with. Nothing ever has to wait for this job. */
+    d3d12_pipeline_state_inc_ref(state);
+
+    pthread_mutex_lock(&pool->lock);
+    list_add_tail(&pool->variant_jobs, &state->variant_precompile_entry);
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void d3d12_pipeline_state_wait_async_compile_slow(struct d3d12_pipeline_state *state)
+{
+    struct vkd3d_pipeline_compile_pool *pool = &state->device->pipeline_compile_pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (state->async_compile_status == VKD3D_PIPELINE_ASYNC_COMPILE_QUEUED)
+    {
+        /* No worker got to it yet. Rather than sitting idle, compile it on this thread. */
+        list_remove(&state->async_compile_entry);
+        state->async_compile_status = VKD3D_PIPELINE_ASYNC_COMPILE_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
+            INFO("Pipeline %p was used before the compile pool got to it.\n", state);
+
+        vkd3d_pipeline_compile_pool_execute(pool, state);
+        return;
+    }
+
+    while (state->async_compile_status != VKD3D_PIPELINE_ASYNC_COMPILE_DONE)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *vkd3d_pipeline_compile_pool_main(void *userdata)
+{
+    struct vkd3d_pipeline_compile_pool *pool = userdata;
+    struct d3d12_pipeline_state *state;
+    bool should_exit;
+
+    vkd3d_set_thread_name("vkd3d_pso");
+    vkd3d_set_current_thread_priority(pool->priority);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+
+        while (list_empty(&pool->jobs) && list_empty(&pool->variant_jobs) && !pool->should_exit)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+
+        /* Pipelines which may be waited on take priority over variant precompiles. */
+        if (!list_empty(&pool->jobs))
+        {
+            state = LIST_ENTRY(list_head(&pool->jobs), struct d3d12_pipeline_state, async_compile_entry);
+            list_remove(&state->async_compile_entry);
+            state->async_compile_status = VKD3D_PIPELINE_ASYNC_COMPILE_RUNNING;
+            pthread_mutex_unlock(&pool->lock);
+
+            vkd3d_pipeline_compile_pool_execute(pool, state);
+        }
+        else if (!list_empty(&pool->variant_jobs))
+        {
+            state = LIST_ENTRY(list_head(&pool->variant_jobs), struct d3d12_pipeline_state, variant_precompile_entry);
+            list_remove(&state->variant_precompile_entry);
+            should_exit = pool->should_exit;
+            pthread_mutex_unlock(&pool->lock);
+
+            /* Variants are only an optimization, so don't spend time on them when tearing down. */
+            if (!should_exit)
+                d3d12_pipeline_state_precompile_variants(state);
+            d3d12_pipeline_state_dec_ref(state);
+        }
+        else
+        {
+            /* Drain the queue before exiting. */
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static bool vkd3d_thread_priority_from_string(const char *str, enum vkd3d_thread_priority *priority)
+{
+    if (!strcmp(str, "lowest"))
+        *priority = VKD3D_THREAD_PRIORITY_LOWEST;
+    else if (!strcmp(str, "low"))
+        *priority = VKD3D_THREAD_PRIORITY_LOW;
+    else if (!strcmp(str, "normal"))
+        *priority = VKD3D_THREAD_PRIORITY_NORMAL;
+    else
+        return false;
+
+    return true;
+}
+
+HRESULT vkd3d_pipeline_compile_pool_init(struct vkd3d_pipeline_compile_pool *pool, struct d3d12_device *device)
+{
+    unsigned int thread_count;
+    char env[64];
+    unsigned int i;
+    HRESULT hr;
+    int rc;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->device = device;
+    list_init(&pool->jobs);
+    list_init(&pool->variant_jobs);
+
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_ASYNC_PIPELINE_COMPILE)
+    {
+        /* Leave a core for the application's own threads. */
+        thread_count = max(vkd3d_get_cpu_count(), 2u) - 1;
+        if (vkd3d_get_env_var("VKD3D_PIPELINE_COMPILE_THREADS", env, sizeof(env)))
+            thread_count = strtoul(env, NULL, 0);
+
+        /* Compilation should not starve the application's render thread. */
+        pool->priority = VKD3D_THREAD_PRIORITY_LOW;
+    }
+    else if (!(vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_APP_CACHE_ONLY))
+    {
+        /* PSOs are still compiled synchronously, but fallback variants recorded in the disk cache
+         * are precompiled by a single background thread so that PSO creation does not pay for them. */
+        thread_count = 1;
+        pool->priority = VKD3D_THREAD_PRIORITY_LOWEST;
+    }
+    else
+        return S_OK;
+
+    if (vkd3d_get_env_var("VKD3D_PIPELINE_COMPILE_THREAD_PRIORITY", env, sizeof(env)) &&
+            !vkd3d_thread_priority_from_string(env, &pool->priority))
+        WARN("Unrecognized thread priority \"%s\".\n", env);
+
+    if (!thread_count)
+        return S_OK;
+
+    if ((rc = pthread_mutex_init(&pool->lock, NULL)))
+        return hresult_from_errno(rc);
+
+    if ((rc = pthread_cond_init(&pool->cond, NULL)))
+    {
+        pthread_mutex_destroy(&pool->lock);
+        return hresult_from_errno(rc);
+    }
+
+    if ((rc = pthread_cond_init(&pool->done_cond, NULL)))
+    {
+        pthread_cond_destroy(&pool->cond);
+        pthread_mutex_destroy(&pool->lock);
+        return hresult_from_errno(rc);
+    }
+
+    if (!(pool->threads = vkd3d_calloc(thread_count, sizeof(*pool->threads))))
+    {
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_cond_destroy(&pool->cond);
+        pthread_mutex_destroy(&pool->lock);
+        return E_OUTOFMEMORY;
+    }
+
+    for (i = 0; i < thread_count; i++)
+    {
+        if (FAILED(hr = vkd3d_create_thread(device->vkd3d_instance,
+                vkd3d_pipeline_compile_pool_main, pool, &pool->threads[i])))
+        {
+            vkd3d_pipeline_compile_pool_cleanup(pool, device);
+            return hr;
+        }
+
+        /* Only ever increment when the thread exists, so cleanup knows what to join. */
+        pool->thread_count++;
+    }
+
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_ASYNC_PIPELINE_COMPILE)
+    {
+        pool->async_pipelines = true;
+        INFO("Using %u threads for asynchronous pipeline compilation.\n", pool->thread_count);
+    }
+
+    return S_OK;
+}
+
+void vkd3d_pipeline_compile_pool_cleanup(struct vkd3d_pipeline_compile_pool *pool, struct d3d12_device *device)
+{
+    unsigned int i;
+    HRESULT hr;
+
+    if (!pool->threads)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->should_exit = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->thread_count; i++)
+    {
+        if (FAILED(hr = vkd3d_join_thread(device->vkd3d_instance, &pool->threads[i])))
+            ERR("Failed to join pipeline compile thread, hr #%x.\n", hr);
+    }
+
+    vkd3d_free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+}
+
 HRESULT d3d12_pipeline_state_create(struct d3d12_device *device, VkPipelineBindPoint bind_point,
         const struct d3d12_pipeline_state_desc *desc, struct d3d12_pipeline_state **state)
 {
@@ -4227,7 +4649,7 @@ HRESULT d3d12_pipeline_state_create(struct d3d12_device *device, VkPipelineBindP
     {
         if (object->root_signature)
             d3d12_root_signature_dec_ref(object->root_signature);
-        d3d12_pipeline_state_free_spirv_code(object);
+        d3d12_pipeline_state_free_spirv_code(object, device);
         d3d12_pipeline_state_destroy_shader_modules(object, device);
         if (object->pipeline_type == VKD3D_PIPELINE_TYPE_GRAPHICS || object->pipeline_type == VKD3D_PIPELINE_TYPE_MESH_GRAPHICS)
             d3d12_pipeline_state_free_cached_desc(&object->graphics.cached_desc);
@@ -4238,43 +4660,22 @@ HRESULT d3d12_pipeline_state_create(struct d3d12_device *device, VkPipelineBindP
         return hr;
     }
 
-    /* The strategy here is that we need to keep the SPIR-V alive somehow.
-     * If we don't need to serialize SPIR-V from the PSO, then we don't need to keep the code alive as pointer/size pairs.
-     * The scenarios for this case is:
-     * - When we choose to not serialize SPIR-V at all with VKD3D_CONFIG
-     * - PSO was loaded from a cached blob. It's extremely unlikely that anyone is going to try
-     *   serializing that PSO again, so there should be no need to keep it alive.
-     * - We are using a disk cache with SHADER_IDENTIFIER support.
-     *   In this case, we'll never store the SPIR-V itself, but the identifier, so we don't need to keep the code around.
-     *
-     * The worst that would happen is a performance loss should that entry be reloaded later.
-     * For graphics pipelines, we have to keep VkShaderModules around in case we need fallback pipelines.
-     * If we keep the SPIR-V around in memory, we can always create shader modules on-demand in case we
-     * need to actually create fallback pipelines. This avoids unnecessary memory bloat. */
-    if (desc_cached_pso->blob.CachedBlobSizeInBytes ||
-            (device->disk_cache.library && (device->disk_cache.library->flags & VKD3D_PIPELINE_LIBRARY_FLAG_SHADER_IDENTIFIER)) ||
-            (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_NO_SERIALIZE_SPIRV))
-        d3d12_pipeline_state_free_spirv_code(object);
-    else
-        d3d12_pipeline_state_destroy_shader_modules(object, device);
-
     /* We don't expect to serialize the PSO blob if we loaded it from cache.
-     * Free the cache now to save on memory. */
+     * Set this explicitly so we avoid attempting to touch code[i] when serializing the PSO blob.
+     * We are at risk of compiling code on the fly in some upcoming situations. */
     if (desc_cached_pso->blob.CachedBlobSizeInBytes)
-    {
-        VK_CALL(vkDestroyPipelineCache(device->vk_device, object->vk_pso_cache, NULL));
-        object->vk_pso_cache = VK_NULL_HANDLE;
-
-        /* Set this explicitly so we avoid attempting to touch code[i] when serializing the PSO blob.
-         * We are at risk of compiling code on the fly in some upcoming situations. */
         object->pso_is_loaded_from_cached_blob = true;
-    }
-    else if (device->disk_cache.library)
+
+    /* Fallback variants recorded in an earlier run are compiled in the background so that draws do not hitch
+     * on them. Asynchronous PSOs do this along with the main pipeline, otherwise queue up a separate job. */
+    if (object->async_compile_status)
+        vkd3d_pipeline_compile_pool_enqueue(&device->pipeline_compile_pool, object);
+    else
     {
-        /* We compiled this PSO without any cache (internal or app-provided),
-         * so we should serialize this to internal disk cache.
-         * Pushes work to disk$ thread. */
-        vkd3d_pipeline_library_store_pipeline_to_disk_cache(&device->disk_cache, object);
+        d3d12_pipeline_state_finish_creation(object);
+        if (device->pipeline_compile_pool.thread_count && device->disk_cache.library &&
+                d3d12_pipeline_state_is_graphics(object))
+            vkd3d_pipeline_compile_pool_enqueue_variants(&device->pipeline_compile_pool, object);
     }
 
     TRACE("Created pipeline state %p.\n", object);
@@ -4383,18 +4784,15 @@ static VkPipeline d3d12_pipeline_state_find_compiled_pipeline(struct d3d12_pipel
         const struct vkd3d_pipeline_key *key, uint32_t *dynamic_state_flags)
 {
     const struct d3d12_graphics_pipeline_state *graphics = &state->graphics;
-    struct vkd3d_compiled_pipeline *current;
+    const struct vkd3d_compiled_pipeline *compiled_pipeline;
     VkPipeline vk_pipeline = VK_NULL_HANDLE;
 
     rwlock_lock_read(&state->lock);
-    LIST_FOR_EACH_ENTRY(current, &graphics->compiled_fallback_pipelines, struct vkd3d_compiled_pipeline, entry)
+    if ((compiled_pipeline = (const struct vkd3d_compiled_pipeline *)hash_map_find(
+            &graphics->compiled_fallback_pipelines, key)))
     {
-        if (!memcmp(&current->key, key, sizeof(*key)))
-        {
-            vk_pipeline = current->vk_pipeline;
-            *dynamic_state_flags = current->dynamic_state_flags;
-            break;
-        }
+        vk_pipeline = compiled_pipeline->vk_pipeline;
+        *dynamic_state_flags = compiled_pipeline->dynamic_state_flags;
     }
     rwlock_unlock_read(&state->lock);
 
@@ -4405,32 +4803,48 @@ static bool d3d12_pipeline_state_put_pipeline_to_cache(struct d3d12_pipeline_sta
         const struct vkd3d_pipeline_key *key, VkPipeline vk_pipeline, uint32_t dynamic_state_flags)
 {
     struct d3d12_graphics_pipeline_state *graphics = &state->graphics;
-    struct vkd3d_compiled_pipeline *compiled_pipeline, *current;
-
-    if (!(compiled_pipeline = vkd3d_malloc(sizeof(*compiled_pipeline))))
-        return false;
+    struct vkd3d_compiled_pipeline compiled_pipeline, *inserted;
+    bool success;
 
-    compiled_pipeline->key = *key;
-    compiled_pipeline->vk_pipeline = vk_pipeline;
-    compiled_pipeline->dynamic_state_flags = dynamic_state_flags;
+    memset(&compiled_pipeline, 0, sizeof(compiled_pipeline));
+    memcpy(&compiled_pipeline.key, key, sizeof(*key));
+    compiled_pipeline.vk_pipeline = vk_pipeline;
+    compiled_pipeline.dynamic_state_flags = dynamic_state_flags;
 
     rwlock_lock_write(&state->lock);
+    inserted = (struct vkd3d_compiled_pipeline *)hash_map_insert(&graphics->compiled_fallback_pipelines,
+            key, &compiled_pipeline.entry);
+    /* If another thread raced us, the existing pipeline wins and the caller destroys ours. */
+    success = inserted && inserted->vk_pipeline == vk_pipeline;
+    rwlock_unlock_write(&state->lock);
 
-    LIST_FOR_EACH_ENTRY(current, &graphics->compiled_fallback_pipelines, struct vkd3d_compiled_pipeline, entry)
-    {
-        if (!memcmp(&current->key, key, sizeof(*key)))
-        {
-            vkd3d_free(compiled_pipeline);
-            compiled_pipeline = NULL;
-            break;
-        }
-    }
+    return success;
+}
 
-    if (compiled_pipeline)
-        list_add_tail(&graphics->compiled_fallback_pipelines, &compiled_pipeline->entry);
+static void vkd3d_pipeline_variant_desc_from_key(struct vkd3d_pipeline_variant_desc *variant,
+        const struct vkd3d_pipeline_key *key, const struct vkd3d_format *dsv_format)
+{
+    memset(variant, 0, sizeof(*variant));
+    variant->topology = key->topology;
+    variant->viewport_count = key->viewport_count;
+    memcpy(variant->strides, key->strides, sizeof(variant->strides));
+    variant->dsv_format = dsv_format ? dsv_format->dxgi_format : DXGI_FORMAT_UNKNOWN;
+    if (key->dynamic_stride)
+        variant->flags |= VKD3D_PIPELINE_VARIANT_DYNAMIC_STRIDE;
+    if (key->dynamic_topology)
+        variant->flags |= VKD3D_PIPELINE_VARIANT_DYNAMIC_TOPOLOGY;
+}
 
-    rwlock_unlock_write(&state->lock);
-    return compiled_pipeline;
+static void vkd3d_pipeline_key_from_variant_desc(struct vkd3d_pipeline_key *key,
+        const struct vkd3d_pipeline_variant_desc *variant, const struct vkd3d_format *dsv_format)
+{
+    memset(key, 0, sizeof(*key));
+    key->topology = variant->topology;
+    key->viewport_count = variant->viewport_count;
+    memcpy(key->strides, variant->strides, sizeof(key->strides));
+    key->dsv_format = dsv_format ? dsv_format->vk_format : VK_FORMAT_UNDEFINED;
+    key->dynamic_stride = !!(variant->flags & VKD3D_PIPELINE_VARIANT_DYNAMIC_STRIDE);
+    key->dynamic_topology = !!(variant->flags & VKD3D_PIPELINE_VARIANT_DYNAMIC_TOPOLOGY);
 }
 
 VkPipeline d3d12_pipeline_state_create_pipeline_variant(struct d3d12_pipeline_state *state,
@@ -4673,7 +5087,7 @@ err:
     while (stages_module_dup_mask)
     {
         i = vkd3d_bitmask_iter32(&stages_module_dup_mask);
-        VK_CALL(vkDestroyShaderModule(device->vk_device, stages[i].module, NULL));
+        d3d12_pipeline_state_release_shader_module(device, stages[i].module);
     }
 
     return vk_pipeline;
@@ -4757,6 +5171,7 @@ VkPipeline d3d12_pipeline_state_get_or_create_pipeline(struct d3d12_pipeline_sta
 {
     const struct vkd3d_vk_device_procs *vk_procs = &state->device->vk_procs;
     struct d3d12_graphics_pipeline_state *graphics = &state->graphics;
+    struct vkd3d_pipeline_variant_desc variant;
     struct d3d12_device *device = state->device;
     struct vkd3d_pipeline_key pipeline_key;
     uint32_t stride, stride_align_mask;
@@ -4816,7 +5231,15 @@ VkPipeline d3d12_pipeline_state_get_or_create_pipeline(struct d3d12_pipeline_sta
     }
 
     if (d3d12_pipeline_state_put_pipeline_to_cache(state, &pipeline_key, vk_pipeline, *dynamic_state_flags))
+    {
+        /* Remember the variant so that the next run can compile it up front. */
+        if (device->disk_cache.library)
+        {
+            vkd3d_pipeline_variant_desc_from_key(&variant, &pipeline_key, dsv_format);
+            vkd3d_pipeline_library_store_pipeline_variant_to_disk_cache(&device->disk_cache, state, &variant);
+        }
         return vk_pipeline;
+    }
 
     /* Other thread compiled the pipeline before us. */
     VK_CALL(vkDestroyPipeline(device->vk_device, vk_pipeline, NULL));
@@ -4826,6 +5249,55 @@ VkPipeline d3d12_pipeline_state_get_or_create_pipeline(struct d3d12_pipeline_sta
     return vk_pipeline;
 }
 
+static void d3d12_pipeline_state_precompile_variants(struct d3d12_pipeline_state *state)
+{
+    const struct vkd3d_vk_device_procs *vk_procs = &state->device->vk_procs;
+    struct vkd3d_pipeline_variant_desc *variants;
+    struct d3d12_device *device = state->device;
+    const struct vkd3d_format *dsv_format;
+    struct vkd3d_pipeline_key key;
+    uint32_t dynamic_state_flags;
+    size_t variant_count, i;
+    VkPipeline vk_pipeline;
+
+    if (!d3d12_pipeline_state_is_graphics(state) || !device->disk_cache.library)
+        return;
+
+    if (!(variant_count = vkd3d_pipeline_library_find_variants_from_disk_cache(&device->disk_cache,
+            &state->pipeline_cache_compat, &variants)))
+        return;
+
+    if (vkd3d_config_flags & VKD3D_CONFIG_FLAG_PIPELINE_LIBRARY_LOG)
+        INFO("Precompiling %zu fallback pipeline variants for PSO %p.\n", variant_count, state);
+
+    for (i = 0; i < variant_count; i++)
+    {
+        dsv_format = NULL;
+        if (variants[i].dsv_format != DXGI_FORMAT_UNKNOWN &&
+                !(dsv_format = vkd3d_get_format(device, variants[i].dsv_format, true)))
+        {
+            WARN("Ignoring variant with unsupported DSV format %#x.\n", variants[i].dsv_format);
+            continue;
+        }
+
+        vkd3d_pipeline_key_from_variant_desc(&key, &variants[i], dsv_format);
+        if (d3d12_pipeline_state_find_compiled_pipeline(state, &key, &dynamic_state_flags))
+            continue;
+
+        if (!(vk_pipeline = d3d12_pipeline_state_create_pipeline_variant(state,
+                &key, dsv_format, VK_NULL_HANDLE, &dynamic_state_flags)))
+        {
+            WARN("Failed to precompile pipeline variant %zu for PSO %p.\n", i, state);
+            continue;
+        }
+
+        if (!d3d12_pipeline_state_put_pipeline_to_cache(state, &key, vk_pipeline, dynamic_state_flags))
+            VK_CALL(vkDestroyPipeline(device->vk_device, vk_pipeline, NULL));
+    }
+
+    vkd3d_free(variants);
+}
+
 static uint32_t d3d12_max_descriptor_count_from_heap_type(D3D12_DESCRIPTOR_HEAP_TYPE heap_type)
 {
     switch (heap_type)
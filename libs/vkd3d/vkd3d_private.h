@@ -40,6 +40,9 @@
 #include "vkd3d_device_vkd3d_ext.h"
 #include "vkd3d_string.h"
 #include "vkd3d_file_utils.h"
+#include "vkd3d_tlsf.h"
+#include "vkd3d_chunk_pool.h"
+#include "vkd3d_hash.h"
 #include <assert.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -47,8 +50,6 @@
 
 #define VK_CALL(f) (vk_procs->f)
 
-#define MAKE_MAGIC(a,b,c,d) (((uint32_t)a) | (((uint32_t)b) << 8) | (((uint32_t)c) << 16) | (((uint32_t)d) << 24))
-
 #define VKD3D_MAX_COMPATIBLE_FORMAT_COUNT 10u
 #define VKD3D_MAX_SHADER_STAGES           5u
 #define VKD3D_MAX_VK_SYNC_OBJECTS         4u
@@ -252,6 +253,12 @@ struct vkd3d_fence_worker
     struct vkd3d_waiting_fence *enqueued_fences;
     size_t enqueued_fences_size;
 
+    /* Host-signalled timeline which is part of every wait-any,
+     * so that newly enqueued fences can interrupt a pending wait. */
+    VkSemaphore wake_timeline;
+    uint64_t wake_timeline_value;
+    bool waiting_on_gpu;
+
     struct d3d12_device *device;
 };
 
@@ -718,6 +725,7 @@ struct vkd3d_memory_allocation
     uint64_t clear_semaphore_value;
 
     struct vkd3d_memory_chunk *chunk;
+    uint32_t chunk_block_index;
 };
 
 static inline void vkd3d_memory_allocation_slice(struct vkd3d_memory_allocation *dst,
@@ -732,18 +740,37 @@ static inline void vkd3d_memory_allocation_slice(struct vkd3d_memory_allocation
         dst->cpu_address = void_ptr_offset(dst->cpu_address, offset);
 }
 
-struct vkd3d_memory_free_range
-{
-    VkDeviceSize offset;
-    VkDeviceSize length;
-};
+struct vkd3d_memory_pool;
 
 struct vkd3d_memory_chunk
 {
     struct vkd3d_memory_allocation allocation;
-    struct vkd3d_memory_free_range *free_ranges;
-    size_t free_ranges_size;
-    size_t free_ranges_count;
+    struct vkd3d_memory_pool *pool;
+    uint32_t region_block_index;
+};
+
+/* All chunks with the same heap type, heap flags and memory type are
+ * interchangeable, so they share a single TLSF instance. Each pool is
+ * locked independently so that unrelated allocations do not contend. */
+struct vkd3d_memory_pool
+{
+    D3D12_HEAP_TYPE heap_type;
+    D3D12_HEAP_FLAGS heap_flags;
+    uint32_t vk_memory_type;
+
+    pthread_mutex_t mutex;
+    struct vkd3d_tlsf tlsf;
+
+    struct vkd3d_memory_chunk **chunks;
+    size_t chunks_size;
+    size_t chunks_count;
+
+#ifdef VKD3D_ENABLE_PROFILING
+    /* Contended lock acquisitions are reported as a profiling region. */
+    char profiling_name[48];
+    spinlock_t profiling_lock;
+    uint32_t profiling_latch;
+#endif
 };
 
 #define VKD3D_MEMORY_CLEAR_COMMAND_BUFFER_COUNT (16u)
@@ -769,11 +796,12 @@ struct vkd3d_memory_clear_queue
 
 struct vkd3d_memory_allocator
 {
-    pthread_mutex_t mutex;
-
-    struct vkd3d_memory_chunk **chunks;
-    size_t chunks_size;
-    size_t chunks_count;
+    /* Pools are only ever added, so this is only taken
+     * for writing when a new pool is created. */
+    rwlock_t pools_lock;
+    struct vkd3d_memory_pool **pools;
+    size_t pools_size;
+    size_t pools_count;
 
     struct vkd3d_va_map va_map;
 
@@ -1653,7 +1681,7 @@ struct d3d12_graphics_pipeline_state
 
     VkPipelineLayout pipeline_layout;
     VkPipeline pipeline;
-    struct list compiled_fallback_pipelines;
+    struct hash_map compiled_fallback_pipelines;
 
     bool xfb_enabled;
 };
@@ -1703,9 +1731,53 @@ struct d3d12_pipeline_state
     bool root_signature_compat_hash_is_dxbc_derived;
     bool pso_is_loaded_from_cached_blob;
 
+    /* Only used when VkPipeline creation is deferred to the pipeline compile pool. */
+    struct list async_compile_entry;
+    uint32_t async_compile_status; /* enum vkd3d_pipeline_async_compile_status */
+    /* Only used when just the recorded fallback variants are precompiled in the pool. */
+    struct list variant_precompile_entry;
+
     struct vkd3d_private_store private_store;
 };
 
+enum vkd3d_pipeline_async_compile_status
+{
+    VKD3D_PIPELINE_ASYNC_COMPILE_DONE = 0,
+    VKD3D_PIPELINE_ASYNC_COMPILE_QUEUED,
+    VKD3D_PIPELINE_ASYNC_COMPILE_RUNNING,
+};
+
+void d3d12_pipeline_state_wait_async_compile_slow(struct d3d12_pipeline_state *state);
+
+/* Must be called before anything touches the VkPipeline, SPIR-V or pipeline cache of a PSO
+ * which may have been created asynchronously. */
+static inline void d3d12_pipeline_state_wait_async_compile(struct d3d12_pipeline_state *state)
+{
+    if (vkd3d_atomic_uint32_load_explicit(&state->async_compile_status, vkd3d_memory_order_acquire))
+        d3d12_pipeline_state_wait_async_compile_slow(state);
+}
+
+struct vkd3d_pipeline_compile_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t done_cond;
+    struct list jobs;
+    struct list variant_jobs;
+    bool should_exit;
+    /* If false, the pool only precompiles recorded fallback variants. */
+    bool async_pipelines;
+
+    union vkd3d_thread_handle *threads;
+    unsigned int thread_count;
+    enum vkd3d_thread_priority priority;
+
+    struct d3d12_device *device;
+};
+
+HRESULT vkd3d_pipeline_compile_pool_init(struct vkd3d_pipeline_compile_pool *pool, struct d3d12_device *device);
+void vkd3d_pipeline_compile_pool_cleanup(struct vkd3d_pipeline_compile_pool *pool, struct d3d12_device *device);
+
 static inline bool d3d12_pipeline_state_is_compute(const struct d3d12_pipeline_state *state)
 {
     return state && state->pipeline_type == VKD3D_PIPELINE_TYPE_COMPUTE;
@@ -1824,9 +1896,31 @@ static inline struct d3d12_pipeline_state *impl_from_ID3D12PipelineState(ID3D12P
 /* ID3D12PipelineLibrary */
 typedef ID3D12PipelineLibrary1 d3d12_pipeline_library_iface;
 
+enum vkd3d_pipeline_variant_flag
+{
+    VKD3D_PIPELINE_VARIANT_DYNAMIC_STRIDE = 1 << 0,
+    VKD3D_PIPELINE_VARIANT_DYNAMIC_TOPOLOGY = 1 << 1,
+};
+
+/* Serializable form of a vkd3d_pipeline_key. The DSV format is stored as a DXGI format
+ * since VkFormat alone is not enough to recreate the pipeline. */
+struct vkd3d_pipeline_variant_desc
+{
+    uint32_t topology; /* D3D12_PRIMITIVE_TOPOLOGY */
+    uint32_t viewport_count;
+    uint32_t strides[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+    uint32_t dsv_format; /* DXGI_FORMAT */
+    uint32_t flags; /* vkd3d_pipeline_variant_flag */
+};
+
 struct vkd3d_pipeline_library_disk_cache_item
 {
+    /* If NULL, record that the archived PSO identified by use_hash was used. */
     struct d3d12_pipeline_state *state;
+    /* If set, record a fallback pipeline variant of state rather than state itself. */
+    bool is_variant;
+    struct vkd3d_pipeline_variant_desc variant;
+    uint64_t use_hash;
 };
 
 struct vkd3d_pipeline_library_disk_cache
@@ -1848,13 +1942,71 @@ struct vkd3d_pipeline_library_disk_cache
     char read_path[VKD3D_PATH_MAX];
     char write_path[VKD3D_PATH_MAX];
 
+    /* Least recently used PSOs are evicted on merge to keep the archive below this size. 0 means unlimited. */
+    uint64_t max_size;
+    /* PSOs from the read-only archive which we have already recorded a use for. Only accessed by disk thread. */
+    struct hash_map used_pipeline_map;
+
+    /* Scratch space for serializing and compressing entries before they are written.
+     * Only accessed by disk thread. */
+    uint8_t *serialize_buffer;
+    size_t serialize_buffer_size;
+    uint8_t *compress_buffer;
+    size_t compress_buffer_size;
+
+    /* Entries pending for the next group commit to stream_archive_write_file. */
+    uint8_t *write_buffer;
+    size_t write_buffer_size;
+    size_t write_buffer_offset;
+
     /* The stream archive is designed to be safe against concurrent readers and writers, ala Fossilize.
-     * There is a read-only portion, and a write-only portion which can be merged back to the read-only archive
-     * on demand. */
+     * There is a read-only portion, and a write-only portion per process (write_path is <read_path>.write.<pid>)
+     * which is merged back to the read-only archive on next startup. */
     FILE *stream_archive_write_file;
     bool stream_archive_attempted_write;
 };
 
+/* Blob maps are split by key hash into independently locked shards, so that threads
+ * creating, loading and storing unrelated pipelines do not contend on a single lock.
+ * Only whole-library serialization needs to lock every shard. */
+#define VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT_LOG2 4
+#define VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT (1u << VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT_LOG2)
+
+/* Entry of a serialized library blob which has not been looked at yet.
+ * Only the key is known, the blob is validated when the entry is first requested. */
+struct d3d12_pipeline_library_lazy_entry
+{
+    uint32_t hash;
+    uint32_t toc_index;
+    const uint8_t *name;
+};
+
+struct d3d12_pipeline_library_map_shard
+{
+    rwlock_t lock;
+    struct hash_map map;
+    /* Serialized footprint of the entries in this shard. */
+    size_t name_table_size;
+    size_t blob_size;
+    /* Range of the lazy index owned by this shard. Immutable after creation. */
+    const struct d3d12_pipeline_library_lazy_entry *lazy_entries;
+    size_t lazy_count;
+    /* Lazy entries not yet moved into the hash map. Protected by lock. */
+    size_t lazy_pending_count;
+};
+
+struct vkd3d_serialized_pipeline_toc_entry;
+
+struct d3d12_pipeline_library_map
+{
+    struct d3d12_pipeline_library_map_shard shards[VKD3D_PIPELINE_LIBRARY_MAP_SHARD_COUNT];
+    /* Index over the application's serialized blob, sorted by key hash, so that opening
+     * a large library does not need to touch every entry. Null if nothing was loaded. */
+    struct d3d12_pipeline_library_lazy_entry *lazy_index;
+    const struct vkd3d_serialized_pipeline_toc_entry *lazy_toc_entries;
+    const uint8_t *lazy_data;
+};
+
 struct d3d12_pipeline_library
 {
     d3d12_pipeline_library_iface ID3D12PipelineLibrary_iface;
@@ -1864,17 +2016,13 @@ struct d3d12_pipeline_library
 
     struct d3d12_device *device;
 
+    /* Only protects pso_variant_map. The blob maps are locked per shard. */
     rwlock_t mutex;
-    /* driver_cache_map and spirv_cache_map can be touched in serialize_pipeline_state.
-     * Use the internal mutex when touching the internal caches
-     * so we don't need a big lock on the outside when serializing. */
-    rwlock_t internal_hashmap_mutex;
-    struct hash_map pso_map;
-    struct hash_map driver_cache_map;
-    struct hash_map spirv_cache_map;
-
-    size_t total_name_table_size;
-    size_t total_blob_size;
+    struct d3d12_pipeline_library_map pso_map;
+    struct d3d12_pipeline_library_map driver_cache_map;
+    struct d3d12_pipeline_library_map spirv_cache_map;
+    /* Fallback pipeline variants seen for a PSO, keyed by PSO hash. Protected by mutex. */
+    struct hash_map pso_variant_map;
 
     /* Non-owned pointer. Calls back into the disk cache when blobs are added. */
     struct vkd3d_pipeline_library_disk_cache *disk_cache_listener;
@@ -1925,12 +2073,77 @@ ULONG d3d12_pipeline_library_dec_public_ref(struct d3d12_pipeline_library *state
 void d3d12_pipeline_library_inc_ref(struct d3d12_pipeline_library *state);
 void d3d12_pipeline_library_dec_ref(struct d3d12_pipeline_library *state);
 
+/* Everything which can affect the SPIR-V generated for a given DXBC blob. */
+struct vkd3d_shader_memo_key
+{
+    vkd3d_shader_hash_t dxbc_hash;
+    uint64_t shader_interface_key;
+    uint64_t root_signature_hash;
+    uint64_t compile_args_hash;
+};
+
+struct vkd3d_shader_memo_cache
+{
+    pthread_mutex_t lock;
+    struct hash_map map;
+    /* Most recently used entries first. */
+    struct list lru;
+    size_t total_size;
+    size_t max_size;
+
+    uint32_t hit_count;
+    uint32_t miss_count;
+    uint32_t eviction_count;
+};
+
+HRESULT vkd3d_shader_memo_cache_init(struct vkd3d_shader_memo_cache *cache);
+void vkd3d_shader_memo_cache_cleanup(struct vkd3d_shader_memo_cache *cache);
+bool vkd3d_shader_memo_cache_lookup(struct vkd3d_shader_memo_cache *cache,
+        const struct vkd3d_shader_memo_key *key, struct vkd3d_shader_code *spirv_code);
+void vkd3d_shader_memo_cache_insert(struct vkd3d_shader_memo_cache *cache,
+        const struct vkd3d_shader_memo_key *key, const struct vkd3d_shader_code *spirv_code);
+
+/* Device-wide table of SPIR-V blobs and VkShaderModules, keyed by SPIR-V hash.
+ * PSOs which end up with identical SPIR-V share a single copy of the code and a single module.
+ * Code and module are refcounted independently since PSOs may drop either one early. */
+struct vkd3d_shader_intern_table
+{
+    pthread_mutex_t lock;
+    struct hash_map code_map;
+    struct hash_map module_map;
+
+    /* Referenced counts what PSOs would hold without interning, resident what is actually allocated. */
+    size_t referenced_code_size;
+    size_t resident_code_size;
+    size_t peak_saved_code_size;
+    uint32_t referenced_module_count;
+    uint32_t resident_module_count;
+    uint32_t peak_saved_module_count;
+};
+
+HRESULT vkd3d_shader_intern_table_init(struct vkd3d_shader_intern_table *table);
+void vkd3d_shader_intern_table_cleanup(struct vkd3d_shader_intern_table *table, struct d3d12_device *device);
+void vkd3d_shader_intern_table_intern_code(struct vkd3d_shader_intern_table *table,
+        struct vkd3d_shader_code *spirv_code);
+void vkd3d_shader_intern_table_release_code(struct vkd3d_shader_intern_table *table,
+        struct vkd3d_shader_code *spirv_code);
+HRESULT vkd3d_shader_intern_table_acquire_module(struct vkd3d_shader_intern_table *table,
+        struct d3d12_device *device, const struct vkd3d_shader_code *spirv_code, VkShaderModule *vk_module);
+void vkd3d_shader_intern_table_release_module(struct vkd3d_shader_intern_table *table,
+        struct d3d12_device *device, VkShaderModule vk_module);
+void vkd3d_shader_intern_table_report(struct vkd3d_shader_intern_table *table);
+
 /* For internal on-disk pipeline cache fallback. The key to Load/StorePipeline is implied by the PSO cache compatibility. */
 HRESULT vkd3d_pipeline_library_store_pipeline_to_disk_cache(struct vkd3d_pipeline_library_disk_cache *pipeline_library,
         struct d3d12_pipeline_state *state);
 HRESULT vkd3d_pipeline_library_find_cached_blob_from_disk_cache(struct vkd3d_pipeline_library_disk_cache *pipeline_library,
         const struct vkd3d_pipeline_cache_compatibility *compat,
         struct d3d12_cached_pipeline_state *cached_state);
+HRESULT vkd3d_pipeline_library_store_pipeline_variant_to_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
+        struct d3d12_pipeline_state *state, const struct vkd3d_pipeline_variant_desc *variant);
+/* Returns the number of variants recorded for the PSO. Caller frees *variants. */
+size_t vkd3d_pipeline_library_find_variants_from_disk_cache(struct vkd3d_pipeline_library_disk_cache *cache,
+        const struct vkd3d_pipeline_cache_compatibility *compat, struct vkd3d_pipeline_variant_desc **variants);
 void vkd3d_pipeline_library_disk_cache_notify_blob_insert(struct vkd3d_pipeline_library_disk_cache *disk_cache,
         uint64_t hash, uint32_t type /* vkd3d_serialized_pipeline_stream_entry_type */,
         const void *data, size_t size);
@@ -2089,6 +2302,10 @@ struct vkd3d_pipeline_bindings
     uint64_t root_descriptor_dirty_mask;
     uint64_t root_descriptor_active_mask;
 
+    /* Addresses set through the API since the last root signature change. */
+    D3D12_GPU_VIRTUAL_ADDRESS root_descriptor_vas[D3D12_MAX_ROOT_COST];
+    uint64_t root_descriptor_va_mask;
+
     uint32_t root_constants[D3D12_MAX_ROOT_COST];
     uint64_t root_constant_dirty_mask;
 };
@@ -2224,6 +2441,7 @@ enum vkd3d_batch_type
     VKD3D_BATCH_TYPE_COPY_BUFFER_TO_IMAGE,
     VKD3D_BATCH_TYPE_COPY_IMAGE_TO_BUFFER,
     VKD3D_BATCH_TYPE_COPY_IMAGE,
+    VKD3D_BATCH_TYPE_COPY_BUFFER,
 };
 
 struct vkd3d_image_copy_info
@@ -2244,14 +2462,30 @@ struct vkd3d_image_copy_info
 };
 
 #define VKD3D_COPY_TEXTURE_REGION_MAX_BATCH_SIZE 16
+#define VKD3D_COPY_BUFFER_REGION_MAX_BATCH_SIZE 64
 
 struct d3d12_transfer_batch_state
 {
     enum vkd3d_batch_type batch_type;
     struct vkd3d_image_copy_info batch[VKD3D_COPY_TEXTURE_REGION_MAX_BATCH_SIZE];
+    /* For VKD3D_BATCH_TYPE_COPY_BUFFER, all regions share one buffer pair. */
+    VkBufferCopy2KHR buffer_copies[VKD3D_COPY_BUFFER_REGION_MAX_BATCH_SIZE];
+    VkBuffer src_buffer;
+    VkBuffer dst_buffer;
     size_t batch_len;
 };
 
+#define MAX_BATCHED_IMAGE_BARRIERS 16
+struct d3d12_command_list_barrier_batch
+{
+    VkImageMemoryBarrier vk_image_barriers[MAX_BATCHED_IMAGE_BARRIERS];
+    VkMemoryBarrier vk_memory_barrier;
+    uint32_t image_barrier_count;
+    VkPipelineStageFlags dst_stage_mask, src_stage_mask;
+    /* Number of vkCmdPipelineBarrier calls this batch has emitted. */
+    uint32_t pipeline_barrier_count;
+};
+
 struct d3d12_command_list
 {
     d3d12_command_list_iface ID3D12GraphicsCommandList_iface;
@@ -2354,6 +2588,15 @@ struct d3d12_command_list
 
     struct d3d12_transfer_batch_state transfer_batch;
 
+    /* ResourceBarrier() only accumulates into this batch. It is flushed right before
+     * the next command which depends on it, so back-to-back barrier calls merge. */
+    struct d3d12_command_list_barrier_batch pending_barriers;
+    unsigned int resource_barrier_count;
+
+    /* State setters which did not change anything, versus ones which did. */
+    unsigned int filtered_state_count;
+    unsigned int effective_state_count;
+
     struct vkd3d_private_store private_store;
 
 #ifdef VKD3D_ENABLE_BREADCRUMBS
@@ -2365,6 +2608,7 @@ HRESULT d3d12_command_list_create(struct d3d12_device *device,
         UINT node_mask, D3D12_COMMAND_LIST_TYPE type, struct d3d12_command_list **list);
 bool d3d12_command_list_reset_query(struct d3d12_command_list *list,
         VkQueryPool vk_pool, uint32_t index);
+void d3d12_command_list_flush_pending_barriers(struct d3d12_command_list *list);
 
 static inline struct vkd3d_pipeline_bindings *d3d12_command_list_get_bindings(
         struct d3d12_command_list *list, enum vkd3d_pipeline_type pipeline_type)
@@ -2388,6 +2632,7 @@ static inline struct vkd3d_pipeline_bindings *d3d12_command_list_get_bindings(
 
 #define VKD3D_BUNDLE_CHUNK_SIZE (256 << 10)
 #define VKD3D_BUNDLE_COMMAND_ALIGNMENT (sizeof(UINT64))
+#define VKD3D_CACHED_BUNDLE_CHUNK_COUNT 64
 
 struct d3d12_bundle_allocator
 {
@@ -2399,6 +2644,18 @@ struct d3d12_bundle_allocator
     size_t chunks_count;
     size_t chunk_offset;
 
+    /* Chunks kept around after Reset, trimmed to the number of chunks used
+     * by the previous recording. Excess chunks go back to the device. */
+    struct vkd3d_chunk_pool free_chunks;
+
+    /* Scratch memory for d3d12_bundle_bake(), kept across recordings. */
+    struct d3d12_bundle_command **bake_commands;
+    size_t bake_commands_size;
+    struct hash_map bake_state_map;
+
+    /* Number of times the chunk array or bake scratch memory had to grow. */
+    size_t scratch_heap_alloc_count;
+
     struct d3d12_bundle *current_bundle;
     struct d3d12_device *device;
 
@@ -2550,6 +2807,24 @@ struct d3d12_command_queue_submission
     };
 };
 
+/* Must be a power of two. */
+#define VKD3D_SUBMISSION_RING_SIZE 256u
+
+struct d3d12_command_queue_submission_slot
+{
+    uint32_t sequence;
+    struct d3d12_command_queue_submission submission;
+};
+
+/* Bounded MPSC queue. Producers claim a slot with CAS on write_index and publish
+ * it by bumping the slot sequence. Only the submission thread reads from the ring. */
+struct d3d12_command_queue_submission_ring
+{
+    uint32_t write_index;
+    uint32_t read_index;
+    struct d3d12_command_queue_submission_slot slots[VKD3D_SUBMISSION_RING_SIZE];
+};
+
 struct vkd3d_timeline_semaphore
 {
     VkSemaphore vk_semaphore;
@@ -2579,14 +2854,27 @@ struct d3d12_command_queue
 
     pthread_mutex_t queue_lock;
     pthread_cond_t queue_cond;
+    pthread_cond_t drain_cond;
     pthread_t submission_thread;
 
-    struct d3d12_command_queue_submission *submissions;
-    size_t submissions_count;
-    size_t submissions_size;
+    struct d3d12_command_queue_submission_ring submission_ring;
+    uint32_t worker_sleeping;
+
+    /* Only used if the ring is full. Protected by queue_lock. */
+    struct d3d12_command_queue_submission *overflow_submissions;
+    size_t overflow_submissions_count;
+    size_t overflow_submissions_size;
+    size_t overflow_submissions_read;
+    uint32_t overflow_active;
+
     uint64_t drain_count;
     uint64_t queue_drain_count;
 
+    /* Set while an external user holds the VkQueue. serialized_drain is the drain which started it,
+     * and is protected by queue_lock. */
+    uint32_t serialized;
+    uint64_t serialized_drain;
+
     struct vkd3d_fence_worker fence_worker;
     struct vkd3d_private_store private_store;
 
@@ -2999,8 +3287,8 @@ struct vkd3d_memory_info
 
     uint32_t budget_sensitive_mask;
     VkDeviceSize type_budget[VK_MAX_MEMORY_TYPES];
-    VkDeviceSize type_current[VK_MAX_MEMORY_TYPES];
-    pthread_mutex_t budget_lock;
+    /* Updated atomically. */
+    UINT64 type_current[VK_MAX_MEMORY_TYPES];
 };
 
 HRESULT vkd3d_memory_info_init(struct vkd3d_memory_info *info,
@@ -3517,6 +3805,8 @@ struct d3d12_device
     struct vkd3d_cached_command_allocator cached_command_allocators[VKD3D_CACHED_COMMAND_ALLOCATOR_COUNT];
     size_t cached_command_allocator_count;
 
+    struct vkd3d_chunk_pool bundle_chunk_pool;
+
     uint32_t *descriptor_heap_gpu_vas;
     size_t descriptor_heap_gpu_va_count;
     size_t descriptor_heap_gpu_va_size;
@@ -3535,6 +3825,9 @@ struct d3d12_device
     struct vkd3d_sampler_state sampler_state;
     struct vkd3d_shader_debug_ring debug_ring;
     struct vkd3d_pipeline_library_disk_cache disk_cache;
+    struct vkd3d_shader_memo_cache shader_memo_cache;
+    struct vkd3d_shader_intern_table shader_intern_table;
+    struct vkd3d_pipeline_compile_pool pipeline_compile_pool;
 #ifdef VKD3D_ENABLE_BREADCRUMBS
     struct vkd3d_breadcrumb_tracer breadcrumb_tracer;
 #endif
@@ -3589,6 +3882,8 @@ void d3d12_device_return_scratch_buffer(struct d3d12_device *device, enum vkd3d_
 
 HRESULT d3d12_device_get_query_pool(struct d3d12_device *device, uint32_t type_index, struct vkd3d_query_pool *pool);
 void d3d12_device_return_query_pool(struct d3d12_device *device, const struct vkd3d_query_pool *pool);
+void *d3d12_device_alloc_bundle_chunk(struct d3d12_device *device);
+void d3d12_device_free_bundle_chunk(struct d3d12_device *device, void *chunk);
 
 uint64_t d3d12_device_get_descriptor_heap_gpu_va(struct d3d12_device *device);
 void d3d12_device_return_descriptor_heap_gpu_va(struct d3d12_device *device, uint64_t va);
@@ -0,0 +1,1275 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Offline inspection and maintenance of pipeline libraries and stream archives (vkd3d-proton.cache).
+ * Does not need a Vulkan device, so it can run on CI machines without a GPU.
+ * Device compatibility (vendor, device, cache UUID) is never checked here, the library does that on load. */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "vkd3d_common.h"
+#include "vkd3d_atomic.h"
+#include "vkd3d_memory.h"
+#include "vkd3d_platform.h"
+#include "vkd3d_threads.h"
+#include "vkd3d_lz.h"
+#include "vkd3d_pipeline_library_format.h"
+#include "vkd3d_shader.h"
+
+#define STREAM_ENTRY_TYPE_COUNT (VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE + 1)
+#define VALIDATE_BATCH_SIZE 64
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+static const char *stream_entry_type_name(uint32_t type)
+{
+    switch (type)
+    {
+        case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV:
+            return "SPIR-V";
+        case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE:
+            return "driver cache";
+        case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE:
+            return "PSO";
+        case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT:
+            return "PSO variant";
+        case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE:
+            return "PSO use";
+        default:
+            return "unknown";
+    }
+}
+
+/* Work distribution */
+
+typedef bool (*parallel_func)(void *userdata, size_t index);
+
+struct parallel_context
+{
+    parallel_func func;
+    void *userdata;
+    uint8_t *results;
+    uint32_t item_count;
+    uint32_t batch_size;
+    uint32_t next_item;
+};
+
+static void *parallel_worker_main(void *userdata)
+{
+    struct parallel_context *ctx = userdata;
+    uint32_t begin, end, i;
+
+    for (;;)
+    {
+        begin = vkd3d_atomic_uint32_add(&ctx->next_item, ctx->batch_size, vkd3d_memory_order_relaxed) - ctx->batch_size;
+        if (begin >= ctx->item_count)
+            break;
+
+        end = min(begin + ctx->batch_size, ctx->item_count);
+        for (i = begin; i < end; i++)
+            ctx->results[i] = ctx->func(ctx->userdata, i);
+    }
+
+    return NULL;
+}
+
+/* Runs func for every item, and stores the result in results[]. Returns the number of failed items. */
+static size_t run_parallel(unsigned int thread_count, size_t item_count, size_t batch_size,
+        parallel_func func, void *userdata, uint8_t *results)
+{
+    struct parallel_context ctx;
+    unsigned int i, spawned = 0;
+    size_t failed = 0;
+    pthread_t *threads;
+
+    ctx.func = func;
+    ctx.userdata = userdata;
+    ctx.results = results;
+    ctx.item_count = item_count;
+    ctx.batch_size = batch_size;
+    ctx.next_item = 0;
+
+    thread_count = max(thread_count, 1u);
+    threads = vkd3d_calloc(thread_count, sizeof(*threads));
+
+    /* The calling thread participates as well. */
+    for (i = 0; threads && i + 1 < thread_count; i++)
+    {
+        if (pthread_create(&threads[spawned], NULL, parallel_worker_main, &ctx))
+            break;
+        spawned++;
+    }
+
+    parallel_worker_main(&ctx);
+
+    for (i = 0; i < spawned; i++)
+        pthread_join(threads[i], NULL);
+    vkd3d_free(threads);
+
+    for (i = 0; i < item_count; i++)
+        if (!results[i])
+            failed++;
+
+    return failed;
+}
+
+/* Archive loading */
+
+struct archive
+{
+    const char *path;
+    uint8_t *data;
+    size_t size;
+};
+
+static bool read_file(const char *path, uint8_t **data, size_t *size)
+{
+    int64_t file_size;
+    FILE *file;
+
+    *data = NULL;
+    *size = 0;
+
+    if (!(file = fopen(path, "rb")))
+    {
+        fprintf(stderr, "Cannot open file for reading: '%s'.\n", path);
+        return false;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "Could not determine size of file: '%s'.\n", path);
+        fclose(file);
+        return false;
+    }
+
+    /* Keep at least one byte allocated so that empty files are not confused with failure. */
+    if (!(*data = vkd3d_malloc(max(file_size, 1))))
+    {
+        fprintf(stderr, "Out of memory.\n");
+        fclose(file);
+        return false;
+    }
+
+    if (fread(*data, 1, file_size, file) != (size_t)file_size)
+    {
+        fprintf(stderr, "Could not read file: '%s'.\n", path);
+        vkd3d_free(*data);
+        *data = NULL;
+        fclose(file);
+        return false;
+    }
+
+    *size = file_size;
+    fclose(file);
+    return true;
+}
+
+static bool read_archive(const char *path, struct archive *archive)
+{
+    archive->path = path;
+    return read_file(path, &archive->data, &archive->size);
+}
+
+static void free_archive(struct archive *archive)
+{
+    vkd3d_free(archive->data);
+    archive->data = NULL;
+}
+
+static uint32_t archive_get_version(const struct archive *archive)
+{
+    uint32_t version;
+
+    if (archive->size < sizeof(version))
+        return 0;
+    memcpy(&version, archive->data, sizeof(version));
+    return version;
+}
+
+static const struct vkd3d_serialized_pipeline_library_stream *archive_get_stream_header(const struct archive *archive)
+{
+    if (archive->size < sizeof(struct vkd3d_serialized_pipeline_library_stream) ||
+            archive_get_version(archive) != VKD3D_PIPELINE_LIBRARY_VERSION_STREAM)
+    {
+        fprintf(stderr, "'%s' is not a stream archive.\n", archive->path);
+        return NULL;
+    }
+
+    return (const struct vkd3d_serialized_pipeline_library_stream *)archive->data;
+}
+
+struct stream_entry_list
+{
+    const struct vkd3d_serialized_pipeline_stream_entry **entries;
+    size_t count;
+    size_t size;
+    /* Bytes after the last whole entry, i.e. a torn write. */
+    size_t trailing_size;
+};
+
+/* Only walks the framing, checksums are left to the caller. */
+static bool parse_stream_entries(const struct archive *archive, struct stream_entry_list *list)
+{
+    const struct vkd3d_serialized_pipeline_stream_entry *entry;
+    size_t offset, aligned_size;
+
+    memset(list, 0, sizeof(*list));
+    offset = sizeof(struct vkd3d_serialized_pipeline_library_stream);
+
+    if (archive->size < offset)
+    {
+        fprintf(stderr, "'%s' is truncated.\n", archive->path);
+        return false;
+    }
+
+    while (archive->size - offset >= sizeof(*entry))
+    {
+        entry = (const struct vkd3d_serialized_pipeline_stream_entry *)&archive->data[offset];
+        aligned_size = align(entry->size, VKD3D_PIPELINE_BLOB_ALIGN);
+        if (archive->size - offset - sizeof(*entry) < aligned_size)
+            break;
+
+        if (!vkd3d_array_reserve((void **)&list->entries, &list->size, list->count + 1, sizeof(*list->entries)))
+        {
+            fprintf(stderr, "Out of memory.\n");
+            return false;
+        }
+
+        list->entries[list->count++] = entry;
+        offset += sizeof(*entry) + aligned_size;
+    }
+
+    list->trailing_size = archive->size - offset;
+    return true;
+}
+
+static void free_stream_entry_list(struct stream_entry_list *list)
+{
+    vkd3d_free(list->entries);
+    memset(list, 0, sizeof(*list));
+}
+
+/* Returns the uncompressed payload. If the entry is compressed, *allocation must be freed by the caller. */
+static bool stream_entry_get_payload(const struct vkd3d_serialized_pipeline_stream_entry *entry,
+        const uint8_t **data, size_t *size, void **allocation)
+{
+    const struct vkd3d_serialized_pipeline_compressed_blob *compressed;
+
+    *allocation = NULL;
+
+    if (!(entry->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED))
+    {
+        *data = entry->data;
+        *size = entry->size;
+        return true;
+    }
+
+    compressed = (const struct vkd3d_serialized_pipeline_compressed_blob *)entry->data;
+    if (entry->size < sizeof(*compressed) || !(*allocation = vkd3d_malloc(max(compressed->decompressed_size, 1u))))
+        return false;
+
+    if (!vkd3d_lz_decompress(compressed->data, entry->size - sizeof(*compressed),
+            *allocation, compressed->decompressed_size))
+    {
+        vkd3d_free(*allocation);
+        *allocation = NULL;
+        return false;
+    }
+
+    *data = *allocation;
+    *size = compressed->decompressed_size;
+    return true;
+}
+
+static bool stream_entry_validate_cb(void *userdata, size_t index)
+{
+    const struct stream_entry_list *list = userdata;
+    const struct vkd3d_serialized_pipeline_stream_entry *entry = list->entries[index];
+    const uint8_t *data;
+    void *allocation;
+    size_t size;
+
+    if (!vkd3d_serialized_pipeline_stream_entry_validate(entry->data, entry))
+        return false;
+
+    /* A compressed entry with a valid checksum can still be garbage if the writer was broken. */
+    if (entry->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED)
+    {
+        if (!stream_entry_get_payload(entry, &data, &size, &allocation))
+            return false;
+        vkd3d_free(allocation);
+    }
+
+    return true;
+}
+
+/* Returns the number of invalid entries. valid[] receives per-entry results. */
+static size_t validate_stream_entries(const struct stream_entry_list *list, unsigned int thread_count, uint8_t *valid)
+{
+    return run_parallel(thread_count, list->count, VALIDATE_BATCH_SIZE, stream_entry_validate_cb, (void *)list, valid);
+}
+
+/* Entry set keyed by (hash, type), used for de-duplication and reachability. */
+
+static void entry_set_init(struct hash_map *set)
+{
+    hash_map_init(set, vkd3d_serialized_pipeline_entry_hash, vkd3d_serialized_pipeline_entry_compare,
+            sizeof(struct vkd3d_serialized_pipeline_entry));
+}
+
+/* Returns true if the key was not in the set before. */
+static bool entry_set_insert(struct hash_map *set, uint64_t hash, uint32_t type)
+{
+    struct vkd3d_serialized_pipeline_entry e;
+
+    memset(&e, 0, sizeof(e));
+    e.key.hash = hash;
+    e.key.type = type;
+
+    if (hash_map_find(set, &e.key))
+        return false;
+    return !!hash_map_insert(set, &e.key, &e.entry);
+}
+
+static bool entry_set_contains(const struct hash_map *set, uint64_t hash, uint32_t type)
+{
+    struct vkd3d_serialized_pipeline_entry_key key;
+
+    key.hash = hash;
+    key.type = type;
+    return !!hash_map_find(set, &key);
+}
+
+static bool write_stream_entry(FILE *file, const struct vkd3d_serialized_pipeline_stream_entry *entry)
+{
+    size_t aligned_size = align(entry->size, VKD3D_PIPELINE_BLOB_ALIGN);
+
+    /* Padding is part of the archive already, so the entry can be copied verbatim. */
+    return fwrite(entry, 1, sizeof(*entry) + aligned_size, file) == sizeof(*entry) + aligned_size;
+}
+
+/* Commands */
+
+struct options
+{
+    const char *output;
+    unsigned int thread_count;
+    bool has_build;
+    uint64_t build;
+    bool has_interface_key;
+    uint64_t interface_key;
+    char **files;
+    int file_count;
+};
+
+static bool parse_u64(const char *str, uint64_t *value)
+{
+    char *end;
+
+    *value = strtoull(str, &end, 0);
+    return *str && !*end;
+}
+
+static bool parse_options(int argc, char **argv, struct options *options)
+{
+    uint64_t value;
+    int i;
+
+    memset(options, 0, sizeof(*options));
+    options->thread_count = vkd3d_get_cpu_count();
+
+    for (i = 0; i < argc; i++)
+    {
+        if (argv[i][0] != '-')
+            break;
+
+        if (i + 1 >= argc)
+            return false;
+
+        if (!strcmp(argv[i], "-o"))
+            options->output = argv[++i];
+        else if (!strcmp(argv[i], "--threads"))
+        {
+            if (!parse_u64(argv[++i], &value) || !value)
+                return false;
+            options->thread_count = value;
+        }
+        else if (!strcmp(argv[i], "--build"))
+        {
+            if (!parse_u64(argv[++i], &options->build))
+                return false;
+            options->has_build = true;
+        }
+        else if (!strcmp(argv[i], "--interface-key"))
+        {
+            if (!parse_u64(argv[++i], &options->interface_key))
+                return false;
+            options->has_interface_key = true;
+        }
+        else
+            return false;
+    }
+
+    options->files = &argv[i];
+    options->file_count = argc - i;
+    return options->file_count > 0;
+}
+
+static void print_stream_header(const struct vkd3d_serialized_pipeline_library_stream *header)
+{
+    printf("  vendor %#x, device %#x, build %#"PRIx64", interface key %#"PRIx64"\n",
+            header->vendor_id, header->device_id, header->vkd3d_build, header->vkd3d_shader_interface_key);
+}
+
+static bool stats_stream_archive(const struct archive *archive)
+{
+    uint64_t stored_size[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    uint64_t raw_size[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    size_t compressed[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    size_t count[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    const struct vkd3d_serialized_pipeline_compressed_blob *blob;
+    const struct vkd3d_serialized_pipeline_stream_entry *entry;
+    const struct vkd3d_serialized_pipeline_library_stream *header;
+    struct stream_entry_list list;
+    size_t duplicates = 0;
+    struct hash_map set;
+    uint32_t type;
+    size_t i;
+
+    if (!(header = archive_get_stream_header(archive)) || !parse_stream_entries(archive, &list))
+        return false;
+
+    printf("%s: stream archive, %zu bytes\n", archive->path, archive->size);
+    print_stream_header(header);
+
+    entry_set_init(&set);
+    for (i = 0; i < list.count; i++)
+    {
+        entry = list.entries[i];
+        type = min(vkd3d_serialized_pipeline_stream_entry_get_type(entry), STREAM_ENTRY_TYPE_COUNT);
+
+        count[type]++;
+        stored_size[type] += sizeof(*entry) + align(entry->size, VKD3D_PIPELINE_BLOB_ALIGN);
+
+        blob = (const struct vkd3d_serialized_pipeline_compressed_blob *)entry->data;
+        if ((entry->type & VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_FLAG_COMPRESSED) && entry->size >= sizeof(*blob))
+        {
+            compressed[type]++;
+            raw_size[type] += blob->decompressed_size;
+        }
+        else
+            raw_size[type] += entry->size;
+
+        if (!entry_set_insert(&set, entry->hash, type))
+            duplicates++;
+    }
+    hash_map_clear(&set);
+
+    printf("  %-14s %10s %14s %14s %10s\n", "type", "count", "stored bytes", "payload bytes", "compressed");
+    for (i = 0; i <= STREAM_ENTRY_TYPE_COUNT; i++)
+    {
+        if (!count[i])
+            continue;
+        printf("  %-14s %10zu %14"PRIu64" %14"PRIu64" %10zu\n", stream_entry_type_name(i),
+                count[i], stored_size[i], raw_size[i], compressed[i]);
+    }
+
+    if (duplicates)
+        printf("  %zu duplicate entries.\n", duplicates);
+    if (list.trailing_size)
+        printf("  %zu trailing bytes after the last whole entry (torn write).\n", list.trailing_size);
+
+    free_stream_entry_list(&list);
+    return true;
+}
+
+static bool stats_toc_archive(const struct archive *archive)
+{
+    const struct vkd3d_serialized_pipeline_library_toc *header;
+    static const char * const names[] = { "SPIR-V", "driver cache", "PSO" };
+    uint64_t blob_size[ARRAY_SIZE(names)] = {0};
+    uint32_t counts[ARRAY_SIZE(names)];
+    size_t total_entries, i, j, k;
+
+    header = (const struct vkd3d_serialized_pipeline_library_toc *)archive->data;
+    if (archive->size < sizeof(*header))
+        return false;
+
+    counts[0] = header->spirv_count;
+    counts[1] = header->driver_cache_count;
+    counts[2] = header->pipeline_count;
+    total_entries = (size_t)counts[0] + counts[1] + counts[2];
+
+    if (archive->size < sizeof(*header) + total_entries * sizeof(header->entries[0]))
+    {
+        fprintf(stderr, "'%s': TOC is truncated.\n", archive->path);
+        return false;
+    }
+
+    for (i = 0, k = 0; i < ARRAY_SIZE(names); i++)
+        for (j = 0; j < counts[i]; j++)
+            blob_size[i] += header->entries[k++].blob_length;
+
+    printf("%s: pipeline library, %zu bytes\n", archive->path, archive->size);
+    printf("  vendor %#x, device %#x, build %#"PRIx64", interface key %#"PRIx64"\n",
+            header->vendor_id, header->device_id, header->vkd3d_build, header->vkd3d_shader_interface_key);
+    printf("  %-14s %10s %14s\n", "type", "count", "blob bytes");
+    for (i = 0; i < ARRAY_SIZE(names); i++)
+        printf("  %-14s %10u %14"PRIu64"\n", names[i], counts[i], blob_size[i]);
+
+    return true;
+}
+
+static int cmd_stats(const struct options *options)
+{
+    struct archive archive;
+    bool ret = true;
+    int i;
+
+    for (i = 0; i < options->file_count; i++)
+    {
+        if (!read_archive(options->files[i], &archive))
+        {
+            ret = false;
+            continue;
+        }
+
+        switch (archive_get_version(&archive))
+        {
+            case VKD3D_PIPELINE_LIBRARY_VERSION_STREAM:
+                ret &= stats_stream_archive(&archive);
+                break;
+            case VKD3D_PIPELINE_LIBRARY_VERSION_TOC:
+                ret &= stats_toc_archive(&archive);
+                break;
+            default:
+                fprintf(stderr, "'%s': unrecognized or outdated format.\n", archive.path);
+                ret = false;
+                break;
+        }
+
+        free_archive(&archive);
+    }
+
+    return ret ? 0 : 1;
+}
+
+struct toc_blob
+{
+    const uint8_t *data;
+    size_t size;
+    bool is_pipeline;
+};
+
+static bool toc_blob_validate_cb(void *userdata, size_t index)
+{
+    const struct toc_blob *blob = &((const struct toc_blob *)userdata)[index];
+    const struct vkd3d_pipeline_blob_internal *internal;
+    const struct vkd3d_pipeline_blob *pipeline;
+
+    if (blob->is_pipeline)
+    {
+        pipeline = (const struct vkd3d_pipeline_blob *)blob->data;
+        return blob->size >= sizeof(*pipeline) && pipeline->version == VKD3D_CACHE_BLOB_VERSION &&
+                pipeline->checksum == vkd3d_pipeline_blob_compute_data_checksum(pipeline->data,
+                        blob->size - sizeof(*pipeline));
+    }
+
+    internal = (const struct vkd3d_pipeline_blob_internal *)blob->data;
+    return blob->size >= sizeof(*internal) &&
+            internal->checksum == vkd3d_pipeline_blob_compute_data_checksum(internal->data,
+                    blob->size - sizeof(*internal));
+}
+
+static bool verify_toc_archive(const struct archive *archive, unsigned int thread_count)
+{
+    const struct vkd3d_serialized_pipeline_library_toc *header;
+    const struct vkd3d_serialized_pipeline_toc_entry *entry;
+    size_t total_entries, data_size, i;
+    struct toc_blob *blobs;
+    const uint8_t *base;
+    uint8_t *valid;
+    size_t failed;
+
+    header = (const struct vkd3d_serialized_pipeline_library_toc *)archive->data;
+    if (archive->size < sizeof(*header))
+        return false;
+
+    total_entries = (size_t)header->spirv_count + header->driver_cache_count + header->pipeline_count;
+    if (archive->size < sizeof(*header) + total_entries * sizeof(*entry))
+    {
+        printf("%s: TOC is truncated.\n", archive->path);
+        return false;
+    }
+
+    base = (const uint8_t *)&header->entries[total_entries];
+    data_size = archive->size - sizeof(*header) - total_entries * sizeof(*entry);
+
+    blobs = vkd3d_calloc(max(total_entries, 1), sizeof(*blobs));
+    valid = vkd3d_calloc(max(total_entries, 1), sizeof(*valid));
+    if (!blobs || !valid)
+    {
+        vkd3d_free(blobs);
+        vkd3d_free(valid);
+        return false;
+    }
+
+    for (i = 0; i < total_entries; i++)
+    {
+        entry = &header->entries[i];
+        if (entry->blob_offset > data_size || entry->blob_length > data_size - entry->blob_offset)
+        {
+            printf("%s: entry %zu is out of bounds.\n", archive->path, i);
+            vkd3d_free(blobs);
+            vkd3d_free(valid);
+            return false;
+        }
+
+        blobs[i].data = base + entry->blob_offset;
+        blobs[i].size = entry->blob_length;
+        blobs[i].is_pipeline = i >= (size_t)header->spirv_count + header->driver_cache_count;
+    }
+
+    failed = run_parallel(thread_count, total_entries, VALIDATE_BATCH_SIZE, toc_blob_validate_cb, blobs, valid);
+    printf("%s: %zu entries, %zu corrupt.\n", archive->path, total_entries, failed);
+
+    vkd3d_free(blobs);
+    vkd3d_free(valid);
+    return !failed;
+}
+
+static bool verify_stream_archive(const struct archive *archive, unsigned int thread_count)
+{
+    struct stream_entry_list list;
+    size_t failed, i;
+    uint8_t *valid;
+
+    if (!parse_stream_entries(archive, &list))
+        return false;
+
+    if (!(valid = vkd3d_calloc(max(list.count, 1), sizeof(*valid))))
+    {
+        free_stream_entry_list(&list);
+        return false;
+    }
+
+    failed = validate_stream_entries(&list, thread_count, valid);
+
+    for (i = 0; i < list.count; i++)
+    {
+        if (!valid[i])
+        {
+            printf("%s: corrupt %s entry %016"PRIx64" at offset %zu.\n", archive->path,
+                    stream_entry_type_name(vkd3d_serialized_pipeline_stream_entry_get_type(list.entries[i])),
+                    list.entries[i]->hash, (size_t)((const uint8_t *)list.entries[i] - archive->data));
+        }
+    }
+
+    printf("%s: %zu entries, %zu corrupt", archive->path, list.count, failed);
+    if (list.trailing_size)
+        printf(", %zu bytes of torn data at the end", list.trailing_size);
+    printf(".\n");
+
+    vkd3d_free(valid);
+    free_stream_entry_list(&list);
+    return !failed;
+}
+
+static int cmd_verify(const struct options *options)
+{
+    struct archive archive;
+    bool ret = true;
+    double start;
+    int i;
+
+    start = get_time();
+
+    for (i = 0; i < options->file_count; i++)
+    {
+        if (!read_archive(options->files[i], &archive))
+        {
+            ret = false;
+            continue;
+        }
+
+        switch (archive_get_version(&archive))
+        {
+            case VKD3D_PIPELINE_LIBRARY_VERSION_STREAM:
+                ret &= verify_stream_archive(&archive, options->thread_count);
+                break;
+            case VKD3D_PIPELINE_LIBRARY_VERSION_TOC:
+                ret &= verify_toc_archive(&archive, options->thread_count);
+                break;
+            default:
+                fprintf(stderr, "'%s': unrecognized or outdated format.\n", archive.path);
+                ret = false;
+                break;
+        }
+
+        free_archive(&archive);
+    }
+
+    printf("Verified %d files in %.3f s using %u threads.\n", options->file_count,
+            get_time() - start, options->thread_count);
+    return ret ? 0 : 1;
+}
+
+static bool stream_headers_match(const struct vkd3d_serialized_pipeline_library_stream *a,
+        const struct vkd3d_serialized_pipeline_library_stream *b)
+{
+    return a->vendor_id == b->vendor_id && a->device_id == b->device_id &&
+            a->vkd3d_build == b->vkd3d_build &&
+            a->vkd3d_shader_interface_key == b->vkd3d_shader_interface_key &&
+            !memcmp(a->cache_uuid, b->cache_uuid, sizeof(a->cache_uuid));
+}
+
+static int cmd_merge(const struct options *options)
+{
+    struct vkd3d_serialized_pipeline_library_stream merged_header;
+    const struct vkd3d_serialized_pipeline_library_stream *header;
+    const struct vkd3d_serialized_pipeline_stream_entry *entry;
+    size_t new_entries = 0, total_entries = 0, i;
+    struct stream_entry_list list;
+    bool has_header = false;
+    struct archive archive;
+    struct hash_map set;
+    uint8_t *valid;
+    bool ret = true;
+    uint32_t type;
+    FILE *file;
+    int j;
+
+    if (!options->output)
+    {
+        fprintf(stderr, "merge requires an output file.\n");
+        return 1;
+    }
+
+    if (!(file = fopen(options->output, "wb")))
+    {
+        fprintf(stderr, "Cannot open file for writing: '%s'.\n", options->output);
+        return 1;
+    }
+
+    entry_set_init(&set);
+
+    for (j = 0; j < options->file_count; j++)
+    {
+        if (!read_archive(options->files[j], &archive))
+        {
+            ret = false;
+            continue;
+        }
+
+        if (!(header = archive_get_stream_header(&archive)))
+        {
+            free_archive(&archive);
+            ret = false;
+            continue;
+        }
+
+        /* The library discards a whole archive on header mismatch, so mixing builds or devices is pointless. */
+        if (!has_header)
+        {
+            merged_header = *header;
+            if (fwrite(&merged_header, sizeof(merged_header), 1, file) != 1)
+            {
+                fprintf(stderr, "Failed to write archive header.\n");
+                free_archive(&archive);
+                ret = false;
+                break;
+            }
+            has_header = true;
+        }
+        else if (!stream_headers_match(&merged_header, header))
+        {
+            fprintf(stderr, "'%s' was written by a different build or device, skipping.\n", archive.path);
+            free_archive(&archive);
+            ret = false;
+            continue;
+        }
+
+        if (!parse_stream_entries(&archive, &list) ||
+                !(valid = vkd3d_calloc(max(list.count, 1), sizeof(*valid))))
+        {
+            free_stream_entry_list(&list);
+            free_archive(&archive);
+            ret = false;
+            continue;
+        }
+
+        validate_stream_entries(&list, options->thread_count, valid);
+
+        for (i = 0; i < list.count; i++)
+        {
+            entry = list.entries[i];
+            type = vkd3d_serialized_pipeline_stream_entry_get_type(entry);
+
+            /* Same as the library, an archive is only trusted up to its first corrupt entry. */
+            if (!valid[i])
+            {
+                fprintf(stderr, "'%s': corrupt entry, ignoring rest of archive.\n", archive.path);
+                break;
+            }
+
+            /* Use records only matter to the library's own LRU index. */
+            if (type == VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE)
+                continue;
+
+            total_entries++;
+            if (!entry_set_insert(&set, entry->hash, type))
+                continue;
+
+            if (!write_stream_entry(file, entry))
+            {
+                fprintf(stderr, "Failed to write to '%s'.\n", options->output);
+                ret = false;
+                break;
+            }
+            new_entries++;
+        }
+
+        vkd3d_free(valid);
+        free_stream_entry_list(&list);
+        free_archive(&archive);
+    }
+
+    hash_map_clear(&set);
+
+    if (fclose(file) != 0)
+        ret = false;
+
+    printf("Merged %zu entries, %zu unique, into '%s'.\n", total_entries, new_entries, options->output);
+    return ret ? 0 : 1;
+}
+
+static bool pipeline_blob_matches(const uint8_t *data, size_t size, uint64_t build, uint64_t interface_key)
+{
+    const struct vkd3d_pipeline_blob *blob = (const struct vkd3d_pipeline_blob *)data;
+
+    return size >= sizeof(*blob) && blob->version == VKD3D_CACHE_BLOB_VERSION &&
+            blob->vkd3d_build == build && blob->vkd3d_shader_interface_key == interface_key;
+}
+
+static int cmd_prune(const struct options *options)
+{
+    size_t kept[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    size_t dropped[STREAM_ENTRY_TYPE_COUNT + 1] = {0};
+    struct vkd3d_serialized_pipeline_entry_key pipeline_links[VKD3D_PIPELINE_BLOB_MAX_LINKS];
+    const struct vkd3d_serialized_pipeline_library_stream *header;
+    const struct vkd3d_serialized_pipeline_stream_entry *entry;
+    uint64_t build, interface_key, pso_hash;
+    struct hash_map kept_pipelines, links, written;
+    struct stream_entry_list list;
+    struct archive archive;
+    uint8_t *keep = NULL;
+    size_t i, j, size, link_count;
+    const uint8_t *data;
+    void *allocation;
+    bool ret = true;
+    uint32_t type;
+    FILE *file;
+
+    if (!options->output || options->file_count != 1)
+    {
+        fprintf(stderr, "prune requires an output file and exactly one archive.\n");
+        return 1;
+    }
+
+    if (!read_archive(options->files[0], &archive))
+        return 1;
+
+    if (!(header = archive_get_stream_header(&archive)) || !parse_stream_entries(&archive, &list))
+    {
+        free_archive(&archive);
+        return 1;
+    }
+
+    /* By default, drop PSOs which would be rejected when loading this archive. */
+    build = options->has_build ? options->build : header->vkd3d_build;
+    interface_key = options->has_interface_key ? options->interface_key : header->vkd3d_shader_interface_key;
+
+    entry_set_init(&kept_pipelines);
+    entry_set_init(&links);
+    entry_set_init(&written);
+
+    if (!(keep = vkd3d_calloc(max(list.count, 1), sizeof(*keep))))
+    {
+        ret = false;
+        goto out;
+    }
+
+    validate_stream_entries(&list, options->thread_count, keep);
+
+    /* Truncate at the first corrupt entry, and find which PSOs survive. */
+    for (i = 0; i < list.count; i++)
+    {
+        if (!keep[i])
+        {
+            memset(&keep[i], 0, list.count - i);
+            break;
+        }
+
+        entry = list.entries[i];
+        if (vkd3d_serialized_pipeline_stream_entry_get_type(entry) != VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE)
+            continue;
+
+        if (!stream_entry_get_payload(entry, &data, &size, &allocation) ||
+                !pipeline_blob_matches(data, size, build, interface_key))
+            keep[i] = 0;
+        else if (entry_set_insert(&kept_pipelines, entry->hash, VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE))
+        {
+            link_count = vkd3d_pipeline_blob_get_links(data, size, pipeline_links);
+            for (j = 0; j < link_count; j++)
+                entry_set_insert(&links, pipeline_links[j].hash, pipeline_links[j].type);
+        }
+        else
+            keep[i] = 0;
+
+        vkd3d_free(allocation);
+    }
+
+    /* Drop everything no surviving PSO refers to. */
+    for (i = 0; i < list.count; i++)
+    {
+        if (!keep[i])
+            continue;
+
+        entry = list.entries[i];
+        switch ((type = vkd3d_serialized_pipeline_stream_entry_get_type(entry)))
+        {
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_SPIRV:
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_DRIVER_CACHE:
+                if (!entry_set_contains(&links, entry->hash, type) || !entry_set_insert(&written, entry->hash, type))
+                    keep[i] = 0;
+                break;
+
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_VARIANT:
+                /* Payload starts with the hash of the PSO it belongs to. */
+                keep[i] = 0;
+                if (stream_entry_get_payload(entry, &data, &size, &allocation))
+                {
+                    if (size >= sizeof(pso_hash))
+                    {
+                        memcpy(&pso_hash, data, sizeof(pso_hash));
+                        keep[i] = entry_set_contains(&kept_pipelines, pso_hash,
+                                VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE) &&
+                                entry_set_insert(&written, entry->hash, type);
+                    }
+                    vkd3d_free(allocation);
+                }
+                break;
+
+            case VKD3D_SERIALIZED_PIPELINE_STREAM_ENTRY_PIPELINE_USE:
+                keep[i] = 0;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (!(file = fopen(options->output, "wb")))
+    {
+        fprintf(stderr, "Cannot open file for writing: '%s'.\n", options->output);
+        ret = false;
+        goto out;
+    }
+
+    if (fwrite(header, sizeof(*header), 1, file) != 1)
+        ret = false;
+
+    for (i = 0; i < list.count && ret; i++)
+    {
+        type = min(vkd3d_serialized_pipeline_stream_entry_get_type(list.entries[i]), STREAM_ENTRY_TYPE_COUNT);
+        if (keep[i])
+        {
+            kept[type]++;
+            if (!write_stream_entry(file, list.entries[i]))
+                ret = false;
+        }
+        else
+            dropped[type]++;
+    }
+
+    if (fclose(file) != 0 || !ret)
+    {
+        fprintf(stderr, "Failed to write to '%s'.\n", options->output);
+        ret = false;
+        goto out;
+    }
+
+    printf("%s -> %s\n", archive.path, options->output);
+    for (i = 0; i <= STREAM_ENTRY_TYPE_COUNT; i++)
+    {
+        if (kept[i] || dropped[i])
+            printf("  %-14s kept %zu, dropped %zu\n", stream_entry_type_name(i), kept[i], dropped[i]);
+    }
+
+out:
+    hash_map_clear(&kept_pipelines);
+    hash_map_clear(&links);
+    hash_map_clear(&written);
+    vkd3d_free(keep);
+    free_stream_entry_list(&list);
+    free_archive(&archive);
+    return ret ? 0 : 1;
+}
+
+struct compile_context
+{
+    char **files;
+    const char *output_dir;
+};
+
+static bool write_file(const char *path, const void *data, size_t size)
+{
+    bool ret;
+    FILE *file;
+
+    if (!(file = fopen(path, "wb")))
+        return false;
+    ret = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ret;
+}
+
+/* Finds the program chunk of a DXBC container. The program version token is laid out
+ * the same way for SM4+ bytecode and DXIL, with the program type in the upper 16 bits. */
+static bool dxbc_get_program_info(const uint8_t *data, size_t size, bool *is_dxil, VkShaderStageFlagBits *stage)
+{
+    uint32_t chunk_count, chunk_offset, chunk_tag, chunk_size, version;
+    uint32_t i;
+
+    if (size < 8 * sizeof(uint32_t))
+        return false;
+
+    memcpy(&chunk_tag, data, sizeof(chunk_tag));
+    if (chunk_tag != MAKE_MAGIC('D', 'X', 'B', 'C'))
+        return false;
+
+    memcpy(&chunk_count, data + 7 * sizeof(uint32_t), sizeof(chunk_count));
+    if (chunk_count > (size - 8 * sizeof(uint32_t)) / sizeof(uint32_t))
+        return false;
+
+    for (i = 0; i < chunk_count; i++)
+    {
+        memcpy(&chunk_offset, data + (8 + i) * sizeof(uint32_t), sizeof(chunk_offset));
+        if (chunk_offset > size || size - chunk_offset < 3 * sizeof(uint32_t))
+            return false;
+
+        memcpy(&chunk_tag, data + chunk_offset, sizeof(chunk_tag));
+        memcpy(&chunk_size, data + chunk_offset + sizeof(uint32_t), sizeof(chunk_size));
+        if (chunk_size < sizeof(version) || size - chunk_offset - 2 * sizeof(uint32_t) < chunk_size)
+            return false;
+
+        if (chunk_tag != MAKE_MAGIC('D', 'X', 'I', 'L') &&
+                chunk_tag != MAKE_MAGIC('S', 'H', 'D', 'R') &&
+                chunk_tag != MAKE_MAGIC('S', 'H', 'E', 'X'))
+            continue;
+
+        *is_dxil = chunk_tag == MAKE_MAGIC('D', 'X', 'I', 'L');
+        memcpy(&version, data + chunk_offset + 2 * sizeof(uint32_t), sizeof(version));
+
+        switch (version >> 16)
+        {
+            case 0: *stage = VK_SHADER_STAGE_FRAGMENT_BIT; return true;
+            case 1: *stage = VK_SHADER_STAGE_VERTEX_BIT; return true;
+            case 2: *stage = VK_SHADER_STAGE_GEOMETRY_BIT; return true;
+            case 3: *stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; return true;
+            case 4: *stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; return true;
+            case 5: *stage = VK_SHADER_STAGE_COMPUTE_BIT; return true;
+            case 13: *stage = VK_SHADER_STAGE_MESH_BIT_EXT; return true;
+            case 14: *stage = VK_SHADER_STAGE_TASK_BIT_EXT; return true;
+            default: return false;
+        }
+    }
+
+    return false;
+}
+
+static bool compile_cb(void *userdata, size_t index)
+{
+    struct vkd3d_shader_interface_info shader_interface;
+    const struct compile_context *ctx = userdata;
+    const char *path = ctx->files[index];
+    char output_path[VKD3D_PATH_MAX];
+    struct vkd3d_shader_code dxbc, spirv;
+    VkShaderStageFlagBits stage;
+    const char *name, *sep;
+    bool is_dxil;
+    uint8_t *data;
+    size_t size;
+    int ret;
+
+    if (!read_file(path, &data, &size))
+        return false;
+
+    if (!dxbc_get_program_info(data, size, &is_dxil, &stage))
+    {
+        fprintf(stderr, "'%s' is not a DXBC container with a supported shader stage.\n", path);
+        vkd3d_free(data);
+        return false;
+    }
+
+    memset(&dxbc, 0, sizeof(dxbc));
+    memset(&spirv, 0, sizeof(spirv));
+    dxbc.code = data;
+    dxbc.size = size;
+
+    /* DXIL is dispatched to dxil-spirv internally, which needs to know the stage.
+     * There is no root signature here, so only DXIL shaders without resource bindings can be compiled. */
+    memset(&shader_interface, 0, sizeof(shader_interface));
+    shader_interface.stage = stage;
+    ret = vkd3d_shader_compile_dxbc(&dxbc, &spirv, 0, is_dxil ? &shader_interface : NULL, NULL);
+    vkd3d_free(data);
+
+    if (ret < 0)
+    {
+        if (is_dxil)
+            fprintf(stderr, "Failed to compile DXIL shader '%s', ret %d. Shaders which access resources need a root signature.\n", path, ret);
+        else
+            fprintf(stderr, "Failed to compile '%s', ret %d.\n", path, ret);
+        return false;
+    }
+
+    if (ctx->output_dir)
+    {
+        name = path;
+        if ((sep = strrchr(name, '/')))
+            name = sep + 1;
+        if ((sep = strrchr(name, '\\')))
+            name = sep + 1;
+
+        snprintf(output_path, sizeof(output_path), "%s/%s.spv", ctx->output_dir, name);
+        if (!write_file(output_path, spirv.code, spirv.size))
+        {
+            fprintf(stderr, "Could not write '%s'.\n", output_path);
+            vkd3d_shader_free_shader_code(&spirv);
+            return false;
+        }
+    }
+
+    vkd3d_shader_free_shader_code(&spirv);
+    return true;
+}
+
+static int cmd_compile(const struct options *options)
+{
+    struct compile_context ctx;
+    uint8_t *results;
+    double start;
+    size_t failed;
+
+    if (!(results = vkd3d_calloc(options->file_count, sizeof(*results))))
+        return 1;
+
+    ctx.files = options->files;
+    ctx.output_dir = options->output;
+
+    start = get_time();
+    failed = run_parallel(options->thread_count, options->file_count, 1, compile_cb, &ctx, results);
+
+    printf("Compiled %d shaders in %.3f s using %u threads, %zu failed.\n", options->file_count,
+            get_time() - start, options->thread_count, failed);
+
+    vkd3d_free(results);
+    return failed ? 1 : 0;
+}
+
+static const struct
+{
+    const char *name;
+    int (*func)(const struct options *options);
+    const char *usage;
+}
+commands[] =
+{
+    {"stats", cmd_stats, "<archive>...\n"
+            "    Prints entry counts and sizes per type."},
+    {"verify", cmd_verify, "[--threads <n>] <archive>...\n"
+            "    Validates all checksums and compressed payloads."},
+    {"merge", cmd_merge, "[--threads <n>] -o <output> <archive>...\n"
+            "    Merges stream archives from the same build and device, dropping duplicates."},
+    {"prune", cmd_prune, "[--threads <n>] [--build <key>] [--interface-key <key>] -o <output> <archive>\n"
+            "    Drops PSOs from other builds or shader interfaces (default: the archive's own),\n"
+            "    and any SPIR-V, driver cache or variant entry no remaining PSO refers to."},
+    {"compile", cmd_compile, "[--threads <n>] [-o <directory>] <dxbc or dxil>...\n"
+            "    Compiles shaders to SPIR-V in parallel."},
+};
+
+static void print_usage(const char *program_name)
+{
+    unsigned int i;
+
+    fprintf(stderr, "usage: %s <command> [options]\n", program_name);
+    for (i = 0; i < ARRAY_SIZE(commands); i++)
+        fprintf(stderr, "  %s %s\n", commands[i].name, commands[i].usage);
+}
+
+int main(int argc, char **argv)
+{
+    struct options options;
+    unsigned int i;
+
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(commands); i++)
+    {
+        if (!strcmp(argv[1], commands[i].name))
+        {
+            if (!parse_options(argc - 2, argv + 2, &options))
+            {
+                print_usage(argv[0]);
+                return 1;
+            }
+
+            return commands[i].func(&options);
+        }
+    }
+
+    print_usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Simulates bundle allocators recording and resetting through vkd3d_chunk_pool_recycle(),
+ * and compares that to allocating every chunk from the heap. Fails if recording still hits
+ * the heap once all allocators have reached their steady state. The real bundle allocator
+ * is covered by test_bundle_allocator_steady_state in the d3d12 tests. */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_chunk_pool.h"
+#include "vkd3d_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define CHUNK_SIZE (256 << 10)
+#define ALLOCATOR_COUNT 16
+#define MAX_SHARED_CHUNKS 64
+#define MAX_CHUNKS_PER_RECORDING 8
+#define WARMUP_ITERATIONS 16
+#define ITERATIONS 4096
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+struct allocator
+{
+    void *chunks[MAX_CHUNKS_PER_RECORDING];
+    size_t chunks_count;
+    struct vkd3d_chunk_pool free_chunks;
+};
+
+static void *allocator_alloc_chunk(struct allocator *allocator, struct vkd3d_chunk_pool *shared_pool)
+{
+    void *chunk;
+
+    if (!(chunk = vkd3d_chunk_pool_take(&allocator->free_chunks)))
+        chunk = vkd3d_chunk_pool_alloc(shared_pool);
+
+    return allocator->chunks[allocator->chunks_count++] = chunk;
+}
+
+static void allocator_reset(struct allocator *allocator, struct vkd3d_chunk_pool *shared_pool)
+{
+    /* Same trimming as d3d12_bundle_allocator_recycle_chunks(). */
+    vkd3d_chunk_pool_recycle(&allocator->free_chunks, allocator->chunks, allocator->chunks_count,
+            shared_pool, NULL);
+    allocator->chunks_count = 0;
+}
+
+static size_t get_chunk_count(unsigned int allocator_index)
+{
+    /* Each allocator records bundles of a fixed size, but sizes vary between allocators. */
+    return 1 + allocator_index % MAX_CHUNKS_PER_RECORDING;
+}
+
+static void record(void *chunk)
+{
+    /* Touch the chunk like command recording would. */
+    memset(chunk, 0, 4096);
+}
+
+static double run_heap(void)
+{
+    void *chunks[MAX_CHUNKS_PER_RECORDING];
+    unsigned int i, j;
+    double start;
+    size_t k;
+
+    start = get_time();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        for (j = 0; j < ALLOCATOR_COUNT; j++)
+        {
+            for (k = 0; k < get_chunk_count(j); k++)
+                record(chunks[k] = vkd3d_malloc(CHUNK_SIZE));
+            for (k = 0; k < get_chunk_count(j); k++)
+                vkd3d_free(chunks[k]);
+        }
+    }
+
+    return get_time() - start;
+}
+
+static double run_pool(size_t *steady_state_heap_allocs)
+{
+    struct allocator allocators[ALLOCATOR_COUNT];
+    struct vkd3d_chunk_pool shared_pool;
+    size_t warm_heap_alloc_count = 0;
+    unsigned int i, j;
+    double start = 0.0;
+    size_t k;
+
+    memset(allocators, 0, sizeof(allocators));
+    for (j = 0; j < ALLOCATOR_COUNT; j++)
+        vkd3d_chunk_pool_init(&allocators[j].free_chunks, CHUNK_SIZE, SIZE_MAX);
+    vkd3d_chunk_pool_init(&shared_pool, CHUNK_SIZE, MAX_SHARED_CHUNKS);
+
+    for (i = 0; i < WARMUP_ITERATIONS + ITERATIONS; i++)
+    {
+        if (i == WARMUP_ITERATIONS)
+        {
+            warm_heap_alloc_count = shared_pool.heap_alloc_count;
+            start = get_time();
+        }
+
+        for (j = 0; j < ALLOCATOR_COUNT; j++)
+        {
+            for (k = 0; k < get_chunk_count(j); k++)
+                record(allocator_alloc_chunk(&allocators[j], &shared_pool));
+            allocator_reset(&allocators[j], &shared_pool);
+        }
+    }
+
+    start = get_time() - start;
+    *steady_state_heap_allocs = shared_pool.heap_alloc_count - warm_heap_alloc_count;
+
+    for (j = 0; j < ALLOCATOR_COUNT; j++)
+        vkd3d_chunk_pool_cleanup(&allocators[j].free_chunks);
+    vkd3d_chunk_pool_cleanup(&shared_pool);
+    return start;
+}
+
+int main(int argc, char **argv)
+{
+    size_t steady_state_heap_allocs;
+    double heap_time, pool_time;
+    unsigned int recordings;
+
+    recordings = ITERATIONS * ALLOCATOR_COUNT;
+    heap_time = run_heap();
+    pool_time = run_pool(&steady_state_heap_allocs);
+
+    printf("Heap: %8.3f us per recording.\n", 1e6 * heap_time / recordings);
+    printf("Pool: %8.3f us per recording (%5.1fx), %zu heap allocations in steady state.\n",
+            1e6 * pool_time / recordings, heap_time / pool_time, steady_state_heap_allocs);
+
+    if (steady_state_heap_allocs)
+    {
+        printf("Expected no heap allocations in steady state.\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -21,6 +21,7 @@
 
 #define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
 #include "d3d12_crosstest.h"
+#include "vkd3d_bundle_stats.h"
 
 void test_set_render_targets(void)
 {
@@ -58,6 +59,268 @@ void test_set_render_targets(void)
     destroy_test_context(&context);
 }
 
+void test_redundant_render_target_rebind(void)
+{
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC pso_desc;
+    ID3D12GraphicsCommandList *command_list;
+    D3D12_CPU_DESCRIPTOR_HANDLE rtv, rtv2;
+    struct depth_stencil_resource ds;
+    D3D12_CLEAR_VALUE clear_value;
+    ID3D12DescriptorHeap *rtv_heap;
+    struct test_context_desc desc;
+    struct test_context context;
+    ID3D12CommandQueue *queue;
+    ID3D12Resource *rt2;
+    HRESULT hr;
+
+    static const DWORD ps_color_code[] =
+    {
+#if 0
+        float4 color;
+
+        float4 main(float4 position : SV_POSITION) : SV_Target
+        {
+            return color;
+        }
+#endif
+        0x43425844, 0xd18ead43, 0x8b8264c1, 0x9c0a062d, 0xfc843226, 0x00000001, 0x000000e0, 0x00000003,
+        0x0000002c, 0x00000060, 0x00000094, 0x4e475349, 0x0000002c, 0x00000001, 0x00000008, 0x00000020,
+        0x00000000, 0x00000001, 0x00000003, 0x00000000, 0x0000000f, 0x505f5653, 0x5449534f, 0x004e4f49,
+        0x4e47534f, 0x0000002c, 0x00000001, 0x00000008, 0x00000020, 0x00000000, 0x00000000, 0x00000003,
+        0x00000000, 0x0000000f, 0x545f5653, 0x65677261, 0xabab0074, 0x58454853, 0x00000044, 0x00000050,
+        0x00000011, 0x0100086a, 0x04000059, 0x00208e46, 0x00000000, 0x00000001, 0x03000065, 0x001020f2,
+        0x00000000, 0x06000036, 0x001020f2, 0x00000000, 0x00208e46, 0x00000000, 0x00000000, 0x0100003e,
+    };
+    static const D3D12_SHADER_BYTECODE ps_color = {ps_color_code, sizeof(ps_color_code)};
+    static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    static const struct vec4 green = {0.0f, 1.0f, 0.0f, 1.0f};
+    static const struct vec4 blue = {0.0f, 0.0f, 1.0f, 1.0f};
+    static const struct vec4 red = {1.0f, 0.0f, 0.0f, 1.0f};
+
+    memset(&desc, 0, sizeof(desc));
+    desc.no_root_signature = true;
+    if (!init_test_context(&context, &desc))
+        return;
+    command_list = context.list;
+    queue = context.queue;
+
+    clear_value.Format = DXGI_FORMAT_D32_FLOAT;
+    clear_value.DepthStencil.Depth = 1.0f;
+    clear_value.DepthStencil.Stencil = 0;
+    init_depth_stencil(&ds, context.device, 32, 32, 1, 1, DXGI_FORMAT_D32_FLOAT, 0, &clear_value);
+
+    context.root_signature = create_32bit_constants_root_signature(context.device,
+            0, 4, D3D12_SHADER_VISIBILITY_PIXEL);
+
+    init_pipeline_state_desc(&pso_desc, context.root_signature,
+            context.render_target_desc.Format, NULL, &ps_color, NULL);
+    pso_desc.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+    pso_desc.DepthStencilState.DepthEnable = true;
+    pso_desc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
+    pso_desc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
+    hr = ID3D12Device_CreateGraphicsPipelineState(context.device, &pso_desc,
+            &IID_ID3D12PipelineState, (void **)&context.pipeline_state);
+    ok(hr == S_OK, "Failed to create graphics pipeline state, hr %#x.\n", hr);
+
+    rt2 = create_default_texture(context.device, 32, 32, context.render_target_desc.Format,
+            D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+    rtv_heap = create_cpu_descriptor_heap(context.device, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, 2);
+    rtv = get_cpu_rtv_handle(&context, rtv_heap, 0);
+    rtv2 = get_cpu_rtv_handle(&context, rtv_heap, 1);
+    ID3D12Device_CreateRenderTargetView(context.device, context.render_target, NULL, rtv);
+    ID3D12Device_CreateRenderTargetView(context.device, rt2, NULL, rtv2);
+
+    ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, rtv, white, 0, NULL);
+    ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, rtv2, white, 0, NULL);
+    ID3D12GraphicsCommandList_ClearDepthStencilView(command_list, ds.dsv_handle,
+            D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, NULL);
+
+    ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &rtv, false, &ds.dsv_handle);
+    ID3D12GraphicsCommandList_SetGraphicsRootSignature(command_list, context.root_signature);
+    ID3D12GraphicsCommandList_SetPipelineState(command_list, context.pipeline_state);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(command_list, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    set_viewport(&context.viewport, 0.0f, 0.0f, 32.0f, 32.0f, 0.5f, 0.5f);
+    ID3D12GraphicsCommandList_RSSetViewports(command_list, 1, &context.viewport);
+    ID3D12GraphicsCommandList_RSSetScissorRects(command_list, 1, &context.scissor_rect);
+    ID3D12GraphicsCommandList_SetGraphicsRoot32BitConstants(command_list, 0, 4, &red.x, 0);
+    ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+
+    /* Binding the same attachments again between draws. */
+    ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &rtv, false, &ds.dsv_handle);
+    ID3D12GraphicsCommandList_SetGraphicsRoot32BitConstants(command_list, 0, 4, &green.x, 0);
+    ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+
+    /* The handle is the same, but the descriptor behind it now points to another resource. */
+    ID3D12Device_CreateRenderTargetView(context.device, rt2, NULL, rtv);
+    ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &rtv, false, &ds.dsv_handle);
+    ID3D12GraphicsCommandList_SetGraphicsRoot32BitConstants(command_list, 0, 4, &blue.x, 0);
+    ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+
+    transition_resource_state(command_list, context.render_target,
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    check_sub_resource_uint(context.render_target, 0, queue, command_list, 0xff00ff00, 0);
+    reset_command_list(command_list, context.allocator);
+    transition_resource_state(command_list, rt2,
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    check_sub_resource_uint(rt2, 0, queue, command_list, 0xffff0000, 0);
+    reset_command_list(command_list, context.allocator);
+    transition_resource_state(command_list, ds.texture,
+            D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    check_sub_resource_float(ds.texture, 0, queue, command_list, 0.5f, 1);
+
+    ID3D12DescriptorHeap_Release(rtv_heap);
+    ID3D12Resource_Release(rt2);
+    destroy_depth_stencil(&ds);
+    destroy_test_context(&context);
+}
+
+void test_redundant_root_arguments(void)
+{
+    D3D12_CONSTANT_BUFFER_VIEW_DESC cbv_desc;
+    D3D12_ROOT_SIGNATURE_DESC root_signature_desc;
+    ID3D12PipelineState *pso_const, *pso_table;
+    ID3D12RootSignature *rs_const, *rs_table;
+    D3D12_DESCRIPTOR_RANGE descriptor_range;
+    ID3D12GraphicsCommandList *command_list;
+    D3D12_ROOT_PARAMETER root_parameter;
+    D3D12_GPU_DESCRIPTOR_HANDLE table;
+    struct test_context_desc desc;
+    struct test_context context;
+    struct resource_readback rb;
+    ID3D12DescriptorHeap *heap;
+    ID3D12CommandQueue *queue;
+    D3D12_VIEWPORT viewport;
+    ID3D12Resource *cb;
+    unsigned int i;
+    uint8_t *ptr;
+    HRESULT hr;
+
+    static const DWORD ps_color_code[] =
+    {
+#if 0
+        float4 color;
+
+        float4 main(float4 position : SV_POSITION) : SV_Target
+        {
+            return color;
+        }
+#endif
+        0x43425844, 0xd18ead43, 0x8b8264c1, 0x9c0a062d, 0xfc843226, 0x00000001, 0x000000e0, 0x00000003,
+        0x0000002c, 0x00000060, 0x00000094, 0x4e475349, 0x0000002c, 0x00000001, 0x00000008, 0x00000020,
+        0x00000000, 0x00000001, 0x00000003, 0x00000000, 0x0000000f, 0x505f5653, 0x5449534f, 0x004e4f49,
+        0x4e47534f, 0x0000002c, 0x00000001, 0x00000008, 0x00000020, 0x00000000, 0x00000000, 0x00000003,
+        0x00000000, 0x0000000f, 0x545f5653, 0x65677261, 0xabab0074, 0x58454853, 0x00000044, 0x00000050,
+        0x00000011, 0x0100086a, 0x04000059, 0x00208e46, 0x00000000, 0x00000001, 0x03000065, 0x001020f2,
+        0x00000000, 0x06000036, 0x001020f2, 0x00000000, 0x00208e46, 0x00000000, 0x00000000, 0x0100003e,
+    };
+    static const D3D12_SHADER_BYTECODE ps_color = {ps_color_code, sizeof(ps_color_code)};
+    static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    static const struct vec4 green = {0.0f, 1.0f, 0.0f, 1.0f};
+    static const struct vec4 blue = {0.0f, 0.0f, 1.0f, 1.0f};
+    static const struct vec4 red = {1.0f, 0.0f, 0.0f, 1.0f};
+    static const unsigned int expected_colors[] = {0xff00ff00, 0xffff0000, 0xff00ff00, 0xffff0000};
+
+    memset(&desc, 0, sizeof(desc));
+    desc.rt_width = ARRAY_SIZE(expected_colors);
+    desc.rt_height = 1;
+    desc.no_root_signature = true;
+    desc.no_pipeline = true;
+    if (!init_test_context(&context, &desc))
+        return;
+    command_list = context.list;
+    queue = context.queue;
+
+    rs_const = create_32bit_constants_root_signature(context.device, 0, 4, D3D12_SHADER_VISIBILITY_PIXEL);
+
+    descriptor_range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_CBV;
+    descriptor_range.NumDescriptors = 1;
+    descriptor_range.BaseShaderRegister = 0;
+    descriptor_range.RegisterSpace = 0;
+    descriptor_range.OffsetInDescriptorsFromTableStart = 0;
+    root_parameter.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+    root_parameter.DescriptorTable.NumDescriptorRanges = 1;
+    root_parameter.DescriptorTable.pDescriptorRanges = &descriptor_range;
+    root_parameter.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
+    memset(&root_signature_desc, 0, sizeof(root_signature_desc));
+    root_signature_desc.NumParameters = 1;
+    root_signature_desc.pParameters = &root_parameter;
+    hr = create_root_signature(context.device, &root_signature_desc, &rs_table);
+    ok(hr == S_OK, "Failed to create root signature, hr %#x.\n", hr);
+
+    pso_const = create_pipeline_state(context.device, rs_const,
+            context.render_target_desc.Format, NULL, &ps_color, NULL);
+    pso_table = create_pipeline_state(context.device, rs_table,
+            context.render_target_desc.Format, NULL, &ps_color, NULL);
+
+    cb = create_upload_buffer(context.device, 2 * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, NULL);
+    hr = ID3D12Resource_Map(cb, 0, NULL, (void **)&ptr);
+    ok(hr == S_OK, "Failed to map buffer, hr %#x.\n", hr);
+    memcpy(ptr, &red, sizeof(red));
+    memcpy(ptr + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, &blue, sizeof(blue));
+    ID3D12Resource_Unmap(cb, 0, NULL);
+
+    heap = create_gpu_descriptor_heap(context.device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 2);
+    for (i = 0; i < 2; i++)
+    {
+        cbv_desc.BufferLocation = ID3D12Resource_GetGPUVirtualAddress(cb) +
+                i * D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+        cbv_desc.SizeInBytes = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+        ID3D12Device_CreateConstantBufferView(context.device, &cbv_desc,
+                get_cpu_descriptor_handle(&context, heap, i));
+    }
+    table = get_gpu_descriptor_handle(&context, heap, 1);
+
+    ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, context.rtv, white, 0, NULL);
+    ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &context.rtv, false, NULL);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(command_list, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D12GraphicsCommandList_RSSetScissorRects(command_list, 1, &context.scissor_rect);
+    ID3D12GraphicsCommandList_SetDescriptorHeaps(command_list, 1, &heap);
+
+    /* Root arguments are undefined after a root signature change,
+     * setting the same values as before again must still bind them. */
+    for (i = 0; i < ARRAY_SIZE(expected_colors); i++)
+    {
+        set_viewport(&viewport, (float)i, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f);
+        ID3D12GraphicsCommandList_RSSetViewports(command_list, 1, &viewport);
+
+        if (i & 1)
+        {
+            ID3D12GraphicsCommandList_SetGraphicsRootSignature(command_list, rs_table);
+            ID3D12GraphicsCommandList_SetPipelineState(command_list, pso_table);
+            ID3D12GraphicsCommandList_SetDescriptorHeaps(command_list, 1, &heap);
+            ID3D12GraphicsCommandList_SetGraphicsRootDescriptorTable(command_list, 0, table);
+        }
+        else
+        {
+            ID3D12GraphicsCommandList_SetGraphicsRootSignature(command_list, rs_const);
+            ID3D12GraphicsCommandList_SetPipelineState(command_list, pso_const);
+            ID3D12GraphicsCommandList_SetGraphicsRoot32BitConstants(command_list, 0, 4, &green.x, 0);
+        }
+
+        ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+    }
+
+    transition_resource_state(command_list, context.render_target,
+            D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    get_texture_readback_with_command_list(context.render_target, 0, &rb, queue, command_list);
+    for (i = 0; i < ARRAY_SIZE(expected_colors); i++)
+    {
+        unsigned int value = get_readback_uint(&rb, i, 0, 0);
+        ok(value == expected_colors[i], "Got unexpected value %#x at %u, expected %#x.\n",
+                value, i, expected_colors[i]);
+    }
+    release_resource_readback(&rb);
+
+    ID3D12Resource_Release(cb);
+    ID3D12DescriptorHeap_Release(heap);
+    ID3D12PipelineState_Release(pso_const);
+    ID3D12PipelineState_Release(pso_table);
+    ID3D12RootSignature_Release(rs_const);
+    ID3D12RootSignature_Release(rs_table);
+    destroy_test_context(&context);
+}
+
 void test_draw_instanced(void)
 {
     static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -1164,6 +1427,161 @@ void test_bundle_state_inheritance(void)
     destroy_test_context(&context);
 }
 
+void test_bundle_redundant_state(void)
+{
+    static const float white[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    ID3D12GraphicsCommandList *command_list, *bundle;
+    ID3D12CommandAllocator *bundle_allocator;
+    struct test_context context;
+    ID3D12CommandQueue *queue;
+    ID3D12Device *device;
+    unsigned int i;
+    HRESULT hr;
+
+    if (!init_test_context(&context, NULL))
+        return;
+    device = context.device;
+    command_list = context.list;
+    queue = context.queue;
+
+    hr = ID3D12Device_CreateCommandAllocator(device, D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            &IID_ID3D12CommandAllocator, (void **)&bundle_allocator);
+    ok(SUCCEEDED(hr), "Failed to create command allocator, hr %#x.\n", hr);
+    hr = ID3D12Device_CreateCommandList(device, 0, D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            bundle_allocator, NULL, &IID_ID3D12GraphicsCommandList, (void **)&bundle);
+    ok(SUCCEEDED(hr), "Failed to create command list, hr %#x.\n", hr);
+
+    /* State that is overwritten before a draw, or set to its current value,
+     * may be folded when the bundle is closed, but the final state must not change. */
+    ID3D12GraphicsCommandList_SetGraphicsRootSignature(bundle, context.root_signature);
+    ID3D12GraphicsCommandList_SetPipelineState(bundle, context.pipeline_state);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+    ID3D12GraphicsCommandList_SetPipelineState(bundle, context.pipeline_state);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D12GraphicsCommandList_DrawInstanced(bundle, 3, 1, 0, 0);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D12GraphicsCommandList_SetGraphicsRootSignature(bundle, context.root_signature);
+    ID3D12GraphicsCommandList_SetPipelineState(bundle, context.pipeline_state);
+    ID3D12GraphicsCommandList_DrawInstanced(bundle, 3, 1, 0, 0);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+    ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    hr = ID3D12GraphicsCommandList_Close(bundle);
+    ok(SUCCEEDED(hr), "Failed to close bundle, hr %#x.\n", hr);
+
+    /* Replay the same bundle multiple times, and make sure state set at
+     * the end of the bundle is still visible to the command list. */
+    for (i = 0; i < 2; i++)
+    {
+        ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, context.rtv, white, 0, NULL);
+        ID3D12GraphicsCommandList_OMSetRenderTargets(command_list, 1, &context.rtv, false, NULL);
+        ID3D12GraphicsCommandList_RSSetViewports(command_list, 1, &context.viewport);
+        ID3D12GraphicsCommandList_RSSetScissorRects(command_list, 1, &context.scissor_rect);
+
+        ID3D12GraphicsCommandList_ExecuteBundle(command_list, bundle);
+        if (i)
+        {
+            ID3D12GraphicsCommandList_ClearRenderTargetView(command_list, context.rtv, white, 0, NULL);
+            ID3D12GraphicsCommandList_DrawInstanced(command_list, 3, 1, 0, 0);
+        }
+        else
+            ID3D12GraphicsCommandList_ExecuteBundle(command_list, bundle);
+
+        transition_resource_state(command_list, context.render_target,
+                D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        check_sub_resource_uint(context.render_target, 0, queue, command_list, 0xff00ff00, 0);
+
+        reset_command_list(command_list, context.allocator);
+        transition_resource_state(command_list, context.render_target,
+                D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET);
+    }
+
+    ID3D12GraphicsCommandList_Release(bundle);
+    ID3D12CommandAllocator_Release(bundle_allocator);
+    destroy_test_context(&context);
+}
+
+static bool get_bundle_allocator_stats(ID3D12CommandAllocator *allocator, struct vkd3d_bundle_allocator_stats *stats)
+{
+    UINT size = sizeof(*stats);
+    HRESULT hr;
+
+    hr = ID3D12CommandAllocator_GetPrivateData(allocator, &VKD3D_BUNDLE_ALLOCATOR_STATS_GUID, &size, stats);
+    if (hr == DXGI_ERROR_NOT_FOUND)
+        return false;
+    ok(hr == S_OK, "Failed to get bundle allocator stats, hr %#x.\n", hr);
+    ok(size == sizeof(*stats), "Got unexpected size %u.\n", size);
+    return hr == S_OK;
+}
+
+void test_bundle_allocator_steady_state(void)
+{
+    struct vkd3d_bundle_allocator_stats warm_stats, stats;
+    static const float blend_factor[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    ID3D12CommandAllocator *bundle_allocator;
+    ID3D12GraphicsCommandList *bundle;
+    struct test_context context;
+    ID3D12Device *device;
+    unsigned int i, j;
+    HRESULT hr;
+
+    if (!init_test_context(&context, NULL))
+        return;
+    device = context.device;
+
+    hr = ID3D12Device_CreateCommandAllocator(device, D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            &IID_ID3D12CommandAllocator, (void **)&bundle_allocator);
+    ok(SUCCEEDED(hr), "Failed to create command allocator, hr %#x.\n", hr);
+    hr = ID3D12Device_CreateCommandList(device, 0, D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            bundle_allocator, NULL, &IID_ID3D12GraphicsCommandList, (void **)&bundle);
+    ok(SUCCEEDED(hr), "Failed to create command list, hr %#x.\n", hr);
+    hr = ID3D12GraphicsCommandList_Close(bundle);
+    ok(SUCCEEDED(hr), "Failed to close bundle, hr %#x.\n", hr);
+
+    if (!get_bundle_allocator_stats(bundle_allocator, &warm_stats))
+    {
+        skip("Bundle allocator statistics are not available.\n");
+        goto done;
+    }
+
+    /* Once the allocator has seen a recording of this size, recording it again
+     * must be served entirely from recycled chunks and scratch memory. */
+    for (i = 0; i < 64; i++)
+    {
+        if (i == 4)
+            get_bundle_allocator_stats(bundle_allocator, &warm_stats);
+
+        hr = ID3D12CommandAllocator_Reset(bundle_allocator);
+        ok(SUCCEEDED(hr), "Failed to reset command allocator, hr %#x.\n", hr);
+        hr = ID3D12GraphicsCommandList_Reset(bundle, bundle_allocator, context.pipeline_state);
+        ok(SUCCEEDED(hr), "Failed to reset bundle, hr %#x.\n", hr);
+
+        ID3D12GraphicsCommandList_SetGraphicsRootSignature(bundle, context.root_signature);
+        for (j = 0; j < 4096; j++)
+        {
+            ID3D12GraphicsCommandList_IASetPrimitiveTopology(bundle, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            ID3D12GraphicsCommandList_OMSetBlendFactor(bundle, blend_factor);
+            ID3D12GraphicsCommandList_OMSetStencilRef(bundle, j);
+            ID3D12GraphicsCommandList_DrawInstanced(bundle, 3, 1, 0, 0);
+        }
+
+        hr = ID3D12GraphicsCommandList_Close(bundle);
+        ok(SUCCEEDED(hr), "Failed to close bundle, hr %#x.\n", hr);
+    }
+
+    get_bundle_allocator_stats(bundle_allocator, &stats);
+    ok(stats.chunk_heap_alloc_count == warm_stats.chunk_heap_alloc_count,
+            "Allocated %"PRIu64" bundle chunks from the heap after warm-up.\n",
+            stats.chunk_heap_alloc_count - warm_stats.chunk_heap_alloc_count);
+    ok(stats.scratch_heap_alloc_count == warm_stats.scratch_heap_alloc_count,
+            "Grew scratch memory %"PRIu64" times after warm-up.\n",
+            stats.scratch_heap_alloc_count - warm_stats.scratch_heap_alloc_count);
+
+done:
+    ID3D12GraphicsCommandList_Release(bundle);
+    ID3D12CommandAllocator_Release(bundle_allocator);
+    destroy_test_context(&context);
+}
+
 void test_null_vbv(void)
 {
     ID3D12GraphicsCommandList *command_list;
@@ -2080,12 +2498,21 @@ void test_execute_indirect_state(void)
         /* Other state is cleared to 0. */
 
         ID3D12GraphicsCommandList_DrawInstanced(command_list, 2, 1, 0, 0);
+
+        /* Setting the same state as before ExecuteIndirect() again must restore it,
+         * even though it is identical to what the application set last. */
+        ID3D12GraphicsCommandList_IASetIndexBuffer(command_list, &ibv);
+        ID3D12GraphicsCommandList_IASetVertexBuffers(command_list, 0, 2, vbvs);
+        for (j = 0; j < (tests[i].pso_index ? 12 : 1); j++)
+            ID3D12GraphicsCommandList_SetGraphicsRoot32BitConstants(command_list, 0, 4, &values, 4 * j);
+        ID3D12GraphicsCommandList_DrawIndexedInstanced(command_list, 2, 1, 1, 0, 0);
+
         transition_resource_state(command_list, streamout_buffer, D3D12_RESOURCE_STATE_STREAM_OUT, D3D12_RESOURCE_STATE_COPY_SOURCE);
 
         get_buffer_readback_with_command_list(streamout_buffer, DXGI_FORMAT_R32G32B32A32_FLOAT, &rb, queue, command_list);
         reset_command_list(command_list, context.allocator);
 
-        expected_output_size = (tests[i].expected_output_count * 3 + 2) * sizeof(struct vec4);
+        expected_output_size = (tests[i].expected_output_count * 3 + 4) * sizeof(struct vec4);
         size = get_readback_uint(&rb, 0, 0, 0);
         ok(size == expected_output_size, "Expected size %u, got %u.\n", expected_output_size, size);
 
@@ -2141,6 +2568,18 @@ void test_execute_indirect_state(void)
                     j, v->x, v->y, v->z, v->w, expect->x, expect->y, expect->z, expect->w);
         }
 
+        for (j = 0; j < 2; j++)
+        {
+            expect_reset_state[j] = values;
+            expect_reset_state[j].x += 1.0f + j;
+            expect_reset_state[j].y += 65.0f + j;
+
+            v = get_readback_vec4(&rb, j + 3 + 3 * tests[i].expected_output_count, 0);
+            expect = &expect_reset_state[j];
+            ok(compare_vec4(v, expect, 0), "Restored element %u failed: (%f, %f, %f, %f) != (%f, %f, %f, %f)\n",
+                    j, v->x, v->y, v->z, v->w, expect->x, expect->y, expect->z, expect->w);
+        }
+
         ID3D12CommandSignature_Release(command_signature);
         ID3D12Resource_Release(argument_buffer);
         ID3D12Resource_Release(argument_buffer_late);
@@ -3666,6 +4105,71 @@ void test_write_buffer_immediate(void)
     destroy_test_context(&context);
 }
 
+void test_write_buffer_immediate_marker_after_barrier(void)
+{
+    D3D12_WRITEBUFFERIMMEDIATE_PARAMETER parameters[2];
+    ID3D12GraphicsCommandList2 *command_list2;
+    D3D12_WRITEBUFFERIMMEDIATE_MODE modes[2];
+    ID3D12GraphicsCommandList *command_list;
+    ID3D12Resource *buffer, *upload_buffer;
+    struct resource_readback rb;
+    struct test_context context;
+    ID3D12CommandQueue *queue;
+    ID3D12Device *device;
+    unsigned int value;
+    HRESULT hr;
+
+    static const unsigned int data_values[] = {0xdeadbeef, 0xf00baa, 0xdeadbeef, 0xf00baa};
+
+    if (!init_test_context(&context, NULL))
+        return;
+    device = context.device;
+    command_list = context.list;
+    queue = context.queue;
+
+    if (FAILED(hr = ID3D12GraphicsCommandList_QueryInterface(command_list,
+            &IID_ID3D12GraphicsCommandList2, (void **)&command_list2)))
+    {
+        skip("ID3D12GraphicsCommandList2 not implemented.\n");
+        destroy_test_context(&context);
+        return;
+    }
+
+    buffer = create_default_buffer(device, sizeof(data_values),
+            D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+    upload_buffer = create_upload_buffer(device, sizeof(data_values), data_values);
+
+    /* The markers must land after the copy, which is only ordered by the barriers in between. */
+    ID3D12GraphicsCommandList_CopyBufferRegion(command_list, buffer, 0, upload_buffer, 0, sizeof(data_values));
+    transition_resource_state(command_list, buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COMMON);
+    transition_resource_state(command_list, buffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
+
+    parameters[0].Dest = ID3D12Resource_GetGPUVirtualAddress(buffer);
+    parameters[0].Value = 0x1020304;
+    parameters[1].Dest = parameters[0].Dest + sizeof(data_values[0]) * 2;
+    parameters[1].Value = 0x5060708;
+    modes[0] = D3D12_WRITEBUFFERIMMEDIATE_MODE_MARKER_IN;
+    modes[1] = D3D12_WRITEBUFFERIMMEDIATE_MODE_MARKER_OUT;
+    ID3D12GraphicsCommandList2_WriteBufferImmediate(command_list2, ARRAY_SIZE(parameters), parameters, modes);
+    transition_resource_state(command_list, buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+    get_buffer_readback_with_command_list(buffer, DXGI_FORMAT_R32_UINT, &rb, queue, command_list);
+    value = get_readback_uint(&rb, 0, 0, 0);
+    ok(value == parameters[0].Value, "Got unexpected value %#x, expected %#x.\n", value, parameters[0].Value);
+    value = get_readback_uint(&rb, 1, 0, 0);
+    ok(value == data_values[1], "Got unexpected value %#x, expected %#x.\n", value, data_values[1]);
+    value = get_readback_uint(&rb, 2, 0, 0);
+    ok(value == parameters[1].Value, "Got unexpected value %#x, expected %#x.\n", value, parameters[1].Value);
+    value = get_readback_uint(&rb, 3, 0, 0);
+    ok(value == data_values[3], "Got unexpected value %#x, expected %#x.\n", value, data_values[3]);
+    release_resource_readback(&rb);
+
+    ID3D12Resource_Release(upload_buffer);
+    ID3D12Resource_Release(buffer);
+    ID3D12GraphicsCommandList2_Release(command_list2);
+    destroy_test_context(&context);
+}
+
 void test_aliasing_barrier(void)
 {
     /* This test mostly serves to verify that validation is clean,
@@ -1321,3 +1321,87 @@ void test_copy_buffer_overlap(void)
     destroy_test_context(&context);
 }
 
+#define COPY_BUFFER_BATCH_ELEMENTS 4096
+
+static void copy_buffer_region_tracked(ID3D12GraphicsCommandList *list, ID3D12Resource **buffers,
+        uint32_t (*reference)[COPY_BUFFER_BATCH_ELEMENTS], unsigned int dst, unsigned int dst_index,
+        unsigned int src, unsigned int src_index, unsigned int count)
+{
+    ID3D12GraphicsCommandList_CopyBufferRegion(list,
+            buffers[dst], dst_index * sizeof(uint32_t),
+            buffers[src], src_index * sizeof(uint32_t),
+            count * sizeof(uint32_t));
+    memmove(&reference[dst][dst_index], &reference[src][src_index], count * sizeof(uint32_t));
+}
+
+void test_copy_buffer_region_batching(void)
+{
+    uint32_t reference[3][COPY_BUFFER_BATCH_ELEMENTS];
+    struct test_context context;
+    struct resource_readback rb;
+    ID3D12Resource *buffers[3];
+    unsigned int i, j;
+
+    /* Many small copies between the same pair of buffers are expected to be merged
+     * into fewer copy commands. Verify that merging does not reorder overlapping copies,
+     * and that copies reading the result of earlier copies observe it. */
+
+    if (!init_compute_test_context(&context))
+        return;
+
+    for (i = 0; i < COPY_BUFFER_BATCH_ELEMENTS; i++)
+        reference[0][i] = i;
+
+    buffers[0] = create_upload_buffer(context.device, sizeof(reference[0]), reference[0]);
+    for (i = 1; i < ARRAY_SIZE(buffers); i++)
+    {
+        buffers[i] = create_default_buffer(context.device, sizeof(reference[i]),
+                D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST);
+    }
+
+    /* Initialize everything, so every later copy overwrites earlier data. */
+    copy_buffer_region_tracked(context.list, buffers, reference, 1, 0, 0, 0, COPY_BUFFER_BATCH_ELEMENTS);
+    copy_buffer_region_tracked(context.list, buffers, reference, 2, 0, 0, 0, COPY_BUFFER_BATCH_ELEMENTS);
+
+    /* More disjoint copies than fit in one batch, interleaved with copies to another buffer pair. */
+    for (i = 0; i < 200; i++)
+    {
+        copy_buffer_region_tracked(context.list, buffers, reference, 1, (199 - i) * 8, 0, 2048 + i * 8, 8);
+        if (i % 5 == 0)
+            copy_buffer_region_tracked(context.list, buffers, reference, 2, 3000 + i, 0, 100 + i * 3, 3);
+    }
+
+    /* Overlapping writes to the same destination must complete in order. */
+    copy_buffer_region_tracked(context.list, buffers, reference, 1, 100, 0, 3000, 64);
+    copy_buffer_region_tracked(context.list, buffers, reference, 1, 120, 0, 10, 10);
+    copy_buffer_region_tracked(context.list, buffers, reference, 1, 4000, 0, 1, 16);
+    copy_buffer_region_tracked(context.list, buffers, reference, 1, 4008, 0, 500, 16);
+
+    /* Chain the results into another buffer. */
+    transition_resource_state(context.list, buffers[1],
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    copy_buffer_region_tracked(context.list, buffers, reference, 2, 1024, 1, 0, 512);
+    copy_buffer_region_tracked(context.list, buffers, reference, 2, 1536, 1, 512, 512);
+    copy_buffer_region_tracked(context.list, buffers, reference, 2, 1100, 1, 3990, 100);
+    copy_buffer_region_tracked(context.list, buffers, reference, 2, 0, 1, 4000, 32);
+    transition_resource_state(context.list, buffers[2],
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+    for (i = 1; i < ARRAY_SIZE(buffers); i++)
+    {
+        get_buffer_readback_with_command_list(buffers[i], DXGI_FORMAT_R32_UINT, &rb, context.queue, context.list);
+        reset_command_list(context.list, context.allocator);
+
+        for (j = 0; j < COPY_BUFFER_BATCH_ELEMENTS; j++)
+        {
+            ok(get_readback_uint(&rb, j, 0, 0) == reference[i][j], "%u, %u: Expected %u, got %u.\n",
+                    i, j, reference[i][j], get_readback_uint(&rb, j, 0, 0));
+        }
+
+        release_resource_readback(&rb);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(buffers); i++)
+        ID3D12Resource_Release(buffers[i]);
+    destroy_test_context(&context);
+}
@@ -129,8 +129,10 @@ void test_pipeline_library(void)
     ID3D12PipelineState *state2;
     ID3D12PipelineState *state;
     ULONG reference_refcount;
+    size_t reserialized_size;
     size_t serialized_size;
     ID3D12Device1 *device1;
+    void *reserialized_data;
     void *serialized_data;
     ID3D12Device *device;
     ID3D12Fence *fence;
@@ -180,6 +182,7 @@ void test_pipeline_library(void)
 
     const WCHAR *graphics_name = u"GRAPHICS";
     const WCHAR *compute_name  = u"COMPUTE";
+    const WCHAR *compute_copy_name = u"COMPUTE_COPY";
 
     if (!init_test_context(&context, NULL))
         return;
@@ -296,6 +299,14 @@ void test_pipeline_library(void)
             serialized_size, &IID_ID3D12PipelineLibrary, (void**)&pipeline_library);
     ok(hr == S_OK, "Failed to create pipeline library, hr %#x.\n");
 
+    /* Pipelines which have not been loaded yet must still be known to the library. */
+    hr = ID3D12Device_CreateComputePipelineState(device,
+            &compute_desc, &IID_ID3D12PipelineState, (void**)&state);
+    ok(hr == S_OK, "Failed to create compute pipeline, hr %#x.\n", hr);
+    hr = ID3D12PipelineLibrary_StorePipeline(pipeline_library, compute_name, state);
+    ok(hr == E_INVALIDARG, "Unexpected hr %#x.\n", hr);
+    ID3D12PipelineState_Release(state);
+
     /* Verify that PSO library must internally ref-count a unique PSO. */
     hr = ID3D12PipelineLibrary_LoadGraphicsPipeline(pipeline_library,
             graphics_name, &graphics_desc, &IID_ID3D12PipelineState, (void**)&state);
@@ -364,11 +375,65 @@ void test_pipeline_library(void)
     if (SUCCEEDED(hr))
         ID3D12PipelineState_Release(state);
 
+    /* Loading entries from the blob must not duplicate them on reserialization. */
+    ok(ID3D12PipelineLibrary_GetSerializedSize(pipeline_library) == serialized_size,
+            "Unexpected serialized size %zu.\n", (size_t)ID3D12PipelineLibrary_GetSerializedSize(pipeline_library));
+
     ID3D12PipelineLibrary_Release(pipeline_library);
     /* This should release the fence reference. */
     ok(get_refcount(fence) == 1, "Refcount %u != 1.\n", get_refcount(fence));
     ID3D12Fence_Release(fence);
 
+    /* Entries which were never requested must survive reserialization. */
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, serialized_data,
+            serialized_size, &IID_ID3D12PipelineLibrary, (void**)&pipeline_library);
+    ok(hr == S_OK, "Failed to create pipeline library, hr %#x.\n", hr);
+    ok(ID3D12PipelineLibrary_GetSerializedSize(pipeline_library) == serialized_size,
+            "Unexpected serialized size %zu.\n", (size_t)ID3D12PipelineLibrary_GetSerializedSize(pipeline_library));
+
+    /* Shader blobs shared with entries which were never requested must not be stored twice. */
+    hr = ID3D12Device_CreateComputePipelineState(device,
+            &compute_desc, &IID_ID3D12PipelineState, (void**)&state);
+    ok(hr == S_OK, "Failed to create compute pipeline, hr %#x.\n", hr);
+    hr = ID3D12PipelineLibrary_StorePipeline(pipeline_library, compute_copy_name, state);
+    ok(hr == S_OK, "Failed to store compute pipeline, hr %#x.\n", hr);
+    ID3D12PipelineState_Release(state);
+
+    reserialized_size = ID3D12PipelineLibrary_GetSerializedSize(pipeline_library);
+    ok(reserialized_size > serialized_size, "Unexpected serialized size %zu.\n", reserialized_size);
+    reserialized_data = malloc(reserialized_size);
+    hr = ID3D12PipelineLibrary_Serialize(pipeline_library, reserialized_data, reserialized_size);
+    ok(hr == S_OK, "Failed to serialize pipeline library, hr %#x.\n", hr);
+    ID3D12PipelineLibrary_Release(pipeline_library);
+
+    /* A library with the compute pipeline already loaded must end up with the same size. */
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, serialized_data,
+            serialized_size, &IID_ID3D12PipelineLibrary, (void**)&pipeline_library);
+    ok(hr == S_OK, "Failed to create pipeline library, hr %#x.\n", hr);
+    hr = ID3D12PipelineLibrary_LoadComputePipeline(pipeline_library,
+            compute_name, &compute_desc, &IID_ID3D12PipelineState, (void**)&state);
+    ok(hr == S_OK, "Failed to load compute pipeline from pipeline library, hr %#x.\n", hr);
+    hr = ID3D12PipelineLibrary_StorePipeline(pipeline_library, compute_copy_name, state);
+    ok(hr == S_OK, "Failed to store compute pipeline, hr %#x.\n", hr);
+    ID3D12PipelineState_Release(state);
+    ok(ID3D12PipelineLibrary_GetSerializedSize(pipeline_library) == reserialized_size,
+            "Unexpected serialized size %zu.\n", (size_t)ID3D12PipelineLibrary_GetSerializedSize(pipeline_library));
+    ID3D12PipelineLibrary_Release(pipeline_library);
+
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, reserialized_data,
+            reserialized_size, &IID_ID3D12PipelineLibrary, (void**)&pipeline_library);
+    ok(hr == S_OK, "Failed to create pipeline library, hr %#x.\n", hr);
+    hr = ID3D12PipelineLibrary_LoadGraphicsPipeline(pipeline_library,
+            graphics_name, &graphics_desc, &IID_ID3D12PipelineState, (void**)&state);
+    ok(hr == S_OK, "Failed to load graphics pipeline from pipeline library, hr %#x.\n", hr);
+    ID3D12PipelineState_Release(state);
+    hr = ID3D12PipelineLibrary_LoadComputePipeline(pipeline_library,
+            compute_copy_name, &compute_desc, &IID_ID3D12PipelineState, (void**)&state);
+    ok(hr == S_OK, "Failed to load compute pipeline from pipeline library, hr %#x.\n", hr);
+    ID3D12PipelineState_Release(state);
+    ID3D12PipelineLibrary_Release(pipeline_library);
+
+    free(reserialized_data);
     free(serialized_data);
     ID3D12RootSignature_Release(root_signature);
     ID3D12Device1_Release(device1);
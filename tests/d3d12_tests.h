@@ -54,6 +54,8 @@ decl_test(test_clear_render_target_view);
 decl_test(test_clear_unordered_access_view_buffer);
 decl_test(test_clear_unordered_access_view_image);
 decl_test(test_set_render_targets);
+decl_test(test_redundant_render_target_rebind);
+decl_test(test_redundant_root_arguments);
 decl_test(test_draw_instanced);
 decl_test(test_draw_indexed_instanced);
 decl_test(test_draw_no_descriptor_bindings);
@@ -73,6 +75,8 @@ decl_test(test_device_removed_reason);
 decl_test(test_map_resource);
 decl_test(test_map_placed_resources);
 decl_test(test_bundle_state_inheritance);
+decl_test(test_bundle_redundant_state);
+decl_test(test_bundle_allocator_steady_state);
 decl_test(test_shader_instructions);
 decl_test(test_shader_instructions_dxil);
 decl_test(test_compute_shader_instructions);
@@ -150,6 +154,7 @@ decl_test(test_copy_texture_buffer);
 decl_test(test_copy_buffer_texture);
 decl_test(test_copy_block_compressed_texture);
 decl_test(test_copy_buffer_overlap);
+decl_test(test_copy_buffer_region_batching);
 decl_test(test_separate_bindings);
 decl_test(test_face_culling_dxbc);
 decl_test(test_face_culling_dxil);
@@ -211,6 +216,7 @@ decl_test(test_conditional_rendering);
 decl_test(test_bufinfo_instruction_dxbc);
 decl_test(test_bufinfo_instruction_dxil);
 decl_test(test_write_buffer_immediate);
+decl_test(test_write_buffer_immediate_marker_after_barrier);
 decl_test(test_register_space_sm51);
 decl_test(test_register_space_dxil);
 decl_test(test_constant_buffer_sm51);
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Measures throughput of vkd3d_hash64() against the byte-wise FNV-1a hash it replaced
+ * for cache keys and checksums, and checks that the selected SIMD path matches
+ * the portable implementation bit for bit. */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_hash.h"
+#include "vkd3d_memory.h"
+#include "hashmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+static uint32_t rand_next(uint32_t *state)
+{
+    /* xorshift32, deterministic across platforms. */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static uint64_t hash_fnv1a_bytes(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    uint64_t h = hash_fnv1_init();
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        h = hash_fnv1_iterate_u8(h, bytes[i]);
+    return h;
+}
+
+static bool validate(const uint8_t *data, size_t max_size)
+{
+    size_t size, offset;
+
+    /* Cover every tail length and misaligned starts. */
+    for (size = 0; size <= max_size; size += size < 2048 ? 1 : 509)
+    {
+        for (offset = 0; offset < 8; offset++)
+        {
+            if (vkd3d_hash64(data + offset, size) != vkd3d_hash64_portable(data + offset, size))
+            {
+                printf("Mismatch against portable implementation, size %zu, offset %zu.\n", size, offset);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void run_size(const uint8_t *data, size_t size, size_t total_bytes)
+{
+    double fnv_time, hash_time, start;
+    size_t iterations, i;
+    uint64_t sink = 0;
+
+    iterations = max(total_bytes / size, 1);
+
+    start = get_time();
+    for (i = 0; i < iterations; i++)
+        sink += hash_fnv1a_bytes(data, size);
+    fnv_time = get_time() - start;
+
+    start = get_time();
+    for (i = 0; i < iterations; i++)
+        sink += vkd3d_hash64(data, size);
+    hash_time = get_time() - start;
+
+    printf("  %8zu bytes: FNV-1a %8.3f GB/s, vkd3d_hash64 %8.3f GB/s (%5.1fx) [%016llx]\n", size,
+            1e-9 * (double)(iterations * size) / fnv_time,
+            1e-9 * (double)(iterations * size) / hash_time,
+            fnv_time / hash_time, (unsigned long long)sink);
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536, 1024 * 1024, 16 * 1024 * 1024 };
+    const size_t buffer_size = 16 * 1024 * 1024 + 64;
+    const size_t total_bytes = 256 * 1024 * 1024;
+    uint32_t seed = 0x1337;
+    uint8_t *data;
+    size_t i;
+
+    data = vkd3d_malloc(buffer_size);
+    for (i = 0; i < buffer_size; i++)
+        data[i] = rand_next(&seed);
+
+    printf("vkd3d_hash64 implementation: %s\n", vkd3d_hash64_get_impl_name());
+
+    if (!validate(data, 16 * 1024))
+    {
+        vkd3d_free(data);
+        return 1;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++)
+        run_size(data, sizes[i], total_bytes);
+
+    vkd3d_free(data);
+    return 0;
+}
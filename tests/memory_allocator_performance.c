@@ -0,0 +1,476 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Replays synthetic suballocation traces against the TLSF allocator used for
+ * memory chunks and against the sorted free range list it replaced. This does
+ * not need a GPU, only address ranges are simulated. */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_tlsf.h"
+#include "vkd3d_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define CHUNK_SIZE (16ull * 1024 * 1024)
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+static uint32_t rand_next(uint32_t *state)
+{
+    /* xorshift32, deterministic across platforms. */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+struct trace_alloc
+{
+    uint64_t size;
+    uint64_t alignment;
+};
+
+struct live_alloc
+{
+    bool valid;
+    uint64_t size;
+    uint32_t chunk;
+    uint64_t offset;
+    uint32_t block_index;
+};
+
+struct stats
+{
+    double time;
+    size_t failures;
+    size_t peak_chunks;
+    uint64_t free_size;
+    uint64_t largest_free;
+};
+
+/* Reference implementation of the previous per-chunk worst-fit allocator. */
+struct range
+{
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct range_chunk
+{
+    bool used;
+    struct range *ranges;
+    size_t ranges_size;
+    size_t ranges_count;
+};
+
+struct range_allocator
+{
+    struct range_chunk *chunks;
+    size_t chunks_size;
+    size_t chunks_count;
+    size_t live_chunks;
+};
+
+static void range_chunk_insert(struct range_chunk *chunk, size_t index, uint64_t offset, uint64_t length)
+{
+    vkd3d_array_reserve((void **)&chunk->ranges, &chunk->ranges_size, chunk->ranges_count + 1, sizeof(*chunk->ranges));
+    memmove(&chunk->ranges[index + 1], &chunk->ranges[index], sizeof(*chunk->ranges) * (chunk->ranges_count - index));
+    chunk->ranges[index].offset = offset;
+    chunk->ranges[index].length = length;
+    chunk->ranges_count++;
+}
+
+static void range_chunk_remove(struct range_chunk *chunk, size_t index)
+{
+    chunk->ranges_count--;
+    memmove(&chunk->ranges[index], &chunk->ranges[index + 1], sizeof(*chunk->ranges) * (chunk->ranges_count - index));
+}
+
+static bool range_chunk_allocate(struct range_chunk *chunk, uint64_t size, uint64_t alignment, uint64_t *offset)
+{
+    struct range *pick = NULL;
+    uint64_t l_length, r_length;
+    size_t i, pick_index = 0;
+
+    for (i = 0; i < chunk->ranges_count; i++)
+    {
+        struct range *r = &chunk->ranges[i];
+
+        if (r->offset + r->length < align64(r->offset, alignment) + size)
+            continue;
+
+        if (r->length == size)
+        {
+            pick = r;
+            pick_index = i;
+            break;
+        }
+
+        if (!pick || r->length > pick->length)
+        {
+            pick = r;
+            pick_index = i;
+        }
+    }
+
+    if (!pick)
+        return false;
+
+    *offset = align64(pick->offset, alignment);
+    l_length = *offset - pick->offset;
+    r_length = pick->offset + pick->length - *offset - size;
+
+    if (l_length)
+    {
+        pick->length = l_length;
+        if (r_length)
+            range_chunk_insert(chunk, pick_index + 1, *offset + size, r_length);
+    }
+    else if (r_length)
+    {
+        pick->offset = *offset + size;
+        pick->length = r_length;
+    }
+    else
+        range_chunk_remove(chunk, pick_index);
+
+    return true;
+}
+
+static void range_chunk_free(struct range_chunk *chunk, uint64_t offset, uint64_t size)
+{
+    bool adjacent_l = false, adjacent_r = false;
+    size_t lo = 0, hi = chunk->ranges_count, index;
+
+    while (lo < hi)
+    {
+        index = lo + (hi - lo) / 2;
+        if (chunk->ranges[index].offset > offset)
+            hi = index;
+        else
+            lo = index + 1;
+    }
+    index = lo;
+
+    if (index > 0)
+        adjacent_l = chunk->ranges[index - 1].offset + chunk->ranges[index - 1].length == offset;
+    if (index < chunk->ranges_count)
+        adjacent_r = chunk->ranges[index].offset == offset + size;
+
+    if (adjacent_l)
+    {
+        chunk->ranges[index - 1].length += size;
+        if (adjacent_r)
+        {
+            chunk->ranges[index - 1].length += chunk->ranges[index].length;
+            range_chunk_remove(chunk, index);
+        }
+    }
+    else if (adjacent_r)
+    {
+        chunk->ranges[index].offset = offset;
+        chunk->ranges[index].length += size;
+    }
+    else
+        range_chunk_insert(chunk, index, offset, size);
+}
+
+static bool range_allocator_allocate(struct range_allocator *allocator, const struct trace_alloc *req,
+        struct live_alloc *alloc)
+{
+    struct range_chunk *chunk;
+    size_t i;
+
+    for (i = 0; i < allocator->chunks_count; i++)
+    {
+        if (allocator->chunks[i].used && range_chunk_allocate(&allocator->chunks[i], req->size, req->alignment, &alloc->offset))
+        {
+            alloc->chunk = i;
+            return true;
+        }
+    }
+
+    for (i = 0; i < allocator->chunks_count; i++)
+    {
+        if (!allocator->chunks[i].used)
+            break;
+    }
+
+    if (i == allocator->chunks_count)
+    {
+        vkd3d_array_reserve((void **)&allocator->chunks, &allocator->chunks_size,
+                allocator->chunks_count + 1, sizeof(*allocator->chunks));
+        memset(&allocator->chunks[allocator->chunks_count++], 0, sizeof(*allocator->chunks));
+    }
+
+    chunk = &allocator->chunks[i];
+    chunk->used = true;
+    chunk->ranges_count = 0;
+    range_chunk_insert(chunk, 0, 0, CHUNK_SIZE);
+    allocator->live_chunks++;
+
+    alloc->chunk = i;
+    return range_chunk_allocate(chunk, req->size, req->alignment, &alloc->offset);
+}
+
+static void range_allocator_free(struct range_allocator *allocator, const struct live_alloc *alloc)
+{
+    struct range_chunk *chunk = &allocator->chunks[alloc->chunk];
+
+    range_chunk_free(chunk, alloc->offset, alloc->size);
+
+    if (chunk->ranges_count == 1 && chunk->ranges[0].length == CHUNK_SIZE)
+    {
+        chunk->used = false;
+        allocator->live_chunks--;
+    }
+}
+
+static void range_allocator_get_free_stats(const struct range_allocator *allocator, struct stats *stats)
+{
+    size_t i, j;
+
+    stats->free_size = 0;
+    stats->largest_free = 0;
+
+    for (i = 0; i < allocator->chunks_count; i++)
+    {
+        if (!allocator->chunks[i].used)
+            continue;
+
+        for (j = 0; j < allocator->chunks[i].ranges_count; j++)
+        {
+            stats->free_size += allocator->chunks[i].ranges[j].length;
+            stats->largest_free = max(stats->largest_free, allocator->chunks[i].ranges[j].length);
+        }
+    }
+}
+
+static void range_allocator_cleanup(struct range_allocator *allocator)
+{
+    size_t i;
+
+    for (i = 0; i < allocator->chunks_count; i++)
+        vkd3d_free(allocator->chunks[i].ranges);
+    vkd3d_free(allocator->chunks);
+}
+
+struct tlsf_allocator
+{
+    struct vkd3d_tlsf tlsf;
+    uint32_t *region_blocks;
+    size_t region_blocks_size;
+    size_t region_count;
+    size_t live_chunks;
+};
+
+static bool tlsf_allocator_allocate(struct tlsf_allocator *allocator, const struct trace_alloc *req,
+        struct live_alloc *alloc)
+{
+    struct vkd3d_tlsf_allocation allocation;
+    size_t i;
+
+    if (!vkd3d_tlsf_allocate(&allocator->tlsf, req->size, req->alignment, &allocation))
+    {
+        for (i = 0; i < allocator->region_count; i++)
+        {
+            if (allocator->region_blocks[i] == VKD3D_TLSF_INVALID_BLOCK)
+                break;
+        }
+
+        if (i == allocator->region_count)
+        {
+            vkd3d_array_reserve((void **)&allocator->region_blocks, &allocator->region_blocks_size,
+                    allocator->region_count + 1, sizeof(*allocator->region_blocks));
+            allocator->region_count++;
+        }
+
+        /* Region pointers are only used as identifiers here. */
+        allocator->region_blocks[i] = vkd3d_tlsf_add_region(&allocator->tlsf, (void *)(uintptr_t)(i + 1), CHUNK_SIZE);
+        allocator->live_chunks++;
+
+        if (!vkd3d_tlsf_allocate(&allocator->tlsf, req->size, req->alignment, &allocation))
+            return false;
+    }
+
+    alloc->chunk = (uint32_t)((uintptr_t)allocation.region - 1);
+    alloc->offset = allocation.offset;
+    alloc->block_index = allocation.block_index;
+    return true;
+}
+
+static void tlsf_allocator_free(struct tlsf_allocator *allocator, const struct live_alloc *alloc)
+{
+    uint32_t block_index = vkd3d_tlsf_free(&allocator->tlsf, alloc->block_index);
+
+    if (vkd3d_tlsf_block_is_region(&allocator->tlsf, block_index))
+    {
+        vkd3d_tlsf_remove_region(&allocator->tlsf, block_index);
+        allocator->region_blocks[alloc->chunk] = VKD3D_TLSF_INVALID_BLOCK;
+        allocator->live_chunks--;
+    }
+}
+
+static void generate_trace(struct trace_alloc *trace, size_t count, uint32_t seed, bool mixed_alignment)
+{
+    uint32_t state = seed, r;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        r = rand_next(&state);
+
+        /* Mostly small buffers and textures, with a long tail up to 4 MiB. */
+        switch (r % 8)
+        {
+            case 0: case 1: case 2:
+                trace[i].size = 256 + (rand_next(&state) % 64) * 256;
+                break;
+            case 3: case 4: case 5:
+                trace[i].size = 64 * 1024 * (1 + rand_next(&state) % 4);
+                break;
+            case 6:
+                trace[i].size = 256 * 1024 + (rand_next(&state) % 768) * 1024;
+                break;
+            default:
+                trace[i].size = 1024 * 1024 * (1 + rand_next(&state) % 4);
+                break;
+        }
+
+        if (mixed_alignment)
+            trace[i].alignment = (r >> 8) & 1 ? 256 : 64 * 1024;
+        else
+            trace[i].alignment = 64 * 1024;
+    }
+}
+
+static void run_trace(const char *name, const struct trace_alloc *trace, size_t count, size_t live_count)
+{
+    struct tlsf_allocator tlsf_allocator;
+    struct range_allocator range_allocator;
+    struct stats range_stats, tlsf_stats;
+    struct live_alloc *live;
+    uint32_t state = 1234;
+    double start_time;
+    size_t i, slot;
+
+    live = vkd3d_calloc(live_count, sizeof(*live));
+
+    /* Legacy range list. */
+    memset(&range_allocator, 0, sizeof(range_allocator));
+    memset(&range_stats, 0, sizeof(range_stats));
+    start_time = get_time();
+
+    for (i = 0; i < count; i++)
+    {
+        slot = rand_next(&state) % live_count;
+
+        if (live[slot].valid)
+            range_allocator_free(&range_allocator, &live[slot]);
+
+        live[slot].size = trace[i].size;
+        if (!(live[slot].valid = range_allocator_allocate(&range_allocator, &trace[i], &live[slot])))
+            range_stats.failures++;
+
+        range_stats.peak_chunks = max(range_stats.peak_chunks, range_allocator.live_chunks);
+    }
+
+    range_stats.time = get_time() - start_time;
+    range_allocator_get_free_stats(&range_allocator, &range_stats);
+    range_allocator_cleanup(&range_allocator);
+
+    /* TLSF, replaying the exact same sequence of operations. */
+    memset(live, 0, live_count * sizeof(*live));
+    memset(&tlsf_allocator, 0, sizeof(tlsf_allocator));
+    memset(&tlsf_stats, 0, sizeof(tlsf_stats));
+    vkd3d_tlsf_init(&tlsf_allocator.tlsf);
+    state = 1234;
+    start_time = get_time();
+
+    for (i = 0; i < count; i++)
+    {
+        slot = rand_next(&state) % live_count;
+
+        if (live[slot].valid)
+            tlsf_allocator_free(&tlsf_allocator, &live[slot]);
+
+        live[slot].size = trace[i].size;
+        if (!(live[slot].valid = tlsf_allocator_allocate(&tlsf_allocator, &trace[i], &live[slot])))
+            tlsf_stats.failures++;
+
+        tlsf_stats.peak_chunks = max(tlsf_stats.peak_chunks, tlsf_allocator.live_chunks);
+    }
+
+    tlsf_stats.time = get_time() - start_time;
+    tlsf_stats.free_size = tlsf_allocator.tlsf.free_size;
+    tlsf_stats.largest_free = vkd3d_tlsf_get_largest_free_block_size(&tlsf_allocator.tlsf);
+    vkd3d_tlsf_cleanup(&tlsf_allocator.tlsf);
+    vkd3d_free(tlsf_allocator.region_blocks);
+    vkd3d_free(live);
+
+    printf("%s (%zu ops, %zu live):\n", name, count, live_count);
+    printf("  range list: %8.1f ns/op, %3zu peak chunks, %7.2f MiB free, largest free block %7.2f MiB.\n",
+            1e9 * range_stats.time / count, range_stats.peak_chunks,
+            range_stats.free_size / (1024.0 * 1024.0), range_stats.largest_free / (1024.0 * 1024.0));
+    printf("  TLSF:       %8.1f ns/op, %3zu peak chunks, %7.2f MiB free, largest free block %7.2f MiB.\n",
+            1e9 * tlsf_stats.time / count, tlsf_stats.peak_chunks,
+            tlsf_stats.free_size / (1024.0 * 1024.0), tlsf_stats.largest_free / (1024.0 * 1024.0));
+
+    if (range_stats.failures || tlsf_stats.failures)
+        printf("  Failures: range list %zu, TLSF %zu.\n", range_stats.failures, tlsf_stats.failures);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t count = 1000000;
+    struct trace_alloc *trace;
+
+    trace = vkd3d_calloc(count, sizeof(*trace));
+
+    generate_trace(trace, count, 0x1337, false);
+    run_trace("Steady state, 64 KiB alignment", trace, count, 512);
+    run_trace("Heavy churn, 64 KiB alignment", trace, count, 4096);
+
+    generate_trace(trace, count, 0xc0ffee, true);
+    run_trace("Steady state, mixed alignment", trace, count, 512);
+    run_trace("Heavy churn, mixed alignment", trace, count, 4096);
+
+    vkd3d_free(trace);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Hammers a single ID3D12PipelineLibrary with StorePipeline and LoadComputePipeline
+ * from many threads at once, to measure lock contention on the library maps. */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#define INITGUID
+#define VKD3D_TEST_DECLARE_MAIN
+#include "d3d12_crosstest.h"
+
+#define MAX_THREADS 16
+#define PIPELINES_PER_THREAD 256
+#define LOAD_ITERATIONS 64
+
+static void setup(int argc, char **argv)
+{
+    pfn_D3D12CreateDevice = get_d3d12_pfn(D3D12CreateDevice);
+    pfn_D3D12EnableExperimentalFeatures = get_d3d12_pfn(D3D12EnableExperimentalFeatures);
+    pfn_D3D12GetDebugInterface = get_d3d12_pfn(D3D12GetDebugInterface);
+
+    parse_args(argc, argv);
+    enable_d3d12_debug_layer(argc, argv);
+    init_adapter_info();
+
+    pfn_D3D12CreateVersionedRootSignatureDeserializer = get_d3d12_pfn(D3D12CreateVersionedRootSignatureDeserializer);
+    pfn_D3D12SerializeVersionedRootSignature = get_d3d12_pfn(D3D12SerializeVersionedRootSignature);
+}
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+struct pipeline_library_thread
+{
+    ID3D12PipelineLibrary *library;
+    const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc;
+    ID3D12PipelineState *state;
+    unsigned int thread_index;
+    bool load;
+    unsigned int failures;
+};
+
+static void get_pipeline_name(WCHAR *name, unsigned int thread_index, unsigned int pipeline_index)
+{
+    char ascii[32];
+    unsigned int i;
+
+    sprintf(ascii, "PSO_%02u_%04u", thread_index, pipeline_index);
+    for (i = 0; ascii[i]; i++)
+        name[i] = ascii[i];
+    name[i] = 0;
+}
+
+static void pipeline_library_thread_main(void *userdata)
+{
+    struct pipeline_library_thread *thread = userdata;
+    ID3D12PipelineState *state;
+    unsigned int i, j;
+    WCHAR name[32];
+    HRESULT hr;
+
+    if (!thread->load)
+    {
+        for (i = 0; i < PIPELINES_PER_THREAD; i++)
+        {
+            get_pipeline_name(name, thread->thread_index, i);
+            if (FAILED(ID3D12PipelineLibrary_StorePipeline(thread->library, name, thread->state)))
+                thread->failures++;
+        }
+        return;
+    }
+
+    for (j = 0; j < LOAD_ITERATIONS; j++)
+    {
+        for (i = 0; i < PIPELINES_PER_THREAD; i++)
+        {
+            /* Spread the lookups over names stored by other threads too. */
+            get_pipeline_name(name, (thread->thread_index + j) % MAX_THREADS, i);
+            hr = ID3D12PipelineLibrary_LoadComputePipeline(thread->library, name,
+                    thread->desc, &IID_ID3D12PipelineState, (void **)&state);
+
+            if (SUCCEEDED(hr))
+                ID3D12PipelineState_Release(state);
+            else
+                thread->failures++;
+        }
+    }
+}
+
+static void run_threads(struct pipeline_library_thread *threads, unsigned int thread_count, bool load)
+{
+    HANDLE handles[MAX_THREADS];
+    unsigned int i;
+
+    for (i = 0; i < thread_count; i++)
+    {
+        threads[i].load = load;
+        threads[i].failures = 0;
+        handles[i] = create_thread(pipeline_library_thread_main, &threads[i]);
+        ok(!!handles[i], "Failed to create thread.\n");
+    }
+
+    for (i = 0; i < thread_count; i++)
+        ok(join_thread(handles[i]), "Failed to join thread.\n");
+
+    for (i = 0; i < thread_count; i++)
+        ok(!threads[i].failures, "Thread %u: %u operations failed.\n", i, threads[i].failures);
+}
+
+static void do_benchmark_run(ID3D12Device1 *device1, const D3D12_COMPUTE_PIPELINE_STATE_DESC *desc,
+        ID3D12PipelineState *state, unsigned int thread_count)
+{
+    struct pipeline_library_thread threads[MAX_THREADS];
+    ID3D12PipelineLibrary *library;
+    double start_time, end_time;
+    unsigned int i;
+    HRESULT hr;
+
+    hr = ID3D12Device1_CreatePipelineLibrary(device1, NULL, 0, &IID_ID3D12PipelineLibrary, (void **)&library);
+    ok(hr == S_OK, "Failed to create pipeline library, hr %#x.\n", hr);
+    if (FAILED(hr))
+        return;
+
+    for (i = 0; i < MAX_THREADS; i++)
+    {
+        threads[i].library = library;
+        threads[i].desc = desc;
+        threads[i].state = state;
+        threads[i].thread_index = i;
+    }
+
+    /* Stores from threads we don't run are done up front, so loads always find their names. */
+    start_time = get_time();
+    run_threads(threads, thread_count, false);
+    end_time = get_time();
+    printf("%2u threads: StorePipeline %8.0f ops/s.\n", thread_count,
+            (double)(thread_count * PIPELINES_PER_THREAD) / (end_time - start_time));
+
+    if (thread_count < MAX_THREADS)
+        run_threads(threads + thread_count, MAX_THREADS - thread_count, false);
+
+    start_time = get_time();
+    run_threads(threads, thread_count, true);
+    end_time = get_time();
+    printf("%2u threads: LoadComputePipeline %8.0f ops/s.\n", thread_count,
+            (double)(thread_count * PIPELINES_PER_THREAD * LOAD_ITERATIONS) / (end_time - start_time));
+
+    ID3D12PipelineLibrary_Release(library);
+}
+
+START_TEST(pipeline_library_performance)
+{
+    D3D12_COMPUTE_PIPELINE_STATE_DESC compute_desc;
+    D3D12_ROOT_SIGNATURE_DESC root_signature_desc;
+    ID3D12RootSignature *root_signature;
+    unsigned int thread_count;
+    ID3D12PipelineState *state;
+    ID3D12Device1 *device1;
+    ID3D12Device *device;
+    HRESULT hr;
+
+#if 0
+    [numthreads(1,1,1)]
+    void main() { }
+#endif
+    static const DWORD cs_dxbc[] =
+    {
+        0x43425844, 0x1acc3ad0, 0x71c7b057, 0xc72c4306, 0xf432cb57, 0x00000001, 0x00000074, 0x00000003,
+        0x0000002c, 0x0000003c, 0x0000004c, 0x4e475349, 0x00000008, 0x00000000, 0x00000008, 0x4e47534f,
+        0x00000008, 0x00000000, 0x00000008, 0x58454853, 0x00000020, 0x00050050, 0x00000008, 0x0100086a,
+        0x0400009b, 0x00000001, 0x00000001, 0x00000001, 0x0100003e,
+    };
+
+    setup(argc, argv);
+    device = create_device();
+    ok(device != NULL, "Failed to create device.\n");
+    if (!device)
+        return;
+
+    if (FAILED(ID3D12Device_QueryInterface(device, &IID_ID3D12Device1, (void **)&device1)))
+    {
+        skip("ID3D12Device1 not available.\n");
+        ID3D12Device_Release(device);
+        return;
+    }
+
+    memset(&root_signature_desc, 0, sizeof(root_signature_desc));
+    hr = create_root_signature(device, &root_signature_desc, &root_signature);
+    ok(hr == S_OK, "Failed to create root signature, hr %#x.\n", hr);
+
+    memset(&compute_desc, 0, sizeof(compute_desc));
+    compute_desc.pRootSignature = root_signature;
+    compute_desc.CS.pShaderBytecode = cs_dxbc;
+    compute_desc.CS.BytecodeLength = sizeof(cs_dxbc);
+
+    hr = ID3D12Device_CreateComputePipelineState(device, &compute_desc, &IID_ID3D12PipelineState, (void **)&state);
+    ok(hr == S_OK, "Failed to create compute pipeline, hr %#x.\n", hr);
+
+    for (thread_count = 1; thread_count <= MAX_THREADS; thread_count *= 2)
+        do_benchmark_run(device1, &compute_desc, state, thread_count);
+
+    ID3D12PipelineState_Release(state);
+    ID3D12RootSignature_Release(root_signature);
+    ID3D12Device1_Release(device1);
+    ID3D12Device_Release(device);
+}
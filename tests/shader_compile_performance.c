@@ -0,0 +1,154 @@
+/*
+ * Copyright 2023 Valve Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/* Measures DXBC -> SPIR-V compile time over a corpus of shaders, e.g. the .dxbc files
+ * written out with VKD3D_SHADER_DUMP_PATH. Run against two builds to compare them.
+ * Usage: shader-compile-performance [-i iterations] file.dxbc... */
+
+#define VKD3D_DBG_CHANNEL VKD3D_DBG_CHANNEL_API
+
+#include "vkd3d_shader.h"
+#include "vkd3d_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static double get_time(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER lc, lf;
+    QueryPerformanceCounter(&lc);
+    QueryPerformanceFrequency(&lf);
+    return (double)lc.QuadPart / (double)lf.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+#endif
+}
+
+static bool read_file(const char *path, struct vkd3d_shader_code *code)
+{
+    void *data = NULL;
+    long size;
+    FILE *f;
+
+    if (!(f = fopen(path, "rb")))
+        return false;
+
+    if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) <= 0)
+        goto err;
+    rewind(f);
+
+    if (!(data = vkd3d_malloc(size)) || fread(data, 1, size, f) != (size_t)size)
+        goto err;
+
+    fclose(f);
+    memset(code, 0, sizeof(*code));
+    code->code = data;
+    code->size = size;
+    return true;
+
+err:
+    vkd3d_free(data);
+    fclose(f);
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    double start_time, total_time = 0.0, slowest_time = 0.0;
+    unsigned int iterations = 10, i;
+    size_t compiled_count = 0;
+    size_t failed_count = 0;
+    const char *slowest = "";
+    struct vkd3d_shader_code dxbc, spirv;
+    double shader_time;
+    int first_file = 1;
+    int rc, j;
+
+    if (argc >= 3 && !strcmp(argv[1], "-i"))
+    {
+        iterations = max(strtoul(argv[2], NULL, 0), 1);
+        first_file = 3;
+    }
+
+    if (first_file >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-i iterations] file.dxbc...\n", argv[0]);
+        return 1;
+    }
+
+    for (j = first_file; j < argc; j++)
+    {
+        if (!read_file(argv[j], &dxbc))
+        {
+            fprintf(stderr, "Failed to read %s.\n", argv[j]);
+            failed_count++;
+            continue;
+        }
+
+        shader_time = 0.0;
+        for (i = 0; i < iterations; i++)
+        {
+            start_time = get_time();
+            rc = vkd3d_shader_compile_dxbc(&dxbc, &spirv, 0, NULL, NULL);
+            shader_time += get_time() - start_time;
+
+            if (rc != VKD3D_OK)
+                break;
+            vkd3d_shader_free_shader_code(&spirv);
+        }
+
+        if (rc != VKD3D_OK)
+        {
+            fprintf(stderr, "Failed to compile %s, rc %d.\n", argv[j], rc);
+            failed_count++;
+        }
+        else
+        {
+            shader_time /= iterations;
+            total_time += shader_time;
+            compiled_count++;
+
+            if (shader_time > slowest_time)
+            {
+                slowest_time = shader_time;
+                slowest = argv[j];
+            }
+        }
+
+        vkd3d_free((void *)dxbc.code);
+    }
+
+    printf("Compiled %zu shaders (%zu failed), %u iterations each.\n", compiled_count, failed_count, iterations);
+    if (compiled_count)
+    {
+        printf("  Total %.3f ms per pass, average %.3f ms per shader.\n",
+                1e3 * total_time, 1e3 * total_time / compiled_count);
+        printf("  Slowest %.3f ms: %s.\n", 1e3 * slowest_time, slowest);
+    }
+
+    return failed_count ? 1 : 0;
+}